@@ -0,0 +1,19 @@
+#include "AdBlockBridge.h"
+#include "AdBlockManager.h"
+#include "URL.h"
+#include "WebPage.h"
+
+AdBlockBridge::AdBlockBridge(WebPage *parent) :
+    QObject(parent),
+    m_page(parent)
+{
+}
+
+AdBlockBridge::~AdBlockBridge()
+{
+}
+
+QString AdBlockBridge::getGenericStylesheet(const QStringList &classes, const QStringList &ids)
+{
+    return AdBlockManager::instance().getGenericStylesheet(URL(m_page->url()), classes, ids);
+}
@@ -0,0 +1,41 @@
+#ifndef ADBLOCKBRIDGE_H
+#define ADBLOCKBRIDGE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class WebPage;
+
+/**
+ * @class AdBlockBridge
+ * @ingroup AdBlock
+ * @brief Acts as a bridge between the \ref AdBlockManager and web content
+ *        through a WebChannel
+ */
+class AdBlockBridge : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// Constructs the AdBlockBridge with the given parent
+    explicit AdBlockBridge(WebPage *parent);
+
+    /// AdBlockBridge destructor
+    ~AdBlockBridge();
+
+public slots:
+    /**
+     * @brief Called by the page with the classes and ids of its elements that have not been reported before
+     * @param classes Class names found in the page
+     * @param ids Element ids found in the page
+     * @return The generic element hiding rules that apply to the given classes and ids
+     */
+    QString getGenericStylesheet(const QStringList &classes, const QStringList &ids);
+
+private:
+    /// Pointer to the web page that owns this bridge
+    WebPage *m_page;
+};
+
+#endif // ADBLOCKBRIDGE_H
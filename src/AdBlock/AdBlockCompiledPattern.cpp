@@ -0,0 +1,473 @@
+#include "AdBlockCompiledPattern.h"
+#include "AdBlockRequestContext.h"
+#include "StringSearch.h"
+
+#include <algorithm>
+
+std::atomic<quint64> AdBlockCompiledPattern::s_evaluations(0);
+std::atomic<quint64> AdBlockCompiledPattern::s_compiledMatches(0);
+std::atomic<quint64> AdBlockCompiledPattern::s_prefilterRejections(0);
+std::atomic<quint64> AdBlockCompiledPattern::s_regExpEvaluations(0);
+
+AdBlockCompiledPattern::AdBlockCompiledPattern() :
+    m_segments(),
+    m_anchors(AnchorNone),
+    m_compiled(false)
+{
+}
+
+AdBlockCompiledPattern AdBlockCompiledPattern::compileWildcard(const QString &pattern, bool matchCase)
+{
+    AdBlockCompiledPattern result;
+
+    QString rule = matchCase ? pattern : pattern.toLower();
+    quint8 anchors = AnchorNone;
+
+    // Anchors are handled the same way as in AdBlockFilterParser::parseRegExp
+    if (rule.startsWith(QStringLiteral("||")))
+    {
+        anchors |= AnchorDomain;
+        rule = rule.mid(2);
+    }
+    else if (rule.startsWith(QChar('|')))
+    {
+        anchors |= AnchorStart;
+        rule = rule.mid(1);
+    }
+    if (rule.endsWith(QChar('|')))
+    {
+        anchors |= AnchorEnd;
+        rule.chop(1);
+    }
+
+    // A wildcard next to an anchor cancels it, except for the scheme that the domain anchor requires
+    if (rule.startsWith(QChar('*')))
+    {
+        if (anchors & AnchorDomain)
+            return result;
+        anchors &= ~AnchorStart;
+    }
+    if (rule.endsWith(QChar('*')))
+        anchors &= ~AnchorEnd;
+
+    // Any other '|' character is ignored
+    QString segment;
+    for (const QChar &c : rule)
+    {
+        if (c == QChar('*'))
+        {
+            if (!segment.isEmpty())
+                result.m_segments.push_back(segment.toUtf8());
+            segment.clear();
+        }
+        else if (c != QChar('|'))
+            segment.append(c);
+    }
+    if (!segment.isEmpty())
+        result.m_segments.push_back(segment.toUtf8());
+
+    if (result.m_segments.empty() && (anchors & AnchorDomain))
+        return result;
+
+    result.m_anchors = anchors;
+    result.m_compiled = true;
+    return result;
+}
+
+AdBlockCompiledPattern AdBlockCompiledPattern::compileRegExp(const QString &pattern, bool matchCase)
+{
+    AdBlockCompiledPattern result;
+
+    const int length = pattern.size();
+
+    // Returns the position after the character class that starts at the given position
+    auto skipClass = [&](int i) {
+        ++i;
+        if (i < length && pattern.at(i) == QChar('^'))
+            ++i;
+        if (i < length && pattern.at(i) == QChar(']'))
+            ++i;
+        while (i < length && pattern.at(i) != QChar(']'))
+        {
+            if (pattern.at(i) == QChar('\\'))
+                ++i;
+            ++i;
+        }
+        return i + 1;
+    };
+
+    // Only concatenations are handled. Any alternation outside of a group could make every literal optional
+    int depth = 0;
+    for (int i = 0; i < length;)
+    {
+        const ushort u = pattern.at(i).unicode();
+        if (u == '\\')
+            i += 2;
+        else if (u == '[')
+            i = skipClass(i);
+        else
+        {
+            if (u == '(')
+                ++depth;
+            else if (u == ')')
+                --depth;
+            else if (u == '|' && depth == 0)
+                return result;
+            ++i;
+        }
+    }
+
+    // Inline options could make a match-case expression case insensitive
+    if (matchCase && pattern.contains(QStringLiteral("(?")))
+        return result;
+
+    QString literal;
+    auto endLiteral = [&]() {
+        if (!literal.isEmpty())
+            result.m_segments.push_back(literal.toUtf8());
+        literal.clear();
+    };
+
+    // Skips any quantifier at the given position. Returns 1 if the preceding element is repeated,
+    // 0 if it is optional and -1 if it is not quantified
+    auto skipQuantifier = [&](int &i) {
+        if (i >= length)
+            return -1;
+
+        int repeat = -1;
+        const ushort u = pattern.at(i).unicode();
+        if (u == '+')
+            repeat = 1;
+        else if (u == '*' || u == '?')
+            repeat = 0;
+        else if (u == '{')
+        {
+            const int close = pattern.indexOf(QChar('}'), i);
+            if (close < 0)
+            {
+                i = length;
+                return 0;
+            }
+            i = close;
+            repeat = 0;
+        }
+        else
+            return -1;
+
+        // Lazy or possessive modifier
+        ++i;
+        if (i < length && (pattern.at(i) == QChar('?') || pattern.at(i) == QChar('+')))
+            ++i;
+        return repeat;
+    };
+
+    int i = 0;
+    while (i < length)
+    {
+        QChar c = pattern.at(i);
+        const ushort u = c.unicode();
+
+        if (u == '[')
+        {
+            endLiteral();
+            i = skipClass(i);
+            skipQuantifier(i);
+            continue;
+        }
+
+        if (u == '(')
+        {
+            // Groups may be optional or contain alternations, so they are skipped entirely
+            endLiteral();
+            int groupDepth = 0;
+            while (i < length)
+            {
+                const ushort g = pattern.at(i).unicode();
+                if (g == '\\')
+                    i += 2;
+                else if (g == '[')
+                    i = skipClass(i);
+                else
+                {
+                    if (g == '(')
+                        ++groupDepth;
+                    ++i;
+                    if (g == ')' && --groupDepth == 0)
+                        break;
+                }
+            }
+            skipQuantifier(i);
+            continue;
+        }
+
+        if (u == '.' || u == '^' || u == '$')
+        {
+            endLiteral();
+            ++i;
+            skipQuantifier(i);
+            continue;
+        }
+
+        if (u == '\\')
+        {
+            if (i + 1 >= length)
+                break;
+
+            // Only escaped punctuation is literal. The separator placeholder cannot be stored as a literal
+            const QChar escaped = pattern.at(i + 1);
+            const bool isLiteral = escaped.unicode() < 128 && !escaped.isLetterOrNumber() && escaped != QChar('^');
+            if (!isLiteral)
+            {
+                endLiteral();
+
+                // Escapes such as \x41 or \1 are followed by characters that are not literals themselves
+                const ushort e = escaped.unicode();
+                if (e != 'd' && e != 'D' && e != 'w' && e != 'W' && e != 's' && e != 'S' && e != 'b' && e != 'B')
+                    break;
+
+                i += 2;
+                skipQuantifier(i);
+                continue;
+            }
+
+            c = escaped;
+            ++i;
+        }
+        else if (u == ')' || u == '*' || u == '+' || u == '?' || u == '{')
+        {
+            // Unbalanced group or a quantifier without an element
+            break;
+        }
+
+        ++i;
+        if (!matchCase)
+            c = c.toLower();
+
+        const int repeat = skipQuantifier(i);
+        if (repeat != 0)
+            literal.append(c);
+        if (repeat >= 0)
+            endLiteral();
+    }
+    endLiteral();
+
+    return result;
+}
+
+bool AdBlockCompiledPattern::isCompiled() const
+{
+    return m_compiled;
+}
+
+const std::vector<QByteArray> &AdBlockCompiledPattern::getSegments() const
+{
+    return m_segments;
+}
+
+bool AdBlockCompiledPattern::isMatch(const AdBlockRequestContext &context, bool matchCase, const QRegularExpression *regExp) const
+{
+    const QByteArray &url = matchCase ? context.RequestUrl : context.RequestUrlLower;
+
+    s_evaluations.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_compiled)
+    {
+        s_compiledMatches.fetch_add(1, std::memory_order_relaxed);
+        return matchSegments(url);
+    }
+
+    if (!matchSegments(url))
+    {
+        s_prefilterRejections.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (!regExp)
+        return false;
+
+    s_regExpEvaluations.fetch_add(1, std::memory_order_relaxed);
+    return regExp->match(context.getRequestUrlString(matchCase)).hasMatch();
+}
+
+AdBlockCompiledPattern::Statistics AdBlockCompiledPattern::getStatistics()
+{
+    return Statistics {
+        s_evaluations.load(std::memory_order_relaxed),
+        s_compiledMatches.load(std::memory_order_relaxed),
+        s_prefilterRejections.load(std::memory_order_relaxed),
+        s_regExpEvaluations.load(std::memory_order_relaxed)
+    };
+}
+
+void AdBlockCompiledPattern::resetStatistics()
+{
+    s_evaluations.store(0, std::memory_order_relaxed);
+    s_compiledMatches.store(0, std::memory_order_relaxed);
+    s_prefilterRejections.store(0, std::memory_order_relaxed);
+    s_regExpEvaluations.store(0, std::memory_order_relaxed);
+}
+
+bool AdBlockCompiledPattern::matchSegments(const QByteArray &url) const
+{
+    const size_t count = m_segments.size();
+    if (count == 0)
+        return true;
+
+    const int urlLength = url.size();
+
+    // Matches the segments after the first one. Each segment is searched for after the end of the
+    // previous one, and the leftmost match of a segment always leaves the most room for the rest
+    auto matchRest = [&](int pos) {
+        for (size_t i = 1; i < count; ++i)
+        {
+            const QByteArray &segment = m_segments[i];
+            int end = 0;
+
+            if (i + 1 == count && (m_anchors & AnchorEnd))
+                return isSegmentAtEnd(url, segment, pos);
+
+            if (findSegment(url, segment, pos, end) < 0)
+                return false;
+            pos = end;
+        }
+        return !(m_anchors & AnchorEnd) || pos == urlLength;
+    };
+
+    const QByteArray &first = m_segments.front();
+    int end = 0;
+
+    if (m_anchors & AnchorStart)
+        return isSegmentAt(url, first, 0, end) && matchRest(end);
+
+    if (m_anchors & AnchorDomain)
+    {
+        // The first segment starts the host, or one of the labels of the host after the first
+        const int schemeEnd = url.indexOf("://");
+        if (schemeEnd <= 0)
+            return false;
+        for (int i = 0; i < schemeEnd; ++i)
+        {
+            const char c = url.at(i);
+            if ((c < 'a' || c > 'z') && (c < 'A' || c > 'Z') && c != '-')
+                return false;
+        }
+
+        const int hostStart = schemeEnd + 3;
+        int authorityEnd = hostStart;
+        while (authorityEnd < urlLength)
+        {
+            const char c = url.at(authorityEnd);
+            if (c == '/' || c == '?' || c == '#')
+                break;
+            ++authorityEnd;
+        }
+
+        if (isSegmentAt(url, first, hostStart, end) && matchRest(end))
+            return true;
+
+        int dot = url.indexOf('.', hostStart + 1);
+        while (dot >= 0 && dot < authorityEnd)
+        {
+            if (isSegmentAt(url, first, dot + 1, end) && matchRest(end))
+                return true;
+            dot = url.indexOf('.', dot + 1);
+        }
+        return false;
+    }
+
+    if (count == 1 && (m_anchors & AnchorEnd))
+        return isSegmentAtEnd(url, first, 0);
+
+    return findSegment(url, first, 0, end) >= 0 && matchRest(end);
+}
+
+int AdBlockCompiledPattern::findSegment(const QByteArray &url, const QByteArray &segment, int from, int &end)
+{
+    const int separatorPos = segment.indexOf('^');
+    if (separatorPos < 0)
+    {
+        const int pos = StringSearch::indexOf(url, segment, from);
+        if (pos >= 0)
+            end = pos + segment.size();
+        return pos;
+    }
+
+    if (separatorPos == 0)
+    {
+        for (int pos = from; pos <= url.size(); ++pos)
+        {
+            if (isSegmentAt(url, segment, pos, end))
+                return pos;
+        }
+        return -1;
+    }
+
+    // Search for the characters before the first separator, then check the rest of the segment
+    for (int pos = qMax(from, 0); pos <= url.size(); ++pos)
+    {
+        const int offset = StringSearch::indexOf(url.constData() + pos, url.size() - pos, segment.constData(), separatorPos);
+        if (offset < 0)
+            return -1;
+
+        pos += offset;
+        if (isSegmentAt(url, segment, pos, end))
+            return pos;
+    }
+    return -1;
+}
+
+bool AdBlockCompiledPattern::isSegmentAt(const QByteArray &url, const QByteArray &segment, int pos, int &end)
+{
+    const int urlLength = url.size();
+    const int length = segment.size();
+    if (pos < 0 || pos > urlLength)
+        return false;
+
+    const char *data = url.constData();
+    for (int i = 0; i < length; ++i)
+    {
+        const char p = segment.at(i);
+        if (pos + i >= urlLength)
+        {
+            // Separators also match the end of the URL
+            for (; i < length; ++i)
+            {
+                if (segment.at(i) != '^')
+                    return false;
+            }
+            end = urlLength;
+            return true;
+        }
+
+        const char c = data[pos + i];
+        if (p == '^' ? !isSeparator(c) : c != p)
+            return false;
+    }
+
+    end = pos + length;
+    return true;
+}
+
+bool AdBlockCompiledPattern::isSegmentAtEnd(const QByteArray &url, const QByteArray &segment, int from)
+{
+    // Each separator at the end of the segment may match the end of the URL instead of a character
+    int numSeparators = 0;
+    for (int i = segment.size() - 1; i >= 0 && segment.at(i) == '^'; --i)
+        ++numSeparators;
+
+    const int urlLength = url.size();
+    int end = 0;
+    for (int start = std::max(from, urlLength - segment.size()); start <= urlLength - segment.size() + numSeparators; ++start)
+    {
+        if (isSegmentAt(url, segment, start, end) && end == urlLength)
+            return true;
+    }
+    return false;
+}
+
+bool AdBlockCompiledPattern::isSeparator(char c)
+{
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return false;
+    return c != '%' && c != '.' && c != '_' && c != '-';
+}
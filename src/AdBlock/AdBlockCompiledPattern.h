@@ -0,0 +1,139 @@
+#ifndef ADBLOCKCOMPILEDPATTERN_H
+#define ADBLOCKCOMPILEDPATTERN_H
+
+#include <atomic>
+#include <vector>
+#include <QByteArray>
+#include <QRegularExpression>
+#include <QString>
+#include <QtGlobal>
+
+struct AdBlockRequestContext;
+
+/**
+ * @class AdBlockCompiledPattern
+ * @ingroup AdBlock
+ * @brief Evaluates filters of the RegExp category without running a regular expression, where possible.
+ *
+ * AdBlock Plus patterns that only contain wildcards (*), separators (^) and anchors (|, ||) are compiled
+ * into an ordered list of literal segments, which are matched by searching for each segment after the end
+ * of the previous one. Regular expression filters (/regexp/) still need their expression, but the literals
+ * that any match must contain are extracted from it, so that the expression only runs on URLs containing
+ * all of them. Segments are stored in UTF-8, and matched against the bytes of the request URL.
+ */
+class AdBlockCompiledPattern
+{
+public:
+    /// Counters of the number of times RegExp filters were evaluated, and how many of those needed a regular expression
+    struct Statistics
+    {
+        /// Number of times a RegExp filter was evaluated
+        quint64 Evaluations;
+
+        /// Number of evaluations that were decided by the segments of a compiled AdBlock Plus pattern
+        quint64 CompiledMatches;
+
+        /// Number of evaluations of a regular expression filter that were rejected because a required literal was missing
+        quint64 PrefilterRejections;
+
+        /// Number of evaluations that ran a regular expression
+        quint64 RegExpEvaluations;
+    };
+
+    /// Constructs an empty pattern, which defers every evaluation to the regular expression
+    AdBlockCompiledPattern();
+
+    /**
+     * @brief Compiles an AdBlock Plus pattern, including any of its anchors
+     * @param pattern Pattern of the filter, without its options
+     * @param matchCase True if the filter has the match-case option, false if else
+     * @return The compiled pattern. If the pattern cannot be handled without a regular expression,
+     *         the result is empty (\ref isCompiled returns false)
+     */
+    static AdBlockCompiledPattern compileWildcard(const QString &pattern, bool matchCase);
+
+    /**
+     * @brief Extracts the literals that any match of a regular expression must contain, in order of their appearance
+     * @param pattern Regular expression, without the enclosing slashes
+     * @param matchCase True if the filter has the match-case option, false if else
+     * @return A prefilter for the regular expression
+     */
+    static AdBlockCompiledPattern compileRegExp(const QString &pattern, bool matchCase);
+
+    /// Returns true if the pattern is matched without a regular expression, false if a regular expression must decide matches
+    bool isCompiled() const;
+
+    /// Returns the literal segments of the pattern. Segments of compiled patterns may contain the separator placeholder ('^')
+    const std::vector<QByteArray> &getSegments() const;
+
+    /**
+     * @brief Determines whether or not the request URL matches the pattern
+     * @param context Properties of the network request
+     * @param matchCase Whether the filter has the match-case option, in which case the URL is matched in its original letter case
+     * @param regExp Regular expression of the filter, used if the pattern is not compiled and the URL passes the prefilter
+     * @return True if the URL matches, false if else
+     */
+    bool isMatch(const AdBlockRequestContext &context, bool matchCase, const QRegularExpression *regExp) const;
+
+    /// Returns the counters of all RegExp filter evaluations since the application was started, or since the last reset
+    static Statistics getStatistics();
+
+    /// Sets all of the evaluation counters to zero
+    static void resetStatistics();
+
+private:
+    /// Anchors applied to the first and last segments of a compiled pattern
+    enum Anchor : quint8
+    {
+        AnchorNone   = 0x00,
+
+        /// The first segment must match at the start of the URL (|)
+        AnchorStart  = 0x01,
+
+        /// The first segment must match at the start of the host, or of one of its labels (||)
+        AnchorDomain = 0x02,
+
+        /// The last segment must match at the end of the URL (|)
+        AnchorEnd    = 0x04
+    };
+
+    /// Returns true if the URL contains every segment, with each segment following the one before it, false if else
+    bool matchSegments(const QByteArray &url) const;
+
+    /// Searches for the segment in the URL, starting at the given position. Returns the position of the match,
+    /// or -1 if there is no match. Sets end to the position after the match
+    static int findSegment(const QByteArray &url, const QByteArray &segment, int from, int &end);
+
+    /// Returns true if the segment matches the URL at the given position, false if else. Sets end to the position after the match
+    static bool isSegmentAt(const QByteArray &url, const QByteArray &segment, int pos, int &end);
+
+    /// Returns true if the segment matches the end of the URL at or after the given position, false if else
+    static bool isSegmentAtEnd(const QByteArray &url, const QByteArray &segment, int from);
+
+    /// Returns true if the character is a separator, as represented by '^' in a filter, false if else
+    static bool isSeparator(char c);
+
+private:
+    /// Literal segments, in order
+    std::vector<QByteArray> m_segments;
+
+    /// Combination of \ref Anchor bits
+    quint8 m_anchors;
+
+    /// True if the segments fully describe the pattern, false if they are only a prefilter for a regular expression
+    bool m_compiled;
+
+    /// Number of times a RegExp filter was evaluated
+    static std::atomic<quint64> s_evaluations;
+
+    /// Number of evaluations decided by the segments of a compiled pattern
+    static std::atomic<quint64> s_compiledMatches;
+
+    /// Number of evaluations rejected by a prefilter
+    static std::atomic<quint64> s_prefilterRejections;
+
+    /// Number of evaluations that ran a regular expression
+    static std::atomic<quint64> s_regExpEvaluations;
+};
+
+#endif // ADBLOCKCOMPILEDPATTERN_H
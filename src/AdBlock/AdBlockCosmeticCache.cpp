@@ -0,0 +1,230 @@
+#include "AdBlockCosmeticCache.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+/// Identifies a cosmetic cache file
+static const quint32 CacheMagic = 0x56434343;
+
+/// Version of the cache format. Must be incremented whenever the layout of the file changes
+static const quint32 CacheVersion = 1;
+
+AdBlockCosmeticCache::AdBlockCosmeticCache(const QString &cachePath, int capacity, qint64 maxBytes) :
+    m_cachePath(cachePath),
+    m_capacity(capacity),
+    m_maxBytes(maxBytes),
+    m_filterSetKey(),
+    m_file(),
+    m_mappedData(nullptr),
+    m_entries(),
+    m_useCounter(0),
+    m_modified(false)
+{
+}
+
+void AdBlockCosmeticCache::setFilterSetKey(const QByteArray &key)
+{
+    if (key == m_filterSetKey)
+        return;
+
+    const bool isFirstKey = m_filterSetKey.isEmpty();
+    m_filterSetKey = key;
+    if (isFirstKey && load())
+        return;
+
+    // Entries built from other filters no longer apply
+    unmap();
+    m_entries.clear();
+}
+
+bool AdBlockCosmeticCache::find(const QString &key, QString &value)
+{
+    if (m_filterSetKey.isEmpty())
+        return false;
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return false;
+
+    it->LastUsed = ++m_useCounter;
+    value = QString::fromUtf8(getData(*it));
+    return true;
+}
+
+void AdBlockCosmeticCache::insert(const QString &key, const QString &value)
+{
+    if (m_filterSetKey.isEmpty() || m_capacity <= 0)
+        return;
+
+    if (!m_entries.contains(key) && m_entries.size() >= m_capacity)
+    {
+        auto leastRecentIt = std::min_element(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+            return a.LastUsed < b.LastUsed;
+        });
+        m_entries.erase(leastRecentIt);
+    }
+
+    m_entries.insert(key, Entry { value.toUtf8(), -1, 0, ++m_useCounter });
+    m_modified = true;
+}
+
+int AdBlockCosmeticCache::size() const
+{
+    return m_entries.size();
+}
+
+bool AdBlockCosmeticCache::save()
+{
+    if (!m_modified || m_filterSetKey.isEmpty())
+        return true;
+
+    // Most recently used entries are written first, leaving out the least recently used ones once the file is full
+    std::vector<std::pair<quint64, QString>> order;
+    order.reserve(static_cast<std::size_t>(m_entries.size()));
+    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+        order.push_back(std::make_pair(it.value().LastUsed, it.key()));
+    std::sort(order.begin(), order.end(), [](const std::pair<quint64, QString> &a, const std::pair<quint64, QString> &b) {
+        return a.first > b.first;
+    });
+
+    // The text of each kept entry is copied out of the mapped file, which must be closed before it is replaced
+    QHash<QString, Entry> keptEntries;
+    std::vector<std::pair<QString, QByteArray>> records;
+    qint64 totalBytes = 0;
+    for (const std::pair<quint64, QString> &item : order)
+    {
+        const Entry &entry = m_entries.constFind(item.second).value();
+        const QByteArray mappedText = getData(entry);
+        if (totalBytes + mappedText.size() > m_maxBytes)
+            continue;
+
+        const QByteArray text(mappedText.constData(), mappedText.size());
+        totalBytes += text.size();
+        keptEntries.insert(item.second, Entry { text, -1, 0, entry.LastUsed });
+        records.push_back(std::make_pair(item.second, text));
+    }
+
+    unmap();
+    m_entries = std::move(keptEntries);
+    m_modified = false;
+
+    QDir cacheDir = QFileInfo(m_cachePath).absoluteDir();
+    if (!cacheDir.exists())
+        cacheDir.mkpath(QStringLiteral("."));
+
+    // Write to a temporary file first, so a partially written cache is never left behind
+    QSaveFile cacheFile(m_cachePath);
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&cacheFile);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    stream << CacheMagic << CacheVersion << m_filterSetKey << static_cast<quint32>(records.size());
+
+    // The index is followed by the text of the entries, at the offsets given in the index
+    qint64 offset = 0;
+    for (const std::pair<QString, QByteArray> &record : records)
+    {
+        stream << record.first << offset << static_cast<qint32>(record.second.size());
+        offset += record.second.size();
+    }
+
+    for (const std::pair<QString, QByteArray> &record : records)
+        stream.writeRawData(record.second.constData(), record.second.size());
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        cacheFile.cancelWriting();
+        return false;
+    }
+
+    return cacheFile.commit();
+}
+
+bool AdBlockCosmeticCache::load()
+{
+    m_file.setFileName(m_cachePath);
+    if (!m_file.exists() || !m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 fileSize = m_file.size();
+    uchar *fileData = fileSize > 0 ? m_file.map(0, fileSize) : nullptr;
+    if (!fileData)
+    {
+        m_file.close();
+        return false;
+    }
+
+    // Only the index is read here. The text of the entries stays in the mapped file until it is looked up
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(fileData), static_cast<int>(fileSize));
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    quint32 magic = 0, version = 0, numEntries = 0;
+    QByteArray filterSetKey;
+    stream >> magic >> version >> filterSetKey >> numEntries;
+
+    // Each index record takes up more than 16 bytes, so a larger count can only come from a corrupt file
+    if (stream.status() != QDataStream::Ok
+            || magic != CacheMagic
+            || version != CacheVersion
+            || filterSetKey != m_filterSetKey
+            || static_cast<qint64>(numEntries) > fileSize / 16)
+    {
+        unmap();
+        return false;
+    }
+
+    // Entries are stored from most to least recently used
+    QHash<QString, Entry> entries;
+    entries.reserve(static_cast<int>(numEntries));
+    for (quint32 i = 0; i < numEntries; ++i)
+    {
+        QString key;
+        qint64 offset = 0;
+        qint32 entrySize = 0;
+        stream >> key >> offset >> entrySize;
+        entries.insert(key, Entry { QByteArray(), offset, entrySize, static_cast<quint64>(numEntries - i) });
+    }
+
+    const qint64 dataStart = stream.device()->pos();
+    const qint64 dataSize = fileSize - dataStart;
+    bool isValid = stream.status() == QDataStream::Ok;
+    for (auto it = entries.cbegin(); isValid && it != entries.cend(); ++it)
+    {
+        const Entry &entry = it.value();
+        isValid = entry.Offset >= 0 && entry.Size >= 0 && entry.Offset + entry.Size <= dataSize;
+    }
+
+    if (!isValid)
+    {
+        unmap();
+        return false;
+    }
+
+    m_mappedData = reinterpret_cast<const char*>(fileData) + dataStart;
+    m_entries = std::move(entries);
+    m_useCounter = numEntries;
+    return true;
+}
+
+void AdBlockCosmeticCache::unmap()
+{
+    // Closing the file also unmaps it
+    m_file.close();
+    m_mappedData = nullptr;
+}
+
+QByteArray AdBlockCosmeticCache::getData(const Entry &entry) const
+{
+    if (entry.Offset < 0)
+        return entry.Data;
+
+    return QByteArray::fromRawData(m_mappedData + entry.Offset, entry.Size);
+}
@@ -0,0 +1,109 @@
+#ifndef ADBLOCKCOSMETICCACHE_H
+#define ADBLOCKCOSMETICCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @class AdBlockCosmeticCache
+ * @ingroup AdBlock
+ * @brief Bounded on-disk cache of the stylesheets and scripts that are injected into the pages of each host,
+ *        so that a site visited in an earlier session does not need its cosmetic filters evaluated again.
+ *
+ * Entries belong to a filter set key, which identifies the filter lists and resources that they were built
+ * from. The cache file is memory-mapped once the first key is given, and only its index is read at that point.
+ * The text of an entry is decoded from the mapped file when it is looked up. All entries are dropped when the
+ * key changes, and the most recently used entries are written back to the file by \ref save.
+ */
+class AdBlockCosmeticCache
+{
+public:
+    /**
+     * @brief Constructs the cache
+     * @param cachePath Path of the cache file
+     * @param capacity Maximum number of entries to store
+     * @param maxBytes Maximum size of the text of the entries that are written to the cache file
+     */
+    AdBlockCosmeticCache(const QString &cachePath, int capacity, qint64 maxBytes);
+
+    /// Sets the key of the filters that new entries are built from. The cache file is loaded on the first call,
+    /// and its entries are kept only if they belong to the same key. Entries are discarded if the key changes
+    void setFilterSetKey(const QByteArray &key);
+
+    /**
+     * @brief Searches for a cached entry
+     * @param key Key of the entry
+     * @param value Set to the text of the entry, if one is found
+     * @return True if the entry was found, false if else or if no filter set key has been given
+     */
+    bool find(const QString &key, QString &value);
+
+    /// Stores the text of an entry, replacing the least recently used entry if the cache is full
+    void insert(const QString &key, const QString &value);
+
+    /// Returns the number of entries in the cache
+    int size() const;
+
+    /// Writes the most recently used entries to the cache file, if any were added since it was loaded or saved.
+    /// Returns true on success, false if the file could not be written
+    bool save();
+
+private:
+    /// A cached piece of text
+    struct Entry
+    {
+        /// UTF-8 text of the entry. Empty if the text is still in the mapped cache file
+        QByteArray Data;
+
+        /// Offset of the text in the data section of the mapped cache file, or -1 if it is held in Data
+        qint64 Offset;
+
+        /// Size of the text in the mapped cache file, in bytes
+        int Size;
+
+        /// Value of the use counter when the entry was last inserted or found
+        quint64 LastUsed;
+    };
+
+    /// Maps the cache file and reads its index, if the file belongs to the current filter set key
+    bool load();
+
+    /// Unmaps and closes the cache file
+    void unmap();
+
+    /// Returns the UTF-8 text of the given entry
+    QByteArray getData(const Entry &entry) const;
+
+private:
+    /// Path of the cache file
+    QString m_cachePath;
+
+    /// Maximum number of entries
+    int m_capacity;
+
+    /// Maximum size of the text written to the cache file
+    qint64 m_maxBytes;
+
+    /// Key of the filters that the entries were built from
+    QByteArray m_filterSetKey;
+
+    /// The cache file, kept open while it is mapped
+    QFile m_file;
+
+    /// Start of the data section of the mapped cache file, or a nullptr if the file is not mapped
+    const char *m_mappedData;
+
+    /// Cached entries, keyed by their host
+    QHash<QString, Entry> m_entries;
+
+    /// Incremented on each use of an entry, ordering the entries from least to most recently used
+    quint64 m_useCounter;
+
+    /// True if entries were inserted since the cache file was loaded or saved
+    bool m_modified;
+};
+
+#endif // ADBLOCKCOSMETICCACHE_H
@@ -0,0 +1,192 @@
+#include "AdBlockDecisionCache.h"
+
+namespace
+{
+    /// Marks a packed result as occupying its slot
+    const quint64 ResultOccupied = 1ULL;
+
+    /// Marks a packed result as having matched a filter
+    const quint64 ResultMatched = 2ULL;
+
+    /// Shift of the action in a packed result
+    const int ResultActionShift = 2;
+}
+
+AdBlockDecisionCache::AdBlockDecisionCache(std::size_t capacity) :
+    m_slots(),
+    m_slotMask(0),
+    m_generation(0),
+    m_lookups(0),
+    m_hits(0),
+    m_timeSavedNs(0)
+{
+    std::size_t slotCount = 1;
+    while (slotCount < capacity)
+        slotCount <<= 1;
+
+    m_slots.reset(new Slot[slotCount]);
+    m_slotMask = static_cast<quint64>(slotCount - 1);
+
+    for (std::size_t i = 0; i < slotCount; ++i)
+    {
+        Slot &slot = m_slots[i];
+        slot.Sequence.store(0, std::memory_order_relaxed);
+        slot.Key.store(0, std::memory_order_relaxed);
+        slot.Generation.store(0, std::memory_order_relaxed);
+        slot.Result.store(0, std::memory_order_relaxed);
+        slot.Filter.store(0, std::memory_order_relaxed);
+        slot.EvaluationTimeNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool AdBlockDecisionCache::find(quint64 key, quint64 generation, Decision &decision)
+{
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+    updateGeneration(generation);
+
+    const Slot &slot = getSlot(key);
+
+    // A slot that is being written is treated as a miss, rather than waiting for the writer
+    const quint64 sequence = slot.Sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0)
+        return false;
+
+    const quint64 slotKey = slot.Key.load(std::memory_order_relaxed);
+    const quint64 slotGeneration = slot.Generation.load(std::memory_order_relaxed);
+    const quint64 result = slot.Result.load(std::memory_order_relaxed);
+    const quintptr filter = slot.Filter.load(std::memory_order_relaxed);
+    const qint64 evaluationTimeNs = slot.EvaluationTimeNs.load(std::memory_order_relaxed);
+
+    // The fields are only consistent if no writer started while they were read
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.Sequence.load(std::memory_order_relaxed) != sequence)
+        return false;
+
+    // A decision made with an older snapshot is never reused, since its filter may already have been released
+    if ((result & ResultOccupied) == 0 || slotKey != key || slotGeneration != generation)
+        return false;
+
+    decision.Matched = (result & ResultMatched) != 0;
+    decision.Action = static_cast<AdBlockFilterAction>(result >> ResultActionShift);
+    decision.Filter = reinterpret_cast<AdBlockFilter*>(filter);
+
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    m_timeSavedNs.fetch_add(static_cast<quint64>(evaluationTimeNs), std::memory_order_relaxed);
+    return true;
+}
+
+void AdBlockDecisionCache::insert(quint64 key, quint64 generation, const Decision &decision, qint64 evaluationTimeNs)
+{
+    // A request evaluated with an older snapshot may finish after the cache moved on to a newer one
+    updateGeneration(generation);
+    if (generation < m_generation.load(std::memory_order_relaxed))
+        return;
+
+    Slot &slot = getSlot(key);
+    quint64 sequence = 0;
+    if (!beginWrite(slot, sequence))
+        return;
+
+    slot.Key.store(key, std::memory_order_relaxed);
+    slot.Generation.store(generation, std::memory_order_relaxed);
+    slot.Result.store(packResult(decision), std::memory_order_relaxed);
+    slot.Filter.store(reinterpret_cast<quintptr>(decision.Filter), std::memory_order_relaxed);
+    slot.EvaluationTimeNs.store(evaluationTimeNs, std::memory_order_relaxed);
+
+    slot.Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void AdBlockDecisionCache::clear()
+{
+    for (quint64 i = 0; i <= m_slotMask; ++i)
+    {
+        Slot &slot = m_slots[i];
+
+        // Waits for a concurrent insert, since a decision left in the slot would survive the clear
+        quint64 sequence = 0;
+        while (!beginWrite(slot, sequence))
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+        slot.Result.store(0, std::memory_order_relaxed);
+        slot.Sequence.store(sequence + 2, std::memory_order_release);
+    }
+}
+
+AdBlockDecisionCache::Statistics AdBlockDecisionCache::getStatistics() const
+{
+    return Statistics { m_lookups.load(), m_hits.load(), m_timeSavedNs.load() };
+}
+
+void AdBlockDecisionCache::resetStatistics()
+{
+    m_lookups = 0;
+    m_hits = 0;
+    m_timeSavedNs = 0;
+}
+
+quint64 AdBlockDecisionCache::makeKey(const AdBlockRequestContext &context)
+{
+    // 64-bit FNV-1a
+    quint64 hash = 14695981039346656037ULL;
+
+    // Hashes the bytes of the request URL, or the UTF-16 characters of the first party host
+    auto hashString = [&hash](const auto *data, int length) {
+        for (int i = 0; i < length; ++i)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ULL;
+        }
+
+        // Separates the strings, so that moving characters from one to the other changes the hash
+        hash ^= 0xFFFFULL;
+        hash *= 1099511628211ULL;
+    };
+
+    hashString(reinterpret_cast<const uchar*>(context.RequestUrl.constData()), context.RequestUrl.size());
+    hashString(context.FirstPartyHost.utf16(), context.FirstPartyHost.size());
+
+    quint64 type = static_cast<quint64>(context.Type);
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= (type & 0xFFULL);
+        hash *= 1099511628211ULL;
+        type >>= 8;
+    }
+
+    return hash;
+}
+
+AdBlockDecisionCache::Slot &AdBlockDecisionCache::getSlot(quint64 key) const
+{
+    return m_slots[key & m_slotMask];
+}
+
+bool AdBlockDecisionCache::beginWrite(Slot &slot, quint64 &sequence)
+{
+    sequence = slot.Sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0
+            || !slot.Sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed))
+        return false;
+
+    // Keeps the stores to the fields from becoming visible before the slot is marked as being written
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+quint64 AdBlockDecisionCache::packResult(const Decision &decision)
+{
+    quint64 result = ResultOccupied;
+    if (decision.Matched)
+        result |= ResultMatched;
+    result |= static_cast<quint64>(decision.Action) << ResultActionShift;
+    return result;
+}
+
+void AdBlockDecisionCache::updateGeneration(quint64 generation)
+{
+    quint64 current = m_generation.load(std::memory_order_relaxed);
+    while (generation > current
+           && !m_generation.compare_exchange_weak(current, generation, std::memory_order_relaxed))
+    {
+    }
+}
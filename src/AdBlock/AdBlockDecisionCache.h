@@ -0,0 +1,151 @@
+#ifndef ADBLOCKDECISIONCACHE_H
+#define ADBLOCKDECISIONCACHE_H
+
+#include "AdBlockLog.h"
+#include "AdBlockRequestContext.h"
+
+#include <atomic>
+#include <memory>
+#include <QtGlobal>
+
+class AdBlockFilter;
+
+/**
+ * @class AdBlockDecisionCache
+ * @ingroup AdBlock
+ * @brief Remembers the outcome of the most recently evaluated network requests, so that a request which is
+ *        repeated on the same page, such as a tracking pixel or an analytics script, is not matched against
+ *        every filter again.
+ *
+ * Each decision is stored under a hash of the request URL, the host of the first party and the request type,
+ * along with the generation of the \ref AdBlockFilterSnapshot that produced it. A decision is only returned to
+ * a lookup made with the same generation, so it is never applied once the filters have changed. This also
+ * means the filter of a decision is only returned while its snapshot, which owns the filter, is in use.
+ *
+ * Requests are intercepted on more than one thread, so the cache does not take any lock. The hash selects a
+ * single slot, guarded by a sequence counter that is odd while the slot is written. A lookup that sees the
+ * counter change while it reads the slot treats it as a miss, and an insert into a slot that another thread
+ * is writing is dropped.
+ */
+class AdBlockDecisionCache
+{
+public:
+    /// The result of evaluating a request against the network filters
+    struct Decision
+    {
+        /// True if a filter matched the request, false if the request is left alone
+        bool Matched;
+
+        /// Action taken on the request. Only meaningful if a filter matched
+        AdBlockFilterAction Action;
+
+        /// The filter that decided the action, or a nullptr if no filter matched
+        AdBlockFilter *Filter;
+    };
+
+    /// Counters of the lookups made in the cache
+    struct Statistics
+    {
+        /// Number of requests that were looked up
+        quint64 Lookups;
+
+        /// Number of requests whose decision was found in the cache
+        quint64 Hits;
+
+        /// Sum of the time that the cached decisions took to evaluate, in nanoseconds, for each time they were reused
+        quint64 TimeSavedNs;
+    };
+
+    /**
+     * @brief Constructs an empty decision cache
+     * @param capacity Maximum number of decisions to store, rounded up to a power of two
+     */
+    explicit AdBlockDecisionCache(std::size_t capacity);
+
+    /**
+     * @brief Searches for the decision of a request
+     * @param key Key of the request, as returned by \ref makeKey
+     * @param generation Generation of the snapshot that the request is evaluated with
+     * @param decision Set to the cached decision, if one is found
+     * @return True if a decision was found, false if the request must be evaluated
+     */
+    bool find(quint64 key, quint64 generation, Decision &decision);
+
+    /**
+     * @brief Stores the decision of a request
+     * @param key Key of the request, as returned by \ref makeKey
+     * @param generation Generation of the snapshot that the request was evaluated with
+     * @param decision Outcome of the evaluation
+     * @param evaluationTimeNs Time spent evaluating the request, in nanoseconds
+     */
+    void insert(quint64 key, quint64 generation, const Decision &decision, qint64 evaluationTimeNs);
+
+    /// Removes all decisions from the cache
+    void clear();
+
+    /// Returns the lookup counters since the cache was created, or since the last reset
+    Statistics getStatistics() const;
+
+    /// Sets all of the lookup counters to zero
+    void resetStatistics();
+
+    /// Returns the key of a request, a 64-bit hash of its URL, the host of its first party and its type.
+    /// The request type must already be set in the context
+    static quint64 makeKey(const AdBlockRequestContext &context);
+
+private:
+    /// A stored decision. Every field is atomic, since a slot may be read while another thread writes it
+    struct Slot
+    {
+        /// Even while the slot can be read, odd while it is written
+        std::atomic<quint64> Sequence;
+
+        /// Key of the request
+        std::atomic<quint64> Key;
+
+        /// Generation of the snapshot that the request was evaluated with
+        std::atomic<quint64> Generation;
+
+        /// Outcome of the evaluation, packed by \ref packResult. Zero if the slot is empty
+        std::atomic<quint64> Result;
+
+        /// The filter that decided the action
+        std::atomic<quintptr> Filter;
+
+        /// Time spent evaluating the request, in nanoseconds
+        std::atomic<qint64> EvaluationTimeNs;
+    };
+
+    /// Returns the slot of the request with the given key
+    Slot &getSlot(quint64 key) const;
+
+    /// Marks the given slot as being written, returning false if another thread is already writing it
+    static bool beginWrite(Slot &slot, quint64 &sequence);
+
+    /// Packs whether the request matched and its action into a non-zero value
+    static quint64 packResult(const Decision &decision);
+
+    /// Raises the newest generation seen by the cache to the given generation, if it is newer
+    void updateGeneration(quint64 generation);
+
+private:
+    /// Stored decisions, indexed by the lowest bits of their key
+    std::unique_ptr<Slot[]> m_slots;
+
+    /// Number of slots minus one, masking a key to its slot
+    quint64 m_slotMask;
+
+    /// Newest generation of the snapshots that requests were looked up or evaluated with
+    std::atomic<quint64> m_generation;
+
+    /// Number of requests that were looked up
+    std::atomic<quint64> m_lookups;
+
+    /// Number of requests whose decision was found
+    std::atomic<quint64> m_hits;
+
+    /// Evaluation time saved by cache hits, in nanoseconds
+    std::atomic<quint64> m_timeSavedNs;
+};
+
+#endif // ADBLOCKDECISIONCACHE_H
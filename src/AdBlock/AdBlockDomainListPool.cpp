@@ -0,0 +1,37 @@
+#include "AdBlockDomainListPool.h"
+
+#include <algorithm>
+
+AdBlockDomainListPool::AdBlockDomainListPool() :
+    m_lists()
+{
+}
+
+QVector<QString> AdBlockDomainListPool::intern(QVector<QString> domains)
+{
+    if (domains.isEmpty())
+        return domains;
+
+    std::sort(domains.begin(), domains.end());
+    domains.erase(std::unique(domains.begin(), domains.end()), domains.end());
+
+    QString key;
+    for (const QString &domain : domains)
+    {
+        key.append(domain);
+        key.append(QChar(','));
+    }
+
+    auto it = m_lists.find(key);
+    if (it != m_lists.end())
+        return it.value();
+
+    domains.squeeze();
+    m_lists.insert(key, domains);
+    return domains;
+}
+
+int AdBlockDomainListPool::size() const
+{
+    return m_lists.size();
+}
@@ -0,0 +1,40 @@
+#ifndef ADBLOCKDOMAINLISTPOOL_H
+#define ADBLOCKDOMAINLISTPOOL_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * @class AdBlockDomainListPool
+ * @ingroup AdBlock
+ * @brief Interns the domain lists of filters, so that filters restricted to the same domains share a
+ *        single sorted list instead of each holding their own copy.
+ *
+ * Cosmetic filter lists contain long runs of rules for the same site (example.com##.ad, example.com##.banner, ...),
+ * and network filters often repeat the same domain option. Since QVector is implicitly shared, every filter
+ * given a list by the pool references the same memory.
+ */
+class AdBlockDomainListPool
+{
+public:
+    /// Constructs an empty pool
+    AdBlockDomainListPool();
+
+    /**
+     * @brief Sorts the domains and removes any duplicates, returning the copy of an identical list if one
+     *        was interned before
+     * @param domains Domains of a filter
+     * @return The shared, sorted list of domains
+     */
+    QVector<QString> intern(QVector<QString> domains);
+
+    /// Returns the number of distinct lists in the pool
+    int size() const;
+
+private:
+    /// Interned lists, keyed by their domains joined by commas
+    QHash<QString, QVector<QString>> m_lists;
+};
+
+#endif // ADBLOCKDOMAINLISTPOOL_H
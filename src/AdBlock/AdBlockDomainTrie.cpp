@@ -0,0 +1,125 @@
+#include "AdBlockDomainTrie.h"
+
+#include <algorithm>
+#include <QSet>
+
+constexpr int AdBlockDomainTrie::RootNode;
+constexpr int AdBlockDomainTrie::EntityRootNode;
+
+AdBlockDomainTrie::AdBlockDomainTrie() :
+    m_nodes(),
+    m_edges(),
+    m_numFilters(0),
+    m_hasEntities(false)
+{
+    clear();
+}
+
+void AdBlockDomainTrie::insert(const QString &domain, AdBlockFilter *filter)
+{
+    QString name = domain.toLower();
+
+    int node = RootNode;
+    if (name.endsWith(QChar('.')))
+    {
+        name.chop(1);
+        node = EntityRootNode;
+        m_hasEntities = true;
+    }
+
+    if (name.isEmpty())
+        return;
+
+    // Insert labels from right to left
+    int end = name.size();
+    while (end > 0)
+    {
+        int start = name.lastIndexOf(QChar('.'), end - 1) + 1;
+        node = getOrAddChild(node, name.mid(start, end - start));
+        end = start - 1;
+    }
+
+    m_nodes[node].Filters.push_back(filter);
+    ++m_numFilters;
+}
+
+void AdBlockDomainTrie::clear()
+{
+    m_nodes.clear();
+    m_nodes.resize(2);
+    m_edges.clear();
+    m_numFilters = 0;
+    m_hasEntities = false;
+}
+
+bool AdBlockDomainTrie::empty() const
+{
+    return m_numFilters == 0;
+}
+
+int AdBlockDomainTrie::size() const
+{
+    return m_numFilters;
+}
+
+std::vector<AdBlockFilter*> AdBlockDomainTrie::getFilters(const QString &host) const
+{
+    std::vector<AdBlockFilter*> filters;
+    QSet<AdBlockFilter*> visited;
+
+    // A filter stored under several domains of the same host is only returned once
+    findMatches(host, [&](AdBlockFilter *filter) {
+        if (!visited.contains(filter))
+        {
+            visited.insert(filter);
+            filters.push_back(filter);
+        }
+        return false;
+    });
+
+    return filters;
+}
+
+int AdBlockDomainTrie::findChild(int node, const QChar *label, int length) const
+{
+    if (length <= 0)
+        return -1;
+
+    const quint64 key = getEdgeKey(node, hashLabel(label, length));
+    for (auto it = m_edges.constFind(key); it != m_edges.cend() && it.key() == key; ++it)
+    {
+        const QString &childLabel = m_nodes[it.value()].Label;
+        if (childLabel.size() == length && std::equal(label, label + length, childLabel.constData()))
+            return it.value();
+    }
+
+    return -1;
+}
+
+int AdBlockDomainTrie::getOrAddChild(int node, const QString &label)
+{
+    if (label.isEmpty())
+        return node;
+
+    int child = findChild(node, label.constData(), label.size());
+    if (child >= 0)
+        return child;
+
+    child = static_cast<int>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes.back().Label = label;
+    m_edges.insert(getEdgeKey(node, hashLabel(label.constData(), label.size())), child);
+    return child;
+}
+
+quint32 AdBlockDomainTrie::hashLabel(const QChar *label, int length)
+{
+    // FNV-1a
+    quint32 hash = 2166136261U;
+    for (int i = 0; i < length; ++i)
+    {
+        hash ^= label[i].unicode();
+        hash *= 16777619U;
+    }
+    return hash;
+}
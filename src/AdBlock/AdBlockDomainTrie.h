@@ -0,0 +1,146 @@
+#ifndef ADBLOCKDOMAINTRIE_H
+#define ADBLOCKDOMAINTRIE_H
+
+#include <vector>
+#include <QChar>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+class AdBlockFilter;
+
+/**
+ * @class AdBlockDomainTrie
+ * @ingroup AdBlock
+ * @brief Stores filters under the domains they apply to, in a trie of reversed host name labels
+ *        (com -> example -> ads). A single walk over the labels of a host visits every domain the
+ *        host belongs to, including entity domains such as "google.*", which are matched against the
+ *        host without its top-level label.
+ */
+class AdBlockDomainTrie
+{
+public:
+    /// Constructs an empty trie
+    AdBlockDomainTrie();
+
+    /**
+     * @brief Stores the filter under the given domain
+     * @param domain Domain the filter applies to. A domain ending with '.' is treated as an entity (the "google." in google.*)
+     * @param filter Filter to be returned for the domain and its subdomains
+     */
+    void insert(const QString &domain, AdBlockFilter *filter);
+
+    /// Removes all domains and filters from the trie
+    void clear();
+
+    /// Returns true if the trie does not contain any filters, false if else
+    bool empty() const;
+
+    /// Returns the number of filters stored in the trie (a filter inserted under several domains is counted once per domain)
+    int size() const;
+
+    /**
+     * @brief Visits the filters stored under the given host and every domain it belongs to, starting with the top-level domain
+     * @param host Lower case host name
+     * @param callback Function invoked with each filter found. The search stops once the callback returns true
+     * @return True if the search was stopped by the callback, false if else
+     */
+    template <typename Callback>
+    bool findMatches(const QString &host, Callback callback) const
+    {
+        if (m_numFilters == 0 || host.isEmpty())
+            return false;
+
+        if (walk(RootNode, host.constData(), host.size(), callback))
+            return true;
+
+        // Entity filters apply regardless of the top-level domain
+        const int lastDot = host.lastIndexOf(QChar('.'));
+        if (lastDot > 0 && m_hasEntities)
+            return walk(EntityRootNode, host.constData(), lastDot, callback);
+
+        return false;
+    }
+
+    /**
+     * @brief Returns the filters stored under the given host and every domain it belongs to
+     * @param host Lower case host name
+     * @return Each filter found, once, in the order in which it was first visited by \ref findMatches
+     */
+    std::vector<AdBlockFilter*> getFilters(const QString &host) const;
+
+private:
+    /// Node of the trie, representing one label of a domain
+    struct Node
+    {
+        /// Label of the node (one component of a domain name)
+        QString Label;
+
+        /// Filters stored under the domain ending at this node
+        std::vector<AdBlockFilter*> Filters;
+    };
+
+    /// Index of the root node of regular domains
+    static constexpr int RootNode = 0;
+
+    /// Index of the root node of entity domains
+    static constexpr int EntityRootNode = 1;
+
+    /// Walks the labels of the given host from right to left, starting at the given node
+    template <typename Callback>
+    bool walk(int node, const QChar *host, int length, Callback callback) const
+    {
+        int end = length;
+        while (end > 0)
+        {
+            int start = end - 1;
+            while (start >= 0 && host[start] != QChar('.'))
+                --start;
+            ++start;
+
+            node = findChild(node, host + start, end - start);
+            if (node < 0)
+                return false;
+
+            for (AdBlockFilter *filter : m_nodes[node].Filters)
+            {
+                if (callback(filter))
+                    return true;
+            }
+
+            end = start - 1;
+        }
+
+        return false;
+    }
+
+    /// Returns the index of the child of the node with the given label, or -1 if there is no such child
+    int findChild(int node, const QChar *label, int length) const;
+
+    /// Returns the index of the child of the node with the given label, creating the child if it does not exist
+    int getOrAddChild(int node, const QString &label);
+
+    /// Returns the key of the edge from the given node with a label of the given hash
+    static inline quint64 getEdgeKey(int node, quint32 labelHash)
+    {
+        return (static_cast<quint64>(node) << 32) | labelHash;
+    }
+
+    /// Returns the hash of a label
+    static quint32 hashLabel(const QChar *label, int length);
+
+private:
+    /// Nodes of the trie. The first two nodes are the roots of the regular and entity domains
+    std::vector<Node> m_nodes;
+
+    /// Edges between nodes, keyed by the parent node and the hash of the child's label
+    QMultiHash<quint64, int> m_edges;
+
+    /// Number of filters stored in the trie
+    int m_numFilters;
+
+    /// True if any entity domain was inserted into the trie
+    bool m_hasEntities;
+};
+
+#endif // ADBLOCKDOMAINTRIE_H
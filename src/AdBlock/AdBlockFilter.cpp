@@ -1,73 +1,60 @@
 #include <algorithm>
 #include <array>
+#include <cstring>
+#include <iterator>
 #include "AdBlockFilter.h"
+#include "AdBlockProfiler.h"
+#include "AdBlockRequestContext.h"
 #include "Bitfield.h"
-#include "CommonUtil.h"
-#include "URL.h"
+#include "StringSearch.h"
+
+#include <QElapsedTimer>
 
 AdBlockFilter::AdBlockFilter(const QString &rule) :
     m_category(FilterCategory::None),
-    m_ruleString(rule),
+    m_options(0),
+    m_ruleString(rule.toUtf8()),
     m_evalString(),
-    m_contentSecurityPolicy(),
-    m_exception(false),
-    m_important(false),
-    m_disabled(false),
-    m_redirect(false),
-    m_redirectName(),
+    m_evalBytes(),
+    m_optionValue(),
     m_allowedTypes(ElementType::None),
     m_blockedTypes(ElementType::None),
-    m_matchCase(false),
-    m_matchAll(false),
     m_domainBlacklist(),
     m_domainWhitelist(),
     m_regExp(nullptr),
-    m_differenceHash(0),
-    m_evalStringHash(0)
+    m_compiledPattern()
 {
 }
 
 AdBlockFilter::AdBlockFilter(const AdBlockFilter &other) :
     m_category(other.m_category),
+    m_options(other.m_options),
     m_ruleString(other.m_ruleString),
     m_evalString(other.m_evalString),
-    m_contentSecurityPolicy(other.m_contentSecurityPolicy),
-    m_exception(other.m_exception),
-    m_important(other.m_important),
-    m_disabled(other.m_disabled),
-    m_redirect(other.m_redirect),
-    m_redirectName(other.m_redirectName),
+    m_evalBytes(other.m_evalBytes),
+    m_optionValue(other.m_optionValue),
     m_allowedTypes(other.m_allowedTypes),
     m_blockedTypes(other.m_blockedTypes),
-    m_matchCase(other.m_matchCase),
-    m_matchAll(other.m_matchAll),
     m_domainBlacklist(other.m_domainBlacklist),
     m_domainWhitelist(other.m_domainWhitelist),
     m_regExp(other.m_regExp ? std::make_unique<QRegularExpression>(*other.m_regExp) : nullptr),
-    m_differenceHash(other.m_differenceHash),
-    m_evalStringHash(other.m_evalStringHash)
+    m_compiledPattern(other.m_compiledPattern)
 {
 }
 
 AdBlockFilter::AdBlockFilter(AdBlockFilter &&other) :
     m_category(other.m_category),
+    m_options(other.m_options),
     m_ruleString(other.m_ruleString),
     m_evalString(other.m_evalString),
-    m_contentSecurityPolicy(other.m_contentSecurityPolicy),
-    m_exception(other.m_exception),
-    m_important(other.m_important),
-    m_disabled(other.m_disabled),
-    m_redirect(other.m_redirect),
-    m_redirectName(other.m_redirectName),
+    m_evalBytes(other.m_evalBytes),
+    m_optionValue(other.m_optionValue),
     m_allowedTypes(other.m_allowedTypes),
     m_blockedTypes(other.m_blockedTypes),
-    m_matchCase(other.m_matchCase),
-    m_matchAll(other.m_matchAll),
     m_domainBlacklist(std::move(other.m_domainBlacklist)),
     m_domainWhitelist(std::move(other.m_domainWhitelist)),
     m_regExp(std::move(other.m_regExp)),
-    m_differenceHash(other.m_differenceHash),
-    m_evalStringHash(other.m_evalStringHash)
+    m_compiledPattern(std::move(other.m_compiledPattern))
 {
 }
 
@@ -76,23 +63,17 @@ AdBlockFilter &AdBlockFilter::operator =(const AdBlockFilter &other)
     if(this != &other)
     {
         m_category = other.m_category;
+        m_options = other.m_options;
         m_ruleString = other.m_ruleString;
         m_evalString = other.m_evalString;
-        m_contentSecurityPolicy = other.m_contentSecurityPolicy;
-        m_exception = other.m_exception;
-        m_important = other.m_important;
-        m_disabled = other.m_disabled;
-        m_redirect = other.m_redirect;
-        m_redirectName = other.m_redirectName;
+        m_evalBytes = other.m_evalBytes;
+        m_optionValue = other.m_optionValue;
         m_allowedTypes = other.m_allowedTypes;
         m_blockedTypes = other.m_blockedTypes;
-        m_matchCase = other.m_matchCase;
-        m_matchAll = other.m_matchAll;
         m_domainBlacklist = other.m_domainBlacklist;
         m_domainWhitelist = other.m_domainWhitelist;
         m_regExp = (other.m_regExp ? std::make_unique<QRegularExpression>(*other.m_regExp) : nullptr);
-        m_differenceHash = other.m_differenceHash;
-        m_evalStringHash = other.m_evalStringHash;
+        m_compiledPattern = other.m_compiledPattern;
     }
 
     return *this;
@@ -103,23 +84,17 @@ AdBlockFilter &AdBlockFilter::operator =(AdBlockFilter &&other)
     if(this != &other)
     {
         m_category = other.m_category;
+        m_options = other.m_options;
         m_ruleString = other.m_ruleString;
         m_evalString = other.m_evalString;
-        m_contentSecurityPolicy = other.m_contentSecurityPolicy;
-        m_exception = other.m_exception;
-        m_important = other.m_important;
-        m_disabled = other.m_disabled;
-        m_redirect = other.m_redirect;
-        m_redirectName = other.m_redirectName;
+        m_evalBytes = other.m_evalBytes;
+        m_optionValue = other.m_optionValue;
         m_allowedTypes = other.m_allowedTypes;
         m_blockedTypes = other.m_blockedTypes;
-        m_matchCase = other.m_matchCase;
-        m_matchAll = other.m_matchAll;
         m_domainBlacklist = std::move(other.m_domainBlacklist);
         m_domainWhitelist = std::move(other.m_domainWhitelist);
         m_regExp = std::move(other.m_regExp);
-        m_differenceHash = other.m_differenceHash;
-        m_evalStringHash = other.m_evalStringHash;
+        m_compiledPattern = std::move(other.m_compiledPattern);
     }
     return *this;
 }
@@ -135,32 +110,33 @@ FilterCategory AdBlockFilter::getCategory() const
 
 void AdBlockFilter::setRule(const QString &rule)
 {
-    m_ruleString = rule;
+    m_ruleString = rule.toUtf8();
 }
 
-const QString &AdBlockFilter::getRule() const
+QString AdBlockFilter::getRule() const
 {
-    return m_ruleString;
+    return QString::fromUtf8(m_ruleString);
 }
 
-const QString &AdBlockFilter::getEvalString() const
+QString AdBlockFilter::getEvalString() const
 {
-    return m_evalString;
+    return hasEncodedEvalString() ? QString::fromUtf8(m_evalBytes) : m_evalString;
 }
 
 const QString &AdBlockFilter::getContentSecurityPolicy() const
 {
-    return m_contentSecurityPolicy;
+    static const QString emptyValue;
+    return hasOption(OptionRedirect) ? emptyValue : m_optionValue;
 }
 
 bool AdBlockFilter::isException() const
 {
-    return m_exception;
+    return hasOption(OptionException);
 }
 
 bool AdBlockFilter::isImportant() const
 {
-    return m_important;
+    return hasOption(OptionImportant);
 }
 
 bool AdBlockFilter::hasDomainRules() const
@@ -170,36 +146,49 @@ bool AdBlockFilter::hasDomainRules() const
 
 bool AdBlockFilter::isRedirect() const
 {
-    return m_redirect;
+    return hasOption(OptionRedirect);
+}
+
+bool AdBlockFilter::isBadFilter() const
+{
+    return hasElementType(m_blockedTypes, ElementType::BadFilter);
 }
 
 const QString &AdBlockFilter::getRedirectName() const
 {
-    return m_redirectName;
+    static const QString emptyValue;
+    return hasOption(OptionRedirect) ? m_optionValue : emptyValue;
 }
 
-bool AdBlockFilter::isMatch(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask)
+const QRegularExpression *AdBlockFilter::getRegExp() const
 {
-    if (m_disabled)
-        return false;
+    return m_regExp.get();
+}
 
-    // Check for domain restrictions
-    if (hasDomainRules() && !isDomainStyleMatch(baseUrl))
-        return false;
+bool AdBlockFilter::isMatch(const AdBlockRequestContext &context)
+{
+    if (!AdBlockProfiler::isEnabled())
+        return evaluateMatch(context);
 
-    // Special cases
-    if (typeMask == ElementType::InlineScript && !hasElementType(m_blockedTypes, ElementType::InlineScript))
-        return false;
-    if (hasElementType(m_blockedTypes, ElementType::ThirdParty) && !hasElementType(typeMask, ElementType::ThirdParty))
-        return false;
-    if (hasElementType(m_allowedTypes, ElementType::ThirdParty) && hasElementType(typeMask, ElementType::ThirdParty))
+    QElapsedTimer timer;
+    timer.start();
+    const bool match = evaluateMatch(context);
+    AdBlockProfiler::instance().recordFilter(m_ruleString, match, timer.nsecsElapsed());
+    return match;
+}
+
+bool AdBlockFilter::evaluateMatch(const AdBlockRequestContext &context)
+{
+    if (!isContextMatch(context.FirstPartyHost, context.Type))
         return false;
 
-    bool match = m_matchAll;
+    bool match = hasOption(OptionMatchAll);
 
     if (!match)
     {
-        Qt::CaseSensitivity caseSensitivity = m_matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
+        // Evaluation strings of filters without the match-case option are stored in lower case,
+        // so they can be compared with the lower case URL without ignoring case
+        const QByteArray &requestUrl = hasOption(OptionMatchCase) ? context.RequestUrl : context.RequestUrlLower;
         switch (m_category)
         {
             case FilterCategory::Stylesheet:    // Handled in AdBlockManager
@@ -207,73 +196,70 @@ bool AdBlockFilter::isMatch(const QString &baseUrl, const QString &requestUrl, c
             case FilterCategory::StylesheetCustom:
                 return false;
             case FilterCategory::Domain:
-                match = isDomainMatch(requestDomain, m_evalString);
+                // Compared with the full host, as in the domain trie, so that filters of a www. host can match
+                match = isHostMatch(context.RequestHostBytes, m_evalBytes);
                 break;
             case FilterCategory::DomainStart:
-                match = isDomainStartMatch(requestUrl, URL(requestDomain).getSecondLevelDomain());
+                match = isDomainStartMatch(requestUrl, context.RequestSecondLevelDomainBytes);
                 break;
             case FilterCategory::StringStartMatch:
-                match = requestUrl.startsWith(m_evalString, caseSensitivity);
+                match = StringSearch::startsWith(requestUrl, m_evalBytes);
                 break;
             case FilterCategory::StringEndMatch:
-                match = requestUrl.endsWith(m_evalString, caseSensitivity);
+                match = StringSearch::endsWith(requestUrl, m_evalBytes);
                 break;
             case FilterCategory::StringExactMatch:
-                match = (requestUrl.compare(m_evalString, caseSensitivity) == 0);
+                match = (requestUrl == m_evalBytes);
                 break;
             case FilterCategory::StringContains:
-            {
-                QString haystack = (m_matchCase ? requestUrl : requestUrl.toLower());
-                match = filterContains(haystack);
+                match = filterContains(requestUrl);
                 break;
-            }
             case FilterCategory::RegExp:
-                match = m_regExp->match(requestUrl).hasMatch();
+                match = m_compiledPattern.isMatch(context, hasOption(OptionMatchCase), m_regExp.get());
                 break;
             default:
                 break;
         }
     }
 
-    if (match)
-    {
-        // Check for element type restrictions (in specific order)
-        std::array<ElementType, 13> elemTypes = {  ElementType::XMLHTTPRequest,  ElementType::Document,   ElementType::Object,
-                                                   ElementType::Subdocument,     ElementType::Image,      ElementType::Script,
-                                                   ElementType::Stylesheet,      ElementType::WebSocket,  ElementType::ObjectSubrequest,
-                                                   ElementType::InlineScript,    ElementType::Ping,       ElementType::CSP,
-                                                   ElementType::Other };
-
-        for (std::size_t i = 0; i < elemTypes.size(); ++i)
-        {
-            ElementType currentType = elemTypes[i];
-            bool isRequestOfType = hasElementType(typeMask, currentType);
-            if (hasElementType(m_allowedTypes, currentType) && isRequestOfType)
-                return false;
-            if (hasElementType(m_blockedTypes, currentType) && isRequestOfType)
-                return true;
-        }
+    return match && isElementTypeMatch(context.Type);
+}
 
+bool AdBlockFilter::isMatch(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask)
+{
+    return isMatch(AdBlockRequestContext(baseUrl, requestUrl, requestDomain, typeMask));
+}
 
-        //ElementType::ThirdParty | ElementType::MatchCase | ElementType::Collapse
-        ElementType ignoreTypeMask = static_cast<ElementType>(~0x00038000ULL);
-        if ((m_blockedTypes & ignoreTypeMask) != ElementType::None)
-            return false;
-        //if (m_blockedTypes != ElementType::None && !hasElementType(m_blockedTypes, ElementType::ThirdParty))
-        //    return false;
-    }
+bool AdBlockFilter::isOptionMatch(const AdBlockRequestContext &context)
+{
+    if (!AdBlockProfiler::isEnabled())
+        return isContextMatch(context.FirstPartyHost, context.Type) && isElementTypeMatch(context.Type);
 
+    QElapsedTimer timer;
+    timer.start();
+    const bool match = isContextMatch(context.FirstPartyHost, context.Type) && isElementTypeMatch(context.Type);
+    AdBlockProfiler::instance().recordFilter(m_ruleString, match, timer.nsecsElapsed());
     return match;
 }
 
 bool AdBlockFilter::isDomainStyleMatch(const QString &domain)
 {
-    if (m_disabled || domain.isEmpty())
+    if (hasOption(OptionDisabled) || domain.isEmpty())
         return false;
 
     if (m_domainBlacklist.empty() && m_domainWhitelist.empty())
         return true;
 
+    // Long domain lists are probed with each domain that the given domain belongs to,
+    // which takes one lookup per label instead of one comparison per list entry
+    const int numLabels = domain.count(QChar('.')) + 1;
+    if (m_domainWhitelist.size() + m_domainBlacklist.size() > 2 * numLabels)
+    {
+        if (containsDomain(m_domainWhitelist, domain))
+            return false;
+        return containsDomain(m_domainBlacklist, domain);
+    }
+
     for (const QString &d : m_domainWhitelist)
     {
         if (isDomainMatch(domain, d))
@@ -288,14 +274,18 @@ bool AdBlockFilter::isDomainStyleMatch(const QString &domain)
     return false;
 }
 
-void AdBlockFilter::addDomainToWhitelist(const QString &domainStr)
+void AdBlockFilter::setDomains(const QVector<QString> &blacklist, const QVector<QString> &whitelist)
 {
-    m_domainWhitelist.insert(domainStr);
+    m_domainBlacklist = blacklist;
+    m_domainWhitelist = whitelist;
 }
 
-void AdBlockFilter::addDomainToBlacklist(const QString &domainStr)
+void AdBlockFilter::addDomainsToWhitelist(const QVector<QString> &domains)
 {
-    m_domainBlacklist.insert(domainStr);
+    QVector<QString> whitelist;
+    whitelist.reserve(m_domainWhitelist.size() + domains.size());
+    std::set_union(m_domainWhitelist.cbegin(), m_domainWhitelist.cend(), domains.cbegin(), domains.cend(), std::back_inserter(whitelist));
+    m_domainWhitelist = whitelist;
 }
 
 void AdBlockFilter::setEvalString(const QString &evalString)
@@ -303,6 +293,33 @@ void AdBlockFilter::setEvalString(const QString &evalString)
     m_evalString = evalString;
 }
 
+void AdBlockFilter::encodeEvalString()
+{
+    m_evalBytes = m_evalString.toUtf8();
+    m_evalString = QString();
+}
+
+bool AdBlockFilter::isUrlCategory() const
+{
+    switch (m_category)
+    {
+        case FilterCategory::DomainStart:
+        case FilterCategory::StringStartMatch:
+        case FilterCategory::StringEndMatch:
+        case FilterCategory::StringExactMatch:
+        case FilterCategory::StringContains:
+        case FilterCategory::RegExp:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool AdBlockFilter::hasEncodedEvalString() const
+{
+    return m_category == FilterCategory::Domain || isUrlCategory();
+}
+
 bool AdBlockFilter::isDomainMatch(QString base, const QString &domainStr) const
 {
     // Check if domain match is being performed on an entity filter
@@ -319,82 +336,121 @@ bool AdBlockFilter::isDomainMatch(QString base, const QString &domainStr) const
     return (evalIdx > 0 && base.at(evalIdx - 1) == QChar('.'));
 }
 
-bool AdBlockFilter::isDomainStartMatch(const QString &requestUrl, const QString &secondLevelDomain) const
+bool AdBlockFilter::isHostMatch(const QByteArray &host, const QByteArray &domain)
 {
-    Qt::CaseSensitivity caseSensitivity = m_matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
-    int matchIdx = requestUrl.indexOf(m_evalString, 0, caseSensitivity);
-    if (matchIdx > 0)
-    {
-        QChar c = requestUrl[matchIdx - 1];
-        const bool validChar = c == QChar('.') || c == QChar('/');
-        return validChar || m_evalString.contains(secondLevelDomain, caseSensitivity);
-    }
-    return false;
+    int hostLength = host.size();
+    if (domain.endsWith('.'))
+        hostLength = host.lastIndexOf('.') + 1;
+
+    const int start = hostLength - domain.size();
+    if (start < 0 || std::memcmp(host.constData() + start, domain.constData(), static_cast<std::size_t>(domain.size())) != 0)
+        return false;
+
+    return start == 0 || host.at(start - 1) == '.';
 }
 
-bool AdBlockFilter::filterContains(const QString &haystack) const
+bool AdBlockFilter::containsDomain(const QVector<QString> &domainList, const QString &domain) const
 {
-    static const quint64 radixLength = 256ULL;
-    static const quint64 prime = 89999027ULL;
+    if (domainList.isEmpty())
+        return false;
 
-    const int needleLength = m_evalString.size();
-    const int haystackLength = haystack.size();
+    auto containsSuffix = [&domainList](const QString &name) {
+        int pos = 0;
+        while (pos >= 0)
+        {
+            if (std::binary_search(domainList.cbegin(), domainList.cend(), name.mid(pos)))
+                return true;
 
-    if (needleLength > haystackLength)
+            pos = name.indexOf(QChar('.'), pos);
+            if (pos >= 0)
+                ++pos;
+        }
         return false;
-    if (needleLength == 0)
-        return true;
+    };
 
-    const QChar *needlePtr = m_evalString.constData();
-    const QChar *haystackPtr = haystack.constData();
+    // Check the domain and each of its parent domains
+    if (containsSuffix(domain))
+        return true;
 
-    int i, j;
-    quint64 t = 0;
+    // Entities (ie "google.") are compared with the domain after removing its top-level domain
+    const int tldIdx = domain.lastIndexOf(QChar('.'));
+    if (tldIdx <= 0)
+        return false;
 
-    // Calculate the hash value of first window of text
-    for (i = 0; i < needleLength; ++i)
-        t = (radixLength * t + ((haystackPtr + i)->unicode())) % prime;
+    return containsSuffix(domain.left(tldIdx + 1));
+}
 
-    const int lengthDiff = haystackLength - needleLength;
-    for (i = 0; i <= lengthDiff; ++i)
+bool AdBlockFilter::isDomainStartMatch(const QByteArray &requestUrl, const QByteArray &secondLevelDomain) const
+{
+    int matchIdx = StringSearch::indexOf(requestUrl, m_evalBytes);
+    if (matchIdx > 0)
     {
-        if (m_evalStringHash == t)
-        {
-            for (j = 0; j < needleLength; j++)
-            {
-                if ((haystackPtr + i + j)->unicode() != (needlePtr + j)->unicode())
-                    break;
-            }
+        const char c = requestUrl.at(matchIdx - 1);
+        const bool validChar = c == '.' || c == '/';
+        return validChar || StringSearch::contains(m_evalBytes, secondLevelDomain, Qt::CaseInsensitive);
+    }
+    return false;
+}
 
-            if (j == needleLength)
-                return true;
-        }
+bool AdBlockFilter::isContextMatch(const QString &firstPartyHost, ElementType typeMask)
+{
+    if (hasOption(OptionDisabled))
+        return false;
 
-        if (i < lengthDiff)
-        {
-            t = radixLength * (t + prime - m_differenceHash * ((haystackPtr + i)->unicode()) % prime) % prime;
-            t = (t + (haystackPtr + needleLength + i)->unicode()) % prime;
-        }
-    }
+    // Check for domain restrictions
+    if (hasDomainRules() && !isDomainStyleMatch(firstPartyHost))
+        return false;
 
-    return false;
+    // Special cases
+    if (typeMask == ElementType::InlineScript && !hasElementType(m_blockedTypes, ElementType::InlineScript))
+        return false;
+    if (hasElementType(m_blockedTypes, ElementType::ThirdParty) && !hasElementType(typeMask, ElementType::ThirdParty))
+        return false;
+    if (hasElementType(m_allowedTypes, ElementType::ThirdParty) && hasElementType(typeMask, ElementType::ThirdParty))
+        return false;
+
+    return true;
 }
 
-void AdBlockFilter::hashEvalString()
+bool AdBlockFilter::isElementTypeMatch(ElementType typeMask) const
 {
-    const int needleLength = m_evalString.size();
-    const QChar *needlePtr = m_evalString.constData();
+    // Check for element type restrictions (in specific order)
+    std::array<ElementType, 15> elemTypes = {  ElementType::XMLHTTPRequest,  ElementType::Document,   ElementType::Object,
+                                               ElementType::Subdocument,     ElementType::Image,      ElementType::Script,
+                                               ElementType::Stylesheet,      ElementType::WebSocket,  ElementType::ObjectSubrequest,
+                                               ElementType::InlineScript,    ElementType::Ping,       ElementType::CSP,
+                                               ElementType::ElemHide,        ElementType::GenericHide, ElementType::Other };
+
+    for (std::size_t i = 0; i < elemTypes.size(); ++i)
+    {
+        ElementType currentType = elemTypes[i];
+        bool isRequestOfType = hasElementType(typeMask, currentType);
+        if (hasElementType(m_allowedTypes, currentType) && isRequestOfType)
+            return false;
+        if (hasElementType(m_blockedTypes, currentType) && isRequestOfType)
+            return true;
+    }
 
-    const quint64 radixLength = 256ULL;
-    const quint64 prime = 89999027ULL;
+    //ElementType::ThirdParty | ElementType::MatchCase | ElementType::Collapse
+    ElementType ignoreTypeMask = static_cast<ElementType>(~0x00038000ULL);
+    if ((m_blockedTypes & ignoreTypeMask) != ElementType::None)
+        return false;
 
-    m_differenceHash = CommonUtil::quPow(radixLength, static_cast<quint64>(needleLength - 1)) % prime;
+    return true;
+}
 
-    for (int index = 0; index < needleLength; ++index)
-        m_evalStringHash = (radixLength * m_evalStringHash + (needlePtr + index)->unicode()) % prime;
+bool AdBlockFilter::filterContains(const QByteArray &haystack) const
+{
+    return StringSearch::contains(haystack, m_evalBytes);
 }
 
 void AdBlockFilter::setContentSecurityPolicy(const QString &csp)
 {
-    m_contentSecurityPolicy = csp;
+    m_optionValue = csp;
+}
+
+void AdBlockFilter::setRedirectName(const QString &name)
+{
+    setOption(OptionRedirect);
+    m_optionValue = name;
 }
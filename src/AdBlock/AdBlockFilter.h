@@ -1,14 +1,18 @@
 #ifndef ADBLOCKFILTER_H
 #define ADBLOCKFILTER_H
 
+#include "AdBlockCompiledPattern.h"
 #include "Bitfield.h"
 #include <cstdint>
 #include <memory>
 #include <tuple>
+#include <QByteArray>
 #include <QHash>
 #include <QRegularExpression>
-#include <QSet>
 #include <QString>
+#include <QVector>
+
+struct AdBlockRequestContext;
 
 /**
  * @ingroup AdBlock
@@ -92,8 +96,12 @@ enum class CosmeticFilter
  */
 class AdBlockFilter
 {
+    friend class AdBlockFilterCache;
+    friend class AdBlockFilterIndex;
     friend class AdBlockFilterParser;
+    friend struct AdBlockFilterSlice;
     friend class AdBlockManager;
+    friend class AdBlockPatternMatcher;
 
 public:
     /// Constructs the filter given the corresponding rule (a line in an adblock plus-formatted file)
@@ -118,10 +126,10 @@ public:
     FilterCategory getCategory() const;
 
     /// Returns the original filter rule as a QString
-    const QString &getRule() const;
+    QString getRule() const;
 
     /// Returns the evaluation string of the rule
-    const QString &getEvalString() const;
+    QString getEvalString() const;
 
     /// Returns the content security policy associated with the filter
     const QString &getContentSecurityPolicy() const;
@@ -138,9 +146,23 @@ public:
     /// Returns true if the filter is set to redirect matching requests to another resource, false if else
     bool isRedirect() const;
 
+    /// Returns true if the filter has the badfilter option, disabling the filters with the same rule, false if else
+    bool isBadFilter() const;
+
     /// Returns the name of the resource the filter is redirecting requests to, or an empty string if this is not a redirecting filter rule
     const QString &getRedirectName() const;
 
+    /// Returns the regular expression that requests are matched against, or a nullptr if the filter is matched without one
+    const QRegularExpression *getRegExp() const;
+
+    /**
+     * @brief Determines whether or not the network request matches the filter. The evaluation is timed and counted
+     *        by the \ref AdBlockProfiler while profiling is enabled
+     * @param context Properties of the network request, including its element type(s). Filter will disregard if type is set to none
+     * @return True if request matches filter, false if else.
+     */
+    bool isMatch(const AdBlockRequestContext &context);
+
     /**
      * @brief Determines whether or not the network request matches the filter
      * @param baseUrl URL of the original network request
@@ -151,6 +173,14 @@ public:
      */
     bool isMatch(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask);
 
+    /**
+     * @brief Determines whether or not the network request matches the options of the filter. Used when the request URL
+     *        is already known to contain the evaluation string, such as after a hit in the \ref AdBlockPatternMatcher
+     * @param context Properties of the network request
+     * @return True if the filter options match the request, false if else.
+     */
+    bool isOptionMatch(const AdBlockRequestContext &context);
+
     /// Returns true if this rule is of the Stylesheet category and applies to the given domain, returns false if else.
     bool isDomainStyleMatch(const QString &domain);
 
@@ -161,61 +191,124 @@ public:
     }
 
 protected:
-    /// Adds the given domain to the whitelist
-    void addDomainToWhitelist(const QString &domainStr);
+    /// Boolean options of the filter, stored together in a single word
+    enum FilterOption : quint8
+    {
+        /// The filter is an exception
+        OptionException     = 0x01,
 
-    /// Adds the given domain to the blacklist
-    void addDomainToBlacklist(const QString &domainStr);
+        /// The filter has the important option and is not an exception (uBlock standard)
+        OptionImportant     = 0x02,
+
+        /// The filter is disabled, and will never match network requests
+        OptionDisabled      = 0x04,
+
+        /// The filter redirects any requests it blocks to a different resource
+        OptionRedirect      = 0x08,
+
+        /// The filter only applies to addresses with a matching letter case
+        OptionMatchCase     = 0x10,
+
+        /// The evaluation string is empty. Requests are still checked against the domain and element type options
+        OptionMatchAll      = 0x20,
+
+        /// The filter was written as a regular expression (/regexp/), rather than generated from an AdBlock Plus pattern
+        OptionRegExpLiteral = 0x40
+    };
+
+    /// Returns true if the given option is set on the filter, false if else
+    inline bool hasOption(FilterOption option) const
+    {
+        return (m_options & option) != 0;
+    }
+
+    /// Sets or clears the given option
+    inline void setOption(FilterOption option, bool enabled = true)
+    {
+        if (enabled)
+            m_options |= option;
+        else
+            m_options &= static_cast<quint8>(~option);
+    }
+
+    /// Sets the domains that the filter applies to, and the domains that it does not apply to. Both lists must be
+    /// sorted and free of duplicates, as done by \ref AdBlockDomainListPool
+    void setDomains(const QVector<QString> &blacklist, const QVector<QString> &whitelist);
+
+    /// Adds the given domains to the whitelist. The domains must be sorted
+    void addDomainsToWhitelist(const QVector<QString> &domains);
 
     /// Sets the evaluation string used to match network requests
     void setEvalString(const QString &evalString);
 
+    /// Moves the evaluation string into its UTF-8 form, which network filters use once they are parsed
+    void encodeEvalString();
+
+    /// Returns true if the filter category is matched against the request URL, false if else
+    bool isUrlCategory() const;
+
+    /// Returns true if the evaluation string of the filter is kept in \ref m_evalBytes, which is the case for
+    /// the filters matched against the request URL or host, false if else
+    bool hasEncodedEvalString() const;
+
     /// Evaluates the rule, setting the filter to reflect the corresponding value(s)
     void setRule(const QString &rule);
 
-    /// Calculates the hash value of the evaluation string and the difference hash variable, used in Rabin-Karp string matching algorithm
-    void hashEvalString();
-
     /// Sets the content security policy of the filter
     void setContentSecurityPolicy(const QString &csp);
 
+    /// Sets the name of the resource that the filter redirects requests to
+    void setRedirectName(const QString &name);
+
 private:
+    /// Matches the request against the filter, as done by \ref isMatch when profiling is disabled
+    bool evaluateMatch(const AdBlockRequestContext &context);
+
+    /// Returns true if the domain restrictions, third party option and inline script special case of the filter
+    /// allow it to be applied to the request, false if else
+    bool isContextMatch(const QString &firstPartyHost, ElementType typeMask);
+
+    /// Returns true if the element type options of the filter apply to a request of the given type(s), false if else
+    bool isElementTypeMatch(ElementType typeMask) const;
+
     /// Returns true if the given domain matches the base domain string, false if else
     bool isDomainMatch(QString base, const QString &domainStr) const;
 
+    /// Returns true if the request host is the domain of a Domain filter, or one of its subdomains, false if else.
+    /// Domains ending in '.' are entity domains (example.*), which are compared with the host up to its last label
+    static bool isHostMatch(const QByteArray &host, const QByteArray &domain);
+
+    /// Returns true if the domain, or a domain that it belongs to, is in the given sorted list of domains (including entity domains)
+    bool containsDomain(const QVector<QString> &domainList, const QString &domain) const;
+
     /// Compares the requested domain the evaluation string, returning true if the filter matches the request, false if else
-    bool isDomainStartMatch(const QString &requestUrl, const QString &secondLevelDomain) const;
+    bool isDomainStartMatch(const QByteArray &requestUrl, const QByteArray &secondLevelDomain) const;
 
-    /// Applies the Rabin-Karp string matching algorithm to the given string, returning true if it contains the filter's eval string, false if else
-    bool filterContains(const QString &haystack) const;
+    /// Returns true if the given string contains the filter's eval string, false if else
+    bool filterContains(const QByteArray &haystack) const;
 
 protected:
     /// Filter category
     FilterCategory m_category;
 
-    /// Original rule string
-    QString m_ruleString;
-
-    /// Comparison string for evaluating rules (only used if category of filter is not RegExp)
-    QString m_evalString;
-
-    /// Content security policy for filters with blocking type CSP
-    QString m_contentSecurityPolicy;
-
-    /// True if the filter is an exception, false if it is a standard blocking rule
-    bool m_exception;
+    /// Combination of \ref FilterOption bits
+    quint8 m_options;
 
-    /// True if the filter has the important option and is not an exception (uBlock standard)
-    bool m_important;
+    /// Original rule string, encoded in UTF-8. The rule is only needed to log and compare filters, so it is kept
+    /// in its most compact form
+    QByteArray m_ruleString;
 
-    /// True if filter is disabled (will never match network requests), false if enabled (default)
-    bool m_disabled;
+    /// Comparison string for evaluating rules. Network filters, which are matched against the request URL or host, only keep
+    /// it while they are parsed, and then use \ref m_evalBytes. Only element hiding and script filters keep it afterwards
+    QString m_evalString;
 
-    /// True if the filter redirects any requests it blocks to a different resource, false if else
-    bool m_redirect;
+    /// Evaluation string of a network filter, encoded in UTF-8: the pattern matched against the request URL, or the domain
+    /// of a Domain filter. For filters of the RegExp category, this holds the pattern the regular expression was built from
+    QByteArray m_evalBytes;
 
-    /// Name of the resource the filter redirects requests to, if m_redirect is true.
-    QString m_redirectName;
+    /// Name of the resource the filter redirects requests to if it has the redirect option, or else the
+    /// content security policy of a filter with blocking type CSP. No filter uses both
+    QString m_optionValue;
 
     /// Bitfield of element types to be allowed
     ElementType m_allowedTypes;
@@ -223,27 +316,18 @@ protected:
     /// Bitfield of element types to be filtered
     ElementType m_blockedTypes;
 
-    /// If true, the filter only applies to addresses with a matching letter case
-    bool m_matchCase;
-
-    /// Set to true if evaluation string is empty. Requests will still be checked based on domain blacklist/whitelist and allowed/blocked element types, etc
-    bool m_matchAll;
-
-    /// List of domains that the filter rule applies to. Specified by the domain filter option
-    QSet<QString> m_domainBlacklist;
+    /// Sorted list of domains that the filter rule applies to. Specified by the domain filter option.
+    /// Filters with the same domain option share the list
+    QVector<QString> m_domainBlacklist;
 
-    /// List of domains that the filter rule does not apply to. Specified by the domain filter option
-    QSet<QString> m_domainWhitelist;
+    /// Sorted list of domains that the filter rule does not apply to. Specified by the domain filter option
+    QVector<QString> m_domainWhitelist;
 
-    /// Unique pointer to a regular expression used by the filter, if filter is of the category RegExp
+    /// Unique pointer to a regular expression used by the filter, if filter is of the category RegExp and its pattern could not be compiled
     std::unique_ptr<QRegularExpression> m_regExp;
 
-private:
-    /// Used for string hash computations in rabin-karp matching algorithm
-    quint64 m_differenceHash;
-
-    /// Contains a hash of the evaluation string, used if filter category is StringContains
-    quint64 m_evalStringHash;
+    /// Literal segments of a filter of the RegExp category. Either replaces the regular expression, or decides when it needs to run
+    AdBlockCompiledPattern m_compiledPattern;
 };
 
 #endif // ADBLOCKFILTER_H
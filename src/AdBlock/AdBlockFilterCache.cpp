@@ -0,0 +1,247 @@
+#include "AdBlockFilterCache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDebug>
+
+/// Identifies a filter cache file
+static const quint32 CacheMagic = 0x56414243;
+
+/// Version of the cache format. Must be incremented whenever the layout of a filter record
+/// or the way filters are parsed changes
+static const quint32 CacheVersion = 6;
+
+/// Bits stored with each filter in addition to its options. The lower byte holds the option bits of the filter
+enum CacheFilterFlag : quint16
+{
+    FlagOptionMask    = 0x00FF,
+    FlagHasRegExp     = 0x0100
+};
+
+AdBlockFilterCache::AdBlockFilterCache(const QString &cacheDir, const QString &subscriptionFile, quint64 resourceKey) :
+    m_cachePath(),
+    m_subscriptionFile(QFileInfo(subscriptionFile).absoluteFilePath()),
+    m_resourceKey(resourceKey),
+    m_fileModified(0),
+    m_fileSize(0),
+    m_fileHash()
+{
+    const QByteArray pathHash = QCryptographicHash::hash(m_subscriptionFile.toUtf8(), QCryptographicHash::Md5).toHex();
+    m_cachePath = QString("%1%2%3.cache").arg(cacheDir).arg(QDir::separator()).arg(QString::fromLatin1(pathHash));
+}
+
+quint64 AdBlockFilterCache::getResourceKey(const QHash<QString, QString> &resources)
+{
+    quint64 resourceKey = 0;
+    for (auto it = resources.cbegin(); it != resources.cend(); ++it)
+        resourceKey += (static_cast<quint64>(qHash(it.key())) << 32) | qHash(it.value());
+    return resourceKey;
+}
+
+bool AdBlockFilterCache::load(QString &title, int &expireDays, std::vector<std::unique_ptr<AdBlockFilter>> &filters)
+{
+    if (!computeFileKey())
+        return false;
+
+    QFile cacheFile(m_cachePath);
+    if (!cacheFile.exists() || !cacheFile.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 cacheSize = cacheFile.size();
+    uchar *cacheData = cacheFile.map(0, cacheSize);
+    if (!cacheData)
+        return false;
+
+    // Read directly from the mapped file, without copying it into memory
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(cacheData), static_cast<int>(cacheSize));
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion)
+        return false;
+
+    QString subscriptionFile;
+    qint64 fileModified = 0, fileSize = 0;
+    QByteArray fileHash;
+    quint64 resourceKey = 0;
+    stream >> subscriptionFile >> fileModified >> fileSize >> fileHash >> resourceKey;
+    if (stream.status() != QDataStream::Ok
+            || subscriptionFile != m_subscriptionFile
+            || fileModified != m_fileModified
+            || fileSize != m_fileSize
+            || fileHash != m_fileHash
+            || resourceKey != m_resourceKey)
+        return false;
+
+    QString cachedTitle;
+    qint32 cachedExpireDays = 0;
+    quint32 numFilters = 0;
+    stream >> cachedTitle >> cachedExpireDays >> numFilters;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    // Each filter record takes up more than 32 bytes, so a larger count can only come from a corrupt file
+    if (static_cast<qint64>(numFilters) > cacheSize / 32)
+        return false;
+
+    AdBlockDomainListPool domainLists;
+    std::vector<std::unique_ptr<AdBlockFilter>> cachedFilters;
+    cachedFilters.reserve(numFilters);
+    for (quint32 i = 0; i < numFilters; ++i)
+    {
+        std::unique_ptr<AdBlockFilter> filter = readFilter(stream, domainLists);
+        if (!filter)
+        {
+            qDebug() << "AdBlockFilterCache::load - cache file " << m_cachePath << " is corrupt";
+            return false;
+        }
+        cachedFilters.push_back(std::move(filter));
+    }
+
+    quint32 trailer = 0;
+    stream >> trailer;
+    if (stream.status() != QDataStream::Ok || trailer != CacheMagic)
+        return false;
+
+    title = cachedTitle;
+    expireDays = cachedExpireDays;
+    for (std::unique_ptr<AdBlockFilter> &filter : cachedFilters)
+        filters.push_back(std::move(filter));
+    return true;
+}
+
+bool AdBlockFilterCache::save(const QString &title, int expireDays, const std::vector<std::unique_ptr<AdBlockFilter>> &filters)
+{
+    if (m_fileHash.isEmpty() && !computeFileKey())
+        return false;
+
+    QDir cacheDir = QFileInfo(m_cachePath).absoluteDir();
+    if (!cacheDir.exists())
+        cacheDir.mkpath(QStringLiteral("."));
+
+    // Write to a temporary file first, so a partially written cache is never left behind
+    QSaveFile cacheFile(m_cachePath);
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&cacheFile);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    stream << CacheMagic << CacheVersion;
+    stream << m_subscriptionFile << m_fileModified << m_fileSize << m_fileHash << m_resourceKey;
+    stream << title << static_cast<qint32>(expireDays) << static_cast<quint32>(filters.size());
+
+    for (const std::unique_ptr<AdBlockFilter> &filter : filters)
+        writeFilter(stream, filter.get());
+
+    stream << CacheMagic;
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        cacheFile.cancelWriting();
+        return false;
+    }
+
+    return cacheFile.commit();
+}
+
+bool AdBlockFilterCache::computeFileKey()
+{
+    QFile subFile(m_subscriptionFile);
+    if (!subFile.exists() || !subFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QFileInfo fileInfo(subFile);
+    m_fileModified = fileInfo.lastModified().toMSecsSinceEpoch();
+    m_fileSize = subFile.size();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    if (m_fileSize > 0)
+    {
+        if (uchar *fileData = subFile.map(0, m_fileSize))
+            hash.addData(reinterpret_cast<const char*>(fileData), static_cast<int>(m_fileSize));
+        else if (!hash.addData(&subFile))
+            return false;
+    }
+
+    m_fileHash = hash.result();
+    return true;
+}
+
+std::unique_ptr<AdBlockFilter> AdBlockFilterCache::readFilter(QDataStream &stream, AdBlockDomainListPool &domainLists) const
+{
+    quint8 category = 0;
+    quint16 flags = 0;
+    quint64 allowedTypes = 0, blockedTypes = 0;
+
+    stream >> category >> flags >> allowedTypes >> blockedTypes;
+    if (stream.status() != QDataStream::Ok || category > static_cast<quint8>(FilterCategory::RegExp))
+        return nullptr;
+
+    std::unique_ptr<AdBlockFilter> filter = std::make_unique<AdBlockFilter>(QString());
+    filter->m_category = static_cast<FilterCategory>(category);
+    filter->m_options = static_cast<quint8>(flags & FlagOptionMask);
+    filter->m_allowedTypes = static_cast<ElementType>(allowedTypes);
+    filter->m_blockedTypes = static_cast<ElementType>(blockedTypes);
+
+    QVector<QString> domainBlacklist, domainWhitelist;
+    stream >> filter->m_ruleString
+           >> filter->m_evalString
+           >> filter->m_evalBytes
+           >> filter->m_optionValue
+           >> domainBlacklist
+           >> domainWhitelist;
+
+    filter->setDomains(domainLists.intern(std::move(domainBlacklist)), domainLists.intern(std::move(domainWhitelist)));
+
+    const bool matchCase = filter->hasOption(AdBlockFilter::OptionMatchCase);
+    if (flags & FlagHasRegExp)
+    {
+        // QRegularExpression does not compile its pattern until the first time it is used
+        // to match a string, so the cost of compiling is only paid by filters that are evaluated
+        QString pattern;
+        stream >> pattern;
+        QRegularExpression::PatternOptions options =
+                (matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+        filter->m_regExp = std::make_unique<QRegularExpression>(pattern, options);
+    }
+
+    // Compiled patterns are not stored in the cache, they are rebuilt from the evaluation string
+    if (filter->m_category == FilterCategory::RegExp)
+    {
+        filter->m_compiledPattern = filter->hasOption(AdBlockFilter::OptionRegExpLiteral)
+                ? AdBlockCompiledPattern::compileRegExp(filter->getEvalString(), matchCase)
+                : AdBlockCompiledPattern::compileWildcard(filter->getEvalString(), matchCase);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        return nullptr;
+
+    return filter;
+}
+
+void AdBlockFilterCache::writeFilter(QDataStream &stream, const AdBlockFilter *filter) const
+{
+    quint16 flags = filter->m_options;
+    if (filter->m_regExp)
+        flags |= FlagHasRegExp;
+
+    stream << static_cast<quint8>(filter->m_category)
+           << flags
+           << static_cast<quint64>(filter->m_allowedTypes)
+           << static_cast<quint64>(filter->m_blockedTypes)
+           << filter->m_ruleString
+           << filter->m_evalString
+           << filter->m_evalBytes
+           << filter->m_optionValue
+           << filter->m_domainBlacklist
+           << filter->m_domainWhitelist;
+
+    if (filter->m_regExp)
+        stream << filter->m_regExp->pattern();
+}
@@ -0,0 +1,80 @@
+#ifndef ADBLOCKFILTERCACHE_H
+#define ADBLOCKFILTERCACHE_H
+
+#include "AdBlockDomainListPool.h"
+#include "AdBlockFilter.h"
+
+#include <memory>
+#include <vector>
+#include <QByteArray>
+#include <QDataStream>
+#include <QHash>
+#include <QString>
+
+/**
+ * @class AdBlockFilterCache
+ * @ingroup AdBlock
+ * @brief Binary cache of the filters parsed from a subscription file. The cache is keyed by the
+ *        path, modification time, size and content hash of the subscription file, so that filters
+ *        can be restored on startup without running each line through the \ref AdBlockFilterParser.
+ *        A cache that does not match its subscription file, or that cannot be read, is ignored.
+ */
+class AdBlockFilterCache
+{
+public:
+    /**
+     * @brief Constructs the cache of a subscription file
+     * @param cacheDir Directory in which the cache file is stored
+     * @param subscriptionFile Path to the subscription file
+     * @param resourceKey Identifies the set of resources that script injection filters were built from
+     */
+    AdBlockFilterCache(const QString &cacheDir, const QString &subscriptionFile, quint64 resourceKey);
+
+    /// Returns the key of the given resources, keyed by their name, to be given to the constructor. Script injection
+    /// filters embed the resource they refer to, so cached filters are only valid for the same set of resources
+    static quint64 getResourceKey(const QHash<QString, QString> &resources);
+
+    /**
+     * @brief Attempts to load the filters of the subscription from the cache
+     * @param title Set to the title found in the subscription file, if any
+     * @param expireDays Set to the number of days after which the subscription expires, or 0 if not given
+     * @param filters Container that the cached filters are appended to
+     * @return True if the cache matched the subscription file and was read successfully, false if else
+     */
+    bool load(QString &title, int &expireDays, std::vector<std::unique_ptr<AdBlockFilter>> &filters);
+
+    /// Writes the filters of the subscription, along with its title and expiration period, to the cache
+    bool save(const QString &title, int expireDays, const std::vector<std::unique_ptr<AdBlockFilter>> &filters);
+
+private:
+    /// Computes the key of the subscription file in its current state. Returns false if the file cannot be read
+    bool computeFileKey();
+
+    /// Reads a single filter from the stream, returning a nullptr if the stream is corrupt.
+    /// Domain lists are shared with the filters read before it through the given pool
+    std::unique_ptr<AdBlockFilter> readFilter(QDataStream &stream, AdBlockDomainListPool &domainLists) const;
+
+    /// Writes a single filter to the stream
+    void writeFilter(QDataStream &stream, const AdBlockFilter *filter) const;
+
+private:
+    /// Path to the cache file
+    QString m_cachePath;
+
+    /// Absolute path to the subscription file
+    QString m_subscriptionFile;
+
+    /// Resource key given to the constructor
+    quint64 m_resourceKey;
+
+    /// Last modification time of the subscription file, in milliseconds since the epoch
+    qint64 m_fileModified;
+
+    /// Size of the subscription file
+    qint64 m_fileSize;
+
+    /// Hash of the contents of the subscription file
+    QByteArray m_fileHash;
+};
+
+#endif // ADBLOCKFILTERCACHE_H
@@ -0,0 +1,423 @@
+#include "AdBlockFilterIndex.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+AdBlockFilterIndex::AdBlockFilterIndex() :
+    m_buckets(),
+    m_domainFilters(),
+    m_domainFilterPositions(),
+    m_fallbackFilters(),
+    m_numFilters(0)
+{
+}
+
+void AdBlockFilterIndex::build(const std::vector<AdBlockFilter*> &filters)
+{
+    clear();
+
+    // Tokens that appear in nearly every URL, and would make for very large buckets
+    static const std::array<quint32, 10> commonTokens = {
+        hashToken(QByteArrayLiteral("com")), hashToken(QByteArrayLiteral("http")), hashToken(QByteArrayLiteral("https")),
+        hashToken(QByteArrayLiteral("www")), hashToken(QByteArrayLiteral("net")),  hashToken(QByteArrayLiteral("org")),
+        hashToken(QByteArrayLiteral("js")),  hashToken(QByteArrayLiteral("html")), hashToken(QByteArrayLiteral("images")),
+        hashToken(QByteArrayLiteral("img"))
+    };
+
+    // Gather the candidate tokens of each filter and count the number of filters using each token
+    std::vector<std::vector<quint32>> filterTokens;
+    filterTokens.reserve(filters.size());
+
+    QHash<quint32, int> tokenCount;
+    for (AdBlockFilter *filter : filters)
+    {
+        filterTokens.push_back(getFilterTokens(filter));
+        for (quint32 token : filterTokens.back())
+            ++tokenCount[token];
+    }
+
+    // Place each filter in the bucket of its least frequently used token
+    for (std::size_t i = 0; i < filters.size(); ++i)
+    {
+        AdBlockFilter *filter = filters.at(i);
+        const int position = static_cast<int>(i);
+        const std::vector<quint32> &tokens = filterTokens.at(i);
+        if (tokens.empty())
+        {
+            // A filter with a domain option only matches requests made from one of the listed domains
+            if (!filter->m_domainBlacklist.isEmpty())
+            {
+                for (const QString &domain : filter->m_domainBlacklist)
+                    m_domainFilters.insert(domain, filter);
+                if (!m_domainFilterPositions.contains(filter))
+                    m_domainFilterPositions.insert(filter, position);
+            }
+            else
+                m_fallbackFilters.push_back(IndexedFilter { position, filter });
+            ++m_numFilters;
+            continue;
+        }
+
+        quint32 bestToken = tokens.at(0);
+        int bestScore = std::numeric_limits<int>::max();
+        for (quint32 token : tokens)
+        {
+            int score = tokenCount.value(token);
+            if (std::find(commonTokens.begin(), commonTokens.end(), token) != commonTokens.end())
+                score += 1000000;
+
+            if (score < bestScore)
+            {
+                bestScore = score;
+                bestToken = token;
+            }
+        }
+
+        m_buckets[bestToken].push_back(IndexedFilter { position, filter });
+        ++m_numFilters;
+    }
+}
+
+void AdBlockFilterIndex::clear()
+{
+    m_buckets.clear();
+    m_domainFilters.clear();
+    m_domainFilterPositions.clear();
+    m_fallbackFilters.clear();
+    m_numFilters = 0;
+}
+
+bool AdBlockFilterIndex::empty() const
+{
+    return m_numFilters == 0;
+}
+
+int AdBlockFilterIndex::size() const
+{
+    return m_numFilters;
+}
+
+AdBlockFilter *AdBlockFilterIndex::findMatch(const AdBlockRequestContext &context) const
+{
+    // The filters of each bucket are in list order, so a bucket is only searched up to its first match, or up to the
+    // position of the best match found in another bucket
+    AdBlockFilter *match = nullptr;
+    int matchPosition = std::numeric_limits<int>::max();
+
+    auto searchFilters = [&](const std::vector<IndexedFilter> &filters) {
+        for (const IndexedFilter &entry : filters)
+        {
+            if (entry.Position >= matchPosition)
+                return;
+
+            if (entry.Filter->isMatch(context))
+            {
+                match = entry.Filter;
+                matchPosition = entry.Position;
+                return;
+            }
+        }
+    };
+
+    for (quint32 token : context.Tokens)
+    {
+        auto it = m_buckets.find(token);
+        if (it != m_buckets.end())
+            searchFilters(*it);
+    }
+
+    m_domainFilters.findMatches(context.FirstPartyHost, [&](AdBlockFilter *filter) {
+        const int position = m_domainFilterPositions.value(filter);
+        if (position < matchPosition && filter->isMatch(context))
+        {
+            match = filter;
+            matchPosition = position;
+        }
+        return false;
+    });
+
+    searchFilters(m_fallbackFilters);
+    return match;
+}
+
+std::vector<quint32> AdBlockFilterIndex::tokenize(const QByteArray &url)
+{
+    std::vector<quint32> tokens;
+
+    const char *data = url.constData();
+    const int length = url.size();
+
+    int tokenStart = -1;
+    for (int i = 0; i <= length; ++i)
+    {
+        const bool isToken = (i < length) && isTokenChar(data[i]);
+        if (isToken && tokenStart < 0)
+            tokenStart = i;
+        else if (!isToken && tokenStart >= 0)
+        {
+            tokens.push_back(hashToken(data + tokenStart, i - tokenStart));
+            tokenStart = -1;
+        }
+    }
+
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+    return tokens;
+}
+
+quint32 AdBlockFilterIndex::hashToken(const char *data, int length)
+{
+    // FNV-1a hash of the lower case token
+    quint32 hash = 2166136261U;
+    for (int i = 0; i < length; ++i)
+    {
+        uchar c = static_cast<uchar>(data[i]);
+        if (c >= 'A' && c <= 'Z')
+            c += 32;
+        hash ^= c;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+quint32 AdBlockFilterIndex::hashToken(const QByteArray &token)
+{
+    return hashToken(token.constData(), token.size());
+}
+
+bool AdBlockFilterIndex::isTokenChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || c == '%';
+}
+
+std::vector<quint32> AdBlockFilterIndex::getFilterTokens(const AdBlockFilter *filter)
+{
+    std::vector<quint32> tokens;
+    QByteArray pattern = filter->hasEncodedEvalString() ? filter->m_evalBytes : filter->m_evalString.toUtf8();
+    if (filter->hasOption(AdBlockFilter::OptionMatchAll) || pattern.isEmpty())
+        return tokens;
+
+    bool leftAnchored = false, rightAnchored = false;
+
+    switch (filter->m_category)
+    {
+        case FilterCategory::Domain:
+        case FilterCategory::StringExactMatch:
+            leftAnchored = true;
+            rightAnchored = true;
+            break;
+        case FilterCategory::StringStartMatch:
+            leftAnchored = true;
+            break;
+        case FilterCategory::StringEndMatch:
+            rightAnchored = true;
+            break;
+        case FilterCategory::DomainStart:
+        case FilterCategory::StringContains:
+            // The start of a domain start filter may also match in the middle of a host name
+            // when the filter contains the second-level domain of the request
+            break;
+        case FilterCategory::RegExp:
+        {
+            if (filter->hasOption(AdBlockFilter::OptionRegExpLiteral))
+            {
+                getRegExpTokens(pattern, tokens);
+                break;
+            }
+
+            // Anchors are handled the same way as in AdBlockFilterParser::parseRegExp
+            if (pattern.startsWith("||"))
+            {
+                pattern = pattern.mid(2);
+                leftAnchored = true;
+            }
+            else if (pattern.startsWith('|'))
+            {
+                pattern = pattern.mid(1);
+                leftAnchored = true;
+            }
+            if (pattern.endsWith('|'))
+            {
+                pattern.chop(1);
+                rightAnchored = true;
+            }
+
+            // The parser ignores any other '|' characters, so characters on either side of those are adjacent
+            QByteArray normalized;
+            normalized.reserve(pattern.size());
+            for (const char c : pattern)
+            {
+                if (c != '|')
+                    normalized.append(c);
+            }
+
+            getPatternTokens(normalized, leftAnchored, rightAnchored, tokens);
+            break;
+        }
+        default:
+            return tokens;
+    }
+
+    if (filter->m_category != FilterCategory::RegExp)
+        getPatternTokens(pattern, leftAnchored, rightAnchored, tokens);
+
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+    return tokens;
+}
+
+void AdBlockFilterIndex::getPatternTokens(const QByteArray &pattern, bool leftAnchored, bool rightAnchored, std::vector<quint32> &tokens)
+{
+    // A token is only usable if both of its boundaries are guaranteed to separate it from other
+    // token characters in a matching URL. Wildcards may expand to anything, and non-ASCII
+    // characters never appear verbatim in an encoded URL
+    auto isBoundary = [](char c) {
+        return c != '*' && static_cast<uchar>(c) < 128;
+    };
+
+    const char *data = pattern.constData();
+    const int length = pattern.size();
+
+    int tokenStart = -1;
+    for (int i = 0; i <= length; ++i)
+    {
+        const bool isToken = (i < length) && isTokenChar(data[i]);
+        if (isToken && tokenStart < 0)
+            tokenStart = i;
+        else if (!isToken && tokenStart >= 0)
+        {
+            const bool leftOk = (tokenStart == 0) ? leftAnchored : isBoundary(data[tokenStart - 1]);
+            const bool rightOk = (i == length) ? rightAnchored : isBoundary(data[i]);
+            if (leftOk && rightOk)
+                tokens.push_back(hashToken(data + tokenStart, i - tokenStart));
+            tokenStart = -1;
+        }
+    }
+}
+
+void AdBlockFilterIndex::getRegExpTokens(const QByteArray &pattern, std::vector<quint32> &tokens)
+{
+    // Only simple expressions are handled. Any alternation could make every literal optional
+    for (int i = 0; i < pattern.size(); ++i)
+    {
+        if (pattern.at(i) == '\\')
+            ++i;
+        else if (pattern.at(i) == '|')
+            return;
+    }
+
+    const int length = pattern.size();
+    int depth = 0, tokenStart = -1;
+    bool leftOk = false;
+    QByteArray token;
+
+    // Returns true if the element ending at the given index is made optional or repeated by a quantifier
+    auto isQuantified = [&](int index) {
+        if (index + 1 >= length)
+            return false;
+        const char next = pattern.at(index + 1);
+        return next == '?' || next == '*' || next == '+' || next == '{';
+    };
+
+    // Ends the token being read, keeping it if the element following it is a safe boundary
+    auto endToken = [&](bool rightOk) {
+        if (tokenStart >= 0 && leftOk && rightOk && !token.isEmpty())
+            tokens.push_back(hashToken(token));
+        token.clear();
+        tokenStart = -1;
+    };
+
+    for (int i = 0; i < length; ++i)
+    {
+        const char c = pattern.at(i);
+        const uchar u = static_cast<uchar>(c);
+
+        // Skip over groups and character classes, as they may be optional or match anything
+        if (u == '(' || u == '[')
+        {
+            endToken(false);
+            ++depth;
+            leftOk = false;
+            continue;
+        }
+        if (u == ')' || u == ']')
+        {
+            if (depth > 0)
+                --depth;
+            leftOk = false;
+            continue;
+        }
+        if (depth > 0)
+        {
+            if (u == '\\')
+                ++i;
+            continue;
+        }
+
+        if (u == '\\')
+        {
+            if (i + 1 >= length)
+            {
+                endToken(false);
+                break;
+            }
+
+            const char escaped = pattern.at(++i);
+            if (escaped == '%')
+            {
+                if (tokenStart < 0)
+                    tokenStart = i;
+                token.append(escaped);
+            }
+            else if (static_cast<uchar>(escaped) < 128 && !isTokenChar(escaped))
+            {
+                // Escaped literal such as \. or \/
+                endToken(!isQuantified(i));
+                leftOk = true;
+            }
+            else
+            {
+                // Character class such as \d, \w or \b
+                endToken(false);
+                leftOk = false;
+            }
+            continue;
+        }
+
+        if (u == '?' || u == '*' || u == '+' || u == '{')
+        {
+            // The last character of the current token is optional or repeated
+            token.clear();
+            tokenStart = -1;
+            leftOk = false;
+            continue;
+        }
+
+        if (isTokenChar(c))
+        {
+            if (tokenStart < 0)
+                tokenStart = i;
+            token.append(c);
+            continue;
+        }
+
+        if (u == '^' && i == 0)
+        {
+            leftOk = true;
+            continue;
+        }
+        if (u == '$' && i + 1 == length)
+        {
+            endToken(true);
+            continue;
+        }
+
+        // Any other special or non-ASCII character is an unsafe boundary
+        const bool isLiteral = u < 128 && u != '.' && u != '^' && u != '$' && u != '}';
+        endToken(isLiteral && !isQuantified(i));
+        leftOk = isLiteral;
+    }
+
+    endToken(false);
+}
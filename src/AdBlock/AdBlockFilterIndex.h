@@ -0,0 +1,104 @@
+#ifndef ADBLOCKFILTERINDEX_H
+#define ADBLOCKFILTERINDEX_H
+
+#include "AdBlockDomainTrie.h"
+#include "AdBlockFilter.h"
+#include "AdBlockRequestContext.h"
+
+#include <vector>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+/**
+ * @class AdBlockFilterIndex
+ * @ingroup AdBlock
+ * @brief Groups network filters into buckets keyed by the least common token
+ *        that must appear in any URL the filter can match. A request is
+ *        tokenized once, and only the filters stored under one of its tokens
+ *        are evaluated. Filters without a usable token that are restricted to
+ *        certain first party domains are stored under those domains, and the
+ *        remaining filters are evaluated for every request.
+ *
+ * Each filter keeps its position in the list the index was built from. When
+ * several filters match a request, the one found first in that list is
+ * returned, no matter which bucket it was stored in.
+ */
+class AdBlockFilterIndex
+{
+public:
+    /// Constructs an empty filter index
+    AdBlockFilterIndex();
+
+    /// Replaces the contents of the index with the given filters, bucketing each under its rarest token.
+    /// The order of the filters decides which of them is returned when more than one matches a request
+    void build(const std::vector<AdBlockFilter*> &filters);
+
+    /// Removes all filters from the index
+    void clear();
+
+    /// Returns true if the index does not contain any filters, false if else
+    bool empty() const;
+
+    /// Returns the number of filters stored in the index
+    int size() const;
+
+    /**
+     * @brief Searches the index for a filter that matches the network request
+     * @param context Properties of the network request, including its tokens
+     * @return The matching filter that comes first in the list the index was built from, or a nullptr if no filters match
+     */
+    AdBlockFilter *findMatch(const AdBlockRequestContext &context) const;
+
+    /// Splits the given (lower case) URL into its alphanumeric tokens, returning the sorted and unique hashes of each token
+    static std::vector<quint32> tokenize(const QByteArray &url);
+
+private:
+    /// A filter and its position in the list the index was built from
+    struct IndexedFilter
+    {
+        /// Position of the filter in the list
+        int Position;
+
+        /// The filter
+        AdBlockFilter *Filter;
+    };
+
+    /// Returns the hash of the given token, ignoring letter case
+    static quint32 hashToken(const char *data, int length);
+
+    /// Returns the hash of the given token, ignoring letter case
+    static quint32 hashToken(const QByteArray &token);
+
+    /// Returns true if the given character can be part of a token (ASCII alphanumeric or '%'), false if else
+    static bool isTokenChar(char c);
+
+    /// Returns the hashes of the tokens that must be present in a URL for the given filter to match it.
+    /// Returns an empty container if no such tokens can be determined
+    static std::vector<quint32> getFilterTokens(const AdBlockFilter *filter);
+
+    /// Extracts the tokens of an AdBlock Plus -formatted pattern. The anchor arguments indicate whether or not the
+    /// start and end of the pattern are guaranteed to be at token boundaries in a matching URL
+    static void getPatternTokens(const QByteArray &pattern, bool leftAnchored, bool rightAnchored, std::vector<quint32> &tokens);
+
+    /// Extracts the literal tokens that every match of a regular expression must contain
+    static void getRegExpTokens(const QByteArray &pattern, std::vector<quint32> &tokens);
+
+private:
+    /// Buckets of filters, keyed by the hash of the token they were indexed under, each in list order
+    QHash<quint32, std::vector<IndexedFilter>> m_buckets;
+
+    /// Filters without any usable token that only apply to the first party domains they are stored under
+    AdBlockDomainTrie m_domainFilters;
+
+    /// Positions of the filters stored in \ref m_domainFilters, which the trie does not keep
+    QHash<const AdBlockFilter*, int> m_domainFilterPositions;
+
+    /// Filters without any usable token or domain restriction, which are checked against every request, in list order
+    std::vector<IndexedFilter> m_fallbackFilters;
+
+    /// Number of filters in the index
+    int m_numFilters;
+};
+
+#endif // ADBLOCKFILTERINDEX_H
@@ -1,5 +1,4 @@
 #include "AdBlockFilterParser.h"
-#include "AdBlockManager.h"
 #include "Bitfield.h"
 
 #include <algorithm>
@@ -21,6 +20,12 @@ QHash<QString, ElementType> eOptionMap = {
     { QStringLiteral("other"), ElementType::Other }
 };
 
+AdBlockFilterParser::AdBlockFilterParser(const QHash<QString, QString> *resources) :
+    m_resources(resources),
+    m_domainLists()
+{
+}
+
 std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) const
 {
     auto filter = std::make_unique<AdBlockFilter>(rule);
@@ -38,7 +43,7 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
     // Check if the rule is an exception
     if (rule.startsWith(QStringLiteral("@@")))
     {
-        filterPtr->m_exception = true;
+        filterPtr->setOption(AdBlockFilter::OptionException);
         rule = rule.mid(2);
     }
 
@@ -52,19 +57,23 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
 
     // Check if rule is a 'Match all' type
     if (rule.size() == 1 && rule.at(0) == QChar('*'))
-        filterPtr->m_matchAll = true;
+        filterPtr->setOption(AdBlockFilter::OptionMatchAll);
 
     // Check if rule is a regular expression
     if (rule.startsWith('/') && rule.endsWith('/'))
     {
         filterPtr->m_category = FilterCategory::RegExp;
+        filterPtr->setOption(AdBlockFilter::OptionRegExpLiteral);
 
         rule = rule.mid(1);
         rule = rule.left(rule.size() - 1);
+        filterPtr->m_evalString = rule;
 
         QRegularExpression::PatternOptions options =
-                (filterPtr->m_matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+                (filterPtr->hasOption(AdBlockFilter::OptionMatchCase) ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
         filterPtr->m_regExp = std::make_unique<QRegularExpression>(rule, options);
+        filterPtr->m_compiledPattern = AdBlockCompiledPattern::compileRegExp(rule, filterPtr->hasOption(AdBlockFilter::OptionMatchCase));
+        filterPtr->encodeEvalString();
         return filter;
     }
 
@@ -82,6 +91,7 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
         rule = rule.mid(2);
         filterPtr->m_evalString = rule.left(rule.size() - 1);
         filterPtr->m_category = FilterCategory::Domain;
+        filterPtr->encodeEvalString();
         return filter;
     }
 
@@ -94,8 +104,9 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
         filterPtr->m_category = FilterCategory::DomainStart;
         filterPtr->m_evalString = rule.mid(2);
 
-        if (!filterPtr->m_matchCase)
+        if (!filterPtr->hasOption(AdBlockFilter::OptionMatchCase))
             filterPtr->m_evalString = filterPtr->m_evalString.toLower();
+        filterPtr->encodeEvalString();
         return filter;
     }
 
@@ -117,13 +128,20 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
         rule = rule.left(rule.size() - 1);
     }
 
-    // Ad block format -> regular expression conversion
+    // Wildcard and separator patterns are matched by their literal segments. Only patterns that
+    // cannot be compiled are converted from the ad block format to a regular expression
     if (maybeRegExp || rule.contains(QChar('|')))
     {
-        QRegularExpression::PatternOptions options =
-                (filterPtr->m_matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
-        filterPtr->m_regExp = std::make_unique<QRegularExpression>(parseRegExp(rule), options);
+        filterPtr->m_compiledPattern = AdBlockCompiledPattern::compileWildcard(rule, filterPtr->hasOption(AdBlockFilter::OptionMatchCase));
+        if (!filterPtr->m_compiledPattern.isCompiled())
+        {
+            QRegularExpression::PatternOptions options =
+                    (filterPtr->hasOption(AdBlockFilter::OptionMatchCase) ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+            filterPtr->m_regExp = std::make_unique<QRegularExpression>(parseRegExp(rule), options);
+        }
         filterPtr->m_category = FilterCategory::RegExp;
+        filterPtr->m_evalString = rule;
+        filterPtr->encodeEvalString();
         return filter;
     }
 
@@ -131,9 +149,9 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
     filterPtr->setEvalString(rule);
 
     if (filterPtr->m_evalString.isEmpty())
-        filterPtr->m_matchAll = true;
+        filterPtr->setOption(AdBlockFilter::OptionMatchAll);
 
-    if (!filterPtr->m_matchCase)
+    if (!filterPtr->hasOption(AdBlockFilter::OptionMatchCase))
         filterPtr->m_evalString = filterPtr->m_evalString.toLower();
 
     // Check for blob: and data: filters
@@ -141,12 +159,11 @@ std::unique_ptr<AdBlockFilter> AdBlockFilterParser::makeFilter(QString rule) con
 
     // If no category set by now, it is a string contains type
     if (filterPtr->getCategory() == FilterCategory::None)
-    {
         filterPtr->m_category = FilterCategory::StringContains;
 
-        // Pre-calculate hash of evaluation string for Rabin-Karp string matching
-        filterPtr->hashEvalString();
-    }
+    // Filters of the remaining categories are matched against the bytes of the request URL or host
+    if (filterPtr->hasEncodedEvalString())
+        filterPtr->encodeEvalString();
 
     return filter;
 }
@@ -203,7 +220,7 @@ bool AdBlockFilterParser::isStylesheetRule(const QString &rule, AdBlockFilter *f
     if ((pos = rule.indexOf(QStringLiteral("#@#"))) >= 0)
     {
         filter->m_category = FilterCategory::Stylesheet;
-        filter->m_exception = true;
+        filter->setOption(AdBlockFilter::OptionException);
 
         // Fill domain whitelist
         if (pos > 0)
@@ -379,8 +396,8 @@ bool AdBlockFilterParser::parseScriptInjection(AdBlockFilter *filter) const
     QStringList injectionArgs = injectionStr.split(QChar(','), QString::SkipEmptyParts);
     const QString &resourceName = injectionArgs.at(0);
 
-    // Fetch resource from AdBlockManager and set value as m_evalString
-    filter->m_evalString = AdBlockManager::instance().getResource(resourceName);
+    // Set the script of the resource as m_evalString
+    filter->m_evalString = m_resources != nullptr ? m_resources->value(resourceName) : QString();
     if (injectionArgs.size() < 2)
         return true;
 
@@ -524,6 +541,7 @@ void AdBlockFilterParser::parseDomains(const QString &domainString, QChar delimi
 	if (domainList.isEmpty())
 		domainList.append(domainString);
 
+    QVector<QString> blacklist, whitelist;
     for (QString &domain : domainList)
     {
         // Check if domain is an entity filter type
@@ -531,10 +549,12 @@ void AdBlockFilterParser::parseDomains(const QString &domainString, QChar delimi
             domain = domain.left(domain.size() - 1);
 
         if (domain.at(0) == QChar('~'))
-            filter->addDomainToWhitelist(domain.mid(1));
+            whitelist.push_back(domain.mid(1));
         else
-            filter->addDomainToBlacklist(domain);
+            blacklist.push_back(domain);
     }
+
+    filter->setDomains(m_domainLists.intern(std::move(blacklist)), m_domainLists.intern(std::move(whitelist)));
 }
 
 void AdBlockFilterParser::parseOptions(const QString &optionString, AdBlockFilter *filter) const
@@ -550,15 +570,15 @@ void AdBlockFilterParser::parseOptions(const QString &optionString, AdBlockFilte
         {
             ElementType elemType = it.value();
             if (elemType == ElementType::MatchCase)
-                filter->m_matchCase = true;
+                filter->setOption(AdBlockFilter::OptionMatchCase);
 
             if (optionException)
                 filter->m_allowedTypes |= elemType;
             else
             {
                 // Don't allow exception filters to whitelist entire pages / disable ad block (uBlock origin setting)
-                if (filter->m_exception && elemType == ElementType::Document)
-                    filter->m_disabled = true;
+                if (filter->isException() && elemType == ElementType::Document)
+                    filter->setOption(AdBlockFilter::OptionDisabled);
 
                 filter->m_blockedTypes |= elemType;
             }
@@ -575,16 +595,15 @@ void AdBlockFilterParser::parseOptions(const QString &optionString, AdBlockFilte
         // Handle options specific to uBlock Origin
         else if (option.startsWith(QStringLiteral("redirect=")))
         {
-            filter->m_redirect = true;
-            filter->m_redirectName = option.mid(9);
+            filter->setRedirectName(option.mid(9));
         }
         else if (option.compare(QStringLiteral("first-party")) == 0)
         {
             filter->m_allowedTypes |= ElementType::ThirdParty;
         }
-        else if (!filter->m_exception && (option.compare(QStringLiteral("important")) == 0))
+        else if (!filter->isException() && (option.compare(QStringLiteral("important")) == 0))
         {
-            filter->m_important = true;
+            filter->setOption(AdBlockFilter::OptionImportant);
         }
     }
 
@@ -592,10 +611,8 @@ void AdBlockFilterParser::parseOptions(const QString &optionString, AdBlockFilte
     // (so the hash can be made and compared to other filters for removal)
     if (filter->hasElementType(filter->m_blockedTypes, ElementType::BadFilter))
     {
-        if (filter->m_ruleString.endsWith(QStringLiteral(",badfilter")))
-            filter->m_ruleString = filter->m_ruleString.left(filter->m_ruleString.indexOf(QStringLiteral(",badfilter")));
-        else if (filter->m_ruleString.endsWith(QStringLiteral("$badfilter")))
-            filter->m_ruleString = filter->m_ruleString.left(filter->m_ruleString.indexOf(QStringLiteral("$badfilter")));
+        if (filter->m_ruleString.endsWith(",badfilter") || filter->m_ruleString.endsWith("$badfilter"))
+            filter->m_ruleString.chop(10);
     }
 }
 
@@ -611,11 +628,14 @@ QString AdBlockFilterParser::parseRegExp(const QString &regExpString) const
     for (int i = 0; i < strSize; ++i)
     {
         c = regExpString.at(i);
+        if (c != QChar('*'))
+            usedStar = false;
 
         switch (c.toLatin1())
         {
             case '*':
             {
+                // Consecutive wildcards are collapsed into one
                 if (!usedStar)
                 {
                     replacement.append(QStringLiteral("[^ ]*?"));
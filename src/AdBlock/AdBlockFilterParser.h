@@ -1,9 +1,12 @@
 #ifndef ADBLOCKFILTERPARSER_H
 #define ADBLOCKFILTERPARSER_H
 
+#include "AdBlockDomainListPool.h"
 #include "AdBlockFilter.h"
 
 #include <memory>
+#include <vector>
+#include <QHash>
 #include <QString>
 
 /// Mapping of option name strings to their corresponding \ref ElementType
@@ -40,8 +43,12 @@ struct CosmeticJSCallback
 class AdBlockFilterParser
 {
 public:
-    /// Default constructor
-    AdBlockFilterParser() = default;
+    /**
+     * @brief Constructs the parser
+     * @param resources Scripts that script injection filters refer to, keyed by their name. If null, or if a filter
+     *        refers to a script that is not given, the filter is left without a script
+     */
+    explicit AdBlockFilterParser(const QHash<QString, QString> *resources = nullptr);
 
     /// Instantiates and returns an AdBlockFilter given a filter string
     std::unique_ptr<AdBlockFilter> makeFilter(QString rule) const;
@@ -82,6 +89,13 @@ private:
 
     /// Parses the given AdBlock Plus -formatted regular expression, returning the equivalent string used for a QRegularExpression
     QString parseRegExp(const QString &regExpString) const;
+
+private:
+    /// Scripts available to script injection filters, or a nullptr if there are none
+    const QHash<QString, QString> *m_resources;
+
+    /// Domain lists of the filters made by this parser, shared between filters with the same domains
+    mutable AdBlockDomainListPool m_domainLists;
 };
 
 #endif // ADBLOCKFILTERPARSER_H
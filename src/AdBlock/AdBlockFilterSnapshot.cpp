@@ -0,0 +1,110 @@
+#include "AdBlockFilterSnapshot.h"
+
+std::atomic<quint64> AdBlockFilterSnapshot::s_lastGeneration(0);
+
+AdBlockFilterSnapshot::AdBlockFilterSnapshot() :
+    m_generation(++s_lastGeneration),
+    m_filterLists(),
+    m_importantBlockFilters(),
+    m_blockFilters(),
+    m_blockFiltersByPattern(),
+    m_blockFiltersByDomain(),
+    m_allowFilters(),
+    m_allowFiltersByDomain()
+{
+}
+
+AdBlockFilterSnapshot::AdBlockFilterSnapshot(const AdBlockFilterSlice &filters, std::vector<std::shared_ptr<const AdBlockFilterList>> filterLists) :
+    m_generation(++s_lastGeneration),
+    m_filterLists(std::move(filterLists)),
+    m_importantBlockFilters(),
+    m_blockFilters(),
+    m_blockFiltersByPattern(),
+    m_blockFiltersByDomain(),
+    m_allowFilters(),
+    m_allowFiltersByDomain()
+{
+    m_importantBlockFilters.build(filters.ImportantBlockFilters);
+    m_blockFilters.build(filters.BlockFilters);
+    m_blockFiltersByPattern.build(filters.BlockFiltersByPattern);
+    m_allowFilters.build(filters.AllowFilters);
+
+    for (AdBlockFilter *filter : filters.BlockFiltersByDomain)
+        m_blockFiltersByDomain.insert(filter->getEvalString(), filter);
+    for (AdBlockFilter *filter : filters.AllowFiltersByDomain)
+        m_allowFiltersByDomain.insert(filter->getEvalString(), filter);
+}
+
+bool AdBlockFilterSnapshot::empty() const
+{
+    return m_importantBlockFilters.empty() && m_blockFilters.empty() && m_blockFiltersByPattern.empty()
+            && m_blockFiltersByDomain.empty() && m_allowFilters.empty() && m_allowFiltersByDomain.empty();
+}
+
+quint64 AdBlockFilterSnapshot::getGeneration() const
+{
+    return m_generation;
+}
+
+AdBlockFilter *AdBlockFilterSnapshot::findImportantBlockFilter(const AdBlockRequestContext &context) const
+{
+    return m_importantBlockFilters.findMatch(context);
+}
+
+AdBlockFilter *AdBlockFilterSnapshot::findBlockFilter(const AdBlockRequestContext &context) const
+{
+    // Domain filters are stored under the domain they block, so any filter found on the path of the request host matches it
+    if (AdBlockFilter *filter = findDomainFilter(m_blockFiltersByDomain, context))
+        return filter;
+
+    if (AdBlockFilter *filter = m_blockFilters.findMatch(context))
+        return filter;
+
+    return m_blockFiltersByPattern.findMatch(context);
+}
+
+AdBlockFilter *AdBlockFilterSnapshot::findAllowFilter(const AdBlockRequestContext &context) const
+{
+    if (AdBlockFilter *filter = findDomainFilter(m_allowFiltersByDomain, context))
+        return filter;
+
+    return m_allowFilters.findMatch(context);
+}
+
+AdBlockDecisionCache::Decision AdBlockFilterSnapshot::evaluate(const AdBlockRequestContext &context) const
+{
+    auto makeDecision = [](AdBlockFilter *filter) {
+        AdBlockFilterAction action = AdBlockFilterAction::Block;
+        if (filter->isException())
+            action = AdBlockFilterAction::Allow;
+        else if (filter->isRedirect())
+            action = AdBlockFilterAction::Redirect;
+        return AdBlockDecisionCache::Decision { true, action, filter };
+    };
+
+    if (AdBlockFilter *filter = findImportantBlockFilter(context))
+        return makeDecision(filter);
+
+    // Look for a matching blocking filter before iterating through the allowed filter list, to avoid wasted resources
+    AdBlockFilter *matchingBlockFilter = findBlockFilter(context);
+    if (matchingBlockFilter == nullptr)
+        return AdBlockDecisionCache::Decision { false, AdBlockFilterAction::Allow, nullptr };
+
+    // Exception filters are only checked once a blocking filter has matched
+    if (AdBlockFilter *matchingAllowFilter = findAllowFilter(context))
+        return makeDecision(matchingAllowFilter);
+
+    return makeDecision(matchingBlockFilter);
+}
+
+AdBlockFilter *AdBlockFilterSnapshot::findDomainFilter(const AdBlockDomainTrie &trie, const AdBlockRequestContext &context)
+{
+    AdBlockFilter *matchingFilter = nullptr;
+    trie.findMatches(context.RequestHost, [&](AdBlockFilter *filter) {
+        if (!filter->isOptionMatch(context))
+            return false;
+        matchingFilter = filter;
+        return true;
+    });
+    return matchingFilter;
+}
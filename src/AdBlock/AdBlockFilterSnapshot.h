@@ -0,0 +1,102 @@
+#ifndef ADBLOCKFILTERSNAPSHOT_H
+#define ADBLOCKFILTERSNAPSHOT_H
+
+#include "AdBlockDecisionCache.h"
+#include "AdBlockDomainTrie.h"
+#include "AdBlockFilter.h"
+#include "AdBlockFilterIndex.h"
+#include "AdBlockPatternMatcher.h"
+#include "AdBlockRequestContext.h"
+#include "AdBlockSubscription.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @class AdBlockFilterSnapshot
+ * @ingroup AdBlock
+ * @brief An immutable set of the network filters of every enabled subscription, sorted into the
+ *        structures that are searched for each request.
+ *
+ * The \ref AdBlockManager builds a new snapshot on the global thread pool whenever its filters
+ * change, and replaces the current one through an \ref AdBlockSnapshotPublisher. The request
+ * interceptor pins the current snapshot without blocking, and may keep using it after it has been
+ * replaced. A snapshot shares the ownership of the filter lists that its filters belong to, since
+ * the subscriptions may release them while it is built or read, and is never modified once built.
+ * Every snapshot is given a generation number greater than that of the snapshots built before it,
+ * which tells caches of request decisions when their contents are out of date.
+ */
+class AdBlockFilterSnapshot
+{
+public:
+    /// Constructs an empty snapshot, which does not match any request
+    AdBlockFilterSnapshot();
+
+    /**
+     * @brief Builds a snapshot of the given network filters
+     * @param filters Network filters, sorted as they are in the slice of a subscription. Only the
+     *        important block, block, allow and domain containers are used
+     * @param filterLists The lists that own the filters, kept alive for the lifetime of the snapshot
+     */
+    AdBlockFilterSnapshot(const AdBlockFilterSlice &filters, std::vector<std::shared_ptr<const AdBlockFilterList>> filterLists);
+
+    /// Copy constructor (forbid)
+    AdBlockFilterSnapshot(const AdBlockFilterSnapshot &other) = delete;
+
+    /// Copy assignment operator (forbid)
+    AdBlockFilterSnapshot &operator =(const AdBlockFilterSnapshot &other) = delete;
+
+    /// Returns true if the snapshot does not contain any network filters, false if else
+    bool empty() const;
+
+    /// Returns the generation of the snapshot, which is greater than that of every snapshot built before it
+    quint64 getGeneration() const;
+
+    /// Returns the first blocking filter with the important option that matches the request, or a nullptr if there is none
+    AdBlockFilter *findImportantBlockFilter(const AdBlockRequestContext &context) const;
+
+    /// Returns the first blocking filter that matches the request, or a nullptr if there is none
+    AdBlockFilter *findBlockFilter(const AdBlockRequestContext &context) const;
+
+    /// Returns the first exception filter that matches the request, or a nullptr if there is none
+    AdBlockFilter *findAllowFilter(const AdBlockRequestContext &context) const;
+
+    /// Matches the request against the filters of the snapshot, returning the filter that decides what happens to it.
+    /// Important blocking filters are checked first, and exception filters only once a blocking filter has matched
+    AdBlockDecisionCache::Decision evaluate(const AdBlockRequestContext &context) const;
+
+private:
+    /// Returns the first filter stored on the path of the request host whose options match the request
+    static AdBlockFilter *findDomainFilter(const AdBlockDomainTrie &trie, const AdBlockRequestContext &context);
+
+private:
+    /// Generation of the snapshot
+    quint64 m_generation;
+
+    /// Lists that own the filters of the snapshot
+    std::vector<std::shared_ptr<const AdBlockFilterList>> m_filterLists;
+
+    /// Index of important blocking filters that are checked before allow filters on network requests
+    AdBlockFilterIndex m_importantBlockFilters;
+
+    /// Index of filters that block content
+    AdBlockFilterIndex m_blockFilters;
+
+    /// Matcher of filters that block content based on a partial string match (needle in haystack)
+    AdBlockPatternMatcher m_blockFiltersByPattern;
+
+    /// Trie of filters that are of the Domain category (||some.domain.com^ style filter rules), keyed by the domain they block
+    AdBlockDomainTrie m_blockFiltersByDomain;
+
+    /// Index of filters that whitelist content
+    AdBlockFilterIndex m_allowFilters;
+
+    /// Trie of exception filters that are of the Domain category (@@||some.domain.com^), keyed by the domain they allow
+    AdBlockDomainTrie m_allowFiltersByDomain;
+
+    /// Generation of the most recently built snapshot
+    static std::atomic<quint64> s_lastGeneration;
+};
+
+#endif // ADBLOCKFILTERSNAPSHOT_H
@@ -1,69 +1,176 @@
 #include "AdBlockLog.h"
 
-#include <algorithm>
+#include <QHash>
+
+constexpr quint64 AdBlockLog::RecordCapacity;
+constexpr quint64 AdBlockLog::StringCapacity;
+constexpr quint64 AdBlockLog::InternTableSize;
+constexpr int AdBlockLog::MaxStringLength;
 
 AdBlockLog::AdBlockLog(QObject *parent) :
     QObject(parent),
-    m_entries(),
-    m_timer()
+    m_records(new Record[RecordCapacity]()),
+    m_recordHead(0),
+    m_strings(new std::atomic<ushort>[StringCapacity]()),
+    m_stringHead(0),
+    m_internTable(new std::atomic<quint64>[InternTableSize]()),
+    m_clock(),
+    m_startTime(QDateTime::currentDateTime())
 {
-    connect(&m_timer, &QTimer::timeout, this, &AdBlockLog::pruneLogs);
-
-    // Prune logs every 30 minutes
-    m_timer.start(1000 * 60 * 30);
+    m_clock.start();
 }
 
 void AdBlockLog::addEntry(AdBlockFilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
-              ElementType resourceType, const QString &rule, const QDateTime &timestamp)
+              ElementType resourceType, const QString &rule)
 {
-    auto it = m_entries.find(firstPartyUrl);
-    if (it != m_entries.end())
-        it->push_back({ action, firstPartyUrl, requestUrl, resourceType, rule, timestamp });
-    else
-        m_entries[firstPartyUrl] = { { action, firstPartyUrl, requestUrl, resourceType, rule, timestamp } };
+    const quint64 firstPartyRef = internString(firstPartyUrl.toString(QUrl::FullyEncoded));
+    const quint64 requestRef = internString(requestUrl.toString(QUrl::FullyEncoded));
+    const quint64 ruleRef = internString(rule);
+
+    // Claim the next record, overwriting the oldest one if the log is full
+    const quint64 position = m_recordHead.fetch_add(1, std::memory_order_relaxed);
+    Record &record = m_records[position & (RecordCapacity - 1)];
+
+    record.Sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record.Time.store(m_clock.elapsed(), std::memory_order_relaxed);
+    record.ResourceType.store(static_cast<quint64>(resourceType), std::memory_order_relaxed);
+    record.FirstPartyUrl.store(firstPartyRef, std::memory_order_relaxed);
+    record.RequestUrl.store(requestRef, std::memory_order_relaxed);
+    record.Rule.store(ruleRef, std::memory_order_relaxed);
+    record.Action.store(static_cast<quint8>(action), std::memory_order_relaxed);
+
+    record.Sequence.store(position + 1, std::memory_order_release);
 }
 
 std::vector<AdBlockLogEntry> AdBlockLog::getAllEntries() const
 {
-    // Combine all entries
+    quint64 cursor = 0;
+    return getEntriesSince(cursor);
+}
+
+std::vector<AdBlockLogEntry> AdBlockLog::getEntriesFor(const QUrl &firstPartyUrl) const
+{
+    quint64 cursor = 0;
+    return getEntriesSince(cursor, firstPartyUrl);
+}
+
+std::vector<AdBlockLogEntry> AdBlockLog::getEntriesSince(quint64 &cursor, const QUrl &firstPartyUrl) const
+{
     std::vector<AdBlockLogEntry> entries;
-    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+
+    const quint64 head = m_recordHead.load(std::memory_order_acquire);
+    quint64 position = cursor;
+    if (head > RecordCapacity && position < head - RecordCapacity)
+        position = head - RecordCapacity;
+
+    // Stored URLs may have been truncated, so the given URL is compared in the same form
+    const QString firstPartyString = toStoredString(firstPartyUrl.toString(QUrl::FullyEncoded));
+    const QString *firstPartyFilter = firstPartyUrl.isEmpty() ? nullptr : &firstPartyString;
+    for (; position < head; ++position)
     {
-        for (const AdBlockLogEntry &logEntry : *it)
-            entries.push_back(logEntry);
+        AdBlockLogEntry entry;
+        if (readRecord(position, entry, firstPartyFilter))
+            entries.push_back(std::move(entry));
     }
 
-    // Sort entries from newest to oldest
-    std::sort(entries.begin(), entries.end(), [](const AdBlockLogEntry &a, const AdBlockLogEntry &b){
-        return a.Timestamp < b.Timestamp;
-    });
-
+    cursor = head;
     return entries;
 }
 
-const std::vector<AdBlockLogEntry> &AdBlockLog::getEntriesFor(const QUrl &firstPartyUrl)
+quint64 AdBlockLog::capacity()
 {
-    auto it = m_entries.find(firstPartyUrl);
-    if (it != m_entries.end())
-        return *it;
+    return RecordCapacity;
+}
 
-    std::vector<AdBlockLogEntry> entriesForUrl;
-    it = m_entries.insert(firstPartyUrl, entriesForUrl);
-    return *it;
+QString AdBlockLog::toStoredString(const QString &str)
+{
+    return str.left(MaxStringLength);
 }
 
-void AdBlockLog::pruneLogs()
+quint64 AdBlockLog::internString(const QString &str)
 {
-    const quint64 pruneThreshold = 1000 * 60 * 30;
-    const QDateTime now = QDateTime::currentDateTime();
-    auto removeCheck = [&](const AdBlockLogEntry &logEntry) {
-        return logEntry.Timestamp.msecsTo(now) >= pruneThreshold;
-    };
+    const QString value = toStoredString(str);
+    const int length = value.size();
 
-    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    // Reuse the copy of a recent string, as long as it is far enough from being overwritten that
+    // the records referencing it are likely to be overwritten first
+    std::atomic<quint64> &slot = m_internTable[qHash(value) & (InternTableSize - 1)];
+    const quint64 cachedRef = slot.load(std::memory_order_acquire);
+    if (cachedRef != 0
+            && m_stringHead.load(std::memory_order_relaxed) - (cachedRef >> 16) < StringCapacity / 2
+            && isStringAt(cachedRef, value))
     {
-        std::vector<AdBlockLogEntry> &entries = *it;
-        auto newEnd = std::remove_if(entries.begin(), entries.end(), removeCheck);
-        entries.erase(newEnd, entries.end());
+        return cachedRef;
     }
+
+    const quint64 position = m_stringHead.fetch_add(static_cast<quint64>(length), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const ushort *data = value.utf16();
+    for (int i = 0; i < length; ++i)
+        m_strings[(position + i) & (StringCapacity - 1)].store(data[i], std::memory_order_relaxed);
+
+    const quint64 ref = (position << 16) | static_cast<quint64>(length);
+    slot.store(ref, std::memory_order_release);
+    return ref;
+}
+
+bool AdBlockLog::readString(quint64 ref, QString &result) const
+{
+    const quint64 position = ref >> 16;
+    const int length = static_cast<int>(ref & 0xFFFF);
+
+    result.resize(length);
+    QChar *data = result.data();
+    for (int i = 0; i < length; ++i)
+        data[i] = QChar(m_strings[(position + i) & (StringCapacity - 1)].load(std::memory_order_relaxed));
+
+    // The copy is only valid if no writer has claimed the characters since they were written
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_stringHead.load(std::memory_order_relaxed) - position <= StringCapacity;
+}
+
+bool AdBlockLog::isStringAt(quint64 ref, const QString &str) const
+{
+    const int length = static_cast<int>(ref & 0xFFFF);
+    if (length != str.size())
+        return false;
+
+    QString stored;
+    return readString(ref, stored) && stored == str;
+}
+
+bool AdBlockLog::readRecord(quint64 position, AdBlockLogEntry &entry, const QString *firstPartyFilter) const
+{
+    const Record &record = m_records[position & (RecordCapacity - 1)];
+    if (record.Sequence.load(std::memory_order_acquire) != position + 1)
+        return false;
+
+    const qint64 time = record.Time.load(std::memory_order_relaxed);
+    const quint64 resourceType = record.ResourceType.load(std::memory_order_relaxed);
+    const quint64 firstPartyRef = record.FirstPartyUrl.load(std::memory_order_relaxed);
+    const quint64 requestRef = record.RequestUrl.load(std::memory_order_relaxed);
+    const quint64 ruleRef = record.Rule.load(std::memory_order_relaxed);
+    const quint8 action = record.Action.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.Sequence.load(std::memory_order_relaxed) != position + 1)
+        return false;
+
+    QString firstPartyUrl, requestUrl, rule;
+    if (!readString(firstPartyRef, firstPartyUrl) || !readString(requestRef, requestUrl) || !readString(ruleRef, rule))
+        return false;
+
+    if (firstPartyFilter != nullptr && *firstPartyFilter != firstPartyUrl)
+        return false;
+
+    entry.Action = static_cast<AdBlockFilterAction>(action);
+    entry.FirstPartyUrl = QUrl(firstPartyUrl);
+    entry.RequestUrl = QUrl(requestUrl);
+    entry.ResourceType = static_cast<ElementType>(resourceType);
+    entry.Rule = rule;
+    entry.Timestamp = m_startTime.addMSecs(time);
+    return true;
 }
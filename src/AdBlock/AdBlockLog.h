@@ -4,10 +4,12 @@
 #include "AdBlockFilter.h"
 
 #include <QDateTime>
-#include <QHash>
-#include <QTimer>
+#include <QElapsedTimer>
+#include <QObject>
 #include <QUrl>
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 /// The types of actions that can be done to a network request by an ad block filter
@@ -46,9 +48,15 @@ struct AdBlockLogEntry
 
 /**
  * @class AdBlockLog
- * @brief This class stores information about any recent network requests that were affected by
+ * @brief This class stores information about the most recent network requests that were affected by
  *        an \ref AdBlockFilter
  * @ingroup AdBlock
+ *
+ * Entries are kept in a fixed number of compact records, and the oldest record is overwritten once the
+ * log is full. The URLs and rule of a record are interned into a circular string buffer, so a page URL or
+ * rule that is logged repeatedly is only stored once. Adding an entry never waits on a lock, since it is
+ * done by the request interceptor. Readers validate each record and string after copying it, and skip
+ * any that were overwritten in the meantime.
  */
 class AdBlockLog : public QObject
 {
@@ -65,28 +73,110 @@ public:
      * @param requestUrl The resource that was requested
      * @param resourceType The type or types associated with the requested resource
      * @param rule The filter rule that was applied to the request
-     * @param timestamp The time of the network action
      */
     void addEntry(AdBlockFilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
-                  ElementType resourceType, const QString &rule, const QDateTime &timestamp);
+                  ElementType resourceType, const QString &rule);
 
-    /// Returns all log entries
+    /// Returns all log entries that are still stored, from oldest to newest
     std::vector<AdBlockLogEntry> getAllEntries() const;
 
     /// Returns all log entries associated with the given first party request url, or
-    /// an empty container if no entries are found
-    const std::vector<AdBlockLogEntry> &getEntriesFor(const QUrl &firstPartyUrl);
+    /// an empty container if no entries are found. URLs longer than the stored length are
+    /// compared on their first \ref MaxStringLength characters
+    std::vector<AdBlockLogEntry> getEntriesFor(const QUrl &firstPartyUrl) const;
 
-private slots:
-    /// Removes any entries from the logs that are more than 30 minutes old
-    void pruneLogs();
+    /**
+     * @brief Returns the entries added after the given cursor, and advances the cursor past them
+     * @param cursor Position in the log, starting at 0 for the first entry. Entries that were already
+     *        overwritten are skipped
+     * @param firstPartyUrl If not empty, only the entries associated with this first party URL are returned
+     * @return Log entries, from oldest to newest
+     */
+    std::vector<AdBlockLogEntry> getEntriesSince(quint64 &cursor, const QUrl &firstPartyUrl = QUrl()) const;
+
+    /// Returns the maximum number of entries that the log stores
+    static quint64 capacity();
+
+    /// Maximum length of a stored string. Longer URLs and rules are truncated, so the URLs of their
+    /// log entries are cut short, and first party URLs that only differ past this length share their entries
+    static constexpr int MaxStringLength = 2048;
 
 private:
-    /// Hashmap of first party URLs associated with requests, to containers of their associated log entries
-    QHash<QUrl, std::vector<AdBlockLogEntry>> m_entries;
+    /// Maximum number of records. Must be a power of two
+    static constexpr quint64 RecordCapacity = 8192;
+
+    /// Number of characters in the string buffer. Must be a power of two
+    static constexpr quint64 StringCapacity = 1 << 20;
+
+    /// Number of slots in the table of recently interned strings. Must be a power of two
+    static constexpr quint64 InternTableSize = 4096;
+
+    /// A logged request. Every field is atomic, so that a reader copying a record while it is
+    /// overwritten does not race with the writer, and can detect the overwrite through the sequence
+    struct Record
+    {
+        /// Position of the entry in the log plus one, or 0 while the record is being written
+        std::atomic<quint64> Sequence;
+
+        /// Milliseconds between the creation of the log and the entry
+        std::atomic<qint64> Time;
+
+        /// Request type bits
+        std::atomic<quint64> ResourceType;
+
+        /// References to the interned first party URL, request URL and rule strings
+        std::atomic<quint64> FirstPartyUrl;
+        std::atomic<quint64> RequestUrl;
+        std::atomic<quint64> Rule;
+
+        /// The action that was done to the request
+        std::atomic<quint8> Action;
+    };
+
+    /// Returns the form of the given string that is stored, truncated to \ref MaxStringLength characters
+    static QString toStoredString(const QString &str);
+
+    /// Returns a reference to the given string in the string buffer, reusing a recent copy of it if there is one.
+    /// A reference holds the position of the string in its upper 48 bits, and its length in the lower 16 bits
+    quint64 internString(const QString &str);
+
+    /// Copies a string out of the string buffer. Returns false if the string was overwritten
+    bool readString(quint64 ref, QString &result) const;
+
+    /// Returns true if the string buffer holds the given string at the position of the reference, false if else
+    bool isStringAt(quint64 ref, const QString &str) const;
+
+    /**
+     * @brief Copies a record into the entry
+     * @param position Position of the entry in the log
+     * @param entry Set to the entry of the record
+     * @param firstPartyFilter If not null, the stored form of the only first party URL whose entries are copied
+     * @return True on success, false if the record does not hold the entry at the given position, or if the
+     *         entry belongs to another first party URL
+     */
+    bool readRecord(quint64 position, AdBlockLogEntry &entry, const QString *firstPartyFilter = nullptr) const;
+
+private:
+    /// Circular buffer of records
+    std::unique_ptr<Record[]> m_records;
+
+    /// Number of entries ever added, which is the position of the next entry
+    std::atomic<quint64> m_recordHead;
+
+    /// Circular buffer of string characters
+    std::unique_ptr<std::atomic<ushort>[]> m_strings;
+
+    /// Number of characters ever written to the string buffer
+    std::atomic<quint64> m_stringHead;
+
+    /// References to recently interned strings, indexed by the hash of the string
+    std::unique_ptr<std::atomic<quint64>[]> m_internTable;
+
+    /// Monotonic clock started when the log was created
+    QElapsedTimer m_clock;
 
-    /// The timer that calls the pruneLogs method
-    QTimer m_timer;
+    /// Wall clock time at which the log was created
+    QDateTime m_startTime;
 };
 
 #endif // ADBLOCKLOG_H
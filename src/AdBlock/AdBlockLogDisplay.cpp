@@ -13,7 +13,9 @@ AdBlockLogDisplay::AdBlockLogDisplay(QWidget *parent) :
     m_proxyModel(new QSortFilterProxyModel(this)),
     m_sourceModel(new AdBlockLogTableModel(this)),
     m_logSource(LogSourcePageUrl),
-    m_sourceUrl()
+    m_sourceUrl(),
+    m_logCursor(0),
+    m_refreshTimer()
 {
     setAttribute(Qt::WA_DeleteOnClose, true);
 
@@ -37,6 +39,10 @@ AdBlockLogDisplay::AdBlockLogDisplay(QWidget *parent) :
     ui->comboBoxLogSource->addItem(tr("All URLs"), QVariant(static_cast<int>(LogSourceAll)));
     connect(ui->comboBoxLogSource, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
             this, &AdBlockLogDisplay::onComboBoxIndexChanged);
+
+    // Stream new entries into the table while it is open
+    connect(&m_refreshTimer, &QTimer::timeout, this, &AdBlockLogDisplay::appendNewEntries);
+    m_refreshTimer.start(2000);
 }
 
 AdBlockLogDisplay::~AdBlockLogDisplay()
@@ -49,14 +55,16 @@ void AdBlockLogDisplay::setLogTableFor(const QUrl &url)
     m_sourceUrl = url;
     ui->comboBoxLogSource->setCurrentIndex(0);
     ui->comboBoxLogSource->setItemText(0, url.toString());
-    m_sourceModel->setLogEntries(AdBlockManager::instance().getLog()->getEntriesFor(url));
+    m_logCursor = 0;
+    m_sourceModel->setLogEntries(AdBlockManager::instance().getLog()->getEntriesSince(m_logCursor, url));
     ui->tableView->resizeColumnsToContents();
 }
 
 void AdBlockLogDisplay::showAllLogs()
 {
     ui->comboBoxLogSource->setCurrentIndex(1);
-    m_sourceModel->setLogEntries(AdBlockManager::instance().getLog()->getAllEntries());
+    m_logCursor = 0;
+    m_sourceModel->setLogEntries(AdBlockManager::instance().getLog()->getEntriesSince(m_logCursor));
     ui->tableView->resizeColumnsToContents();
 }
 
@@ -78,6 +86,15 @@ void AdBlockLogDisplay::onReloadClicked()
     }
 }
 
+void AdBlockLogDisplay::appendNewEntries()
+{
+    const QUrl sourceUrl = (m_logSource == LogSourcePageUrl) ? m_sourceUrl : QUrl();
+    if (m_logSource == LogSourcePageUrl && sourceUrl.isEmpty())
+        return;
+
+    m_sourceModel->appendLogEntries(AdBlockManager::instance().getLog()->getEntriesSince(m_logCursor, sourceUrl));
+}
+
 void AdBlockLogDisplay::onComboBoxIndexChanged(int index)
 {
     LogSource sourceType = static_cast<LogSource>(ui->comboBoxLogSource->itemData(index).toInt());
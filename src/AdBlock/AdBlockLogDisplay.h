@@ -1,6 +1,7 @@
 #ifndef ADBLOCKLOGDISPLAY_H
 #define ADBLOCKLOGDISPLAY_H
 
+#include <QTimer>
 #include <QUrl>
 #include <QWidget>
 
@@ -41,6 +42,9 @@ private slots:
     /// Reloads the log data
     void onReloadClicked();
 
+    /// Appends the entries that were added to the log since the table was last updated
+    void appendNewEntries();
+
     /// Maps the selection in the combo box to the appropriate log source filter
     void onComboBoxIndexChanged(int index);
 
@@ -59,6 +63,12 @@ private:
 
     /// First party URL from which the logs are taken. Only used when the log source type is LogSourcePageUrl
     QUrl m_sourceUrl;
+
+    /// Position in the ad block log after the last entry shown in the table
+    quint64 m_logCursor;
+
+    /// Periodically streams new log entries into the table
+    QTimer m_refreshTimer;
 };
 
 #endif // ADBLOCKLOGDISPLAY_H
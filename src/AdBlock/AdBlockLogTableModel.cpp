@@ -163,3 +163,14 @@ void AdBlockLogTableModel::setLogEntries(const std::vector<AdBlockLogEntry> &ent
     m_logEntries = entries;
     endResetModel();
 }
+
+void AdBlockLogTableModel::appendLogEntries(const std::vector<AdBlockLogEntry> &entries)
+{
+    if (entries.empty())
+        return;
+
+    const int firstRow = static_cast<int>(m_logEntries.size());
+    beginInsertRows(QModelIndex(), firstRow, firstRow + static_cast<int>(entries.size()) - 1);
+    m_logEntries.insert(m_logEntries.end(), entries.begin(), entries.end());
+    endInsertRows();
+}
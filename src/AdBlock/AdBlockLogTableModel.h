@@ -31,6 +31,9 @@ public:
     /// Sets the log entry data to be shown in the table
     void setLogEntries(const std::vector<AdBlockLogEntry> &entries);
 
+    /// Appends newer log entries to the end of the table
+    void appendLogEntries(const std::vector<AdBlockLogEntry> &entries);
+
 private:
     /// Returns the element typemask as a formatted string ("type1[, type2, ..., typeN]")
     QString elementTypeToString(ElementType type) const;
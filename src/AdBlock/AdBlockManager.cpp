@@ -1,49 +1,73 @@
 #include "AdBlockManager.h"
+#include "AdBlockFilterCache.h"
 #include "AdBlockLog.h"
 #include "AdBlockModel.h"
+#include "AdBlockProfiler.h"
 #include "Bitfield.h"
 #include "BrowserApplication.h"
 #include "InternalDownloadItem.h"
 #include "DownloadManager.h"
 #include "Settings.h"
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QDirIterator>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QNetworkRequest>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
 #include <QDebug>
 
+/// Version of the way stylesheets and scripts are built from the cosmetic filters, part of the filter set key.
+/// Must be incremented whenever a change to that code would give different results from the same filters
+static const quint32 CosmeticFormatVersion = 1;
+
 AdBlockManager::AdBlockManager(QObject *parent) :
     QObject(parent),
     m_enabled(true),
     m_configFile(),
     m_subscriptionDir(),
     m_stylesheet(),
+    m_genericSelectors(),
     m_cosmeticJSTemplate(),
+    m_stylesheetJSTemplate(),
     m_subscriptions(),
-    m_importantBlockFilters(),
-    m_blockFilters(),
-    m_blockFiltersByPattern(),
-    m_blockFiltersByDomain(),
-    m_allowFilters(),
+    m_snapshot(std::make_shared<AdBlockFilterSnapshot>()),
+    m_snapshotSequence(0),
+    m_snapshotPending(false),
+    m_decisionCache(1024),
+    m_pageExceptionFilters(),
     m_domainStyleFilters(),
     m_domainJSFilters(),
+    m_genericJSFilters(),
     m_customStyleFilters(),
-    m_genericHideFilters(),
+    m_genericCustomStyleFilters(),
     m_cspFilters(),
+    m_stylesheetExceptionFilters(),
     m_resourceMap(),
-    m_resourceContentTypeMap(),
+    m_decodedResourceMap(),
     m_domainStylesheetCache(24),
     m_jsInjectionCache(24),
+    m_pageExceptionCache(24),
+    m_cosmeticScriptCache(24),
+    m_cosmeticCache(nullptr),
     m_emptyStr(),
     m_adBlockModel(nullptr),
     m_numRequestsBlocked(0),
     m_pageAdBlockCount(),
-    m_log(nullptr)
+    m_log(nullptr),
+    m_loadInProgress(false),
+    m_reloadPending(false)
 {
     // Fetch some global settings before loading ad block data
     Settings *settings = sBrowserApplication->getSettings();
@@ -57,6 +81,10 @@ AdBlockManager::AdBlockManager(QObject *parent) :
     if (!subscriptionDir.exists())
         subscriptionDir.mkpath(m_subscriptionDir);
 
+    // Keeps the stylesheets and scripts of a few hundred hosts
+    const QString cosmeticCachePath = QString("%1%2cache%2cosmetic.cache").arg(m_subscriptionDir).arg(QDir::separator());
+    m_cosmeticCache = std::make_unique<AdBlockCosmeticCache>(cosmeticCachePath, 1024, 16 * 1024 * 1024);
+
     loadDynamicTemplate();
     loadUBOResources();
 
@@ -67,6 +95,7 @@ AdBlockManager::AdBlockManager(QObject *parent) :
 AdBlockManager::~AdBlockManager()
 {
     save();
+    m_cosmeticCache->save();
 }
 
 AdBlockManager &AdBlockManager::instance()
@@ -83,7 +112,14 @@ void AdBlockManager::setEnabled(bool value)
     // filter data from subscriptions if being set to enabled
     clearFilters();
     if (value)
+    {
         extractFilters();
+        return;
+    }
+
+    // Snapshots still being built are not published once the filters are turned off
+    ++m_snapshotSequence;
+    publishSnapshot(std::make_shared<AdBlockFilterSnapshot>());
 }
 
 void AdBlockManager::updateSubscriptions()
@@ -163,8 +199,7 @@ void AdBlockManager::installSubscription(const QUrl &url)
         if (hasModel)
             m_adBlockModel->endInsertRows();
 
-        // Reload filters
-        clearFilters();
+        // Load the filters of the new subscription
         extractFilters();
     });
 }
@@ -197,7 +232,7 @@ void AdBlockManager::createUserSubscription()
 
 void AdBlockManager::loadStarted(const QUrl &url)
 {
-    m_pageAdBlockCount[url] = 0;
+    m_pageAdBlockCount.reset(url);
 }
 
 AdBlockLog *AdBlockManager::getLog() const
@@ -213,27 +248,35 @@ AdBlockModel *AdBlockManager::getModel()
     return m_adBlockModel;
 }
 
-const QString &AdBlockManager::getStylesheet(const URL &url) const
+const QString &AdBlockManager::getStylesheet(const URL &url)
 {
-    // Check generic hide filters
-    QString requestUrl = url.toString(URL::FullyEncoded).toLower();
-    QString secondLevelDomain = url.getSecondLevelDomain();
-    if (secondLevelDomain.isEmpty())
-        secondLevelDomain = url.host();
-    for (AdBlockFilter *filter : m_genericHideFilters)
-    {
-        if (filter->isMatch(requestUrl, requestUrl, secondLevelDomain, ElementType::Other))
-            return m_emptyStr;
-    }
+    // Generic element hiding rules do not apply to pages with a generichide or elemhide exception
+    if ((getPageExceptions(url) & (ElementType::ElemHide | ElementType::GenericHide)) != ElementType::None)
+        return m_emptyStr;
 
     return m_stylesheet;
 }
 
+QString AdBlockManager::getGenericStylesheet(const URL &url, const QStringList &classes, const QStringList &ids)
+{
+    if (!m_enabled || m_genericSelectors.empty())
+        return QString();
+
+    if ((getPageExceptions(url) & (ElementType::ElemHide | ElementType::GenericHide)) != ElementType::None)
+        return QString();
+
+    return m_genericSelectors.getStylesheet(classes, ids);
+}
+
 const QString &AdBlockManager::getDomainStylesheet(const URL &url)
 {
     if (!m_enabled)
         return m_emptyStr;
 
+    // Element hiding rules do not apply to pages with an elemhide exception
+    if ((getPageExceptions(url) & ElementType::ElemHide) == ElementType::ElemHide)
+        return m_emptyStr;
+
     QString domain = url.host().toLower();
     //QString sld = url.getSecondLevelDomain();
     if (domain.startsWith(QLatin1String("www.")))
@@ -244,9 +287,19 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
     if (m_domainStylesheetCache.has(domainStdStr))
         return m_domainStylesheetCache.get(domainStdStr);
 
+    // Check for a stylesheet built with the same filters in an earlier session
+    const QString cosmeticCacheKey = QLatin1String("css:") + domain;
     QString stylesheet;
+    if (!m_snapshotPending && m_cosmeticCache->find(cosmeticCacheKey, stylesheet))
+    {
+        m_domainStylesheetCache.put(domainStdStr, stylesheet);
+        return m_domainStylesheetCache.get(domainStdStr);
+    }
+
+    // Only the filters stored under the domain, or a domain it belongs to, can apply to it.
+    // Their excluded domains are then checked by the filters themselves
     int numStylesheetRules = 0;
-    for (AdBlockFilter *filter : m_domainStyleFilters)
+    for (AdBlockFilter *filter : m_domainStyleFilters.getFilters(domain))
     {
         if (filter->isDomainStyleMatch(domain) && !filter->isException())
         {
@@ -268,13 +321,19 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
     }
 
     // Check for custom stylesheet rules
-    for (AdBlockFilter *filter : m_customStyleFilters)
-    {
-        if (filter->isDomainStyleMatch(domain))
-            stylesheet.append(filter->getEvalString());
-    }
+    auto appendCustomStyles = [&](const std::vector<AdBlockFilter*> &filters) {
+        for (AdBlockFilter *filter : filters)
+        {
+            if (filter->isDomainStyleMatch(domain))
+                stylesheet.append(filter->getEvalString());
+        }
+    };
+    appendCustomStyles(m_genericCustomStyleFilters);
+    appendCustomStyles(m_customStyleFilters.getFilters(domain));
 
     // Insert the stylesheet into cache
+    if (!m_snapshotPending)
+        m_cosmeticCache->insert(cosmeticCacheKey, stylesheet);
     m_domainStylesheetCache.put(domainStdStr, stylesheet);
     return m_domainStylesheetCache.get(domainStdStr);
 }
@@ -302,68 +361,55 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
                                        "meta.setAttribute('content', \"%1\");\n"
                                        "doc.head.appendChild(meta);\n"
                                    "})();");
-    bool usedCspScript = false;
-
-    QString domain = url.host().toLower();
-    if (domain.startsWith(QLatin1String("www.")))
-        domain = domain.mid(4);
-    if (domain.isEmpty())
-        domain = url.getSecondLevelDomain();
 
-    QString requestUrl = url.toString(QUrl::FullyEncoded).toLower();
+    // The page is the first party of its own inline scripts
+    AdBlockRequestContext context(url, url, ElementType::InlineScript);
+    const QString &domain = context.RequestDomain;
 
     // Check for cache hit
-    std::string requestHostStdStr = url.host().toLower().toStdString();
+    std::string requestHostStdStr = context.RequestHost.toStdString();
     if (requestHostStdStr.empty())
         requestHostStdStr = domain.toStdString();
 
     if (m_jsInjectionCache.has(requestHostStdStr))
         return m_jsInjectionCache.get(requestHostStdStr);
 
-    QString javascript;
-
-    std::vector<QString> cspDirectives;
-    for (AdBlockFilter *filter : m_domainJSFilters)
+    // Check for a script built with the same filters in an earlier session
+    const QString cosmeticCacheKey = QLatin1String("js:") + QString::fromStdString(requestHostStdStr);
+    QString result;
+    if (!m_snapshotPending && m_cosmeticCache->find(cosmeticCacheKey, result))
     {
-        if (filter->isDomainStyleMatch(domain))
-            javascript.append(filter->getEvalString());
+        m_jsInjectionCache.put(requestHostStdStr, result);
+        return m_jsInjectionCache.get(requestHostStdStr);
     }
 
-    auto filterCSPCheck = [&](std::deque<AdBlockFilter*> &filterContainer) {
-        for (AdBlockFilter *filter : filterContainer)
-        {
-            if (usedCspScript)
-                return;
+    QString javascript;
 
-            if (filter->hasElementType(filter->m_blockedTypes, ElementType::InlineScript) && filter->isMatch(requestUrl, requestUrl, domain, ElementType::InlineScript))
-            {
-                cspDirectives.push_back(QLatin1String("script-src 'unsafe-eval' * blob: data:"));
-                usedCspScript = true;
-                return;
-            }
+    std::vector<QString> cspDirectives;
+    auto appendScripts = [&](const std::vector<AdBlockFilter*> &filters) {
+        for (AdBlockFilter *filter : filters)
+        {
+            if (filter->isDomainStyleMatch(domain))
+                javascript.append(filter->getEvalString());
         }
     };
+    appendScripts(m_genericJSFilters);
+    appendScripts(m_domainJSFilters.getFilters(domain));
 
-    filterCSPCheck(m_importantBlockFilters);
-
-    auto it = m_blockFiltersByDomain.find(domain);
-    if (it != m_blockFiltersByDomain.end())
-    {
-        filterCSPCheck(*it);
-    }
-
-    filterCSPCheck(m_blockFilters);
-    filterCSPCheck(m_blockFiltersByPattern);
+    // Filters only match the inline-script type if they explicitly block it, so the snapshot can be searched directly
+    AdBlockSnapshotPublisher::Reader snapshot = getSnapshot();
+    if (snapshot->findImportantBlockFilter(context) != nullptr || snapshot->findBlockFilter(context) != nullptr)
+        cspDirectives.push_back(QLatin1String("script-src 'unsafe-eval' * blob: data:"));
 
+    context.Type = ElementType::CSP;
     for (AdBlockFilter *filter : m_cspFilters)
     {
-        if (!filter->isException() && filter->isMatch(requestUrl, requestUrl, domain, ElementType::CSP))
+        if (!filter->isException() && filter->isMatch(context))
         {
             cspDirectives.push_back(filter->getContentSecurityPolicy());
         }
     }
 
-    QString result;
     if (!cspDirectives.empty())
     {
         QString cspConcatenated;
@@ -383,10 +429,65 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
         result.replace(QLatin1String("{{ADBLOCK_INTERNAL}}"), javascript);
     }
 
+    // Scripts built before the snapshot is published may be missing its inline-script rules
+    if (!m_snapshotPending)
+        m_cosmeticCache->insert(cosmeticCacheKey, result);
     m_jsInjectionCache.put(requestHostStdStr, result);
     return m_jsInjectionCache.get(requestHostStdStr);
 }
 
+std::vector<QWebEngineScript> AdBlockManager::getCosmeticScripts(const URL &url)
+{
+    std::vector<QWebEngineScript> scripts;
+
+    const QString host = url.host().toLower();
+    if (!m_enabled || host.isEmpty())
+        return scripts;
+
+    // Pages of the same host can differ in their page-level exceptions, which decide which stylesheets apply
+    const ElementType pageExceptions = getPageExceptions(url);
+    const std::string cacheKey = QString("%1|%2").arg(host).arg(static_cast<quint64>(pageExceptions)).toStdString();
+    if (m_cosmeticScriptCache.has(cacheKey))
+        return m_cosmeticScriptCache.get(cacheKey);
+
+    const QString stylesheet = getStylesheet(url) + getDomainStylesheet(url);
+    if (!stylesheet.isEmpty())
+    {
+        // The stylesheet is passed as a JSON string, which takes care of escaping it
+        const QString stylesheetJson = QString::fromUtf8(QJsonDocument(QJsonArray{ stylesheet }).toJson(QJsonDocument::Compact));
+        QString source = m_stylesheetJSTemplate;
+        source.replace(QLatin1String("{{ADBLOCK_STYLESHEET}}"), stylesheetJson);
+
+        QWebEngineScript stylesheetScript;
+        stylesheetScript.setInjectionPoint(QWebEngineScript::DocumentCreation);
+        stylesheetScript.setName(QLatin1String("viper-adblock-stylesheet"));
+        stylesheetScript.setRunsOnSubFrames(false);
+        stylesheetScript.setWorldId(QWebEngineScript::ApplicationWorld);
+        stylesheetScript.setSourceCode(source);
+        scripts.push_back(stylesheetScript);
+    }
+
+    const QString &javascript = getDomainJavaScript(url);
+    if (!javascript.isEmpty())
+    {
+        // Procedural filters need the content of the document, so the script runs again once it has loaded
+        for (QWebEngineScript::InjectionPoint injectionPoint : { QWebEngineScript::DocumentCreation, QWebEngineScript::Deferred })
+        {
+            QWebEngineScript domainScript;
+            domainScript.setInjectionPoint(injectionPoint);
+            domainScript.setName(injectionPoint == QWebEngineScript::DocumentCreation ? QLatin1String("viper-adblock-script-early")
+                                                                                      : QLatin1String("viper-adblock-script"));
+            domainScript.setRunsOnSubFrames(false);
+            domainScript.setWorldId(QWebEngineScript::ApplicationWorld);
+            domainScript.setSourceCode(javascript);
+            scripts.push_back(domainScript);
+        }
+    }
+
+    m_cosmeticScriptCache.put(cacheKey, scripts);
+    return scripts;
+}
+
 bool AdBlockManager::shouldBlockRequest(QWebEngineUrlRequestInfo &info)
 {
     if (!m_enabled)
@@ -396,100 +497,73 @@ bool AdBlockManager::shouldBlockRequest(QWebEngineUrlRequestInfo &info)
     if (isSchemeWhitelisted(info.requestUrl().scheme().toLower()))
         return false;
 
-    // Get request URL and the originating URL
-    QUrl firstPartyUrl = info.firstPartyUrl();
-    QString requestUrl = info.requestUrl().toString(QUrl::FullyEncoded).toLower();
-    QString baseUrl = getSecondLevelDomain(firstPartyUrl).toLower();
-
-    // Get request domain
-    QString domain = info.requestUrl().host().toLower();
-    if (domain.startsWith(QLatin1String("www.")))
-        domain = domain.mid(4);
-    if (domain.isEmpty())
-        domain = getSecondLevelDomain(info.requestUrl());
+    // The decision of the request is timed while profiling is enabled
+    const bool profiling = AdBlockProfiler::isEnabled();
+    QElapsedTimer requestTimer;
+    if (profiling)
+        requestTimer.start();
 
-    if (baseUrl.isEmpty())
-        baseUrl = firstPartyUrl.host().toLower();
+    // Compute the properties of the request once, to be shared by every filter that is checked
+    const QUrl firstPartyUrl = info.firstPartyUrl();
+    AdBlockRequestContext context(info.requestUrl(), firstPartyUrl);
 
     // Convert QWebEngine request type to AdBlockFilter request type
-    ElementType elemType = getRequestType(info);
+    context.Type = getRequestType(info, context);
+    const ElementType elemType = context.Type;
 
-    // Compare to filters
-    for (auto it = m_importantBlockFilters.begin(); it != m_importantBlockFilters.end(); ++it)
-    {
-        AdBlockFilter *filter = *it;
-        if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
-        {
-            ++m_numRequestsBlocked;
-            ++m_pageAdBlockCount[firstPartyUrl];
-
-            it = m_importantBlockFilters.erase(it);
-            m_importantBlockFilters.push_front(filter);
+    // The snapshot is pinned for the rest of the call, so a concurrent rebuild of the filters cannot release them
+    AdBlockSnapshotPublisher::Reader snapshot = getSnapshot();
 
-            if (filter->isRedirect())
-            {
-                info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
-                m_log->addEntry(AdBlockFilterAction::Redirect, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule(), QDateTime::currentDateTime());
-                return false;
-            }
+    // Repeated requests reuse the decision made with the same snapshot, which still owns the filter of that decision
+    const quint64 decisionKey = AdBlockDecisionCache::makeKey(context);
+    AdBlockDecisionCache::Decision decision;
+    const bool cached = m_decisionCache.find(decisionKey, snapshot->getGeneration(), decision);
+    if (profiling && cached)
+        AdBlockProfiler::instance().recordRequest(AdBlockProfiler::RequestPath::Cached, requestTimer.nsecsElapsed());
 
-            m_log->addEntry(AdBlockFilterAction::Block, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule(), QDateTime::currentDateTime());
-            return true;
-        }
+    // While profiling, the cache is bypassed so that the filters are timed against every request, including repeated ones
+    if (!cached || profiling)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        decision = snapshot->evaluate(context);
+        if (!cached)
+            m_decisionCache.insert(decisionKey, snapshot->getGeneration(), decision, timer.nsecsElapsed());
+
+        if (profiling)
+            AdBlockProfiler::instance().recordRequest(AdBlockProfiler::RequestPath::Evaluated, requestTimer.nsecsElapsed());
     }
 
-    // Look for a matching blocking filter before iterating through the allowed filter list, to avoid wasted resources
-    AdBlockFilter *matchingBlockFilter = nullptr;
-
-    auto checkFiltersForMatch = [&](std::deque<AdBlockFilter*> &filterContainer) {
-        for (auto it = filterContainer.begin(); it != filterContainer.end(); ++it)
-        {
-            AdBlockFilter *filter = *it;
-            if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
-            {
-                matchingBlockFilter = filter;
-                it = filterContainer.erase(it);
-                filterContainer.push_front(filter);
-                return;
-            }
-        }
-    };
-
-    auto itr = m_blockFiltersByDomain.find(getSecondLevelDomain(info.requestUrl()));
-    if (itr != m_blockFiltersByDomain.end())
-        checkFiltersForMatch(*itr);
-
-    if (matchingBlockFilter == nullptr)
-        checkFiltersForMatch(m_blockFilters);
-
-    if (matchingBlockFilter == nullptr)
-        checkFiltersForMatch(m_blockFiltersByPattern);
-
-    if (matchingBlockFilter == nullptr)
+    if (!decision.Matched)
         return false;
 
-    for (AdBlockFilter *filter : m_allowFilters)
+    AdBlockFilter *filter = decision.Filter;
+    switch (decision.Action)
     {
-        if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
-        {
-            m_log->addEntry(AdBlockFilterAction::Allow, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule(), QDateTime::currentDateTime());
+        case AdBlockFilterAction::Allow:
+            m_log->addEntry(AdBlockFilterAction::Allow, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule());
             return false;
-        }
+        case AdBlockFilterAction::Redirect:
+            recordBlockedRequest(firstPartyUrl);
+            info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
+            m_log->addEntry(AdBlockFilterAction::Redirect, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule());
+            return false;
+        case AdBlockFilterAction::Block:
+        default:
+            recordBlockedRequest(firstPartyUrl);
+            m_log->addEntry(AdBlockFilterAction::Block, info.firstPartyUrl(), info.requestUrl(), elemType, filter->getRule());
+            return true;
     }
+}
 
-    // If we reach this point, then the matching block filter is applied to the request
-    ++m_numRequestsBlocked;
-    ++m_pageAdBlockCount[firstPartyUrl];
-
-    if (matchingBlockFilter->isRedirect())
-    {
-        info.redirect(QUrl(QString("blocked:%1").arg(matchingBlockFilter->getRedirectName())));
-        m_log->addEntry(AdBlockFilterAction::Redirect, info.firstPartyUrl(), info.requestUrl(), elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-        return false;
-    }
+AdBlockDecisionCache::Statistics AdBlockManager::getDecisionCacheStatistics() const
+{
+    return m_decisionCache.getStatistics();
+}
 
-    m_log->addEntry(AdBlockFilterAction::Block, info.firstPartyUrl(), info.requestUrl(), elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-    return true;
+void AdBlockManager::clearDecisionCache()
+{
+    m_decisionCache.clear();
 }
 
 quint64 AdBlockManager::getRequestsBlockedCount() const
@@ -499,21 +573,12 @@ quint64 AdBlockManager::getRequestsBlockedCount() const
 
 int AdBlockManager::getNumberAdsBlocked(const QUrl &url)
 {
-    auto it = m_pageAdBlockCount.find(url);
-    if (it != m_pageAdBlockCount.end())
-        return *it;
-
-    return 0;
-}
-
-QString AdBlockManager::getResource(const QString &key) const
-{
-    return m_resourceMap.value(key);
+    return m_pageAdBlockCount.getCount(url);
 }
 
-QString AdBlockManager::getResourceContentType(const QString &key) const
+AdBlockResource AdBlockManager::getResource(const QString &key) const
 {
-    return m_resourceContentTypeMap.value(key);
+    return m_decodedResourceMap.value(key);
 }
 
 int AdBlockManager::getNumSubscriptions() const
@@ -537,8 +602,16 @@ void AdBlockManager::toggleSubscriptionEnabled(int index)
     AdBlockSubscription &sub = m_subscriptions.at(index);
     sub.setEnabled(!sub.isEnabled());
 
-    // Reset filter data
-    reloadSubscriptions();
+    // Only the filters of this subscription need to be loaded or released
+    if (sub.isEnabled())
+    {
+        extractFilters();
+        return;
+    }
+
+    invalidateCaches(sub.m_slice);
+    rebuildFilters();
+    sub.unload();
 }
 
 void AdBlockManager::removeSubscription(int index)
@@ -557,17 +630,17 @@ void AdBlockManager::removeSubscription(int index)
             qDebug() << "[Advertisement Blocker]: Could not remove subscription file " << subFile.fileName();
     }
 
+    // Keep the filters of the subscription alive until the containers no longer refer to them
+    AdBlockSubscription removed = std::move(m_subscriptions.at(index));
     m_subscriptions.erase(it);
 
-    reloadSubscriptions();
+    invalidateCaches(removed.m_slice);
+    rebuildFilters();
 }
 
 void AdBlockManager::reloadSubscriptions()
 {
-    m_domainStylesheetCache.clear();
-    m_jsInjectionCache.clear();
-
-    clearFilters();
+    // Subscriptions whose files have not changed since they were loaded keep their filters
     extractFilters();
 }
 
@@ -589,11 +662,9 @@ bool AdBlockManager::isSchemeWhitelisted(const QString &scheme) const
     return false;
 }
 
-ElementType AdBlockManager::getRequestType(const QWebEngineUrlRequestInfo &info) const
+ElementType AdBlockManager::getRequestType(const QWebEngineUrlRequestInfo &info, const AdBlockRequestContext &context) const
 {
-    const QUrl firstPartyUrl = info.firstPartyUrl();
-    const QUrl requestUrl = info.requestUrl();
-    const QString requestUrlStr = info.requestUrl().toString(QUrl::FullyEncoded).toLower();
+    const QByteArray &requestUrlStr = context.RequestUrlLower;
 
     ElementType elemType = ElementType::None;
     switch (info.resourceType())
@@ -614,9 +685,9 @@ ElementType AdBlockManager::getRequestType(const QWebEngineUrlRequestInfo &info)
             elemType |= ElementType::Image;
             break;
         case QWebEngineUrlRequestInfo::ResourceTypeSubResource:
-            if (requestUrlStr.endsWith(QLatin1String("htm"))
-                || requestUrlStr.endsWith(QLatin1String("html"))
-                || requestUrlStr.endsWith(QLatin1String("xml")))
+            if (requestUrlStr.endsWith("htm")
+                || requestUrlStr.endsWith("html")
+                || requestUrlStr.endsWith("xml"))
             {
                 elemType |= ElementType::Subdocument;
             }
@@ -648,46 +719,64 @@ ElementType AdBlockManager::getRequestType(const QWebEngineUrlRequestInfo &info)
             break;
     }
 
-    // Perform document type and third party type checking
-    QString domain = requestUrl.host().toLower();
-    if (domain.startsWith(QLatin1String("www.")))
-        domain = domain.mid(4);
-    if (domain.isEmpty())
-        domain = getSecondLevelDomain(requestUrl);
-
-    if (firstPartyUrl.isEmpty() || (getSecondLevelDomain(requestUrl) != getSecondLevelDomain(firstPartyUrl)))
+    // Perform third party type checking
+    if (context.ThirdParty)
         elemType |= ElementType::ThirdParty;
 
     return elemType;
 }
 
-QString AdBlockManager::getSecondLevelDomain(const QUrl &url) const
+AdBlockSnapshotPublisher::Reader AdBlockManager::getSnapshot() const
 {
-    const QString topLevelDomain = url.topLevelDomain();
-    const QString host = url.host();
+    return m_snapshot.read();
+}
 
-    if (topLevelDomain.isEmpty() || host.isEmpty())
-        return QString();
+void AdBlockManager::publishSnapshot(std::shared_ptr<const AdBlockFilterSnapshot> snapshot)
+{
+    m_snapshot.publish(std::move(snapshot));
+}
 
-    QString domain = host.left(host.size() - topLevelDomain.size());
+void AdBlockManager::recordBlockedRequest(const QUrl &firstPartyUrl)
+{
+    m_numRequestsBlocked.fetch_add(1, std::memory_order_relaxed);
+    m_pageAdBlockCount.increment(firstPartyUrl);
+}
 
-    if (domain.count(QChar('.')) == 0)
-        return host;
+ElementType AdBlockManager::getPageExceptions(const URL &url)
+{
+    if (m_pageExceptionFilters.empty())
+        return ElementType::None;
+
+    const std::string pageUrlStdStr = url.toString(URL::FullyEncoded).toStdString();
+    if (m_pageExceptionCache.has(pageUrlStdStr))
+        return m_pageExceptionCache.get(pageUrlStdStr);
 
-    while (domain.count(QChar('.')) != 0)
-        domain = domain.mid(domain.indexOf(QChar('.')) + 1);
+    // The page is the first party of its own exceptions
+    AdBlockRequestContext context(url, url);
+
+    ElementType exceptions = ElementType::None;
+    for (ElementType type : { ElementType::Document, ElementType::ElemHide, ElementType::GenericHide })
+    {
+        context.Type = type;
+        if (m_pageExceptionFilters.findMatch(context) != nullptr)
+            exceptions |= type;
+    }
 
-    return domain + topLevelDomain;
+    m_pageExceptionCache.put(pageUrlStdStr, exceptions);
+    return exceptions;
 }
 
 void AdBlockManager::loadDynamicTemplate()
 {
     QFile templateFile(QLatin1String(":/AdBlock.js"));
-    if (!templateFile.open(QIODevice::ReadOnly))
-        return;
-
-    m_cosmeticJSTemplate = templateFile.readAll();
+    if (templateFile.open(QIODevice::ReadOnly))
+        m_cosmeticJSTemplate = templateFile.readAll();
     templateFile.close();
+
+    QFile stylesheetTemplateFile(QLatin1String(":/AdBlockStylesheet.js"));
+    if (stylesheetTemplateFile.open(QIODevice::ReadOnly))
+        m_stylesheetJSTemplate = stylesheetTemplateFile.readAll();
+    stylesheetTemplateFile.close();
 }
 
 void AdBlockManager::loadUBOResources()
@@ -711,13 +800,35 @@ void AdBlockManager::loadResourceFile(const QString &path)
         return;
 
     bool readingValue = false;
-    QString currentKey, mimeType;
-    QByteArray currentValue;
-    QList<QByteArray> contents = f.readAll().split('\n');
-    f.close();
-    for (int i = 0; i < contents.size(); ++i)
+    QString currentKey;
+    QByteArray mimeType, currentValue;
+
+    // Stores the current value in both resource maps, decoding it if the content type says it is base64-encoded
+    auto insertResource = [&]() {
+        AdBlockResource resource;
+        const int base64Idx = mimeType.indexOf(";base64");
+        if (base64Idx >= 0)
+        {
+            resource.MimeType = mimeType.left(base64Idx);
+            resource.Data = QByteArray::fromBase64(currentValue);
+        }
+        else
+        {
+            resource.MimeType = mimeType;
+            resource.Data = currentValue;
+        }
+
+        m_resourceMap.insert(currentKey, QString::fromUtf8(currentValue));
+        m_decodedResourceMap.insert(currentKey, resource);
+        currentValue.clear();
+    };
+
+    while (!f.atEnd())
     {
-        const QByteArray &line = contents.at(i);
+        QByteArray line = f.readLine();
+        while (line.endsWith('\n') || line.endsWith('\r'))
+            line.chop(1);
+
         if ((!readingValue && line.isEmpty()) || line.startsWith('#'))
             continue;
 
@@ -726,12 +837,11 @@ void AdBlockManager::loadResourceFile(const QString &path)
         {
             int sepIdx = line.indexOf(' ');
             if (sepIdx < 0)
-                currentKey = line;
+                currentKey = QString::fromUtf8(line);
             else
             {
-                currentKey = line.left(sepIdx);
-                mimeType = line.mid(sepIdx + 1);
-                m_resourceContentTypeMap.insert(currentKey, mimeType);
+                currentKey = QString::fromUtf8(line.left(sepIdx));
+                mimeType = line.mid(sepIdx + 1).trimmed();
             }
             readingValue = true;
         }
@@ -741,18 +851,21 @@ void AdBlockManager::loadResourceFile(const QString &path)
             if (!line.isEmpty())
             {
                 currentValue.append(line);
-                if (mimeType.contains(QLatin1String("javascript")))
+                if (mimeType.contains("javascript"))
                     currentValue.append('\n');
             }
             else
             {
                 // Insert key-value pair into map once an empty line is reached and search for next key
-                m_resourceMap.insert(currentKey, QString(currentValue));
-                currentValue.clear();
+                insertResource();
                 readingValue = false;
             }
         }
     }
+
+    // The last resource in a file does not need to be followed by an empty line
+    if (readingValue && !currentValue.isEmpty())
+        insertResource();
 }
 
 void AdBlockManager::loadSubscriptions()
@@ -812,187 +925,260 @@ void AdBlockManager::loadSubscriptions()
 
 void AdBlockManager::clearFilters()
 {
-    m_importantBlockFilters.clear();
-    m_allowFilters.clear();
-    m_blockFilters.clear();
-    m_blockFiltersByPattern.clear();
-    m_blockFiltersByDomain.clear();
+    m_pageExceptionFilters.clear();
+    m_pageExceptionCache.clear();
+    m_cosmeticScriptCache.clear();
     m_stylesheet.clear();
+    m_genericSelectors.clear();
     m_domainStyleFilters.clear();
     m_domainJSFilters.clear();
+    m_genericJSFilters.clear();
     m_customStyleFilters.clear();
-    m_genericHideFilters.clear();
+    m_genericCustomStyleFilters.clear();
     m_cspFilters.clear();
+    m_stylesheetExceptionFilters.clear();
 }
 
 void AdBlockManager::extractFilters()
 {
-    // Used to store css rules for the global stylesheet and domain-specific stylesheets
-    QHash<QString, AdBlockFilter*> stylesheetFilterMap;
-    QHash<QString, AdBlockFilter*> stylesheetExceptionMap;
+    std::vector<AdBlockSubscription*> subscriptions;
+    for (AdBlockSubscription &s : m_subscriptions)
+    {
+        if (s.needsLoad())
+            subscriptions.push_back(&s);
+    }
 
-    // Used to remove bad filters (badfilter option from uBlock)
-    QSet<QString> badFilters, badHideFilters;
+    // Subscriptions that need to be read are loaded in the background, and the filters are rebuilt once they are done
+    if (!subscriptions.empty())
+    {
+        loadSubscriptionFilters(subscriptions);
+        return;
+    }
 
-    // Setup global stylesheet string
-    m_stylesheet = QLatin1String("<style>");
+    rebuildFilters();
+}
 
-    for (AdBlockSubscription &s : m_subscriptions)
+void AdBlockManager::loadSubscriptionFilters(const std::vector<AdBlockSubscription*> &subscriptions)
+{
+    // Only one load runs at a time. Subscriptions that change in the meantime are loaded once it is done
+    if (m_loadInProgress)
+    {
+        m_reloadPending = true;
+        return;
+    }
+
+    const QString cacheDir = QString("%1%2%3").arg(m_subscriptionDir).arg(QDir::separator()).arg(QLatin1String("cache"));
+    const QHash<QString, QString> resources = m_resourceMap;
+
+    // The worker only reads the subscription files. The subscriptions stay on this thread, where they are shown by the
+    // model and may be toggled or removed before the load is done, so they are found again by their path afterwards
+    QStringList filePaths;
+    for (AdBlockSubscription *s : subscriptions)
+        filePaths.push_back(s->getFilePath());
+
+    // Reading a binary cache takes a fraction of the time needed to parse its file, so the cached filters are read
+    // before returning. Requests made while the browser starts up are then filtered by them, instead of by no filters
+    std::vector<AdBlockSubscription::LoadedFilters> cached(static_cast<std::size_t>(filePaths.size()));
+    std::vector<int> indices(static_cast<std::size_t>(filePaths.size()));
+    std::iota(indices.begin(), indices.end(), 0);
+    QtConcurrent::blockingMap(indices, [&filePaths, &cacheDir, &resources, &cached](int i) {
+        cached[static_cast<std::size_t>(i)] = AdBlockSubscription::readFilters(filePaths.at(i), cacheDir, resources, true);
+    });
+
+    QStringList cachedPaths, parsedPaths;
+    std::vector<AdBlockSubscription::LoadedFilters> cachedFilters;
+    for (int i = 0; i < filePaths.size(); ++i)
+    {
+        AdBlockSubscription::LoadedFilters &result = cached[static_cast<std::size_t>(i)];
+        if (result.Loaded)
+        {
+            cachedPaths.push_back(filePaths.at(i));
+            cachedFilters.push_back(std::move(result));
+        }
+        else
+            parsedPaths.push_back(filePaths.at(i));
+    }
+
+    if (!cachedPaths.isEmpty())
+        applyLoadedFilters(cachedPaths, cachedFilters);
+
+    // The thread pool is only needed for the files without a matching cache, which are parsed in the background
+    if (parsedPaths.isEmpty() || !m_enabled)
+        return;
+
+    m_loadInProgress = true;
+
+    std::shared_ptr<std::vector<AdBlockSubscription::LoadedFilters>> loaded =
+            std::make_shared<std::vector<AdBlockSubscription::LoadedFilters>>(static_cast<std::size_t>(parsedPaths.size()));
+
+    QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+    connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, parsedPaths, loaded](){
+        watcher->deleteLater();
+        applyLoadedFilters(parsedPaths, *loaded);
+    });
+
+    // The files are read in parallel. Their slices are combined in subscription order by rebuildFilters(),
+    // so the resulting containers do not depend on which subscription finished loading first
+    watcher->setFuture(QtConcurrent::run([parsedPaths, cacheDir, resources, loaded](){
+        std::vector<int> indices(static_cast<std::size_t>(parsedPaths.size()));
+        std::iota(indices.begin(), indices.end(), 0);
+        QtConcurrent::blockingMap(indices, [&parsedPaths, &cacheDir, &resources, &loaded](int i) {
+            (*loaded)[static_cast<std::size_t>(i)] = AdBlockSubscription::readFilters(parsedPaths.at(i), cacheDir, resources);
+        });
+    }));
+}
+
+void AdBlockManager::applyLoadedFilters(const QStringList &filePaths, std::vector<AdBlockSubscription::LoadedFilters> &loaded)
+{
+    m_loadInProgress = false;
+
+    // Filters loaded before the ad block system was disabled are discarded
+    if (m_enabled)
     {
-        // calling load() does nothing if subscription is disabled
-        s.load();
+        // The cosmetic containers must not reference the filters being replaced while they are released. The network
+        // filters are kept alive by the current snapshot until a new one is published
+        clearFilters();
 
-        // Add filters to appropriate containers
-        int numFilters = s.getNumFilters();
-        for (int i = 0; i < numFilters; ++i)
+        for (int i = 0; i < filePaths.size(); ++i)
         {
-            AdBlockFilter *filter = s.getFilter(i);
-            if (!filter)
+            AdBlockSubscription::LoadedFilters &result = loaded[static_cast<std::size_t>(i)];
+            auto it = std::find_if(m_subscriptions.begin(), m_subscriptions.end(), [&filePaths, i](const AdBlockSubscription &s) {
+                return s.getFilePath() == filePaths.at(i);
+            });
+
+            // Subscriptions that were removed or disabled during the load keep their current state
+            if (!result.Loaded || it == m_subscriptions.end() || !it->isEnabled())
                 continue;
 
-            if (filter->getCategory() == FilterCategory::Stylesheet)
-            {
-                if (filter->isException())
-                    stylesheetExceptionMap.insert(filter->getEvalString(), filter);
-                else
-                    stylesheetFilterMap.insert(filter->getEvalString(), filter);
-            }
-            else if (filter->getCategory() == FilterCategory::StylesheetJS)
-            {
-                m_domainJSFilters.push_back(filter);
-            }
-            else if (filter->getCategory() == FilterCategory::StylesheetCustom)
-            {
-                m_customStyleFilters.push_back(filter);
-            }
-            else if (filter->hasElementType(filter->m_blockedTypes, ElementType::BadFilter))
-            {
-                badFilters.insert(filter->getRule());
-            }
-            else if (filter->hasElementType(filter->m_blockedTypes, ElementType::CSP))
+            invalidateCaches(it->m_slice);
+            it->setLoadedFilters(std::move(result));
+            invalidateCaches(it->m_slice);
+
+            // The name of the subscription may come from its file
+            if (m_adBlockModel != nullptr)
             {
-                if (!filter->hasElementType(filter->m_blockedTypes, ElementType::PopUp)) // Temporary workaround for issues with popup types
-                    m_cspFilters.push_back(filter);
-            }
-            else
-            {
-                if (filter->isException())
-                {
-                    if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
-                        m_genericHideFilters.push_back(filter);
-                    else
-                        m_allowFilters.push_back(filter);
-                }
-                else if (filter->isImportant())
-                {
-                    if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
-                        badHideFilters.insert(filter->getRule());
-                    else
-                        m_importantBlockFilters.push_back(filter);
-                }
-                else if (filter->getCategory() == FilterCategory::StringContains)
-                {
-                    m_blockFiltersByPattern.push_back(filter);
-                }
-                else if (filter->getCategory() == FilterCategory::Domain)
-                {
-                    //const QString &filterDomain = filter->getEvalString();
-                    const QString filterDomain = getSecondLevelDomain(QUrl::fromUserInput(filter->getEvalString()));
-                    auto it = m_blockFiltersByDomain.find(filterDomain);
-                    if (it != m_blockFiltersByDomain.end())
-                    {
-                        it->push_back(filter);
-                    }
-                    else
-                    {
-                        std::deque<AdBlockFilter*> queue;
-                        queue.push_back(filter);
-                        m_blockFiltersByDomain.insert(filterDomain, queue);
-                    }
-                }
-                else
-                {
-                    m_blockFilters.push_back(filter);
-                }
+                const QModelIndex nameIndex = m_adBlockModel->index(static_cast<int>(std::distance(m_subscriptions.begin(), it)), 1);
+                emit m_adBlockModel->dataChanged(nameIndex, nameIndex);
             }
         }
+
+        rebuildFilters();
     }
 
-    // Remove bad filters from m_allowFilters, m_blockFilters, m_blockFiltersByPattern, m_genericHideFilters, m_cspFilters
-    for (auto it = m_allowFilters.begin(); it != m_allowFilters.end();)
+    if (m_reloadPending)
     {
-        if (badFilters.contains((*it)->getRule()))
-            it = m_allowFilters.erase(it);
-        else
-            ++it;
+        m_reloadPending = false;
+        if (m_enabled)
+            extractFilters();
     }
-    for (auto it = m_blockFilters.begin(); it != m_blockFilters.end();)
+}
+
+void AdBlockManager::rebuildFilters()
+{
+    clearFilters();
+
+    // Filters of every enabled subscription, combined in subscription order, and the lists that own them
+    AdBlockFilterSlice filters;
+    std::vector<std::shared_ptr<const AdBlockFilterList>> filterLists;
+    for (const AdBlockSubscription &s : m_subscriptions)
     {
-        if (badFilters.contains((*it)->getRule()))
-            it = m_blockFilters.erase(it);
-        else
-            ++it;
+        if (!s.isEnabled())
+            continue;
+
+        filterLists.push_back(s.m_filters);
+        filters.append(s.m_slice);
     }
-    for (auto it = m_blockFiltersByPattern.begin(); it != m_blockFiltersByPattern.end();)
+
+    // Remove bad filters (badfilter option from uBlock), along with the filters that are copies of, or covered by, other
+    // filters. Filters that are combined by the optimizer are owned by the snapshot, with the lists of the subscriptions
+    std::shared_ptr<AdBlockFilterList> mergedFilters = std::make_shared<AdBlockFilterList>();
+    filters.optimize(*mergedFilters);
+    filterLists.push_back(mergedFilters);
+
+    const quint64 sequence = ++m_snapshotSequence;
+    const QByteArray filterSetKey = getFilterSetKey();
+    m_snapshotPending = true;
+
+    // Until the first snapshot of the filters is published, requests are not filtered at all. Rather than letting the
+    // pages that open with the browser through, that snapshot is built on this thread
+    if (getSnapshot()->empty())
+        applySnapshot(std::make_shared<AdBlockFilterSnapshot>(filters, std::move(filterLists)), filterSetKey);
+    else
     {
-        if (badFilters.contains((*it)->getRule()))
-            it = m_blockFiltersByPattern.erase(it);
-        else
-            ++it;
+        // The network filters are indexed on the global thread pool, while requests keep being matched against the previous
+        // snapshot. The lists that own the filters go with them, in case the subscriptions release them in the meantime
+        using SnapshotWatcher = QFutureWatcher<std::shared_ptr<const AdBlockFilterSnapshot>>;
+        SnapshotWatcher *watcher = new SnapshotWatcher(this);
+        connect(watcher, &SnapshotWatcher::finished, this, [this, watcher, sequence, filterSetKey](){
+            watcher->deleteLater();
+
+            // A snapshot of filters that changed while it was built is replaced by the build of the newer filters
+            if (sequence == m_snapshotSequence)
+                applySnapshot(watcher->result(), filterSetKey);
+        });
+        watcher->setFuture(QtConcurrent::run([filters, filterLists]() -> std::shared_ptr<const AdBlockFilterSnapshot> {
+            return std::make_shared<AdBlockFilterSnapshot>(filters, filterLists);
+        }));
     }
-    for (std::deque<AdBlockFilter*> &queue : m_blockFiltersByDomain)
-    {
-        for (auto it = queue.begin(); it != queue.end();)
+
+    m_pageExceptionFilters.build(filters.PageExceptionFilters);
+    m_cspFilters = filters.CSPFilters;
+
+    // Cosmetic filters are stored under each domain they apply to. Filters without any domain apply to every page,
+    // while filters that only exclude domains (~example.com##...) never apply to a page
+    auto insertCosmeticFilters = [](const std::vector<AdBlockFilter*> &cosmeticFilters, AdBlockDomainTrie &domainFilters,
+                                    std::vector<AdBlockFilter*> &genericFilters) {
+        for (AdBlockFilter *filter : cosmeticFilters)
         {
-            if (badFilters.contains((*it)->getRule()))
-                it = queue.erase(it);
-            else
-                ++it;
+            if (!filter->hasDomainRules())
+                genericFilters.push_back(filter);
+
+            for (const QString &domain : filter->m_domainBlacklist)
+                domainFilters.insert(domain, filter);
         }
-    }
-    for (auto it = m_cspFilters.begin(); it != m_cspFilters.end();)
-    {
-        if (badFilters.contains((*it)->getRule()))
-            it = m_cspFilters.erase(it);
-        else
-            ++it;
-    }
-    for (auto it = m_genericHideFilters.begin(); it != m_genericHideFilters.end();)
-    {
-        if (badHideFilters.contains((*it)->getRule()))
-            it = m_genericHideFilters.erase(it);
-        else
-            ++it;
-    }
+    };
+    insertCosmeticFilters(filters.DomainJSFilters, m_domainJSFilters, m_genericJSFilters);
+    insertCosmeticFilters(filters.CustomStyleFilters, m_customStyleFilters, m_genericCustomStyleFilters);
 
-    // Parse stylesheet exceptions
-    QHashIterator<QString, AdBlockFilter*> it(stylesheetExceptionMap);
-    while (it.hasNext())
-    {
-        it.next();
+    // Css rules for the global stylesheet and domain-specific stylesheets
+    QHash<QString, AdBlockFilter*> &stylesheetFilterMap = filters.StylesheetFilters;
+    const QHash<QString, AdBlockFilter*> &stylesheetExceptionMap = filters.StylesheetExceptions;
 
+    // Parse stylesheet exceptions. The blocking rule is copied before the exception is applied,
+    // so that the filters of the subscriptions can be reused by later rebuilds
+    for (auto it = stylesheetExceptionMap.cbegin(); it != stylesheetExceptionMap.cend(); ++it)
+    {
         // Ignore the exception if the blocking rule does not exist
-        if (!stylesheetFilterMap.contains(it.key()))
+        auto blockIt = stylesheetFilterMap.find(it.key());
+        if (blockIt == stylesheetFilterMap.end())
             continue;
 
-        AdBlockFilter *filter = it.value();
-        stylesheetFilterMap.value(it.key())->m_domainWhitelist.unite(filter->m_domainBlacklist);
+        std::unique_ptr<AdBlockFilter> filter = std::make_unique<AdBlockFilter>(*blockIt.value());
+        filter->addDomainsToWhitelist(it.value()->m_domainBlacklist);
+        blockIt.value() = filter.get();
+        m_stylesheetExceptionFilters.push_back(std::move(filter));
     }
 
+    // Setup global stylesheet string
+    m_stylesheet.clear();
+
     // Parse stylesheet blocking rules
-    it = QHashIterator<QString, AdBlockFilter*>(stylesheetFilterMap);
     int numStylesheetRules = 0;
-    while (it.hasNext())
+    for (auto it = stylesheetFilterMap.cbegin(); it != stylesheetFilterMap.cend(); ++it)
     {
-        it.next();
         AdBlockFilter *filter = it.value();
 
         if (filter->hasDomainRules())
         {
-            m_domainStyleFilters.push_back(filter);
+            for (const QString &domain : filter->m_domainBlacklist)
+                m_domainStyleFilters.insert(domain, filter);
             continue;
         }
 
+        // Rules that require a class or id are only sent to the pages that contain it
+        if (m_genericSelectors.insert(filter->getEvalString()))
+            continue;
+
         if (numStylesheetRules > 1000)
         {
             m_stylesheet = m_stylesheet.left(m_stylesheet.size() - 1);
@@ -1010,7 +1196,47 @@ void AdBlockManager::extractFilters()
         m_stylesheet = m_stylesheet.left(m_stylesheet.size() - 1);
         m_stylesheet.append(QLatin1String("{ display: none !important; } "));
     }
-    m_stylesheet.append(QLatin1String("</style>"));
+}
+
+void AdBlockManager::applySnapshot(std::shared_ptr<const AdBlockFilterSnapshot> snapshot, const QByteArray &filterSetKey)
+{
+    publishSnapshot(std::move(snapshot));
+
+    // Stylesheets and scripts cached on disk are only used with the filters that they were built from
+    m_cosmeticCache->setFilterSetKey(filterSetKey);
+    m_snapshotPending = false;
+
+    // Page scripts check the network filters for inline-script rules, so those built before the snapshot was
+    // published may have been built from the previous filters
+    m_jsInjectionCache.clear();
+    m_cosmeticScriptCache.clear();
+}
+
+void AdBlockManager::invalidateCaches(const AdBlockFilterSlice &slice)
+{
+    if (slice.HasStylesheetRules)
+        m_domainStylesheetCache.clear();
+
+    if (slice.HasScriptRules)
+        m_jsInjectionCache.clear();
+}
+
+QByteArray AdBlockManager::getFilterSetKey() const
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(QByteArray::number(CosmeticFormatVersion));
+    hash.addData(m_cosmeticJSTemplate.toUtf8());
+    hash.addData(QByteArray::number(AdBlockFilterCache::getResourceKey(m_resourceMap)));
+    for (const AdBlockSubscription &s : m_subscriptions)
+    {
+        if (!s.isEnabled())
+            continue;
+
+        hash.addData(s.getFilePath().toUtf8());
+        hash.addData(QByteArray::number(s.m_loadedFileTime.toMSecsSinceEpoch()));
+        hash.addData(QByteArray::number(s.m_loadedFileSize));
+    }
+    return hash.result();
 }
 
 void AdBlockManager::save()
@@ -1029,7 +1255,7 @@ void AdBlockManager::save()
     // Subscription object format: { "enabled": (true|false), "last_update": (timestamp),
     //                               "next_update": (timestamp), "source": "origin_url" }
     QJsonObject configObj;
-    configObj.insert(QLatin1String("requests_blocked"), QJsonValue(QString::number(m_numRequestsBlocked)));
+    configObj.insert(QLatin1String("requests_blocked"), QJsonValue(QString::number(m_numRequestsBlocked.load())));
     for (auto it = m_subscriptions.cbegin(); it != m_subscriptions.cend(); ++it)
     {
         QJsonObject subscriptionObj;
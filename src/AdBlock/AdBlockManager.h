@@ -1,17 +1,30 @@
 #ifndef ADBLOCKMANAGER_H
 #define ADBLOCKMANAGER_H
 
+#include "AdBlockCosmeticCache.h"
+#include "AdBlockDecisionCache.h"
+#include "AdBlockDomainTrie.h"
 #include "AdBlockFilter.h"
+#include "AdBlockFilterIndex.h"
+#include "AdBlockFilterSnapshot.h"
+#include "AdBlockPageCounter.h"
+#include "AdBlockRequestContext.h"
+#include "AdBlockSelectorIndex.h"
+#include "AdBlockSnapshotPublisher.h"
 #include "AdBlockSubscription.h"
 #include "LRUCache.h"
 #include "URL.h"
 
+#include <QByteArray>
 #include <QHash>
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QWebEngineScript>
 #include <QWebEngineUrlRequestInfo>
 
-#include <deque>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 class AdBlockLog;
@@ -22,6 +35,20 @@ class AdBlockModel;
  * An implementation of the AdBlockPlus and uBlock Origin style content filtering system
  */
 
+/**
+ * @struct AdBlockResource
+ * @ingroup AdBlock
+ * @brief A resource that redirected requests are served with, decoded once when its resource file is loaded
+ */
+struct AdBlockResource
+{
+    /// Content type of the resource, without the base64 encoding parameter
+    QByteArray MimeType;
+
+    /// Decoded contents of the resource. Implicitly shared with each reply that serves it
+    QByteArray Data;
+};
+
 /**
  * @class AdBlockManager
  * @ingroup AdBlock
@@ -31,7 +58,6 @@ class AdBlockModel;
  */
 class AdBlockManager : public QObject
 {
-    friend class AdBlockFilterParser;
     friend class AdBlockModel;
     friend class AdBlockWidget;
     friend class BrowserApplication;
@@ -58,21 +84,50 @@ public:
     /// Returns the model that is used to view and modify ad block subscriptions
     AdBlockModel *getModel();
 
-    /// Returns the base stylesheet for elements to be blocked. If the given url matches a generichide filter, this will return an empty string
-    const QString &getStylesheet(const URL &url) const;
+    /// Returns the base stylesheet for elements to be blocked. If the given url matches a generichide or elemhide filter, this will return an empty string.
+    /// Generic rules that can be keyed by a class or id are not part of this stylesheet, see \ref getGenericStylesheet
+    const QString &getStylesheet(const URL &url);
 
-    /// Returns the domain-specific blocking stylesheet, or an empty string if not applicable
+    /**
+     * @brief Returns the generic element hiding rules that apply to the classes and ids found in a page
+     * @param url URL of the page
+     * @param classes Class names of the elements in the page
+     * @param ids Ids of the elements in the page
+     * @return Stylesheet rules, or an empty string if none apply (including if the url matches a generichide or elemhide filter)
+     */
+    QString getGenericStylesheet(const URL &url, const QStringList &classes, const QStringList &ids);
+
+    /// Returns the domain-specific blocking stylesheet, or an empty string if not applicable (including if the url matches an elemhide filter)
     const QString &getDomainStylesheet(const URL &url);
 
     /// Returns the domain-specific blocking javascript, or an empty string if not applicable
     const QString &getDomainJavaScript(const URL &url);
 
-    /// Returns true if the given request should be blocked, false if else
+    /**
+     * @brief Returns the scripts that apply the cosmetic filters of the given page, to be installed in the
+     *        page's script collection before it navigates to the url
+     *
+     * The stylesheet script runs at document creation, so that blocked elements are hidden before the first paint.
+     * The javascript of \ref getDomainJavaScript runs at document creation, and again once the document has
+     * loaded for filters that need the content of the page. The scripts are cached for each host.
+     * @param url URL of the page
+     * @return Scripts to inject into the page, or an empty container if no cosmetic filter applies
+     */
+    std::vector<QWebEngineScript> getCosmeticScripts(const URL &url);
+
+    /// Returns true if the given request should be blocked, false if else. Called by the request interceptor on the IO thread,
+    /// so the filters are only read through the current \ref AdBlockFilterSnapshot
     bool shouldBlockRequest(QWebEngineUrlRequestInfo &info);
 
     /// Returns the total number of network requests that have been blocked by the ad blocking system
     quint64 getRequestsBlockedCount() const;
 
+    /// Returns the hit rate and time saved counters of the network request decision cache
+    AdBlockDecisionCache::Statistics getDecisionCacheStatistics() const;
+
+    /// Removes the decisions of all previous requests from the network request decision cache
+    void clearDecisionCache();
+
     /// Returns the number of ads that were blocked on the page with the given URL during its last page load
     int getNumberAdsBlocked(const QUrl &url);
 
@@ -98,13 +153,10 @@ public slots:
     /// Informs the AdBlockManager to begin keeping track of the number of ads that were blocked on the page with the given url
     void loadStarted(const QUrl &url);
 
-// Called by AdBlockFilterParser and BlockedSchemeHandler:
+// Called by BlockedSchemeHandler:
 protected:
-    /// Searches for and returns the value from the resource map that is associated with the given key. Returns an empty string if not found
-    QString getResource(const QString &key) const;
-
-    /// Returns the content type of the resource with the given key. Returns an empty string if the key is not found
-    QString getResourceContentType(const QString &key) const;
+    /// Returns the decoded resource associated with the given key. The resource data is empty if the key is not found
+    AdBlockResource getResource(const QString &key) const;
 
 // Called by AdBlockModel:
 protected:
@@ -138,12 +190,24 @@ private:
     bool isSchemeWhitelisted(const QString &scheme) const;
 
     /// Returns the \ref ElementType of the network request, which is used to check for filter option/type matches
-    ElementType getRequestType(const QWebEngineUrlRequestInfo &info) const;
+    ElementType getRequestType(const QWebEngineUrlRequestInfo &info, const AdBlockRequestContext &context) const;
+
+    /// Returns the current snapshot of the network filters, without blocking. The snapshot stays valid for as long as
+    /// the caller holds the reader
+    AdBlockSnapshotPublisher::Reader getSnapshot() const;
 
-    /// Returns the second-level domain string of the given url
-    QString getSecondLevelDomain(const QUrl &url) const;
+    /// Replaces the current snapshot of the network filters, once the readers of the previous snapshot are done with it.
+    /// Must not be called while holding a reader of the snapshot
+    void publishSnapshot(std::shared_ptr<const AdBlockFilterSnapshot> snapshot);
 
-    /// Loads the AdBlock JavaScript template for dynamic filters
+    /// Counts a request that was blocked or redirected on the page with the given URL
+    void recordBlockedRequest(const QUrl &firstPartyUrl);
+
+    /// Returns the page-level exception types (Document, ElemHide and GenericHide) of the filters that match the given page.
+    /// The result is cached for each page URL
+    ElementType getPageExceptions(const URL &url);
+
+    /// Loads the AdBlock JavaScript templates for dynamic filters and for stylesheet injection
     void loadDynamicTemplate();
 
     /// Load uBlock Origin-style resources file(s) from m_subscriptionDir/resources folder
@@ -152,15 +216,40 @@ private:
     /// Clears current filter data
     void clearFilters();
 
-    /// Extracts pointers to filters from subscriptions into the appropriate containers
+    /// Loads any enabled subscriptions whose filters are missing or out of date, and rebuilds the filter containers
     void extractFilters();
 
+    /// Reads the filters of the given subscriptions in parallel on the global thread pool. Filters with a binary cache that matches
+    /// their file are read before returning, and the filter containers are rebuilt from them right away. Files that must be parsed
+    /// are read without blocking the calling thread, and the containers are rebuilt again once every one of them has been read
+    void loadSubscriptionFilters(const std::vector<AdBlockSubscription*> &subscriptions);
+
+    /// Gives the filters read by \ref loadSubscriptionFilters to the subscriptions with the given file paths, in the same
+    /// order, and rebuilds the filter containers
+    void applyLoadedFilters(const QStringList &filePaths, std::vector<AdBlockSubscription::LoadedFilters> &loaded);
+
+    /// Combines the filter slices of every enabled subscription into the containers used to filter content. The snapshot
+    /// of the network filters is built on the global thread pool, and published once it is done. If no network filters have
+    /// been published yet, the snapshot is built and published before returning, so that requests are not left unfiltered
+    void rebuildFilters();
+
+    /// Publishes the snapshot built by \ref rebuildFilters, and switches the caches of the cosmetic filters to the filters
+    /// with the given key
+    void applySnapshot(std::shared_ptr<const AdBlockFilterSnapshot> snapshot, const QByteArray &filterSetKey);
+
+    /// Clears the stylesheet and/or javascript caches if the filters of the given slice affect their contents
+    void invalidateCaches(const AdBlockFilterSlice &slice);
+
+    /// Returns a key that identifies the loaded versions of the enabled subscriptions, along with the resources
+    /// and the script template that the cosmetic filters are built with, and the way they are built
+    QByteArray getFilterSetKey() const;
+
     /// Saves subscription information to disk, called by destructor
     void save();
 
 private:
     /// True if AdBlock is enabled, false if disabled
-    bool m_enabled;
+    std::atomic<bool> m_enabled;
 
     /// JSON configuration file path
     QString m_configFile;
@@ -168,50 +257,63 @@ private:
     /// Directory path in which subscriptions are located
     QString m_subscriptionDir;
 
-    /// Global adblock stylesheet
+    /// Global adblock stylesheet, containing the generic element hiding rules that cannot be keyed by a class or id
     QString m_stylesheet;
 
+    /// Generic element hiding rules, keyed by the class or id that they require
+    AdBlockSelectorIndex m_genericSelectors;
+
     /// JavaScript template for uBlock style cosmetic filters
     QString m_cosmeticJSTemplate;
 
+    /// JavaScript template that adds a stylesheet to a document as soon as it is created
+    QString m_stylesheetJSTemplate;
+
     /// Container of content blocking subscriptions
     std::vector<AdBlockSubscription> m_subscriptions;
 
-    /// Container of important blocking filters that are checked before allow filters on network requests
-    std::deque<AdBlockFilter*> m_importantBlockFilters;
+    /// Network filters of the enabled subscriptions, read by the request interceptor while the filters are rebuilt
+    AdBlockSnapshotPublisher m_snapshot;
+
+    /// Incremented each time the network filters change. A snapshot is only published if no change was made while it was built
+    quint64 m_snapshotSequence;
 
-    /// Container of filters that block content
-    std::deque<AdBlockFilter*> m_blockFilters;
+    /// True from the time the filters are rebuilt until their snapshot is published. The on-disk cosmetic cache keeps the
+    /// key of the previous filters until then, and is neither searched nor filled
+    bool m_snapshotPending;
 
-    /// Container of filters that block content based on a partial string match (needle in haystack)
-    std::deque<AdBlockFilter*> m_blockFiltersByPattern;
+    /// Decisions of the most recently intercepted network requests, invalidated whenever a new snapshot is published
+    AdBlockDecisionCache m_decisionCache;
 
-    /// Hashmap of filters that are of the Domain category (||some.domain.com^ style filter rules)
-    QHash<QString, std::deque<AdBlockFilter*>> m_blockFiltersByDomain;
+    /// Index of exception filters that apply to whole pages (document, elemhide and generichide options)
+    AdBlockFilterIndex m_pageExceptionFilters;
 
-    /// Container of filters that whitelist content
-    std::vector<AdBlockFilter*> m_allowFilters;
+    /// Trie of filters that have domain-specific stylesheet rules, keyed by each domain they apply to
+    AdBlockDomainTrie m_domainStyleFilters;
 
-    /// Container of filters that have domain-specific stylesheet rules
-    std::vector<AdBlockFilter*> m_domainStyleFilters;
+    /// Trie of filters that have domain-specific javascript rules, keyed by each domain they apply to
+    AdBlockDomainTrie m_domainJSFilters;
 
-    /// Container of filters that have domain-specific javascript rules
-    std::vector<AdBlockFilter*> m_domainJSFilters;
+    /// Container of filters that have javascript rules for every domain
+    std::vector<AdBlockFilter*> m_genericJSFilters;
 
-    /// Container of filters that have custom stylesheet values (:style filter option)
-    std::vector<AdBlockFilter*> m_customStyleFilters;
+    /// Trie of filters that have custom stylesheet values (:style filter option), keyed by each domain they apply to
+    AdBlockDomainTrie m_customStyleFilters;
 
-    /// Container of domain-specific filters for which the generic element hiding rules (in m_stylesheet) do not apply
-    std::vector<AdBlockFilter*> m_genericHideFilters;
+    /// Container of filters that have custom stylesheet values for every domain
+    std::vector<AdBlockFilter*> m_genericCustomStyleFilters;
 
     /// Container of filters that set the content security policy for a matching domain
     std::vector<AdBlockFilter*> m_cspFilters;
 
+    /// Copies of stylesheet filters with the domains of their exception filters whitelisted
+    std::vector<std::unique_ptr<AdBlockFilter>> m_stylesheetExceptionFilters;
+
     /// Resources available to filters by referencing the key. Available for redirect options as well as script injections
     QHash<QString, QString> m_resourceMap;
 
-    /// Mapping of resource names, from the resource map, to their respective content types
-    QHash<QString, QString> m_resourceContentTypeMap;
+    /// Mapping of resource names to their decoded data and content types, used to serve redirected requests
+    QHash<QString, AdBlockResource> m_decodedResourceMap;
 
     /// A cache of the most recently used domain-specific stylesheets
     LRUCache<std::string, QString> m_domainStylesheetCache;
@@ -219,6 +321,15 @@ private:
     /// A cache of the most recently used javascript injection scripts for specific URLs
     LRUCache<std::string, QString> m_jsInjectionCache;
 
+    /// A cache of the page-level exceptions of the most recently visited pages
+    LRUCache<std::string, ElementType> m_pageExceptionCache;
+
+    /// A cache of the cosmetic filter scripts of the most recently visited hosts
+    LRUCache<std::string, std::vector<QWebEngineScript>> m_cosmeticScriptCache;
+
+    /// Domain-specific stylesheets and javascript injection scripts built in this or an earlier session, kept on disk
+    std::unique_ptr<AdBlockCosmeticCache> m_cosmeticCache;
+
     /// Empty string, used when getDomainStylesheet returns nothing
     QString m_emptyStr;
 
@@ -226,13 +337,20 @@ private:
     AdBlockModel *m_adBlockModel;
 
     /// Stores the number of network requests that have been blocked by the ad block system
-    quint64 m_numRequestsBlocked;
+    std::atomic<quint64> m_numRequestsBlocked;
 
-    /// Hash map of URLs to the number of requests that were blocked on that given URL
-    QHash<QUrl, int> m_pageAdBlockCount;
+    /// Number of requests that were blocked on each of the most recently loaded pages. Updated by the request
+    /// interceptor and read by the user interface
+    AdBlockPageCounter m_pageAdBlockCount;
 
     /// Stores logs associated with actions taken by the ad block system
     AdBlockLog *m_log;
+
+    /// True while subscription files are being read in the background
+    bool m_loadInProgress;
+
+    /// True if subscriptions changed while their files were being read, and must be checked again once the load is done
+    bool m_reloadPending;
 };
 
 #endif // ADBLOCKMANAGER_H
@@ -0,0 +1,69 @@
+#include "AdBlockPageCounter.h"
+
+AdBlockPageCounter::AdBlockPageCounter() :
+    m_slots()
+{
+    for (std::atomic<quint64> &slot : m_slots)
+        slot.store(0, std::memory_order_relaxed);
+}
+
+void AdBlockPageCounter::reset(const QUrl &pageUrl)
+{
+    const quint64 key = getKey(pageUrl);
+    getSlot(key).store(getTag(key), std::memory_order_relaxed);
+}
+
+void AdBlockPageCounter::increment(const QUrl &pageUrl)
+{
+    const quint64 key = getKey(pageUrl);
+    const quint64 tag = getTag(key);
+    std::atomic<quint64> &slot = getSlot(key);
+
+    quint64 value = slot.load(std::memory_order_relaxed);
+    quint64 updated = 0;
+    do
+    {
+        // A page found in the slot of another page takes its place
+        if ((value & ~MaxCount) != tag)
+            updated = tag | 1;
+        else
+            updated = (value & MaxCount) < MaxCount ? value + 1 : value;
+    }
+    while (!slot.compare_exchange_weak(value, updated, std::memory_order_relaxed));
+}
+
+int AdBlockPageCounter::getCount(const QUrl &pageUrl) const
+{
+    const quint64 key = getKey(pageUrl);
+    const quint64 value = m_slots[key % m_slots.size()].load(std::memory_order_relaxed);
+    if ((value & ~MaxCount) != getTag(key))
+        return 0;
+
+    return static_cast<int>(value & MaxCount);
+}
+
+quint64 AdBlockPageCounter::getKey(const QUrl &pageUrl)
+{
+    // 64-bit FNV-1a of the UTF-16 characters of the URL
+    const QString url = pageUrl.toString();
+    const ushort *data = url.utf16();
+
+    quint64 hash = 14695981039346656037ULL;
+    for (int i = 0; i < url.size(); ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::atomic<quint64> &AdBlockPageCounter::getSlot(quint64 key)
+{
+    return m_slots[key % m_slots.size()];
+}
+
+quint64 AdBlockPageCounter::getTag(quint64 key)
+{
+    // The lowest bits choose the slot, so the tag is taken from the highest bits
+    return key & ~MaxCount;
+}
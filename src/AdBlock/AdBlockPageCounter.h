@@ -0,0 +1,52 @@
+#ifndef ADBLOCKPAGECOUNTER_H
+#define ADBLOCKPAGECOUNTER_H
+
+#include <array>
+#include <atomic>
+#include <QtGlobal>
+#include <QUrl>
+
+/**
+ * @class AdBlockPageCounter
+ * @ingroup AdBlock
+ * @brief Counts the requests blocked on each of the most recently loaded pages, without any lock, so that the
+ *        request interceptor can update the counts while the user interface reads them.
+ *
+ * Each page is hashed to one of a fixed number of slots. A slot packs the upper bits of the hash of its page
+ * together with the count into a single atomic word, so that a page replaces the one that used its slot
+ * before it. Counts stop increasing once they reach \ref MaxCount.
+ */
+class AdBlockPageCounter
+{
+public:
+    /// Largest count that can be stored for a page
+    static const quint64 MaxCount = (1ULL << 24) - 1;
+
+    /// Constructs the counter with no pages
+    AdBlockPageCounter();
+
+    /// Sets the count of the given page to zero
+    void reset(const QUrl &pageUrl);
+
+    /// Increments the count of the given page, starting from zero if the page is not known
+    void increment(const QUrl &pageUrl);
+
+    /// Returns the count of the given page, or zero if the page is not known
+    int getCount(const QUrl &pageUrl) const;
+
+private:
+    /// Returns a 64-bit hash of the given page URL
+    static quint64 getKey(const QUrl &pageUrl);
+
+    /// Returns the slot of the page with the given key
+    std::atomic<quint64> &getSlot(quint64 key);
+
+    /// Returns the bits of the key that are stored in its slot, with a count of zero
+    static quint64 getTag(quint64 key);
+
+private:
+    /// Page tags and their counts
+    std::array<std::atomic<quint64>, 256> m_slots;
+};
+
+#endif // ADBLOCKPAGECOUNTER_H
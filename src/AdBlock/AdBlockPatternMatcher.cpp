@@ -0,0 +1,79 @@
+#include "AdBlockPatternMatcher.h"
+
+AdBlockPatternMatcher::AdBlockPatternMatcher() :
+    m_caseInsensitiveMatcher(false),
+    m_caseSensitiveMatcher(true),
+    m_filters(),
+    m_fallbackFilters()
+{
+}
+
+void AdBlockPatternMatcher::build(const std::vector<AdBlockFilter*> &filters)
+{
+    clear();
+
+    m_filters.reserve(filters.size());
+    for (AdBlockFilter *filter : filters)
+    {
+        const int id = static_cast<int>(m_filters.size());
+
+        bool added = false;
+        if (!filter->hasOption(AdBlockFilter::OptionMatchAll))
+        {
+            AhoCorasick &matcher = filter->hasOption(AdBlockFilter::OptionMatchCase) ? m_caseSensitiveMatcher : m_caseInsensitiveMatcher;
+            added = matcher.addPattern(filter->m_evalBytes, id);
+        }
+
+        if (added)
+            m_filters.push_back(filter);
+        else
+            m_fallbackFilters.push_back(filter);
+    }
+
+    m_caseInsensitiveMatcher.build();
+    m_caseSensitiveMatcher.build();
+}
+
+void AdBlockPatternMatcher::clear()
+{
+    m_caseInsensitiveMatcher.clear();
+    m_caseSensitiveMatcher.clear();
+    m_filters.clear();
+    m_fallbackFilters.clear();
+}
+
+bool AdBlockPatternMatcher::empty() const
+{
+    return m_filters.empty() && m_fallbackFilters.empty();
+}
+
+AdBlockFilter *AdBlockPatternMatcher::findMatch(const AdBlockRequestContext &context) const
+{
+    AdBlockFilter *match = nullptr;
+
+    auto checkHit = [&](int id) {
+        AdBlockFilter *filter = m_filters[id];
+        if (filter->isOptionMatch(context))
+        {
+            match = filter;
+            return true;
+        }
+        return false;
+    };
+
+    const QByteArray &urlLower = context.RequestUrlLower;
+    if (m_caseInsensitiveMatcher.search(urlLower.constData(), urlLower.size(), checkHit))
+        return match;
+
+    const QByteArray &url = context.RequestUrl;
+    if (m_caseSensitiveMatcher.search(url.constData(), url.size(), checkHit))
+        return match;
+
+    for (AdBlockFilter *filter : m_fallbackFilters)
+    {
+        if (filter->isMatch(context))
+            return filter;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,55 @@
+#ifndef ADBLOCKPATTERNMATCHER_H
+#define ADBLOCKPATTERNMATCHER_H
+
+#include "AdBlockFilter.h"
+#include "AdBlockRequestContext.h"
+#include "AhoCorasick.h"
+
+#include <vector>
+#include <QString>
+
+/**
+ * @class AdBlockPatternMatcher
+ * @ingroup AdBlock
+ * @brief Matches network requests against filters of the StringContains category. The evaluation
+ *        strings of the filters are compiled into Aho-Corasick automata, so that one pass over the
+ *        request URL reports every filter whose string it contains. Only those filters then have
+ *        their options checked.
+ */
+class AdBlockPatternMatcher
+{
+public:
+    /// Constructs an empty pattern matcher
+    AdBlockPatternMatcher();
+
+    /// Replaces the contents of the matcher with the given filters, which should be of the StringContains category
+    void build(const std::vector<AdBlockFilter*> &filters);
+
+    /// Removes all filters from the matcher
+    void clear();
+
+    /// Returns true if the matcher does not contain any filters, false if else
+    bool empty() const;
+
+    /**
+     * @brief Searches for a filter that matches the network request
+     * @param context Properties of the network request
+     * @return The first filter found to match the request, or a nullptr if no filters match
+     */
+    AdBlockFilter *findMatch(const AdBlockRequestContext &context) const;
+
+private:
+    /// Automaton of the evaluation strings of filters without the match-case option
+    AhoCorasick m_caseInsensitiveMatcher;
+
+    /// Automaton of the evaluation strings of filters with the match-case option
+    AhoCorasick m_caseSensitiveMatcher;
+
+    /// Filters referenced by the pattern ids of the automata
+    std::vector<AdBlockFilter*> m_filters;
+
+    /// Filters that cannot be placed in an automaton (empty evaluation strings), which are checked against every request
+    std::vector<AdBlockFilter*> m_fallbackFilters;
+};
+
+#endif // ADBLOCKPATTERNMATCHER_H
@@ -0,0 +1,82 @@
+#include "AdBlockProfileTableModel.h"
+
+AdBlockProfileTableModel::AdBlockProfileTableModel(QObject *parent) :
+    QAbstractTableModel(parent),
+    m_profiles()
+{
+}
+
+QVariant AdBlockProfileTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal)
+        return QVariant();
+
+    if (role == Qt::DisplayRole)
+    {
+        switch (section)
+        {
+            case 0: return tr("Rule");
+            case 1: return tr("Evaluations");
+            case 2: return tr("Hits");
+            case 3: return tr("Total Time (ms)");
+            case 4: return tr("Mean Time (ns)");
+        }
+    }
+
+    return QVariant();
+}
+
+int AdBlockProfileTableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return static_cast<int>(m_profiles.size());
+}
+
+int AdBlockProfileTableModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    // Fixed number of columns
+    return 5;
+}
+
+QVariant AdBlockProfileTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(m_profiles.size()))
+        return QVariant();
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    const AdBlockProfiler::FilterProfile &profile = m_profiles.at(index.row());
+    switch (index.column())
+    {
+        // Rule column
+        case 0:
+            return profile.Rule;
+        // Evaluation count column
+        case 1:
+            return profile.Evaluations;
+        // Hit count column
+        case 2:
+            return profile.Hits;
+        // Total time column
+        case 3:
+            return static_cast<double>(profile.TotalNs) / 1000000.0;
+        // Mean time column
+        case 4:
+            return profile.Evaluations > 0 ? profile.TotalNs / profile.Evaluations : 0;
+    }
+
+    return QVariant();
+}
+
+void AdBlockProfileTableModel::setFilterProfiles(const std::vector<AdBlockProfiler::FilterProfile> &profiles)
+{
+    beginResetModel();
+    m_profiles = profiles;
+    endResetModel();
+}
@@ -0,0 +1,40 @@
+#ifndef ADBLOCKPROFILETABLEMODEL_H
+#define ADBLOCKPROFILETABLEMODEL_H
+
+#include "AdBlockProfiler.h"
+#include <QAbstractTableModel>
+#include <vector>
+
+/**
+ * @class AdBlockProfileTableModel
+ * @brief Interacts with a table view to display the evaluation counts and times of the ad block filters
+ * @ingroup AdBlock
+ */
+class AdBlockProfileTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    /// Constructs the table model with a pointer to its parent
+    explicit AdBlockProfileTableModel(QObject *parent = nullptr);
+
+    // Header:
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    // Basic functionality:
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    /// Returns the data associated at the index with the given role. Counters are returned as numbers, so that
+    /// a proxy model sorts them by value
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /// Sets the filter counters to be shown in the table
+    void setFilterProfiles(const std::vector<AdBlockProfiler::FilterProfile> &profiles);
+
+private:
+    /// Counters stored in the table model
+    std::vector<AdBlockProfiler::FilterProfile> m_profiles;
+};
+
+#endif // ADBLOCKPROFILETABLEMODEL_H
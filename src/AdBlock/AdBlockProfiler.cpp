@@ -0,0 +1,236 @@
+#include "AdBlockProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+
+std::atomic<bool> AdBlockProfiler::s_enabled(false);
+
+qint64 AdBlockProfiler::LatencyHistogram::getPercentile(double percentile) const
+{
+    if (Requests == 0)
+        return 0;
+
+    const quint64 rank = static_cast<quint64>(std::max(1.0, std::ceil(percentile / 100.0 * static_cast<double>(Requests))));
+    quint64 count = 0;
+    for (int i = 0; i < NumBuckets - 1; ++i)
+    {
+        count += Buckets[i];
+        if (count >= rank)
+            return std::min(getBucketUpperBound(i), static_cast<qint64>(MaxNs));
+    }
+    return static_cast<qint64>(MaxNs);
+}
+
+AdBlockProfiler::AdBlockProfiler() :
+    m_mutex(),
+    m_threads(),
+    m_evaluatedRequests(),
+    m_cachedRequests()
+{
+    reset();
+}
+
+AdBlockProfiler &AdBlockProfiler::instance()
+{
+    static AdBlockProfiler profiler;
+    return profiler;
+}
+
+void AdBlockProfiler::setEnabled(bool value)
+{
+    s_enabled.store(value, std::memory_order_relaxed);
+}
+
+qint64 AdBlockProfiler::getBucketUpperBound(int bucket)
+{
+    return FirstBucketNs << bucket;
+}
+
+void AdBlockProfiler::recordFilter(const QByteArray &rule, bool matched, qint64 elapsedNs)
+{
+    ThreadCounters &threadCounters = getThreadCounters();
+    QMutexLocker lock(&threadCounters.Mutex);
+    auto it = threadCounters.Filters.find(rule.constData());
+    if (it == threadCounters.Filters.end())
+        it = threadCounters.Filters.insert(rule.constData(), FilterCounters { rule, 0, 0, 0 });
+
+    FilterCounters &counters = it.value();
+    ++counters.Evaluations;
+    if (matched)
+        ++counters.Hits;
+    counters.TotalNs += static_cast<quint64>(elapsedNs);
+}
+
+void AdBlockProfiler::recordRequest(RequestPath path, qint64 elapsedNs)
+{
+    int bucket = 0;
+    while (bucket < NumBuckets - 1 && elapsedNs > getBucketUpperBound(bucket))
+        ++bucket;
+
+    AtomicHistogram &histogram = getHistogram(path);
+    histogram.Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.Requests.fetch_add(1, std::memory_order_relaxed);
+    histogram.TotalNs.fetch_add(static_cast<quint64>(elapsedNs), std::memory_order_relaxed);
+
+    quint64 maxNs = histogram.MaxNs.load(std::memory_order_relaxed);
+    while (static_cast<quint64>(elapsedNs) > maxNs
+           && !histogram.MaxNs.compare_exchange_weak(maxNs, static_cast<quint64>(elapsedNs), std::memory_order_relaxed))
+    {
+    }
+}
+
+std::vector<AdBlockProfiler::FilterProfile> AdBlockProfiler::getFilterProfiles() const
+{
+    // The counters of a rule may be spread across threads, and across copies of its filter
+    QHash<QByteArray, FilterCounters> filters;
+    {
+        QMutexLocker lock(&m_mutex);
+        for (const std::shared_ptr<ThreadCounters> &threadCounters : m_threads)
+        {
+            QMutexLocker threadLock(&threadCounters->Mutex);
+            for (const FilterCounters &counters : threadCounters->Filters)
+            {
+                FilterCounters &merged = filters[counters.Rule];
+                merged.Evaluations += counters.Evaluations;
+                merged.Hits += counters.Hits;
+                merged.TotalNs += counters.TotalNs;
+            }
+        }
+    }
+
+    std::vector<FilterProfile> profiles;
+    profiles.reserve(static_cast<size_t>(filters.size()));
+    for (auto it = filters.cbegin(); it != filters.cend(); ++it)
+    {
+        const FilterCounters &counters = it.value();
+        profiles.push_back(FilterProfile { QString::fromUtf8(it.key()), counters.Evaluations, counters.Hits, counters.TotalNs });
+    }
+
+    std::sort(profiles.begin(), profiles.end(), [](const FilterProfile &a, const FilterProfile &b) {
+        return a.TotalNs > b.TotalNs;
+    });
+    return profiles;
+}
+
+AdBlockProfiler::LatencyHistogram AdBlockProfiler::getRequestLatencies(RequestPath path) const
+{
+    const AtomicHistogram &histogram = getHistogram(path);
+
+    LatencyHistogram result;
+    for (int i = 0; i < NumBuckets; ++i)
+        result.Buckets[i] = histogram.Buckets[i].load(std::memory_order_relaxed);
+    result.Requests = histogram.Requests.load(std::memory_order_relaxed);
+    result.TotalNs = histogram.TotalNs.load(std::memory_order_relaxed);
+    result.MaxNs = histogram.MaxNs.load(std::memory_order_relaxed);
+    return result;
+}
+
+void AdBlockProfiler::reset()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        for (const std::shared_ptr<ThreadCounters> &threadCounters : m_threads)
+        {
+            QMutexLocker threadLock(&threadCounters->Mutex);
+            threadCounters->Filters.clear();
+        }
+    }
+
+    for (AtomicHistogram *histogram : { &m_evaluatedRequests, &m_cachedRequests })
+    {
+        for (std::atomic<quint64> &bucket : histogram->Buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        histogram->Requests.store(0, std::memory_order_relaxed);
+        histogram->TotalNs.store(0, std::memory_order_relaxed);
+        histogram->MaxNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+QByteArray AdBlockProfiler::toCsv() const
+{
+    // Rules may contain commas and quotes, so they are always quoted
+    auto quote = [](QString value) {
+        value.replace(QLatin1String("\""), QLatin1String("\"\""));
+        return QString("\"%1\"").arg(value);
+    };
+
+    QString csv = QLatin1String("rule,evaluations,hits,total_ns,mean_ns\n");
+    for (const FilterProfile &profile : getFilterProfiles())
+    {
+        const quint64 meanNs = profile.Evaluations > 0 ? profile.TotalNs / profile.Evaluations : 0;
+        csv.append(QString("%1,%2,%3,%4,%5\n").arg(quote(profile.Rule)).arg(profile.Evaluations).arg(profile.Hits)
+                   .arg(profile.TotalNs).arg(meanNs));
+    }
+    return csv.toUtf8();
+}
+
+QByteArray AdBlockProfiler::toJson() const
+{
+    QJsonArray filters;
+    for (const FilterProfile &profile : getFilterProfiles())
+    {
+        QJsonObject filter;
+        filter.insert(QLatin1String("rule"), profile.Rule);
+        filter.insert(QLatin1String("evaluations"), static_cast<double>(profile.Evaluations));
+        filter.insert(QLatin1String("hits"), static_cast<double>(profile.Hits));
+        filter.insert(QLatin1String("total_ns"), static_cast<double>(profile.TotalNs));
+        filter.insert(QLatin1String("mean_ns"), profile.Evaluations > 0 ? static_cast<double>(profile.TotalNs / profile.Evaluations) : 0.0);
+        filters.append(filter);
+    }
+
+    auto histogramToJson = [](const LatencyHistogram &histogram) {
+        QJsonArray buckets;
+        for (int i = 0; i < NumBuckets; ++i)
+        {
+            QJsonObject bucket;
+            bucket.insert(QLatin1String("upper_bound_ns"), i + 1 < NumBuckets ? QJsonValue(static_cast<double>(getBucketUpperBound(i))) : QJsonValue());
+            bucket.insert(QLatin1String("requests"), static_cast<double>(histogram.Buckets[i]));
+            buckets.append(bucket);
+        }
+
+        QJsonObject result;
+        result.insert(QLatin1String("requests"), static_cast<double>(histogram.Requests));
+        result.insert(QLatin1String("total_ns"), static_cast<double>(histogram.TotalNs));
+        result.insert(QLatin1String("max_ns"), static_cast<double>(histogram.MaxNs));
+        result.insert(QLatin1String("p50_ns"), static_cast<double>(histogram.getPercentile(50.0)));
+        result.insert(QLatin1String("p99_ns"), static_cast<double>(histogram.getPercentile(99.0)));
+        result.insert(QLatin1String("buckets"), buckets);
+        return result;
+    };
+
+    QJsonObject latencies;
+    latencies.insert(QLatin1String("evaluated"), histogramToJson(getRequestLatencies(RequestPath::Evaluated)));
+    latencies.insert(QLatin1String("cached"), histogramToJson(getRequestLatencies(RequestPath::Cached)));
+
+    QJsonObject root;
+    root.insert(QLatin1String("filters"), filters);
+    root.insert(QLatin1String("request_latency"), latencies);
+    return QJsonDocument(root).toJson();
+}
+
+AdBlockProfiler::AtomicHistogram &AdBlockProfiler::getHistogram(RequestPath path)
+{
+    return path == RequestPath::Cached ? m_cachedRequests : m_evaluatedRequests;
+}
+
+const AdBlockProfiler::AtomicHistogram &AdBlockProfiler::getHistogram(RequestPath path) const
+{
+    return path == RequestPath::Cached ? m_cachedRequests : m_evaluatedRequests;
+}
+
+AdBlockProfiler::ThreadCounters &AdBlockProfiler::getThreadCounters()
+{
+    thread_local std::shared_ptr<ThreadCounters> threadCounters;
+    if (!threadCounters)
+    {
+        threadCounters = std::make_shared<ThreadCounters>();
+        QMutexLocker lock(&m_mutex);
+        m_threads.push_back(threadCounters);
+    }
+    return *threadCounters;
+}
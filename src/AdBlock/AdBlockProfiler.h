@@ -0,0 +1,201 @@
+#ifndef ADBLOCKPROFILER_H
+#define ADBLOCKPROFILER_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @class AdBlockProfiler
+ * @ingroup AdBlock
+ * @brief Measures the cost of the network filters, so that filters which slow down every request can be found.
+ *
+ * When profiling is enabled, each evaluation of a filter against a request is counted and timed, along with
+ * whether the filter matched, and the total time taken to decide each request is added to a latency histogram.
+ * Filters are identified by their rule, so their counters carry over when the subscriptions are reloaded.
+ * Profiling is disabled by default, in which case the only cost to the filters is a check of \ref isEnabled.
+ *
+ * Each thread that evaluates filters accumulates its own counters, keyed by the address of the rule string
+ * of each filter, and the counters of every thread are merged by rule when they are read. Recording an
+ * evaluation therefore never waits for another thread that is evaluating filters.
+ *
+ * While profiling, the \ref AdBlockDecisionCache is bypassed, so every request is evaluated and counts towards the
+ * evaluations of the filters. Requests whose decision was found in the cache are also added to a histogram of
+ * their own, timed up to the lookup, which shows how long they take when answered by the cache.
+ */
+class AdBlockProfiler
+{
+public:
+    /// Number of buckets in a latency histogram
+    static constexpr int NumBuckets = 24;
+
+    /// Upper bound of the first bucket of a latency histogram, in nanoseconds. Each bucket after it is twice as wide
+    static constexpr qint64 FirstBucketNs = 250;
+
+    /// How the decision of a request was made
+    enum class RequestPath
+    {
+        /// The request was matched against the filters
+        Evaluated,
+
+        /// The decision was found in the decision cache. While profiling, the request is also evaluated
+        Cached
+    };
+
+    /// Counters of a single filter
+    struct FilterProfile
+    {
+        /// The rule of the filter
+        QString Rule;
+
+        /// Number of times the filter was evaluated against a request
+        quint64 Evaluations;
+
+        /// Number of evaluations in which the filter matched the request
+        quint64 Hits;
+
+        /// Total time spent evaluating the filter, in nanoseconds
+        quint64 TotalNs;
+    };
+
+    /// Distribution of the time taken to decide requests
+    struct LatencyHistogram
+    {
+        /// Number of requests in each bucket. The last bucket holds every request that is slower than the one before it
+        std::array<quint64, NumBuckets> Buckets;
+
+        /// Number of requests
+        quint64 Requests;
+
+        /// Total time of all requests, in nanoseconds
+        quint64 TotalNs;
+
+        /// Time of the slowest request, in nanoseconds
+        quint64 MaxNs;
+
+        /// Returns an estimate of the given percentile (0 to 100), as the upper bound of the bucket containing it
+        qint64 getPercentile(double percentile) const;
+    };
+
+    /// Returns the profiler instance
+    static AdBlockProfiler &instance();
+
+    /// Returns true if filters and requests are being profiled, false if else
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Enables or disables profiling. The counters collected so far are kept
+    static void setEnabled(bool value);
+
+    /// Returns the upper bound of the bucket at the given index, in nanoseconds
+    static qint64 getBucketUpperBound(int bucket);
+
+    /**
+     * @brief Records an evaluation of a filter
+     * @param rule The rule of the filter, encoded in UTF-8. Filters are expected to pass the same string on every call
+     * @param matched True if the filter matched the request, false if else
+     * @param elapsedNs Time taken to evaluate the filter, in nanoseconds
+     */
+    void recordFilter(const QByteArray &rule, bool matched, qint64 elapsedNs);
+
+    /// Records the total time taken to decide a request, in nanoseconds
+    void recordRequest(RequestPath path, qint64 elapsedNs);
+
+    /// Returns the counters of every filter that was evaluated, ordered from the most to the least total time
+    std::vector<FilterProfile> getFilterProfiles() const;
+
+    /// Returns the latency histogram of the requests that were decided through the given path
+    LatencyHistogram getRequestLatencies(RequestPath path) const;
+
+    /// Clears all of the counters and histograms
+    void reset();
+
+    /// Returns the filter counters as comma separated values, with a header row
+    QByteArray toCsv() const;
+
+    /// Returns the filter counters and request latency histograms as a JSON document
+    QByteArray toJson() const;
+
+private:
+    /// Constructs the profiler
+    AdBlockProfiler();
+
+    /// Counters of a filter, as they are accumulated
+    struct FilterCounters
+    {
+        /// The rule of the filter. Holding a reference to the rule string keeps its address from being reused by
+        /// another rule, while it is the key of these counters
+        QByteArray Rule;
+
+        /// Number of evaluations
+        quint64 Evaluations;
+
+        /// Number of matches
+        quint64 Hits;
+
+        /// Total evaluation time, in nanoseconds
+        quint64 TotalNs;
+    };
+
+    /// Filter counters accumulated by a single thread
+    struct ThreadCounters
+    {
+        /// Only contended while the counters are being read or reset
+        QMutex Mutex;
+
+        /// Counters of each filter evaluated by the thread, keyed by the address of its rule string
+        QHash<const char*, FilterCounters> Filters;
+    };
+
+    /// Latency histogram that requests are added to without a lock
+    struct AtomicHistogram
+    {
+        /// Number of requests in each bucket
+        std::array<std::atomic<quint64>, NumBuckets> Buckets;
+
+        /// Number of requests
+        std::atomic<quint64> Requests;
+
+        /// Total time of all requests, in nanoseconds
+        std::atomic<quint64> TotalNs;
+
+        /// Time of the slowest request, in nanoseconds
+        std::atomic<quint64> MaxNs;
+    };
+
+    /// Returns the histogram of the given request path
+    AtomicHistogram &getHistogram(RequestPath path);
+
+    /// Returns the histogram of the given request path
+    const AtomicHistogram &getHistogram(RequestPath path) const;
+
+    /// Returns the filter counters of the calling thread, registering them on the first call from the thread
+    ThreadCounters &getThreadCounters();
+
+private:
+    /// True if profiling is enabled
+    static std::atomic<bool> s_enabled;
+
+    /// Guards the list of thread counters
+    mutable QMutex m_mutex;
+
+    /// Filter counters of every thread that evaluated a filter. They are kept after their thread exits, so its counts are still reported
+    std::vector<std::shared_ptr<ThreadCounters>> m_threads;
+
+    /// Latencies of the requests that were matched against the filters
+    AtomicHistogram m_evaluatedRequests;
+
+    /// Latencies of the requests whose decision was cached
+    AtomicHistogram m_cachedRequests;
+};
+
+#endif // ADBLOCKPROFILER_H
@@ -0,0 +1,104 @@
+#include "AdBlockRequestContext.h"
+#include "AdBlockFilterIndex.h"
+#include "PublicSuffixList.h"
+
+namespace
+{
+    /// Returns a copy of the string with its ASCII letters in lower case. Unlike QByteArray::toLower,
+    /// bytes outside of the ASCII range are left unchanged, so that UTF-8 sequences stay intact
+    QByteArray toLowerAscii(const QByteArray &str)
+    {
+        QByteArray result = str;
+        char *data = result.data();
+        for (int i = 0; i < result.size(); ++i)
+        {
+            if (data[i] >= 'A' && data[i] <= 'Z')
+                data[i] += 32;
+        }
+        return result;
+    }
+}
+
+AdBlockRequestContext::AdBlockRequestContext() :
+    RequestUrl(),
+    RequestUrlLower(),
+    RequestHost(),
+    RequestHostBytes(),
+    RequestDomain(),
+    RequestSecondLevelDomain(),
+    RequestSecondLevelDomainBytes(),
+    FirstPartyHost(),
+    FirstPartyDomain(),
+    ThirdParty(false),
+    Type(ElementType::None),
+    Tokens(),
+    m_requestUrlString(),
+    m_requestUrlLowerString()
+{
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QUrl &requestUrl, const QUrl &firstPartyUrl, ElementType typeMask) :
+    RequestUrl(requestUrl.toEncoded(QUrl::FullyEncoded)),
+    RequestUrlLower(),
+    RequestHost(requestUrl.host().toLower()),
+    RequestHostBytes(RequestHost.toUtf8()),
+    RequestDomain(),
+    RequestSecondLevelDomain(),
+    RequestSecondLevelDomainBytes(),
+    FirstPartyHost(firstPartyUrl.host().toLower()),
+    FirstPartyDomain(),
+    ThirdParty(false),
+    Type(typeMask),
+    Tokens(),
+    m_requestUrlString(),
+    m_requestUrlLowerString()
+{
+    RequestUrlLower = toLowerAscii(RequestUrl);
+
+    const PublicSuffixList &publicSuffixList = PublicSuffixList::instance();
+    const QStringRef requestSite = publicSuffixList.getRegistrableDomain(RequestHost);
+    const QStringRef firstPartySite = publicSuffixList.getRegistrableDomain(FirstPartyHost);
+
+    RequestSecondLevelDomain = requestSite.toString();
+    RequestSecondLevelDomainBytes = RequestSecondLevelDomain.toUtf8();
+    FirstPartyDomain = firstPartySite.isNull() ? FirstPartyHost : firstPartySite.toString();
+
+    RequestDomain = RequestHost;
+    if (RequestDomain.startsWith(QLatin1String("www.")))
+        RequestDomain = RequestDomain.mid(4);
+    if (RequestDomain.isEmpty())
+        RequestDomain = RequestSecondLevelDomain;
+
+    // Hosts without a registrable domain, such as IP addresses, are only in the same party as themselves
+    const QStringRef requestParty = requestSite.isNull() ? QStringRef(&RequestHost) : requestSite;
+    const QStringRef firstParty = firstPartySite.isNull() ? QStringRef(&FirstPartyHost) : firstPartySite;
+    ThirdParty = firstPartyUrl.isEmpty() || requestParty != firstParty;
+
+    Tokens = AdBlockFilterIndex::tokenize(RequestUrlLower);
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QString &firstPartyDomain, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) :
+    RequestUrl(requestUrl.toUtf8()),
+    RequestUrlLower(toLowerAscii(RequestUrl)),
+    RequestHost(requestDomain),
+    RequestHostBytes(RequestHost.toUtf8()),
+    RequestDomain(requestDomain),
+    RequestSecondLevelDomain(PublicSuffixList::instance().getRegistrableDomain(requestDomain).toString()),
+    RequestSecondLevelDomainBytes(RequestSecondLevelDomain.toUtf8()),
+    FirstPartyHost(firstPartyDomain),
+    FirstPartyDomain(firstPartyDomain),
+    ThirdParty((typeMask & ElementType::ThirdParty) == ElementType::ThirdParty),
+    Type(typeMask),
+    Tokens(),
+    m_requestUrlString(),
+    m_requestUrlLowerString()
+{
+}
+
+const QString &AdBlockRequestContext::getRequestUrlString(bool matchCase) const
+{
+    QString &urlString = matchCase ? m_requestUrlString : m_requestUrlLowerString;
+    if (urlString.isNull())
+        urlString = QString::fromUtf8(matchCase ? RequestUrl : RequestUrlLower);
+    return urlString;
+}
@@ -0,0 +1,95 @@
+#ifndef ADBLOCKREQUESTCONTEXT_H
+#define ADBLOCKREQUESTCONTEXT_H
+
+#include "AdBlockFilter.h"
+
+#include <vector>
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+
+/**
+ * @struct AdBlockRequestContext
+ * @ingroup AdBlock
+ * @brief Properties of a network request that filters are evaluated against. The context is built
+ *        once per request, so that the URL strings, domains and tokens of the request are not
+ *        recomputed by every filter that checks it.
+ *
+ * The request URL is kept as the bytes of its fully encoded form, which is pure ASCII. Filters are
+ * matched against those bytes directly, instead of a UTF-16 string of twice the size.
+ */
+struct AdBlockRequestContext
+{
+    /// Constructs an empty request context
+    AdBlockRequestContext();
+
+    /**
+     * @brief Constructs the context of a network request
+     * @param requestUrl URL of the actual network request
+     * @param firstPartyUrl URL of the page that made the request
+     * @param typeMask Element type(s) associated with the request
+     */
+    AdBlockRequestContext(const QUrl &requestUrl, const QUrl &firstPartyUrl, ElementType typeMask = ElementType::None);
+
+    /**
+     * @brief Constructs a context from request strings that were computed elsewhere. The tokens of the request are not computed
+     * @param firstPartyDomain Domain of the page that made the request
+     * @param requestUrl URL of the actual network request. Characters outside of the ASCII range are matched in their UTF-8 form
+     * @param requestDomain Domain of the request URL
+     * @param typeMask Element type(s) associated with the request
+     */
+    AdBlockRequestContext(const QString &firstPartyDomain, const QString &requestUrl, const QString &requestDomain, ElementType typeMask);
+
+    /// Fully encoded request URL, in its original letter case
+    QByteArray RequestUrl;
+
+    /// Fully encoded request URL, with its ASCII letters in lower case
+    QByteArray RequestUrlLower;
+
+    /// Host of the request URL, in lower case
+    QString RequestHost;
+
+    /// UTF-8 bytes of \ref RequestHost, which Domain filters are matched against
+    QByteArray RequestHostBytes;
+
+    /// Host of the request URL without any leading "www."
+    QString RequestDomain;
+
+    /// Second-level domain of the request URL (ex: example.com; example.co.uk)
+    QString RequestSecondLevelDomain;
+
+    /// UTF-8 bytes of \ref RequestSecondLevelDomain, for the filters that are matched against the request URL bytes
+    QByteArray RequestSecondLevelDomainBytes;
+
+    /// Host of the first party URL, in lower case
+    QString FirstPartyHost;
+
+    /// Second-level domain of the first party URL, or its host if no second-level domain could be determined
+    QString FirstPartyDomain;
+
+    /// True if the request belongs to a different second-level domain than the first party URL
+    bool ThirdParty;
+
+    /// Element type(s) associated with the request
+    ElementType Type;
+
+    /// Sorted, unique token hashes of the lower case request URL, as returned by \ref AdBlockFilterIndex::tokenize
+    std::vector<quint32> Tokens;
+
+    /**
+     * @brief Returns the request URL as a string, for the regular expression filters that could not be compiled.
+     *        The string is converted when first needed and kept for the other filters that check the request,
+     *        so a context must not be shared between threads while filters are evaluated against it
+     * @param matchCase Whether to return the URL in its original letter case, or with its ASCII letters in lower case
+     */
+    const QString &getRequestUrlString(bool matchCase) const;
+
+private:
+    /// \ref RequestUrl as a string, converted by \ref getRequestUrlString
+    mutable QString m_requestUrlString;
+
+    /// \ref RequestUrlLower as a string, converted by \ref getRequestUrlString
+    mutable QString m_requestUrlLowerString;
+};
+
+#endif // ADBLOCKREQUESTCONTEXT_H
@@ -0,0 +1,141 @@
+#include "AdBlockSelectorIndex.h"
+
+#include <QSet>
+
+AdBlockSelectorIndex::AdBlockSelectorIndex() :
+    m_selectors(),
+    m_numSelectors(0)
+{
+}
+
+bool AdBlockSelectorIndex::insert(const QString &selector)
+{
+    const QString key = getSelectorKey(selector);
+    if (key.isEmpty())
+        return false;
+
+    m_selectors[key].push_back(selector);
+    ++m_numSelectors;
+    return true;
+}
+
+void AdBlockSelectorIndex::clear()
+{
+    m_selectors.clear();
+    m_numSelectors = 0;
+}
+
+bool AdBlockSelectorIndex::empty() const
+{
+    return m_numSelectors == 0;
+}
+
+int AdBlockSelectorIndex::size() const
+{
+    return m_numSelectors;
+}
+
+QString AdBlockSelectorIndex::getStylesheet(const QStringList &classes, const QStringList &ids) const
+{
+    QString stylesheet;
+    if (m_numSelectors == 0)
+        return stylesheet;
+
+    QSet<QString> visitedKeys;
+    int numStylesheetRules = 0;
+
+    auto appendSelectors = [&](const QString &key) {
+        if (visitedKeys.contains(key))
+            return;
+        visitedKeys.insert(key);
+
+        auto it = m_selectors.find(key);
+        if (it == m_selectors.end())
+            return;
+
+        for (const QString &selector : it.value())
+        {
+            if (numStylesheetRules > 1000)
+            {
+                stylesheet = stylesheet.left(stylesheet.size() - 1);
+                stylesheet.append(QLatin1String("{ display: none !important; } "));
+                numStylesheetRules = 0;
+            }
+
+            stylesheet.append(selector + QChar(','));
+            ++numStylesheetRules;
+        }
+    };
+
+    for (const QString &className : classes)
+        appendSelectors(QChar('.') + className);
+    for (const QString &id : ids)
+        appendSelectors(QChar('#') + id);
+
+    if (numStylesheetRules > 0)
+    {
+        stylesheet = stylesheet.left(stylesheet.size() - 1);
+        stylesheet.append(QLatin1String("{ display: none !important; } "));
+    }
+
+    return stylesheet;
+}
+
+QString AdBlockSelectorIndex::getSelectorKey(const QString &selector)
+{
+    auto isNameChar = [](QChar c) {
+        const ushort u = c.unicode();
+        return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '-' || u == '_' || u >= 0x80;
+    };
+
+    QString key;
+    QChar quote;
+    int depth = 0;
+
+    const int length = selector.size();
+    for (int i = 0; i < length; ++i)
+    {
+        const QChar c = selector.at(i);
+
+        // Skip over strings, attribute selectors and the arguments of pseudo-classes such as :not(.name)
+        if (!quote.isNull())
+        {
+            if (c == QChar('\\'))
+                ++i;
+            else if (c == quote)
+                quote = QChar();
+            continue;
+        }
+
+        const ushort u = c.unicode();
+        if (u == '"' || u == '\'')
+            quote = c;
+        else if (u == '[' || u == '(')
+            ++depth;
+        else if (u == ']' || u == ')')
+            --depth;
+        else if (depth == 0)
+        {
+            // Any selector of a list could match an element on its own
+            if (u == ',')
+                return QString();
+
+            // Escaped characters are not handled, so a selector containing them outside of a string is not indexed
+            if (u == '\\')
+                return QString();
+
+            if ((u == '.' || u == '#') && key.isEmpty())
+            {
+                int end = i + 1;
+                while (end < length && isNameChar(selector.at(end)))
+                    ++end;
+
+                if (end > i + 1 && (end == length || selector.at(end) != QChar('\\')))
+                    key = selector.mid(i, end - i);
+                i = end - 1;
+            }
+        }
+    }
+
+    return key;
+}
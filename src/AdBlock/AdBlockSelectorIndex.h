@@ -0,0 +1,63 @@
+#ifndef ADBLOCKSELECTORINDEX_H
+#define ADBLOCKSELECTORINDEX_H
+
+#include <vector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @class AdBlockSelectorIndex
+ * @ingroup AdBlock
+ * @brief Stores the selectors of generic element hiding filters under the class or id that an element must have
+ *        for the selector to match it. Instead of applying every generic selector to every page, a page reports the
+ *        classes and ids of its elements, and only the selectors stored under those are injected into the page.
+ */
+class AdBlockSelectorIndex
+{
+public:
+    /// Constructs an empty selector index
+    AdBlockSelectorIndex();
+
+    /**
+     * @brief Stores the selector under the class or id that it requires
+     * @param selector CSS selector of a generic element hiding filter
+     * @return True if the selector was stored, false if it does not require any class or id. Such selectors
+     *         must be applied to every page
+     */
+    bool insert(const QString &selector);
+
+    /// Removes all selectors from the index
+    void clear();
+
+    /// Returns true if the index does not contain any selectors, false if else
+    bool empty() const;
+
+    /// Returns the number of selectors in the index
+    int size() const;
+
+    /**
+     * @brief Returns a stylesheet that hides the elements matched by the selectors stored under the given classes and ids
+     * @param classes Class names found in a page
+     * @param ids Element ids found in a page
+     * @return Stylesheet rules, or an empty string if no selector is stored under any of the classes or ids
+     */
+    QString getStylesheet(const QStringList &classes, const QStringList &ids) const;
+
+    /**
+     * @brief Determines the class or id that any element matched by the selector must have
+     * @param selector CSS selector
+     * @return The class name prefixed by '.', or the id prefixed by '#'. Returns an empty string if the selector
+     *         does not require a class or id, or if it is a list of selectors
+     */
+    static QString getSelectorKey(const QString &selector);
+
+private:
+    /// Selectors, keyed by the class (".name") or id ("#name") that they require
+    QHash<QString, std::vector<QString>> m_selectors;
+
+    /// Number of selectors in the index
+    int m_numSelectors;
+};
+
+#endif // ADBLOCKSELECTORINDEX_H
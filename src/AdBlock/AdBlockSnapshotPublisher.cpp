@@ -0,0 +1,66 @@
+#include "AdBlockSnapshotPublisher.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+AdBlockSnapshotPublisher::Reader::Reader(std::atomic<quint64> *readerCount, const AdBlockFilterSnapshot *snapshot) :
+    m_readerCount(readerCount),
+    m_snapshot(snapshot)
+{
+}
+
+AdBlockSnapshotPublisher::Reader::Reader(Reader &&other) :
+    m_readerCount(other.m_readerCount),
+    m_snapshot(other.m_snapshot)
+{
+    other.m_readerCount = nullptr;
+}
+
+AdBlockSnapshotPublisher::Reader::~Reader()
+{
+    if (m_readerCount != nullptr)
+        m_readerCount->fetch_sub(1, std::memory_order_release);
+}
+
+AdBlockSnapshotPublisher::AdBlockSnapshotPublisher(std::shared_ptr<const AdBlockFilterSnapshot> snapshot) :
+    m_publishMutex(),
+    m_owner(std::move(snapshot)),
+    m_current(m_owner.get()),
+    m_epoch(0),
+    m_readerCounts()
+{
+    for (std::atomic<quint64> &readerCount : m_readerCounts)
+        readerCount.store(0);
+}
+
+AdBlockSnapshotPublisher::Reader AdBlockSnapshotPublisher::read() const
+{
+    // The reader is registered before the snapshot is loaded. A publisher that finds the counter empty has already
+    // swapped the pointer, so a reader registered after that check can only load the new snapshot
+    std::atomic<quint64> *readerCount = &m_readerCounts[m_epoch.load() & 1];
+    readerCount->fetch_add(1);
+    return Reader(readerCount, m_current.load());
+}
+
+bool AdBlockSnapshotPublisher::publish(std::shared_ptr<const AdBlockFilterSnapshot> snapshot)
+{
+    QMutexLocker lock(&m_publishMutex);
+    if (snapshot->getGeneration() < m_owner->getGeneration())
+        return false;
+
+    std::shared_ptr<const AdBlockFilterSnapshot> previous = std::move(m_owner);
+    m_owner = std::move(snapshot);
+    m_current.store(m_owner.get());
+
+    // A reader may have read the epoch before the first flip and registered after it, so both counters must drain
+    // before every reader of the previous snapshot is known to have left
+    for (int i = 0; i < 2; ++i)
+    {
+        std::atomic<quint64> &readerCount = m_readerCounts[m_epoch.fetch_add(1) & 1];
+        while (readerCount.load(std::memory_order_acquire) != 0)
+            QThread::yieldCurrentThread();
+    }
+
+    // The previous snapshot is released here, unless another owner still holds it
+    return true;
+}
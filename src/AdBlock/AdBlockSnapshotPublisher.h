@@ -0,0 +1,102 @@
+#ifndef ADBLOCKSNAPSHOTPUBLISHER_H
+#define ADBLOCKSNAPSHOTPUBLISHER_H
+
+#include "AdBlockFilterSnapshot.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <QMutex>
+
+/**
+ * @class AdBlockSnapshotPublisher
+ * @ingroup AdBlock
+ * @brief Holds the current \ref AdBlockFilterSnapshot, which is read by the request interceptor on the IO
+ *        thread while new snapshots are published from other threads.
+ *
+ * Reading the snapshot is wait-free: a reader registers itself in one of two reader counters, selected by the
+ * current epoch, and loads a raw pointer to the snapshot. Publishing a snapshot swaps the pointer, then flips
+ * the epoch twice, each time waiting for the readers registered under the previous epoch to leave. Once both
+ * counters have drained, no reader can still be using the replaced snapshot, and it is released. Only the
+ * publishing thread ever waits, and only for the readers that were matching a request at the time.
+ */
+class AdBlockSnapshotPublisher
+{
+public:
+    /**
+     * @class Reader
+     * @brief Keeps the snapshot that was current when it was created alive until it is destroyed. A reader
+     *        must not be held while publishing a snapshot from the same thread, or the publish never returns
+     */
+    class Reader
+    {
+    public:
+        /// Move constructor
+        Reader(Reader &&other);
+
+        /// Copy constructor (forbid)
+        Reader(const Reader &other) = delete;
+
+        /// Copy assignment operator (forbid)
+        Reader &operator =(const Reader &other) = delete;
+
+        /// Leaves the read-side section, allowing the snapshot to be released once it has been replaced
+        ~Reader();
+
+        /// Returns the pinned snapshot
+        const AdBlockFilterSnapshot *operator->() const { return m_snapshot; }
+
+        /// Returns the pinned snapshot
+        const AdBlockFilterSnapshot &operator*() const { return *m_snapshot; }
+
+    private:
+        friend class AdBlockSnapshotPublisher;
+
+        /// Constructs a reader registered under the given reader counter
+        Reader(std::atomic<quint64> *readerCount, const AdBlockFilterSnapshot *snapshot);
+
+        /// Reader counter that the reader is registered under, or a nullptr once it has been moved from
+        std::atomic<quint64> *m_readerCount;
+
+        /// The pinned snapshot
+        const AdBlockFilterSnapshot *m_snapshot;
+    };
+
+    /// Constructs the publisher with the given initial snapshot
+    explicit AdBlockSnapshotPublisher(std::shared_ptr<const AdBlockFilterSnapshot> snapshot);
+
+    /// Copy constructor (forbid)
+    AdBlockSnapshotPublisher(const AdBlockSnapshotPublisher &other) = delete;
+
+    /// Copy assignment operator (forbid)
+    AdBlockSnapshotPublisher &operator =(const AdBlockSnapshotPublisher &other) = delete;
+
+    /// Pins and returns the current snapshot. Never blocks
+    Reader read() const;
+
+    /**
+     * @brief Replaces the current snapshot, unless the given one is older. Snapshots may be built on several threads
+     *        at once, and a build that finishes late must not replace the filters of a build that started after it
+     * @param snapshot The new snapshot
+     * @return True if the snapshot was published, false if a newer snapshot is already current
+     */
+    bool publish(std::shared_ptr<const AdBlockFilterSnapshot> snapshot);
+
+private:
+    /// Guards the owner of the current snapshot, and serializes publishers
+    QMutex m_publishMutex;
+
+    /// Owner of the current snapshot
+    std::shared_ptr<const AdBlockFilterSnapshot> m_owner;
+
+    /// The current snapshot, read without a lock
+    std::atomic<const AdBlockFilterSnapshot*> m_current;
+
+    /// Incremented twice by each publish. Its lowest bit selects the counter that new readers are registered under
+    mutable std::atomic<quint64> m_epoch;
+
+    /// Number of readers registered under each parity of the epoch
+    mutable std::array<std::atomic<quint64>, 2> m_readerCounts;
+};
+
+#endif // ADBLOCKSNAPSHOTPUBLISHER_H
@@ -1,11 +1,306 @@
 #include "AdBlockSubscription.h"
+#include "AdBlockFilterCache.h"
 #include "AdBlockFilterParser.h"
 
+#include <algorithm>
+#include <numeric>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QStringList>
 #include <QTextStream>
+#include <QtConcurrent>
 #include <QDebug>
 
+namespace
+{
+    /// Every property used to match a filter, so that filters which match the same requests can be found in a hash table
+    struct FilterKey
+    {
+        FilterCategory Category;
+        quint8 Options;
+        ElementType AllowedTypes;
+        ElementType BlockedTypes;
+        QString OptionValue;
+        QVector<QString> DomainBlacklist;
+        QVector<QString> DomainWhitelist;
+        QString EvalString;
+
+        bool operator==(const FilterKey &other) const
+        {
+            return Category == other.Category
+                    && Options == other.Options
+                    && AllowedTypes == other.AllowedTypes
+                    && BlockedTypes == other.BlockedTypes
+                    && OptionValue == other.OptionValue
+                    && DomainBlacklist == other.DomainBlacklist
+                    && DomainWhitelist == other.DomainWhitelist
+                    && EvalString == other.EvalString;
+        }
+    };
+
+    uint qHash(const FilterKey &key, uint seed = 0)
+    {
+        auto combine = [&seed](uint hash) {
+            seed ^= hash + 0x9e3779b9U + (seed << 6) + (seed >> 2);
+        };
+
+        combine(::qHash(static_cast<int>(key.Category)));
+        combine(::qHash(key.Options));
+        combine(::qHash(static_cast<quint64>(key.AllowedTypes)));
+        combine(::qHash(static_cast<quint64>(key.BlockedTypes)));
+        combine(::qHash(key.OptionValue));
+        combine(::qHashRange(key.DomainBlacklist.cbegin(), key.DomainBlacklist.cend()));
+        combine(::qHashRange(key.DomainWhitelist.cbegin(), key.DomainWhitelist.cend()));
+        combine(::qHash(key.EvalString));
+        return seed;
+    }
+}
+
+AdBlockFilterSlice AdBlockFilterSlice::fromFilters(const AdBlockFilterList &filters)
+{
+    AdBlockFilterSlice slice;
+
+    for (const std::unique_ptr<AdBlockFilter> &filterPtr : filters)
+    {
+        AdBlockFilter *filter = filterPtr.get();
+        if (!filter)
+            continue;
+
+        if (filter->getCategory() == FilterCategory::Stylesheet)
+        {
+            if (filter->isException())
+                slice.StylesheetExceptions.insert(filter->getEvalString(), filter);
+            else
+                slice.StylesheetFilters.insert(filter->getEvalString(), filter);
+        }
+        else if (filter->getCategory() == FilterCategory::StylesheetJS)
+        {
+            slice.DomainJSFilters.push_back(filter);
+        }
+        else if (filter->getCategory() == FilterCategory::StylesheetCustom)
+        {
+            slice.CustomStyleFilters.push_back(filter);
+        }
+        else if (filter->isBadFilter())
+        {
+            slice.BadFilters.insert(filter->getRule());
+        }
+        else if (filter->hasElementType(filter->m_blockedTypes, ElementType::CSP))
+        {
+            if (!filter->hasElementType(filter->m_blockedTypes, ElementType::PopUp)) // Temporary workaround for issues with popup types
+                slice.CSPFilters.push_back(filter);
+        }
+        else
+        {
+            if (filter->hasElementType(filter->m_blockedTypes, ElementType::InlineScript))
+                slice.HasScriptRules = true;
+
+            if (filter->isException())
+            {
+                if (filter->hasElementType(filter->m_blockedTypes, ElementType::Document)
+                        || filter->hasElementType(filter->m_blockedTypes, ElementType::ElemHide)
+                        || filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
+                    slice.PageExceptionFilters.push_back(filter);
+                else if (filter->getCategory() == FilterCategory::Domain)
+                    slice.AllowFiltersByDomain.push_back(filter);
+                else
+                    slice.AllowFilters.push_back(filter);
+            }
+            else if (filter->isImportant())
+            {
+                if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
+                    slice.BadHideFilters.insert(filter->getRule());
+                else
+                    slice.ImportantBlockFilters.push_back(filter);
+            }
+            else if (filter->getCategory() == FilterCategory::StringContains)
+            {
+                slice.BlockFiltersByPattern.push_back(filter);
+            }
+            else if (filter->getCategory() == FilterCategory::Domain)
+            {
+                slice.BlockFiltersByDomain.push_back(filter);
+            }
+            else
+            {
+                slice.BlockFilters.push_back(filter);
+            }
+        }
+    }
+
+    slice.HasStylesheetRules = !slice.StylesheetFilters.isEmpty() || !slice.StylesheetExceptions.isEmpty() || !slice.CustomStyleFilters.empty();
+    slice.HasScriptRules = slice.HasScriptRules || !slice.DomainJSFilters.empty() || !slice.CSPFilters.empty() || !slice.BadFilters.isEmpty();
+
+    return slice;
+}
+
+void AdBlockFilterSlice::append(const AdBlockFilterSlice &other)
+{
+    auto appendFilters = [](std::vector<AdBlockFilter*> &container, const std::vector<AdBlockFilter*> &filters) {
+        container.insert(container.end(), filters.begin(), filters.end());
+    };
+    appendFilters(ImportantBlockFilters, other.ImportantBlockFilters);
+    appendFilters(BlockFilters, other.BlockFilters);
+    appendFilters(BlockFiltersByPattern, other.BlockFiltersByPattern);
+    appendFilters(BlockFiltersByDomain, other.BlockFiltersByDomain);
+    appendFilters(AllowFilters, other.AllowFilters);
+    appendFilters(AllowFiltersByDomain, other.AllowFiltersByDomain);
+    appendFilters(DomainJSFilters, other.DomainJSFilters);
+    appendFilters(CustomStyleFilters, other.CustomStyleFilters);
+    appendFilters(PageExceptionFilters, other.PageExceptionFilters);
+    appendFilters(CSPFilters, other.CSPFilters);
+
+    for (auto it = other.StylesheetFilters.cbegin(); it != other.StylesheetFilters.cend(); ++it)
+        StylesheetFilters.insert(it.key(), it.value());
+    for (auto it = other.StylesheetExceptions.cbegin(); it != other.StylesheetExceptions.cend(); ++it)
+        StylesheetExceptions.insert(it.key(), it.value());
+
+    BadFilters.unite(other.BadFilters);
+    BadHideFilters.unite(other.BadHideFilters);
+
+    HasStylesheetRules = HasStylesheetRules || other.HasStylesheetRules;
+    HasScriptRules = HasScriptRules || other.HasScriptRules;
+}
+
+AdBlockFilterSlice::OptimizationStatistics AdBlockFilterSlice::optimize(AdBlockFilterList &mergedFilters)
+{
+    OptimizationStatistics statistics { 0, 0, 0, 0 };
+
+    // Element types that can be combined. A filter blocking any of them only matches requests of those types,
+    // so a filter with the types of two filters matches exactly the requests that either of them matched
+    const ElementType mergeableTypes = ElementType::Script | ElementType::Image | ElementType::Stylesheet | ElementType::Object
+            | ElementType::XMLHTTPRequest | ElementType::ObjectSubrequest | ElementType::Subdocument | ElementType::Ping
+            | ElementType::WebSocket | ElementType::Other;
+
+    // Returns a key made of every property used to match the filter, with the given blocked types and evaluation string
+    auto getFilterKey = [](const AdBlockFilter *filter, ElementType blockedTypes, const QString &evalString) {
+        return FilterKey { filter->m_category, filter->m_options, filter->m_allowedTypes, blockedTypes, filter->m_optionValue,
+                           filter->m_domainBlacklist, filter->m_domainWhitelist, evalString };
+    };
+
+    auto hasSameAction = [](const AdBlockFilter *a, const AdBlockFilter *b) {
+        return a->isException() == b->isException()
+                && a->isRedirect() == b->isRedirect()
+                && a->getRedirectName() == b->getRedirectName();
+    };
+
+    auto removeDisabledFilters = [&](std::vector<AdBlockFilter*> &container, bool isPageExceptions) {
+        if (BadFilters.isEmpty() && (!isPageExceptions || BadHideFilters.isEmpty()))
+            return;
+
+        const std::size_t size = container.size();
+        container.erase(std::remove_if(container.begin(), container.end(), [&](AdBlockFilter *filter) {
+            const QString rule = filter->getRule();
+            return BadFilters.contains(rule) || (isPageExceptions && BadHideFilters.contains(rule));
+        }), container.end());
+        statistics.BadFilters += size - container.size();
+    };
+
+    // Copies of a filter match the same requests and take the same action. The index and the domain trie return the
+    // match found first in list order, so a later copy is never the filter that decides a request
+    auto removeDuplicates = [&](std::vector<AdBlockFilter*> &container) {
+        QSet<FilterKey> keys;
+        const std::size_t size = container.size();
+        container.erase(std::remove_if(container.begin(), container.end(), [&](AdBlockFilter *filter) {
+            const FilterKey key = getFilterKey(filter, filter->m_blockedTypes, filter->getEvalString());
+            if (keys.contains(key))
+                return true;
+            keys.insert(key);
+            return false;
+        }), container.end());
+        statistics.Duplicates += size - container.size();
+    };
+
+    // Domain filters are found by walking the labels of the request host from its top-level domain down, so a filter
+    // of a parent domain is always checked before the filter of a subdomain. With the same options and action, the
+    // parent filter matches every request the subdomain filter does, so the latter never decides a request, whatever
+    // the other filters of the container. Entity domains (example.*) are left alone
+    auto removeSubsumedDomains = [&](std::vector<AdBlockFilter*> &container) {
+        QHash<FilterKey, QSet<QString>> domainsByOptions;
+        for (AdBlockFilter *filter : container)
+            domainsByOptions[getFilterKey(filter, filter->m_blockedTypes, QString())].insert(filter->getEvalString().toLower());
+
+        const std::size_t size = container.size();
+        container.erase(std::remove_if(container.begin(), container.end(), [&](AdBlockFilter *filter) {
+            const QString domain = filter->getEvalString().toLower();
+            if (domain.endsWith(QChar('.')))
+                return false;
+
+            const QSet<QString> &domains = domainsByOptions[getFilterKey(filter, filter->m_blockedTypes, QString())];
+            for (int pos = domain.indexOf(QChar('.')); pos >= 0; pos = domain.indexOf(QChar('.'), pos + 1))
+            {
+                if (domains.contains(domain.mid(pos + 1)))
+                    return true;
+            }
+            return false;
+        }), container.end());
+        statistics.Subsumed += size - container.size();
+    };
+
+    // The combined filter takes the place of the first of its filters, where it is checked before the filters that
+    // used to come between them. This only leaves the outcome of requests unchanged if those filters take the same action,
+    // which is checked by the caller. The combined filter keeps the rule of its first filter, which is the one logged
+    auto mergeElementTypes = [&](std::vector<AdBlockFilter*> &container) {
+        QHash<FilterKey, std::size_t> firstIndices;
+        std::vector<bool> isCombined(container.size(), false);
+        std::size_t numKept = 0;
+        for (std::size_t i = 0; i < container.size(); ++i)
+        {
+            AdBlockFilter *filter = container[i];
+            const ElementType types = filter->m_blockedTypes & mergeableTypes;
+            if (types != ElementType::None)
+            {
+                const FilterKey key = getFilterKey(filter, filter->m_blockedTypes & ~mergeableTypes, filter->getEvalString());
+                auto it = firstIndices.find(key);
+                if (it != firstIndices.end())
+                {
+                    // The filters of the subscriptions are shared with later rebuilds, so they are combined into a copy
+                    const std::size_t firstIndex = it.value();
+                    if (!isCombined[firstIndex])
+                    {
+                        mergedFilters.push_back(std::make_unique<AdBlockFilter>(*container[firstIndex]));
+                        container[firstIndex] = mergedFilters.back().get();
+                        isCombined[firstIndex] = true;
+                    }
+
+                    container[firstIndex]->m_blockedTypes |= types;
+                    ++statistics.Merged;
+                    continue;
+                }
+                firstIndices.insert(key, numKept);
+            }
+
+            container[numKept++] = filter;
+        }
+        container.resize(numKept);
+    };
+
+    for (std::vector<AdBlockFilter*> *container : { &ImportantBlockFilters, &BlockFilters, &BlockFiltersByPattern, &BlockFiltersByDomain,
+                                                     &AllowFilters, &AllowFiltersByDomain })
+    {
+        removeDisabledFilters(*container, false);
+        removeDuplicates(*container);
+        if (container == &BlockFiltersByDomain || container == &AllowFiltersByDomain)
+            removeSubsumedDomains(*container);
+
+        // Merging moves a filter ahead of the filters between it and the filter it is combined with. In containers that
+        // mix filters taking different actions, such as blocking and redirecting filters, one of those could stop deciding
+        // the requests it used to
+        if (std::all_of(container->begin(), container->end(), [container, &hasSameAction](AdBlockFilter *filter) {
+                return hasSameAction(container->front(), filter);
+            }))
+            mergeElementTypes(*container);
+    }
+
+    removeDisabledFilters(PageExceptionFilters, true);
+    removeDisabledFilters(CSPFilters, false);
+    for (std::vector<AdBlockFilter*> *container : { &PageExceptionFilters, &CSPFilters, &DomainJSFilters, &CustomStyleFilters })
+        removeDuplicates(*container);
+
+    return statistics;
+}
+
 AdBlockSubscription::AdBlockSubscription() :
     m_enabled(true),
     m_filePath(),
@@ -13,7 +308,10 @@ AdBlockSubscription::AdBlockSubscription() :
     m_sourceUrl(),
     m_lastUpdate(),
     m_nextUpdate(),
-    m_filters()
+    m_filters(std::make_shared<AdBlockFilterList>()),
+    m_slice(),
+    m_loadedFileTime(),
+    m_loadedFileSize(0)
 {
 }
 
@@ -24,7 +322,10 @@ AdBlockSubscription::AdBlockSubscription(const QString &dataFile) :
     m_sourceUrl(),
     m_lastUpdate(),
     m_nextUpdate(),
-    m_filters()
+    m_filters(std::make_shared<AdBlockFilterList>()),
+    m_slice(),
+    m_loadedFileTime(),
+    m_loadedFileSize(0)
 {
 }
 
@@ -35,7 +336,10 @@ AdBlockSubscription::AdBlockSubscription(AdBlockSubscription &&other) :
     m_sourceUrl(other.m_sourceUrl),
     m_lastUpdate(other.m_lastUpdate),
     m_nextUpdate(other.m_nextUpdate),
-    m_filters(std::move(other.m_filters))
+    m_filters(std::move(other.m_filters)),
+    m_slice(std::move(other.m_slice)),
+    m_loadedFileTime(other.m_loadedFileTime),
+    m_loadedFileSize(other.m_loadedFileSize)
 {
 }
 
@@ -68,6 +372,9 @@ AdBlockSubscription &AdBlockSubscription::operator =(AdBlockSubscription &&other
         m_lastUpdate = other.m_lastUpdate;
         m_nextUpdate = other.m_nextUpdate;
         m_filters = std::move(other.m_filters);
+        m_slice = std::move(other.m_slice);
+        m_loadedFileTime = other.m_loadedFileTime;
+        m_loadedFileSize = other.m_loadedFileSize;
     }
 
     return *this;
@@ -107,19 +414,53 @@ const QDateTime &AdBlockSubscription::getNextUpdate() const
     return m_nextUpdate;
 }
 
-void AdBlockSubscription::load()
+void AdBlockSubscription::load(const QString &cacheDir, const QHash<QString, QString> &resources)
 {
     if (!m_enabled || m_filePath.isEmpty())
         return;
 
+    LoadedFilters loaded = readFilters(m_filePath, cacheDir, resources);
+    if (loaded.Loaded)
+        setLoadedFilters(std::move(loaded));
+}
+
+AdBlockSubscription::LoadedFilters AdBlockSubscription::readFilters(const QString &filePath, const QString &cacheDir,
+                                                                   const QHash<QString, QString> &resources, bool cachedOnly)
+{
+    LoadedFilters loaded { false, std::make_shared<AdBlockFilterList>(), AdBlockFilterSlice(), QDateTime(), 0, QString(), 0 };
+
     // Load subscription file
-    QFile subFile(m_filePath);
+    QFile subFile(filePath);
     if (!subFile.exists() || !subFile.open(QIODevice::ReadOnly))
-        return;
+        return loaded;
 
-    m_filters.clear();
+    loaded.Loaded = true;
 
-    AdBlockFilterParser parser;
+    QFileInfo fileInfo(subFile);
+    loaded.FileTime = fileInfo.lastModified();
+    loaded.FileSize = fileInfo.size();
+
+    // Skip the parser if the filters of this version of the file are already cached
+    std::unique_ptr<AdBlockFilterCache> cache = nullptr;
+    if (!cacheDir.isEmpty())
+    {
+        cache = std::make_unique<AdBlockFilterCache>(cacheDir, filePath, AdBlockFilterCache::getResourceKey(resources));
+        if (cache->load(loaded.Title, loaded.ExpireDays, *loaded.Filters))
+        {
+            loaded.Slice = AdBlockFilterSlice::fromFilters(*loaded.Filters);
+            return loaded;
+        }
+        loaded.Filters->clear();
+    }
+
+    if (cachedOnly)
+    {
+        loaded.Loaded = false;
+        return loaded;
+    }
+
+    // Collect the filter rules, handling any metadata as it is found
+    QStringList rules;
 
     QString line;
     QTextStream stream(&subFile);
@@ -129,11 +470,11 @@ void AdBlockSubscription::load()
         if (line.startsWith(QChar('!')))
         {
             // Subscription name
-            if (m_name.isEmpty())
+            if (loaded.Title.isEmpty())
             {
                 int titleIdx = line.indexOf(QStringLiteral("Title:"));
                 if (titleIdx > 0)
-                    m_name = line.mid(titleIdx + 7);
+                    loaded.Title = line.mid(titleIdx + 7);
             }
 
             // Check for next update
@@ -147,9 +488,7 @@ void AdBlockSubscription::load()
                 if (!ok || numDays == 0)
                     continue;
 
-                // Add the number of days to the last update and set as next update
-                QDateTime updateDate = getLastUpdate();
-                m_nextUpdate = updateDate.addDays(numDays);
+                loaded.ExpireDays = numDays;
             }
 
             continue;
@@ -157,10 +496,81 @@ void AdBlockSubscription::load()
         else if (line.isEmpty() || line.compare(QStringLiteral("#")) == 0 || line.startsWith(QStringLiteral("# ")) || line.startsWith(QStringLiteral("[Adblock")))
             continue;
 
-        //m_filters.push_back(std::make_unique<AdBlockFilter>(line));
-        m_filters.push_back(parser.makeFilter(line));
+        rules.push_back(line);
     }
 
+    parseFilters(rules, resources, *loaded.Filters);
+    loaded.Slice = AdBlockFilterSlice::fromFilters(*loaded.Filters);
+
+    if (cache && !cache->save(loaded.Title, loaded.ExpireDays, *loaded.Filters))
+        qDebug() << "AdBlockSubscription::readFilters - could not write filter cache for " << filePath;
+
+    return loaded;
+}
+
+void AdBlockSubscription::setLoadedFilters(LoadedFilters &&loaded)
+{
+    m_filters = std::move(loaded.Filters);
+    m_slice = std::move(loaded.Slice);
+    m_loadedFileTime = loaded.FileTime;
+    m_loadedFileSize = loaded.FileSize;
+
+    applyMetadata(loaded.Title, loaded.ExpireDays);
+}
+
+std::shared_ptr<const AdBlockFilterList> AdBlockSubscription::getFilters() const
+{
+    return m_filters;
+}
+
+const AdBlockFilterSlice &AdBlockSubscription::getSlice() const
+{
+    return m_slice;
+}
+
+void AdBlockSubscription::parseFilters(const QStringList &rules, const QHash<QString, QString> &resources, AdBlockFilterList &filters)
+{
+    // Number of rules given to each task of the thread pool
+    const int chunkSize = 4096;
+
+    const int numRules = rules.size();
+    const int numChunks = (numRules + chunkSize - 1) / chunkSize;
+
+    // The parser does not keep any state between rules, other than the domain lists shared by the filters it makes,
+    // so each chunk can be parsed independently. Chunks are appended in order afterwards, keeping the filter order
+    // identical to that of the file
+    std::vector< std::vector< std::unique_ptr<AdBlockFilter> > > chunkFilters(static_cast<std::size_t>(numChunks));
+    std::vector<int> chunks(static_cast<std::size_t>(numChunks));
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    QtConcurrent::blockingMap(chunks, [&rules, &resources, &chunkFilters, chunkSize, numRules](int chunk) {
+        const int begin = chunk * chunkSize;
+        const int end = std::min(begin + chunkSize, numRules);
+
+        AdBlockFilterParser parser(&resources);
+        std::vector< std::unique_ptr<AdBlockFilter> > &parsedFilters = chunkFilters[chunk];
+        parsedFilters.reserve(static_cast<std::size_t>(end - begin));
+        for (int i = begin; i < end; ++i)
+            parsedFilters.push_back(parser.makeFilter(rules.at(i)));
+    });
+
+    filters.reserve(static_cast<std::size_t>(numRules));
+    for (std::vector< std::unique_ptr<AdBlockFilter> > &chunk : chunkFilters)
+    {
+        for (std::unique_ptr<AdBlockFilter> &filter : chunk)
+            filters.push_back(std::move(filter));
+    }
+}
+
+void AdBlockSubscription::applyMetadata(const QString &title, int expireDays)
+{
+    if (m_name.isEmpty())
+        m_name = title;
+
+    // Add the number of days to the last update and set as next update
+    if (expireDays != 0)
+        m_nextUpdate = getLastUpdate().addDays(expireDays);
+
     // Set name to filename if it was not specified in data region of file
     if (m_name.isEmpty())
     {
@@ -189,7 +599,7 @@ int AdBlockSubscription::getNumFilters() const
     if (!m_enabled)
         return 0;
 
-    return static_cast<int>(m_filters.size());
+    return static_cast<int>(m_filters->size());
 }
 
 AdBlockFilter *AdBlockSubscription::getFilter(int index)
@@ -197,9 +607,9 @@ AdBlockFilter *AdBlockSubscription::getFilter(int index)
     if (!m_enabled)
         return nullptr;
 
-    if (index < 0 || index >= static_cast<int>(m_filters.size()))
+    if (index < 0 || index >= static_cast<int>(m_filters->size()))
         return nullptr;
-    return m_filters[index].get();
+    return m_filters->at(index).get();
 }
 
 const QString &AdBlockSubscription::getFilePath() const
@@ -211,3 +621,23 @@ void AdBlockSubscription::setFilePath(const QString &filePath)
 {
     m_filePath = filePath;
 }
+
+bool AdBlockSubscription::needsLoad() const
+{
+    if (!m_enabled || m_filePath.isEmpty())
+        return false;
+
+    if (m_loadedFileTime.isNull())
+        return true;
+
+    QFileInfo fileInfo(m_filePath);
+    return fileInfo.lastModified() != m_loadedFileTime || fileInfo.size() != m_loadedFileSize;
+}
+
+void AdBlockSubscription::unload()
+{
+    m_slice = AdBlockFilterSlice();
+    m_filters = std::make_shared<AdBlockFilterList>();
+    m_loadedFileTime = QDateTime();
+    m_loadedFileSize = 0;
+}
@@ -5,9 +5,110 @@
 #include <memory>
 #include <vector>
 #include <QDateTime>
+#include <QHash>
+#include <QSet>
 #include <QString>
+#include <QStringList>
 #include <QUrl>
 
+/// Container of the filters that belong to a subscription
+using AdBlockFilterList = std::vector< std::unique_ptr<AdBlockFilter> >;
+
+/**
+ * @ingroup AdBlock
+ * @brief The filters of a single subscription, sorted into the containers used by the \ref AdBlockManager.
+ *        The manager combines the slices of every enabled subscription, so that a change to one
+ *        subscription does not require any of the others to be parsed or sorted again
+ */
+struct AdBlockFilterSlice
+{
+    /// Blocking filters with the important option
+    std::vector<AdBlockFilter*> ImportantBlockFilters;
+
+    /// Blocking filters that are not matched by domain or by pattern
+    std::vector<AdBlockFilter*> BlockFilters;
+
+    /// Blocking filters of the StringContains category
+    std::vector<AdBlockFilter*> BlockFiltersByPattern;
+
+    /// Blocking filters of the Domain category
+    std::vector<AdBlockFilter*> BlockFiltersByDomain;
+
+    /// Exception filters for network requests that are not matched by domain
+    std::vector<AdBlockFilter*> AllowFilters;
+
+    /// Exception filters for network requests of the Domain category
+    std::vector<AdBlockFilter*> AllowFiltersByDomain;
+
+    /// Element hiding filters, keyed by their CSS selector
+    QHash<QString, AdBlockFilter*> StylesheetFilters;
+
+    /// Element hiding exception filters, keyed by their CSS selector
+    QHash<QString, AdBlockFilter*> StylesheetExceptions;
+
+    /// Filters with domain-specific javascript rules
+    std::vector<AdBlockFilter*> DomainJSFilters;
+
+    /// Filters with custom stylesheet values
+    std::vector<AdBlockFilter*> CustomStyleFilters;
+
+    /// Exception filters that apply to whole pages (document, elemhide and generichide options)
+    std::vector<AdBlockFilter*> PageExceptionFilters;
+
+    /// Filters that set a content security policy
+    std::vector<AdBlockFilter*> CSPFilters;
+
+    /// Rules that are disabled by a badfilter option
+    QSet<QString> BadFilters;
+
+    /// Generichide rules that are disabled by an important option
+    QSet<QString> BadHideFilters;
+
+    /// True if any filter of the slice affects the result of \ref AdBlockManager::getDomainStylesheet
+    bool HasStylesheetRules;
+
+    /// True if any filter of the slice affects the result of \ref AdBlockManager::getDomainJavaScript
+    bool HasScriptRules;
+
+    /// Number of filters removed from the containers by each step of \ref optimize
+    struct OptimizationStatistics
+    {
+        /// Filters disabled by a badfilter rule, and page exceptions disabled by an important generichide rule
+        std::size_t BadFilters;
+
+        /// Copies of a filter found earlier in the same container, such as a rule shared by two subscriptions
+        std::size_t Duplicates;
+
+        /// Domain filters made redundant by a filter of a parent domain with the same options
+        std::size_t Subsumed;
+
+        /// Filters combined into a filter that only differed from them in its element types
+        std::size_t Merged;
+    };
+
+    /// Default constructor
+    AdBlockFilterSlice() : HasStylesheetRules(false), HasScriptRules(false) {}
+
+    /// Sorts the given filters of a subscription into the containers of a new slice
+    static AdBlockFilterSlice fromFilters(const AdBlockFilterList &filters);
+
+    /// Appends the filters of another slice to the containers of this slice. Element hiding filters of the
+    /// other slice replace those of this slice with the same selector
+    void append(const AdBlockFilterSlice &other);
+
+    /**
+     * @brief Removes the filters that can never decide the outcome of a request, in a single pass over each container:
+     *        the filters disabled by a badfilter rule, page exceptions disabled by an important generichide rule,
+     *        copies of a filter found earlier in the same container, and domain filters under a parent domain that
+     *        has a filter with the same options. Network filters that only differ in their element types are then
+     *        combined into one filter, keeping the rule of the first of them. Filters are not combined in the network containers
+     *        that hold filters taking different actions, such as blocking and redirecting filters.
+     * @param mergedFilters Container that takes ownership of the combined filters. It must outlive the slice
+     * @return The number of filters removed by each step
+     */
+    OptimizationStatistics optimize(AdBlockFilterList &mergedFilters);
+};
+
 /**
  * @class AdBlockSubscription
  * @ingroup AdBlock
@@ -18,6 +119,31 @@ class AdBlockSubscription
     friend class AdBlockManager;
 
 public:
+    /// Filters read from a subscription file, which are given to the subscription by \ref setLoadedFilters
+    struct LoadedFilters
+    {
+        /// True if the subscription file could be read, false if else
+        bool Loaded;
+
+        /// Container of the filters that were read
+        std::shared_ptr<AdBlockFilterList> Filters;
+
+        /// Filters sorted into the containers used by the \ref AdBlockManager
+        AdBlockFilterSlice Slice;
+
+        /// Modification time of the subscription file when it was read
+        QDateTime FileTime;
+
+        /// Size of the subscription file when it was read
+        qint64 FileSize;
+
+        /// Title given in the metadata of the subscription file
+        QString Title;
+
+        /// Number of days until the subscription expires, or 0 if the metadata does not say
+        int ExpireDays;
+    };
+
     /// Constructs the AdBlockSubscription object
     AdBlockSubscription();
 
@@ -54,15 +180,48 @@ public:
     /// Returns the source URL of the subscription file
     const QUrl &getSourceUrl() const;
 
+    /// Returns the absolute path of the subscription file
+    const QString &getFilePath() const;
+
     /// Returns the time of the subscription's last update
     const QDateTime &getLastUpdate() const;
 
     /// Returns the time of the next update
     const QDateTime &getNextUpdate() const;
 
+    /**
+     * @brief Loads the filters from the subscription file, and sorts them into the slice of the subscription
+     * @param cacheDir Directory of the binary filter caches. If not empty, the filters are read from the cache when it matches
+     *        the subscription file, and the cache is rewritten after parsing the file otherwise
+     * @param resources Scripts available to script injection filters, keyed by their name. These are embedded in the
+     *        filters, so a cache is only used if it was written with the same resources
+     */
+    void load(const QString &cacheDir = QString(), const QHash<QString, QString> &resources = QHash<QString, QString>());
+
+    /**
+     * @brief Reads the filters of a subscription file without modifying any subscription, so that it can be run on
+     *        a worker thread while the subscription keeps being used by the thread that owns it
+     * @param filePath Path of the subscription file
+     * @param cacheDir Directory of the binary filter caches, as given to \ref load
+     * @param resources Scripts available to script injection filters, as given to \ref load
+     * @param cachedOnly If true, the filters are only read from a binary cache that matches the file, and the file is
+     *        not parsed otherwise
+     * @return The filters of the file, which are not loaded if the file could not be opened, or if it had to be parsed
+     *         while cachedOnly is set
+     */
+    static LoadedFilters readFilters(const QString &filePath, const QString &cacheDir, const QHash<QString, QString> &resources,
+                                     bool cachedOnly = false);
+
+    /// Replaces the filters of the subscription with those read by \ref readFilters, and applies the metadata of the file
+    void setLoadedFilters(LoadedFilters &&loaded);
+
+    /// Returns the filters loaded from the subscription file
+    std::shared_ptr<const AdBlockFilterList> getFilters() const;
+
+    /// Returns the filters loaded from the subscription file, sorted into the containers used to match requests and pages
+    const AdBlockFilterSlice &getSlice() const;
+
 protected:
-    /// Loads the filters from the subscription file
-    void load();
 
     /// Sets the time of the last update of the subscription file
     void setLastUpdate(const QDateTime &date);
@@ -79,12 +238,22 @@ protected:
     /// Returns the filter at the given index
     AdBlockFilter *getFilter(int index);
 
-    /// Returns the absolute path of the subscription file
-    const QString &getFilePath() const;
-
     /// Updates the path of the subscription file - called after completion of an update if the file name is different
     void setFilePath(const QString &filePath);
 
+    /// Returns true if the subscription is enabled and its filters have not been loaded since the subscription file was last modified
+    bool needsLoad() const;
+
+    /// Releases the filters of the subscription
+    void unload();
+
+private:
+    /// Parses the given filter rules into the filter container, splitting the work across the global thread pool
+    static void parseFilters(const QStringList &rules, const QHash<QString, QString> &resources, AdBlockFilterList &filters);
+
+    /// Sets the name and next update time of the subscription from the metadata of the subscription file
+    void applyMetadata(const QString &title, int expireDays);
+
 private:
     /// True if subscription is enabled, false if else
     bool m_enabled;
@@ -104,8 +273,18 @@ private:
     /// Time when the subscription should be updated
     QDateTime m_nextUpdate;
 
-    /// Container of AdBlock Filters that belong to the subscription
-    std::vector< std::unique_ptr<AdBlockFilter> > m_filters;
+    /// Container of AdBlock Filters that belong to the subscription. Each load creates a new container, while the
+    /// previous one stays alive as long as a filter snapshot of the \ref AdBlockManager refers to it
+    std::shared_ptr<AdBlockFilterList> m_filters;
+
+    /// Filters of the subscription, sorted into the containers used by the \ref AdBlockManager
+    AdBlockFilterSlice m_slice;
+
+    /// Modification time of the subscription file when its filters were loaded
+    QDateTime m_loadedFileTime;
+
+    /// Size of the subscription file when its filters were loaded
+    qint64 m_loadedFileSize;
 };
 
 #endif // ADBLOCKSUBSCRIPTION_H
@@ -2,21 +2,43 @@
 #include "ui_AdBlockWidget.h"
 #include "AdBlockManager.h"
 #include "AdBlockModel.h"
+#include "AdBlockProfiler.h"
+#include "AdBlockProfileTableModel.h"
 #include "AdBlockSubscribeDialog.h"
 #include "CustomFilterEditor.h"
 
 #include <algorithm>
 #include <vector>
 
+#include <QFile>
+#include <QFileDialog>
+#include <QHeaderView>
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
 #include <QResizeEvent>
+#include <QSortFilterProxyModel>
 #include <QUrl>
 
+namespace
+{
+    /// Returns a duration given in nanoseconds as a string, in the most readable unit
+    QString formatDuration(qint64 ns)
+    {
+        if (ns < 1000)
+            return QString("%1 ns").arg(ns);
+        if (ns < 1000000)
+            return QString("%1 \u00B5s").arg(static_cast<double>(ns) / 1000.0, 0, 'f', 1);
+        return QString("%1 ms").arg(static_cast<double>(ns) / 1000000.0, 0, 'f', 1);
+    }
+}
+
 AdBlockWidget::AdBlockWidget(QWidget *parent) :
     QWidget(parent),
-    ui(new Ui::AdBlockWidget)
+    ui(new Ui::AdBlockWidget),
+    m_profileProxyModel(new QSortFilterProxyModel(this)),
+    m_profileModel(new AdBlockProfileTableModel(this)),
+    m_profileRefreshTimer()
 {
     setAttribute(Qt::WA_DeleteOnClose, true);
     ui->setupUi(this);
@@ -36,6 +58,26 @@ AdBlockWidget::AdBlockWidget(QWidget *parent) :
 
     // Show total number of ads that have been blocked since using ad blocker
     ui->labelRequestsBlockedValue->setText(QString::number(AdBlockManager::instance().getRequestsBlockedCount()));
+
+    // Setup profiling tab
+    m_profileProxyModel->setSourceModel(m_profileModel);
+    ui->tableViewFilterProfile->setModel(m_profileProxyModel);
+    ui->tableViewFilterProfile->sortByColumn(3, Qt::DescendingOrder);
+
+    ui->tableWidgetRequestLatency->setColumnCount(3);
+    ui->tableWidgetRequestLatency->setHorizontalHeaderLabels({ tr("Latency"), tr("Evaluated Requests"), tr("Cached Requests") });
+    ui->tableWidgetRequestLatency->verticalHeader()->setVisible(false);
+
+    ui->checkBoxProfilingEnabled->setChecked(AdBlockProfiler::isEnabled());
+    connect(ui->checkBoxProfilingEnabled, &QCheckBox::toggled,     this, &AdBlockWidget::setProfilingEnabled);
+    connect(ui->pushButtonRefreshProfile, &QPushButton::clicked,   this, &AdBlockWidget::refreshProfile);
+    connect(ui->pushButtonResetProfile,   &QPushButton::clicked,   this, &AdBlockWidget::resetProfile);
+    connect(ui->pushButtonExportProfile,  &QPushButton::clicked,   this, &AdBlockWidget::exportProfile);
+    connect(&m_profileRefreshTimer,       &QTimer::timeout,        this, &AdBlockWidget::refreshProfile);
+
+    if (AdBlockProfiler::isEnabled())
+        m_profileRefreshTimer.start(2000);
+    refreshProfile();
 }
 
 AdBlockWidget::~AdBlockWidget()
@@ -137,3 +179,89 @@ void AdBlockWidget::deleteSelectedSubscriptions()
     for (int row : selectedRows)
         model->removeRow(row);
 }
+
+void AdBlockWidget::setProfilingEnabled(bool enabled)
+{
+    AdBlockProfiler::setEnabled(enabled);
+
+    // The decision cache is bypassed while profiling. It is emptied so that the cached requests only count the
+    // decisions made during the profiling session
+    if (enabled)
+    {
+        AdBlockManager::instance().clearDecisionCache();
+        m_profileRefreshTimer.start(2000);
+    }
+    else
+        m_profileRefreshTimer.stop();
+
+    refreshProfile();
+}
+
+void AdBlockWidget::refreshProfile()
+{
+    const AdBlockProfiler &profiler = AdBlockProfiler::instance();
+    m_profileModel->setFilterProfiles(profiler.getFilterProfiles());
+
+    const AdBlockProfiler::LatencyHistogram evaluated = profiler.getRequestLatencies(AdBlockProfiler::RequestPath::Evaluated);
+    const AdBlockProfiler::LatencyHistogram cached = profiler.getRequestLatencies(AdBlockProfiler::RequestPath::Cached);
+
+    ui->labelRequestLatency->setText(tr("Evaluated requests: %1 (median %2, 99th percentile %3, slowest %4). "
+                                        "Cached requests, also evaluated while profiling: %5")
+                                     .arg(evaluated.Requests)
+                                     .arg(formatDuration(evaluated.getPercentile(50.0)))
+                                     .arg(formatDuration(evaluated.getPercentile(99.0)))
+                                     .arg(formatDuration(static_cast<qint64>(evaluated.MaxNs)))
+                                     .arg(cached.Requests));
+
+    // Only the buckets between the fastest and slowest requests are shown
+    int firstBucket = AdBlockProfiler::NumBuckets, lastBucket = -1;
+    for (int i = 0; i < AdBlockProfiler::NumBuckets; ++i)
+    {
+        if (evaluated.Buckets[i] == 0 && cached.Buckets[i] == 0)
+            continue;
+        firstBucket = std::min(firstBucket, i);
+        lastBucket = i;
+    }
+
+    ui->tableWidgetRequestLatency->setRowCount(std::max(0, lastBucket - firstBucket + 1));
+    for (int i = firstBucket; i <= lastBucket; ++i)
+    {
+        const int row = i - firstBucket;
+        const QString latency = (i + 1 < AdBlockProfiler::NumBuckets)
+                ? QString("\u2264 %1").arg(formatDuration(AdBlockProfiler::getBucketUpperBound(i)))
+                : QString("> %1").arg(formatDuration(AdBlockProfiler::getBucketUpperBound(i - 1)));
+        ui->tableWidgetRequestLatency->setItem(row, 0, new QTableWidgetItem(latency));
+        ui->tableWidgetRequestLatency->setItem(row, 1, new QTableWidgetItem(QString::number(evaluated.Buckets[i])));
+        ui->tableWidgetRequestLatency->setItem(row, 2, new QTableWidgetItem(QString::number(cached.Buckets[i])));
+    }
+}
+
+void AdBlockWidget::resetProfile()
+{
+    AdBlockProfiler::instance().reset();
+    refreshProfile();
+}
+
+void AdBlockWidget::exportProfile()
+{
+    const QString csvFilter = tr("CSV files (*.csv)");
+    const QString jsonFilter = tr("JSON files (*.json)");
+
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Profile"), QString(),
+                                                    QString("%1;;%2").arg(csvFilter, jsonFilter), &selectedFilter);
+    if (fileName.isEmpty())
+        return;
+
+    const bool isJson = fileName.endsWith(QLatin1String(".json"), Qt::CaseInsensitive)
+            || (selectedFilter == jsonFilter && !fileName.endsWith(QLatin1String(".csv"), Qt::CaseInsensitive));
+
+    const AdBlockProfiler &profiler = AdBlockProfiler::instance();
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || file.write(isJson ? profiler.toJson() : profiler.toCsv()) < 0)
+    {
+        static_cast<void>(QMessageBox::warning(this, tr("Export Error"), tr("Could not save the profile to %1.").arg(fileName),
+                                               QMessageBox::Ok, QMessageBox::Ok));
+    }
+}
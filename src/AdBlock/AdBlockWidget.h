@@ -1,17 +1,21 @@
 #ifndef ADBLOCKWIDGET_H
 #define ADBLOCKWIDGET_H
 
+#include <QTimer>
 #include <QWidget>
 
 namespace Ui {
     class AdBlockWidget;
 }
 
+class AdBlockProfileTableModel;
+class QSortFilterProxyModel;
+
 /**
  * @class AdBlockWidget
  * @ingroup AdBlock
  * @brief Acts as a management window for the user to view, add, modify and/or delete
- *        their advertisement blocking subscriptions
+ *        their advertisement blocking subscriptions, and to profile the cost of their filters
  */
 class AdBlockWidget : public QWidget
 {
@@ -44,9 +48,30 @@ private slots:
     /// Removes the selected subscriptions from the user's ad block profile and deletes them from storage
     void deleteSelectedSubscriptions();
 
+    /// Enables or disables the profiling of filters and requests
+    void setProfilingEnabled(bool enabled);
+
+    /// Shows the current filter counters and request latencies in the profiling tab
+    void refreshProfile();
+
+    /// Clears the filter counters and request latencies
+    void resetProfile();
+
+    /// Asks the user for a file, and saves the profiling data to it as CSV or JSON, depending on the file type chosen
+    void exportProfile();
+
 private:
     /// Pointer to the user interface items
     Ui::AdBlockWidget *ui;
+
+    /// Proxy model used to sort the filter counters
+    QSortFilterProxyModel *m_profileProxyModel;
+
+    /// Source model of the filter counters
+    AdBlockProfileTableModel *m_profileModel;
+
+    /// Periodically refreshes the profiling tab while profiling is enabled
+    QTimer m_profileRefreshTimer;
 };
 
 #endif // ADBLOCKWIDGET_H
@@ -0,0 +1,148 @@
+#include "AhoCorasick.h"
+
+#include <algorithm>
+#include <deque>
+
+AhoCorasick::AhoCorasick(bool caseSensitive) :
+    m_caseSensitive(caseSensitive),
+    m_buildEdges(),
+    m_buildOutputs(),
+    m_rootTransitions(),
+    m_edgeOffsets(),
+    m_edgeLabels(),
+    m_edgeTargets(),
+    m_failLinks(),
+    m_outputLinks(),
+    m_outputOffsets(),
+    m_outputs()
+{
+    clear();
+}
+
+bool AhoCorasick::addPattern(const QByteArray &pattern, int id)
+{
+    if (pattern.isEmpty())
+        return false;
+
+    if (m_buildEdges.empty())
+    {
+        m_buildEdges.emplace_back();
+        m_buildOutputs.emplace_back();
+    }
+
+    int state = 0;
+    for (const char ch : pattern)
+    {
+        const uchar c = m_caseSensitive ? static_cast<uchar>(ch) : foldCase(static_cast<uchar>(ch));
+
+        std::vector<std::pair<uchar, int>> &edges = m_buildEdges[state];
+        auto it = std::find_if(edges.begin(), edges.end(), [c](const std::pair<uchar, int> &edge) {
+            return edge.first == c;
+        });
+
+        if (it != edges.end())
+        {
+            state = it->second;
+            continue;
+        }
+
+        const int nextState = static_cast<int>(m_buildEdges.size());
+        edges.push_back(std::make_pair(c, nextState));
+        m_buildEdges.emplace_back();
+        m_buildOutputs.emplace_back();
+        state = nextState;
+    }
+
+    m_buildOutputs[state].push_back(id);
+    return true;
+}
+
+void AhoCorasick::build()
+{
+    if (m_buildEdges.empty())
+        return;
+
+    const std::size_t numStates = m_buildEdges.size();
+
+    // Sort the transitions of each state, and flatten them into contiguous arrays
+    m_edgeOffsets.assign(numStates + 1, 0);
+    m_edgeLabels.clear();
+    m_edgeTargets.clear();
+    for (std::size_t i = 0; i < numStates; ++i)
+    {
+        std::vector<std::pair<uchar, int>> &edges = m_buildEdges[i];
+        std::sort(edges.begin(), edges.end());
+
+        m_edgeOffsets[i] = static_cast<quint32>(m_edgeLabels.size());
+        for (const std::pair<uchar, int> &edge : edges)
+        {
+            m_edgeLabels.push_back(edge.first);
+            m_edgeTargets.push_back(edge.second);
+        }
+    }
+    m_edgeOffsets[numStates] = static_cast<quint32>(m_edgeLabels.size());
+
+    m_rootTransitions.fill(0);
+    for (const std::pair<uchar, int> &edge : m_buildEdges[0])
+        m_rootTransitions[edge.first] = edge.second;
+
+    // Compute failure and output links in breadth-first order
+    m_failLinks.assign(numStates, 0);
+    m_outputLinks.assign(numStates, 0);
+
+    std::deque<int> queue;
+    for (const std::pair<uchar, int> &edge : m_buildEdges[0])
+        queue.push_back(edge.second);
+
+    while (!queue.empty())
+    {
+        const int state = queue.front();
+        queue.pop_front();
+
+        for (const std::pair<uchar, int> &edge : m_buildEdges[state])
+        {
+            const int child = edge.second;
+            m_failLinks[child] = getNextState(m_failLinks[state], edge.first);
+
+            const int fail = m_failLinks[child];
+            m_outputLinks[child] = m_buildOutputs[fail].empty() ? m_outputLinks[fail] : fail;
+
+            queue.push_back(child);
+        }
+    }
+
+    // Flatten the output pattern ids
+    m_outputOffsets.assign(numStates + 1, 0);
+    m_outputs.clear();
+    for (std::size_t i = 0; i < numStates; ++i)
+    {
+        m_outputOffsets[i] = static_cast<quint32>(m_outputs.size());
+        m_outputs.insert(m_outputs.end(), m_buildOutputs[i].begin(), m_buildOutputs[i].end());
+    }
+    m_outputOffsets[numStates] = static_cast<quint32>(m_outputs.size());
+
+    // Release the memory used while building
+    m_buildEdges.clear();
+    m_buildEdges.shrink_to_fit();
+    m_buildOutputs.clear();
+    m_buildOutputs.shrink_to_fit();
+}
+
+void AhoCorasick::clear()
+{
+    m_buildEdges.clear();
+    m_buildOutputs.clear();
+    m_rootTransitions.fill(0);
+    m_edgeOffsets.clear();
+    m_edgeLabels.clear();
+    m_edgeTargets.clear();
+    m_failLinks.clear();
+    m_outputLinks.clear();
+    m_outputOffsets.clear();
+    m_outputs.clear();
+}
+
+bool AhoCorasick::empty() const
+{
+    return m_outputs.empty() && m_buildEdges.empty();
+}
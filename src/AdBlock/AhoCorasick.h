@@ -0,0 +1,136 @@
+#ifndef AHOCORASICK_H
+#define AHOCORASICK_H
+
+#include <array>
+#include <utility>
+#include <vector>
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * @class AhoCorasick
+ * @ingroup AdBlock
+ * @brief Aho-Corasick automaton that searches for any number of byte string patterns
+ *        in a single pass over a string of bytes. Once built, the transitions of each state are
+ *        kept in contiguous sorted arrays, and the root state has a direct lookup table.
+ */
+class AhoCorasick
+{
+public:
+    /// Constructs an empty automaton. If caseSensitive is false, the ASCII letters of patterns and input are compared in lower case
+    explicit AhoCorasick(bool caseSensitive = false);
+
+    /**
+     * @brief Adds a pattern to the automaton. Must be called before \ref AhoCorasick::build
+     * @param pattern The string to search for
+     * @param id Identifier reported to the search callback when the pattern is found
+     * @return True if the pattern was added, false if it is empty
+     */
+    bool addPattern(const QByteArray &pattern, int id);
+
+    /// Computes the failure links of the automaton and compacts its transition tables. No patterns may be added afterwards
+    void build();
+
+    /// Removes all patterns from the automaton
+    void clear();
+
+    /// Returns true if the automaton does not contain any patterns, false if else
+    bool empty() const;
+
+    /**
+     * @brief Searches the given string for every pattern in the automaton
+     * @param data Pointer to the bytes of the string
+     * @param length Length of the string
+     * @param callback Function invoked with the id of each pattern found, in order of the end position of the pattern.
+     *        The search stops once the callback returns true
+     * @return True if the search was stopped by the callback, false if else
+     */
+    template <typename Callback>
+    bool search(const char *data, int length, Callback callback) const
+    {
+        if (m_failLinks.empty())
+            return false;
+
+        int state = 0;
+        for (int i = 0; i < length; ++i)
+        {
+            uchar c = static_cast<uchar>(data[i]);
+            if (!m_caseSensitive)
+                c = foldCase(c);
+
+            state = getNextState(state, c);
+
+            for (int s = (m_outputOffsets[state] != m_outputOffsets[state + 1]) ? state : m_outputLinks[state]; s > 0; s = m_outputLinks[s])
+            {
+                for (quint32 o = m_outputOffsets[s]; o < m_outputOffsets[s + 1]; ++o)
+                {
+                    if (callback(m_outputs[o]))
+                        return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+private:
+    /// Returns the lower case form of the given character, if it is an ASCII letter
+    static inline uchar foldCase(uchar c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<uchar>(c + 32) : c;
+    }
+
+    /// Returns the state reached from the given state on the input character, following failure links as needed
+    inline int getNextState(int state, uchar c) const
+    {
+        while (state != 0)
+        {
+            const uchar *begin = m_edgeLabels.data() + m_edgeOffsets[state];
+            const uchar *end = m_edgeLabels.data() + m_edgeOffsets[state + 1];
+            for (const uchar *it = begin; it != end && *it <= c; ++it)
+            {
+                if (*it == c)
+                    return m_edgeTargets[it - m_edgeLabels.data()];
+            }
+            state = m_failLinks[state];
+        }
+
+        return m_rootTransitions[c];
+    }
+
+private:
+    /// True if the automaton compares characters with case sensitivity
+    bool m_caseSensitive;
+
+    /// Transitions of each state while the automaton is being built, as pairs of the input character and the next state
+    std::vector<std::vector<std::pair<uchar, int>>> m_buildEdges;
+
+    /// Pattern ids belonging to each state while the automaton is being built
+    std::vector<std::vector<int>> m_buildOutputs;
+
+    /// Direct lookup table of transitions from the root state
+    std::array<int, 256> m_rootTransitions;
+
+    /// Offsets of each state's transitions in the label and target arrays. Contains one more entry than the number of states
+    std::vector<quint32> m_edgeOffsets;
+
+    /// Input characters of each transition, sorted in ascending order per state
+    std::vector<uchar> m_edgeLabels;
+
+    /// Target states of each transition
+    std::vector<int> m_edgeTargets;
+
+    /// Failure link of each state (longest proper suffix of the state that is also a state)
+    std::vector<int> m_failLinks;
+
+    /// Closest state in the failure chain of each state that has output patterns, or 0 if there is none
+    std::vector<int> m_outputLinks;
+
+    /// Offsets of each state's output pattern ids in m_outputs. Contains one more entry than the number of states
+    std::vector<quint32> m_outputOffsets;
+
+    /// Ids of the patterns ending at each state
+    std::vector<int> m_outputs;
+};
+
+#endif // AHOCORASICK_H
@@ -10,6 +10,7 @@ BrowserScripts::BrowserScripts() :
     initWebChannelScript();
     initFaviconScript();
     initAutoFillObserverScript();
+    initAdBlockCosmeticScript();
 }
 
 const std::vector<QWebEngineScript> &BrowserScripts::getGlobalScripts() const
@@ -97,3 +98,21 @@ void BrowserScripts::initAutoFillObserverScript()
 
     m_publicOnlyScripts.push_back(autoFillObserverScript);
 }
+
+void BrowserScripts::initAdBlockCosmeticScript()
+{
+    QString adBlockCosmeticJS;
+    QFile adBlockCosmeticFile(QLatin1String(":/AdBlockCosmetic.js"));
+    if (adBlockCosmeticFile.open(QIODevice::ReadOnly))
+        adBlockCosmeticJS = adBlockCosmeticFile.readAll();
+    adBlockCosmeticFile.close();
+
+    QWebEngineScript adBlockCosmeticScript;
+    adBlockCosmeticScript.setInjectionPoint(QWebEngineScript::DocumentReady);
+    adBlockCosmeticScript.setName(QLatin1String("viper-adblock-cosmetic"));
+    adBlockCosmeticScript.setRunsOnSubFrames(false);
+    adBlockCosmeticScript.setWorldId(QWebEngineScript::ApplicationWorld);
+    adBlockCosmeticScript.setSourceCode(adBlockCosmeticJS);
+
+    m_globalScripts.push_back(adBlockCosmeticScript);
+}
@@ -23,6 +23,10 @@ public:
     const std::vector<QWebEngineScript> &getPublicOnlyScripts() const;
 
 private:
+    /// Initializes the script that reports the classes and ids of each page to the \ref AdBlockManager, and applies
+    /// the generic element hiding rules that match them
+    void initAdBlockCosmeticScript();
+
     /// Initializes the script that listens for form submission events, in order to be sent to the \ref AutoFill handler
     void initAutoFillObserverScript();
 
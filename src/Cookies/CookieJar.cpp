@@ -11,6 +11,7 @@
 
 #include "BrowserApplication.h"
 #include "CookieJar.h"
+#include "PublicSuffixList.h"
 #include "Settings.h"
 
 CookieJar::CookieJar(bool enableCookies, bool privateJar, QObject *parent) :
@@ -46,17 +47,23 @@ bool CookieJar::hasCookiesFor(const QString &host) const
     if (host.isEmpty())
         return false;
 
-    // If host string of format "xxx.yyy.zzz", must check for any cookies ending
-    // in ".yyy.zzz"
-    QString hostSearch = host;
-    int numDots = host.count(QChar('.'));
-    if (numDots > 1)
-        hostSearch = host.right(host.size() - host.indexOf(QChar('.'), 0));
+    // Check for cookies set on the registrable domain of the host or any of its subdomains
+    const QString hostLower = host.toLower();
+    QStringRef site = PublicSuffixList::instance().getRegistrableDomain(hostLower);
+    if (site.isNull())
+        site = QStringRef(&hostLower);
 
     auto cookies = allCookies();
     for (const QNetworkCookie &cookie : cookies)
-        if (cookie.domain().endsWith(hostSearch))
+    {
+        const QString cookieDomain = cookie.domain();
+        if (!cookieDomain.endsWith(site, Qt::CaseInsensitive))
+            continue;
+
+        const int boundary = cookieDomain.size() - site.size() - 1;
+        if (boundary < 0 || cookieDomain.at(boundary) == QChar('.'))
             return true;
+    }
     return false;
 }
 
@@ -86,15 +93,21 @@ void CookieJar::setThirdPartyCookiesEnabled(bool value)
         m_store->setCookieFilter([=](const QWebEngineCookieStore::FilterRequest &request) {
             if (request.thirdParty && m_enableCookies)
             {
-                const QString originHost = request.origin.host();
+                // An exemption applies to every host with the same registrable domain as the exempt host
+                const PublicSuffixList &publicSuffixList = PublicSuffixList::instance();
+                const QString originHost = request.origin.host().toLower();
+                QStringRef originSite = publicSuffixList.getRegistrableDomain(originHost);
+                if (originSite.isNull())
+                    originSite = QStringRef(&originHost);
+
                 for (auto &url : m_exemptParties)
                 {
-                    const QString urlHost = url.host();
-                    if (urlHost == originHost)
-                        return true;
+                    const QString urlHost = url.host().toLower();
+                    QStringRef urlSite = publicSuffixList.getRegistrableDomain(urlHost);
+                    if (urlSite.isNull())
+                        urlSite = QStringRef(&urlHost);
 
-                    const int domainIndex = originHost.indexOf(urlHost);
-                    if (domainIndex > 0 && originHost.at(domainIndex - 1) == QLatin1Char('.'))
+                    if (urlSite == originSite)
                         return true;
                 }
                 return false;
@@ -1,5 +1,6 @@
 #include "BrowserApplication.h"
 #include "HistoryManager.h"
+#include "PublicSuffixList.h"
 #include "Settings.h"
 #include "WebWidget.h"
 
@@ -8,7 +9,6 @@
 #include <QFuture>
 #include <QIcon>
 #include <QImage>
-#include <QRegExp>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
@@ -172,11 +172,23 @@ int HistoryManager::getTimesVisitedHost(const QString &host) const
 {
     int timesVisited = 0;
 
+    // Count the visits to any host that belongs to the same registrable domain
+    const PublicSuffixList &publicSuffixList = PublicSuffixList::instance();
+    const QString hostLower = host.toLower();
+    QStringRef site = publicSuffixList.getRegistrableDomain(hostLower);
+    if (site.isNull())
+        site = QStringRef(&hostLower);
+
     QSqlQuery query(m_database);
     query.prepare(QLatin1String("SELECT COUNT(VisitID) FROM Visits WHERE VisitID = (:id)"));
     for (const WebHistoryItem &item : m_historyItems)
     {
-        if (host.endsWith(item.URL.host().remove(QRegExp("(http(s)?://)?(www.)"))))
+        const QString itemHost = item.URL.host();
+        QStringRef itemSite = publicSuffixList.getRegistrableDomain(itemHost);
+        if (itemSite.isNull())
+            itemSite = QStringRef(&itemHost);
+
+        if (itemSite == site)
         {
             query.bindValue(QLatin1String(":id"), item.VisitID);
             if (query.exec() && query.next())
@@ -0,0 +1,116 @@
+(function() {
+    var onWebChannelSetup = function(cb) {
+        if (window._webchannel_initialized) {
+            cb();
+        } else {
+            document.addEventListener("_webchannel_setup", cb);
+        }
+    };
+
+    var knownClasses = new Set();
+    var knownIds = new Set();
+    var pendingClasses = [];
+    var pendingIds = [];
+    var pendingNodes = [];
+    var styleElement = null;
+    var timerId = null;
+
+    function addElement(element) {
+        if (element.id && !knownIds.has(element.id)) {
+            knownIds.add(element.id);
+            pendingIds.push(element.id);
+        }
+
+        var classList = element.classList;
+        if (!classList)
+            return;
+
+        for (var i = 0; i < classList.length; ++i) {
+            var className = classList[i];
+            if (!knownClasses.has(className)) {
+                knownClasses.add(className);
+                pendingClasses.push(className);
+            }
+        }
+    }
+
+    function addTree(root) {
+        if (root.nodeType !== Node.ELEMENT_NODE)
+            return;
+
+        addElement(root);
+
+        var elements = root.querySelectorAll('[id],[class]');
+        for (var i = 0; i < elements.length; ++i)
+            addElement(elements[i]);
+    }
+
+    function applyStylesheet(stylesheet) {
+        if (!stylesheet)
+            return;
+
+        if (styleElement === null || !styleElement.isConnected) {
+            styleElement = document.createElement('style');
+            (document.head || document.documentElement).appendChild(styleElement);
+        }
+
+        styleElement.appendChild(document.createTextNode(stylesheet));
+    }
+
+    function sendPending() {
+        timerId = null;
+
+        for (var i = 0; i < pendingNodes.length; ++i)
+            addTree(pendingNodes[i]);
+        pendingNodes = [];
+
+        if (pendingClasses.length === 0 && pendingIds.length === 0)
+            return;
+
+        var classes = pendingClasses;
+        var ids = pendingIds;
+        pendingClasses = [];
+        pendingIds = [];
+
+        window.viper.adblock.getGenericStylesheet(classes, ids, applyStylesheet);
+    }
+
+    function scheduleSend() {
+        if (timerId === null)
+            timerId = setTimeout(sendPending, 100);
+    }
+
+    function onMutation(mutations) {
+        for (var i = 0; i < mutations.length; ++i) {
+            var mutation = mutations[i];
+            if (mutation.type === 'attributes') {
+                addElement(mutation.target);
+            } else {
+                var addedNodes = mutation.addedNodes;
+                for (var j = 0; j < addedNodes.length; ++j) {
+                    if (addedNodes[j].nodeType === Node.ELEMENT_NODE)
+                        pendingNodes.push(addedNodes[j]);
+                }
+            }
+        }
+
+        if (pendingNodes.length > 0 || pendingClasses.length > 0 || pendingIds.length > 0)
+            scheduleSend();
+    }
+
+    onWebChannelSetup(() => {
+        if (!window.viper.adblock)
+            return;
+
+        addTree(document.documentElement);
+        sendPending();
+
+        var observer = new MutationObserver(onMutation);
+        observer.observe(document.documentElement, {
+            childList: true,
+            subtree: true,
+            attributes: true,
+            attributeFilter: ['class', 'id']
+        });
+    });
+})();
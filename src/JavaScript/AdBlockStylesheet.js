@@ -0,0 +1,22 @@
+(function() {
+    var stylesheet = {{ADBLOCK_STYLESHEET}}[0];
+
+    function injectStylesheet() {
+        var style = document.createElement('style');
+        style.type = 'text/css';
+        style.textContent = stylesheet;
+        (document.head || document.documentElement).appendChild(style);
+    }
+
+    if (document.documentElement) {
+        injectStylesheet();
+    } else {
+        var observer = new MutationObserver(function() {
+            if (document.documentElement) {
+                observer.disconnect();
+                injectStylesheet();
+            }
+        });
+        observer.observe(document, { childList: true });
+    }
+})();
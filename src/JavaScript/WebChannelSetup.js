@@ -16,6 +16,7 @@
             viper.storage = channel.objects.extStorage;
             viper.favicons = channel.objects.favicons;
             viper.autofill = channel.objects.autofill;
+            viper.adblock = channel.objects.adblock;
             window.viper = viper; 
             notifySetupComplete();
         });
@@ -13,32 +13,16 @@ BlockedSchemeHandler::BlockedSchemeHandler(QObject *parent) :
 
 void BlockedSchemeHandler::requestStarted(QWebEngineUrlRequestJob *request)
 {
-    AdBlockManager &adBlockMgr = AdBlockManager::instance();
-
-    QString resourceName = request->requestUrl().toString();
-    resourceName = resourceName.mid(8);
-
-    QString mimeTypeStr = adBlockMgr.getResourceContentType(resourceName);
-    const bool isB64 = mimeTypeStr.contains(QLatin1String(";base64"));
-    if (isB64)
-        mimeTypeStr = mimeTypeStr.left(mimeTypeStr.indexOf(QLatin1String(";base64")));
-
-    QByteArray mimeType;
-    mimeType.append(mimeTypeStr);
-
-    QByteArray resourceData;
-    resourceData.append(adBlockMgr.getResource(resourceName));
-    if (isB64)
-        resourceData = QByteArray::fromBase64(resourceData);
-
-    if (resourceData.isEmpty())
+    // Resources are decoded when they are loaded, so the reply can be served from the shared data as-is
+    const AdBlockResource resource = AdBlockManager::instance().getResource(request->requestUrl().path());
+    if (resource.Data.isEmpty())
     {
         request->fail(QWebEngineUrlRequestJob::UrlNotFound);
         return;
     }
 
     QBuffer *buffer = new QBuffer;
-    buffer->setData(resourceData);
+    buffer->setData(resource.Data);
     if (!buffer->open(QIODevice::ReadOnly))
     {
         delete buffer;
@@ -48,5 +32,5 @@ void BlockedSchemeHandler::requestStarted(QWebEngineUrlRequestJob *request)
 
     connect(request, &QObject::destroyed, buffer, &QBuffer::deleteLater);
 
-    request->reply(mimeType, buffer);
+    request->reply(resource.MimeType, buffer);
 }
@@ -0,0 +1,333 @@
+#include "StringSearch.h"
+
+#include <atomic>
+#include <cstring>
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define STRINGSEARCH_HAS_SSE2
+#  include <emmintrin.h>
+#endif
+
+// The AVX2 kernel is compiled with a function level target, and only used if the processor supports it
+#if defined(STRINGSEARCH_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define STRINGSEARCH_HAS_AVX2
+#  include <immintrin.h>
+#endif
+
+namespace
+{
+    /// Returns the kernel that searches run with by default
+    StringSearch::Kernel detectKernel()
+    {
+#if defined(STRINGSEARCH_HAS_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return StringSearch::Kernel::AVX2;
+#endif
+#if defined(STRINGSEARCH_HAS_SSE2)
+        return StringSearch::Kernel::SSE2;
+#else
+        return StringSearch::Kernel::Scalar;
+#endif
+    }
+
+    /// Kernel used by searches
+    std::atomic<StringSearch::Kernel> currentKernel(detectKernel());
+
+    /// Converts an ASCII upper case letter to lower case. Other characters are returned unchanged
+    template <typename Char>
+    inline Char foldCase(Char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<Char>(c | 0x20) : c;
+    }
+
+    /// Returns true if the first length characters of both strings are equal, false if else
+    template <typename Char>
+    inline bool isEqual(const Char *a, const Char *b, int length, bool caseInsensitive)
+    {
+        if (!caseInsensitive)
+            return std::memcmp(a, b, static_cast<size_t>(length) * sizeof(Char)) == 0;
+
+        for (int i = 0; i < length; ++i)
+        {
+            if (foldCase(a[i]) != foldCase(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    /// Searches one haystack position at a time. The needle must not be empty or longer than the haystack
+    template <typename Char>
+    int indexOfScalar(const Char *haystack, int haystackLength, const Char *needle, int needleLength, bool caseInsensitive)
+    {
+        const Char first = caseInsensitive ? foldCase(needle[0]) : needle[0];
+        const int lastStart = haystackLength - needleLength;
+        for (int i = 0; i <= lastStart; ++i)
+        {
+            const Char c = caseInsensitive ? foldCase(haystack[i]) : haystack[i];
+            if (c == first && isEqual(haystack + i + 1, needle + 1, needleLength - 1, caseInsensitive))
+                return i;
+        }
+        return -1;
+    }
+
+    /// Clears the bits of the character at the given offset from a byte mask of vector comparison results
+    template <typename Char>
+    inline quint32 clearCharacter(quint32 mask, int offset)
+    {
+        const quint32 charBits = (1U << sizeof(Char)) - 1;
+        return mask & ~(charBits << (offset * static_cast<int>(sizeof(Char))));
+    }
+
+#if defined(STRINGSEARCH_HAS_SSE2)
+    namespace SSE2
+    {
+        inline __m128i broadcast(char c) { return _mm_set1_epi8(c); }
+        inline __m128i broadcast(ushort c) { return _mm_set1_epi16(static_cast<short>(c)); }
+
+        inline __m128i compare(__m128i a, __m128i b, char) { return _mm_cmpeq_epi8(a, b); }
+        inline __m128i compare(__m128i a, __m128i b, ushort) { return _mm_cmpeq_epi16(a, b); }
+
+        // Characters outside of the ASCII range compare as negative numbers, and are never folded
+        inline __m128i foldCase(__m128i v, char)
+        {
+            const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                                _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+            return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        }
+        inline __m128i foldCase(__m128i v, ushort)
+        {
+            const __m128i upper = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('A' - 1)),
+                                                _mm_cmplt_epi16(v, _mm_set1_epi16('Z' + 1)));
+            return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi16(0x20)));
+        }
+
+        /// Compares the first and last characters of the needle against 16 bytes of haystack positions at a time
+        template <typename Char>
+        int indexOf(const Char *haystack, int haystackLength, const Char *needle, int needleLength, bool caseInsensitive)
+        {
+            const int lanes = static_cast<int>(sizeof(__m128i) / sizeof(Char));
+            const int lastStart = haystackLength - needleLength;
+            const int middleLength = needleLength > 2 ? needleLength - 2 : 0;
+            const __m128i first = broadcast(caseInsensitive ? ::foldCase(needle[0]) : needle[0]);
+            const __m128i last = broadcast(caseInsensitive ? ::foldCase(needle[needleLength - 1]) : needle[needleLength - 1]);
+
+            int i = 0;
+            for (; i + lanes - 1 <= lastStart; i += lanes)
+            {
+                __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+                __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needleLength - 1));
+                if (caseInsensitive)
+                {
+                    blockFirst = foldCase(blockFirst, Char());
+                    blockLast = foldCase(blockLast, Char());
+                }
+
+                quint32 mask = static_cast<quint32>(_mm_movemask_epi8(
+                            _mm_and_si128(compare(blockFirst, first, Char()), compare(blockLast, last, Char()))));
+                while (mask != 0)
+                {
+                    const int offset = static_cast<int>(qCountTrailingZeroBits(mask) / sizeof(Char));
+                    if (isEqual(haystack + i + offset + 1, needle + 1, middleLength, caseInsensitive))
+                        return i + offset;
+                    mask = clearCharacter<Char>(mask, offset);
+                }
+            }
+
+            const int pos = indexOfScalar(haystack + i, haystackLength - i, needle, needleLength, caseInsensitive);
+            return pos >= 0 ? i + pos : -1;
+        }
+    }
+#endif
+
+#if defined(STRINGSEARCH_HAS_AVX2)
+    namespace AVX2
+    {
+        __attribute__((target("avx2"))) inline __m256i broadcast(char c) { return _mm256_set1_epi8(c); }
+        __attribute__((target("avx2"))) inline __m256i broadcast(ushort c) { return _mm256_set1_epi16(static_cast<short>(c)); }
+
+        __attribute__((target("avx2"))) inline __m256i compare(__m256i a, __m256i b, char) { return _mm256_cmpeq_epi8(a, b); }
+        __attribute__((target("avx2"))) inline __m256i compare(__m256i a, __m256i b, ushort) { return _mm256_cmpeq_epi16(a, b); }
+
+        __attribute__((target("avx2"))) inline __m256i foldCase(__m256i v, char)
+        {
+            const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+            return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+        }
+        __attribute__((target("avx2"))) inline __m256i foldCase(__m256i v, ushort)
+        {
+            const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16('A' - 1)),
+                                                   _mm256_cmpgt_epi16(_mm256_set1_epi16('Z' + 1), v));
+            return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi16(0x20)));
+        }
+
+        /// Compares the first and last characters of the needle against 32 bytes of haystack positions at a time
+        template <typename Char>
+        __attribute__((target("avx2")))
+        int indexOf(const Char *haystack, int haystackLength, const Char *needle, int needleLength, bool caseInsensitive)
+        {
+            const int lanes = static_cast<int>(sizeof(__m256i) / sizeof(Char));
+            const int lastStart = haystackLength - needleLength;
+            const int middleLength = needleLength > 2 ? needleLength - 2 : 0;
+            const __m256i first = broadcast(caseInsensitive ? ::foldCase(needle[0]) : needle[0]);
+            const __m256i last = broadcast(caseInsensitive ? ::foldCase(needle[needleLength - 1]) : needle[needleLength - 1]);
+
+            int i = 0;
+            for (; i + lanes - 1 <= lastStart; i += lanes)
+            {
+                __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+                __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + needleLength - 1));
+                if (caseInsensitive)
+                {
+                    blockFirst = foldCase(blockFirst, Char());
+                    blockLast = foldCase(blockLast, Char());
+                }
+
+                quint32 mask = static_cast<quint32>(_mm256_movemask_epi8(
+                            _mm256_and_si256(compare(blockFirst, first, Char()), compare(blockLast, last, Char()))));
+                while (mask != 0)
+                {
+                    const int offset = static_cast<int>(qCountTrailingZeroBits(mask) / sizeof(Char));
+                    if (isEqual(haystack + i + offset + 1, needle + 1, middleLength, caseInsensitive))
+                        return i + offset;
+                    mask = clearCharacter<Char>(mask, offset);
+                }
+            }
+
+            // The remaining positions are fewer than one 256-bit block, so they are searched with the 128-bit kernel
+            const int pos = SSE2::indexOf(haystack + i, haystackLength - i, needle, needleLength, caseInsensitive);
+            return pos >= 0 ? i + pos : -1;
+        }
+    }
+#endif
+
+    /// Runs the search with the current kernel
+    template <typename Char>
+    int search(const Char *haystack, int haystackLength, const Char *needle, int needleLength, Qt::CaseSensitivity cs)
+    {
+        if (needleLength <= 0)
+            return 0;
+        if (needleLength > haystackLength)
+            return -1;
+
+        const bool caseInsensitive = (cs == Qt::CaseInsensitive);
+        switch (currentKernel.load(std::memory_order_relaxed))
+        {
+#if defined(STRINGSEARCH_HAS_AVX2)
+            case StringSearch::Kernel::AVX2:
+                return AVX2::indexOf(haystack, haystackLength, needle, needleLength, caseInsensitive);
+#endif
+#if defined(STRINGSEARCH_HAS_SSE2)
+            case StringSearch::Kernel::SSE2:
+                return SSE2::indexOf(haystack, haystackLength, needle, needleLength, caseInsensitive);
+#endif
+            default:
+                return indexOfScalar(haystack, haystackLength, needle, needleLength, caseInsensitive);
+        }
+    }
+
+    inline const ushort *utf16(const QChar *str)
+    {
+        return reinterpret_cast<const ushort*>(str);
+    }
+}
+
+namespace StringSearch
+{
+    Kernel getKernel()
+    {
+        return currentKernel.load(std::memory_order_relaxed);
+    }
+
+    bool setKernel(Kernel kernel)
+    {
+        const Kernel bestKernel = detectKernel();
+        if (kernel > bestKernel)
+            return false;
+
+        currentKernel.store(kernel, std::memory_order_relaxed);
+        return true;
+    }
+
+    const char *getKernelName()
+    {
+        switch (getKernel())
+        {
+            case Kernel::AVX2:
+                return "AVX2";
+            case Kernel::SSE2:
+                return "SSE2";
+            default:
+                return "Scalar";
+        }
+    }
+
+    int indexOf(const QChar *haystack, int haystackLength, const QChar *needle, int needleLength, Qt::CaseSensitivity cs)
+    {
+        return search(utf16(haystack), haystackLength, utf16(needle), needleLength, cs);
+    }
+
+    int indexOf(const char *haystack, int haystackLength, const char *needle, int needleLength, Qt::CaseSensitivity cs)
+    {
+        return search(haystack, haystackLength, needle, needleLength, cs);
+    }
+
+    int indexOf(const QString &haystack, const QString &needle, int from, Qt::CaseSensitivity cs)
+    {
+        from = qMax(from, 0);
+        if (from > haystack.size())
+            return -1;
+
+        const int pos = search(utf16(haystack.constData()) + from, haystack.size() - from,
+                               utf16(needle.constData()), needle.size(), cs);
+        return pos >= 0 ? from + pos : -1;
+    }
+
+    int indexOf(const QByteArray &haystack, const QByteArray &needle, int from, Qt::CaseSensitivity cs)
+    {
+        from = qMax(from, 0);
+        if (from > haystack.size())
+            return -1;
+
+        const int pos = search(haystack.constData() + from, haystack.size() - from, needle.constData(), needle.size(), cs);
+        return pos >= 0 ? from + pos : -1;
+    }
+
+    bool contains(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs)
+    {
+        return search(utf16(haystack.constData()), haystack.size(), utf16(needle.constData()), needle.size(), cs) >= 0;
+    }
+
+    bool contains(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs)
+    {
+        return search(haystack.constData(), haystack.size(), needle.constData(), needle.size(), cs) >= 0;
+    }
+
+    bool startsWith(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs)
+    {
+        return needle.size() <= haystack.size()
+                && isEqual(utf16(haystack.constData()), utf16(needle.constData()), needle.size(), cs == Qt::CaseInsensitive);
+    }
+
+    bool startsWith(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs)
+    {
+        return needle.size() <= haystack.size()
+                && isEqual(haystack.constData(), needle.constData(), needle.size(), cs == Qt::CaseInsensitive);
+    }
+
+    bool endsWith(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs)
+    {
+        const int start = haystack.size() - needle.size();
+        return start >= 0
+                && isEqual(utf16(haystack.constData()) + start, utf16(needle.constData()), needle.size(), cs == Qt::CaseInsensitive);
+    }
+
+    bool endsWith(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs)
+    {
+        const int start = haystack.size() - needle.size();
+        return start >= 0
+                && isEqual(haystack.constData() + start, needle.constData(), needle.size(), cs == Qt::CaseInsensitive);
+    }
+}
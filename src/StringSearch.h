@@ -0,0 +1,73 @@
+#ifndef STRINGSEARCH_H
+#define STRINGSEARCH_H
+
+#include <QByteArray>
+#include <QChar>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Substring, prefix and suffix search over UTF-16 and Latin-1/UTF-8 strings.
+ *
+ * Searches compare the first and last characters of the needle against a block of haystack
+ * positions at a time, using AVX2 or SSE2 when the processor supports them, and only compare
+ * the rest of the needle at the positions where both of those characters match. The fastest
+ * supported instruction set is chosen at startup. Case insensitive searches fold ASCII letters only,
+ * which is sufficient for URLs and filter rules.
+ */
+namespace StringSearch
+{
+    /// Instruction sets that searches can run with, from slowest to fastest
+    enum class Kernel
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /// Returns the kernel used by searches
+    Kernel getKernel();
+
+    /// Sets the kernel used by searches, in order to compare kernels in tests and benchmarks.
+    /// Returns false if the kernel is not supported by this build or processor, in which case the kernel is not changed
+    bool setKernel(Kernel kernel);
+
+    /// Returns the name of the kernel used by searches ("AVX2", "SSE2" or "Scalar")
+    const char *getKernelName();
+
+    /// Returns the position of the first occurrence of the needle in the haystack, or -1 if there is none
+    int indexOf(const QChar *haystack, int haystackLength, const QChar *needle, int needleLength,
+                Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns the position of the first occurrence of the needle in the haystack, or -1 if there is none
+    int indexOf(const char *haystack, int haystackLength, const char *needle, int needleLength,
+                Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns the position of the first occurrence of the needle in the haystack at or after the given position,
+    /// or -1 if there is none
+    int indexOf(const QString &haystack, const QString &needle, int from = 0, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns the position of the first occurrence of the needle in the haystack at or after the given position,
+    /// or -1 if there is none
+    int indexOf(const QByteArray &haystack, const QByteArray &needle, int from = 0, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack contains the needle, false if else
+    bool contains(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack contains the needle, false if else
+    bool contains(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack begins with the needle, false if else
+    bool startsWith(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack begins with the needle, false if else
+    bool startsWith(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack ends with the needle, false if else
+    bool endsWith(const QString &haystack, const QString &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Returns true if the haystack ends with the needle, false if else
+    bool endsWith(const QByteArray &haystack, const QByteArray &needle, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+}
+
+#endif // STRINGSEARCH_H
@@ -2,6 +2,7 @@
 #include "BookmarkManager.h"
 #include "FaviconStore.h"
 #include "HistoryManager.h"
+#include "StringSearch.h"
 #include "URLSuggestionWorker.h"
 
 #include <algorithm>
@@ -15,11 +16,10 @@ URLSuggestionWorker::URLSuggestionWorker(QObject *parent) :
     m_searchTerm(),
     m_searchWords(),
     m_searchTermHasScheme(false),
+    m_searchTermIsAscii(true),
     m_suggestionFuture(),
     m_suggestionWatcher(nullptr),
-    m_suggestions(),
-    m_differenceHash(0),
-    m_searchTermHash(0)
+    m_suggestions()
 {
     m_suggestionWatcher = new QFutureWatcher<void>(this);
     connect(m_suggestionWatcher, &QFutureWatcher<void>::finished, [this](){
@@ -36,12 +36,14 @@ void URLSuggestionWorker::findSuggestionsFor(const QString &text)
         m_suggestionFuture.waitForFinished();
     }
 
-    m_searchTerm = text.toUpper();
+    m_searchTerm = text;
     m_searchWords = m_searchTerm.split(QLatin1Char(' '), QString::SkipEmptyParts);
-    m_searchTermHasScheme = (m_searchTerm.startsWith(QLatin1String("HTTP"))
-            || m_searchTerm.startsWith(QLatin1String("FILE"))
-            || m_searchTerm.startsWith(QLatin1String("VIPER")));
-    hashSearchTerm();
+    m_searchTermHasScheme = (m_searchTerm.startsWith(QLatin1String("HTTP"), Qt::CaseInsensitive)
+            || m_searchTerm.startsWith(QLatin1String("FILE"), Qt::CaseInsensitive)
+            || m_searchTerm.startsWith(QLatin1String("VIPER"), Qt::CaseInsensitive));
+    m_searchTermIsAscii = std::all_of(m_searchTerm.cbegin(), m_searchTerm.cend(), [](const QChar &c) {
+        return c.unicode() < 0x80;
+    });
 
     m_suggestionFuture = QtConcurrent::run(this, &URLSuggestionWorker::searchForHits);
     m_suggestionWatcher->setFuture(m_suggestionFuture);
@@ -72,7 +74,7 @@ void URLSuggestionWorker::searchForHits()
             continue;
 
         const QString url = it->getURL().toString();
-        if (isEntryMatch(it->getName().toUpper(), url.toUpper(), it->getShortcut().toUpper()))
+        if (isEntryMatch(it->getName(), url, it->getShortcut()))
         {
             auto suggestion = URLSuggestion(it->getIcon(), it->getName(), url, true, historyMgr->getTimesVisited(url));
             hits.insert(suggestion.URL);
@@ -100,7 +102,7 @@ void URLSuggestionWorker::searchForHits()
         if (hits.contains(url))
             continue;
 
-        if (isEntryMatch(it->Title.toUpper(), url.toUpper()))
+        if (isEntryMatch(it->Title, url))
         {
             auto suggestion = URLSuggestion(faviconStore->getFavicon(it->URL), it->Title, url, false, historyMgr->getTimesVisited(it->URL));
             histSuggestions.push_back(suggestion);
@@ -125,91 +127,36 @@ void URLSuggestionWorker::searchForHits()
 
 bool URLSuggestionWorker::isEntryMatch(const QString &title, const QString &url, const QString &shortcut)
 {
-    if (isStringMatch(title) || (!shortcut.isEmpty() && m_searchTerm.startsWith(shortcut)))
+    if (isStringMatch(title) || (!shortcut.isEmpty() && m_searchTerm.startsWith(shortcut, Qt::CaseInsensitive)))
         return true;
 
     if (m_searchWords.size() > 1)
     {
         for (const QString &word : m_searchWords)
         {
-            if (title.contains(word, Qt::CaseSensitive))
+            if (indexOfTerm(title, word) >= 0)
                 return true;
         }
     }
 
+    // Skip over the scheme of the url if the search term does not have one
     int prefix = url.indexOf(QLatin1String("://"));
     if (!m_searchTermHasScheme && prefix >= 0)
-    {
-        QString urlMutable = url;
-        urlMutable = urlMutable.mid(prefix + 3);
-        return isStringMatch(urlMutable);
-    }
+        return indexOfTerm(url, m_searchTerm, prefix + 3) >= 0;
 
     return isStringMatch(url);
 }
 
-void URLSuggestionWorker::hashSearchTerm()
+bool URLSuggestionWorker::isStringMatch(const QString &haystack) const
 {
-    m_searchTermHash = 0;
-
-    const int needleLength = m_searchTerm.size();
-    const QChar *needlePtr = m_searchTerm.constData();
-
-    const quint64 radixLength = 256ULL;
-    const quint64 prime = 72057594037927931ULL;
-
-    m_differenceHash = 1;
-    for (int i = 0; i < needleLength - 1; ++i)
-        m_differenceHash = (m_differenceHash * radixLength) % prime;
-
-    for (int index = 0; index < needleLength; ++index)
-        m_searchTermHash = (radixLength * m_searchTermHash + (needlePtr + index)->toLatin1()) % prime;
+    return indexOfTerm(haystack, m_searchTerm) >= 0;
 }
 
-bool URLSuggestionWorker::isStringMatch(const QString &haystack)
+int URLSuggestionWorker::indexOfTerm(const QString &haystack, const QString &needle, int from) const
 {
-    static const quint64 radixLength = 256ULL;
-    static const quint64 prime = 72057594037927931ULL;
-
-    const int needleLength = m_searchTerm.size();
-    const int haystackLength = haystack.size();
-
-    if (needleLength > haystackLength)
-        return false;
-    if (needleLength == 0)
-        return true;
-
-    const QChar *needlePtr = m_searchTerm.constData();
-    const QChar *haystackPtr = haystack.constData();
-
-    int i, j;
-    quint64 t = 0;
+    // The search kernels only fold ASCII letters, so other terms fall back to the Unicode aware search of QString
+    if (m_searchTermIsAscii)
+        return StringSearch::indexOf(haystack, needle, from, Qt::CaseInsensitive);
 
-    // Calculate the hash value of first window of text
-    for (i = 0; i < needleLength; ++i)
-        t = (radixLength * t + ((haystackPtr + i)->toLatin1())) % prime;
-
-    for (i = 0; i <= haystackLength - needleLength; ++i)
-    {
-        if (m_searchTermHash == t)
-        {
-            for (j = 0; j < needleLength; j++)
-            {
-                if ((haystackPtr + i + j)->toLatin1() != (needlePtr + j)->toLatin1())
-                    break;
-            }
-
-            if (j == needleLength)
-                return true;
-        }
-
-        if (i < haystackLength - needleLength)
-        {
-            t = (((t + prime - m_differenceHash * ((haystackPtr + i)->toLatin1()) % prime) % prime)
-                    * radixLength + ((haystackPtr + i + needleLength)->toLatin1())) % prime;
-        }
-    }
-
-    return false;
+    return haystack.indexOf(needle, from, Qt::CaseInsensitive);
 }
-
@@ -40,11 +40,12 @@ private:
     /// true on a match and false if not matching
     bool isEntryMatch(const QString &title, const QString &url, const QString &shortcut = QString());
 
-    /// Applies the Rabin-Karp string matching algorithm to determine whether or not the haystack contains the search term
-    bool isStringMatch(const QString &haystack);
+    /// Returns true if the haystack contains the search term, ignoring case, false if else
+    bool isStringMatch(const QString &haystack) const;
 
-    /// Generates a hash of the search term before looking for suggestions
-    void hashSearchTerm();
+    /// Returns the position of the needle, a part of the search term, in the haystack at or after the given
+    /// position, ignoring case. Returns -1 if it is not found
+    int indexOfTerm(const QString &haystack, const QString &needle, int from = 0) const;
 
 private:
     /// True if the worker thread is active, false if else
@@ -59,6 +60,9 @@ private:
     /// True if the search term contains a scheme (used for string matching)
     bool m_searchTermHasScheme;
 
+    /// True if the search term only has ASCII characters, so that it can be searched with \ref StringSearch
+    bool m_searchTermIsAscii;
+
     /// Future of the searchForHits operation
     QFuture<void> m_suggestionFuture;
 
@@ -67,12 +71,6 @@ private:
 
     /// Stores the suggested URLs based on the current input
     std::vector<URLSuggestion> m_suggestions;
-
-    /// Used for string hash comparisons in implementation of Rabin-Karp algorithm
-    quint64 m_differenceHash;
-
-    /// Contains a hash of the search term string
-    quint64 m_searchTermHash;
 };
 
 #endif // URLSUGGESTIONWORKER_H
@@ -0,0 +1,264 @@
+#include "PublicSuffixList.h"
+
+#include <algorithm>
+#include <QFile>
+#include <QUrl>
+
+PublicSuffixList::PublicSuffixList() :
+    m_nodes(),
+    m_labels(),
+    m_edges(),
+    m_numRules(0)
+{
+    m_nodes.push_back(Node{ 0, 0, 0 });
+}
+
+const PublicSuffixList &PublicSuffixList::instance()
+{
+    static const PublicSuffixList publicSuffixList = [] {
+        PublicSuffixList list;
+        list.loadFile(QLatin1String(":/public_suffix_list.dat"));
+        return list;
+    }();
+    return publicSuffixList;
+}
+
+bool PublicSuffixList::loadFile(const QString &fileName)
+{
+    QFile listFile(fileName);
+    if (!listFile.exists() || !listFile.open(QIODevice::ReadOnly))
+        return false;
+
+    parse(listFile.readAll());
+    listFile.close();
+    return true;
+}
+
+void PublicSuffixList::parse(const QByteArray &data)
+{
+    const QString text = QString::fromUtf8(data);
+
+    int pos = 0;
+    while (pos < text.size())
+    {
+        int lineEnd = text.indexOf(QChar('\n'), pos);
+        if (lineEnd < 0)
+            lineEnd = text.size();
+
+        QStringRef line = text.midRef(pos, lineEnd - pos).trimmed();
+        pos = lineEnd + 1;
+
+        if (line.isEmpty() || line.startsWith(QLatin1String("//")))
+            continue;
+
+        // Each rule ends at the first whitespace character of its line
+        for (int i = 0; i < line.size(); ++i)
+        {
+            if (line.at(i).isSpace())
+            {
+                line = line.left(i);
+                break;
+            }
+        }
+
+        const QString rule = line.toString().toLower();
+        addRule(rule);
+
+        // Hosts may be given in their ASCII compatible encoding, so internationalized rules are stored in both forms
+        const bool isAscii = std::all_of(rule.cbegin(), rule.cend(), [](QChar c) { return c.unicode() < 0x80; });
+        if (!isAscii)
+        {
+            int prefixLength = 0;
+            if (rule.startsWith(QChar('!')))
+                prefixLength = 1;
+            else if (rule.startsWith(QLatin1String("*.")))
+                prefixLength = 2;
+
+            const QByteArray ace = QUrl::toAce(rule.mid(prefixLength));
+            if (!ace.isEmpty())
+                addRule(rule.left(prefixLength) + QString::fromLatin1(ace));
+        }
+    }
+}
+
+int PublicSuffixList::size() const
+{
+    return m_numRules;
+}
+
+QStringRef PublicSuffixList::getRegistrableDomain(const QString &host) const
+{
+    int end = 0;
+    const int suffixStart = findPublicSuffix(host, end);
+
+    // The registrable domain needs a non-empty label in front of the public suffix
+    if (suffixStart < 2)
+        return QStringRef();
+
+    const int start = host.lastIndexOf(QChar('.'), suffixStart - 2) + 1;
+    if (start == suffixStart - 1)
+        return QStringRef();
+
+    return host.midRef(start, end - start);
+}
+
+QStringRef PublicSuffixList::getPublicSuffix(const QString &host) const
+{
+    int end = 0;
+    const int suffixStart = findPublicSuffix(host, end);
+    if (suffixStart < 0)
+        return QStringRef();
+
+    return host.midRef(suffixStart, end - suffixStart);
+}
+
+void PublicSuffixList::addRule(const QString &rule)
+{
+    quint8 flag = FlagRule;
+    int nameStart = 0;
+    if (rule.startsWith(QChar('!')))
+    {
+        flag = FlagException;
+        nameStart = 1;
+    }
+    else if (rule.startsWith(QLatin1String("*.")))
+    {
+        flag = FlagWildcard;
+        nameStart = 2;
+    }
+
+    // The default rule ("*") is always applied
+    if (rule.size() <= nameStart || rule.at(nameStart) == QChar('*'))
+        return;
+
+    // Insert labels from right to left
+    int node = 0;
+    int end = rule.size();
+    while (end > nameStart)
+    {
+        int start = rule.lastIndexOf(QChar('.'), end - 1) + 1;
+        if (start < nameStart)
+            start = nameStart;
+
+        node = getOrAddChild(node, rule.mid(start, end - start));
+        end = start - 1;
+    }
+
+    m_nodes[node].Flags |= flag;
+    ++m_numRules;
+}
+
+int PublicSuffixList::findPublicSuffix(const QString &host, int &end) const
+{
+    end = host.size();
+    if (end > 0 && host.at(end - 1) == QChar('.'))
+        --end;
+
+    if (end <= 0 || isAddress(host))
+        return -1;
+
+    const QChar *data = host.constData();
+
+    // Walk the labels of the host from right to left. The prevailing rule is the one that matches the most labels,
+    // unless an exception rule matches, and the default rule matches the top-level label of any host
+    int suffixStart = -1;
+    int parentStart = end + 1;
+    int node = 0;
+    int labelEnd = end;
+    while (labelEnd > 0)
+    {
+        int start = labelEnd - 1;
+        while (start >= 0 && data[start] != QChar('.'))
+            --start;
+        ++start;
+
+        if (suffixStart < 0)
+            suffixStart = start;
+
+        const int child = findChild(node, data + start, labelEnd - start);
+        if (child >= 0 && (m_nodes[child].Flags & FlagException))
+            return parentStart;
+
+        if (m_nodes[node].Flags & FlagWildcard)
+            suffixStart = start;
+
+        if (child < 0)
+            break;
+
+        if (m_nodes[child].Flags & FlagRule)
+            suffixStart = start;
+
+        node = child;
+        parentStart = start;
+        labelEnd = start - 1;
+    }
+
+    return suffixStart;
+}
+
+int PublicSuffixList::findChild(int node, const QChar *label, int length) const
+{
+    if (length <= 0)
+        return -1;
+
+    const quint64 key = getEdgeKey(node, hashLabel(label, length));
+    for (auto it = m_edges.constFind(key); it != m_edges.cend() && it.key() == key; ++it)
+    {
+        const Node &child = m_nodes[it.value()];
+        if (child.LabelLength == length && std::equal(label, label + length, m_labels.constData() + child.LabelPos))
+            return it.value();
+    }
+
+    return -1;
+}
+
+int PublicSuffixList::getOrAddChild(int node, const QString &label)
+{
+    if (label.isEmpty())
+        return node;
+
+    int child = findChild(node, label.constData(), label.size());
+    if (child >= 0)
+        return child;
+
+    child = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(Node{ m_labels.size(), label.size(), 0 });
+    m_labels.append(label);
+    m_edges.insert(getEdgeKey(node, hashLabel(label.constData(), label.size())), child);
+    return child;
+}
+
+quint32 PublicSuffixList::hashLabel(const QChar *label, int length)
+{
+    // FNV-1a
+    quint32 hash = 2166136261U;
+    for (int i = 0; i < length; ++i)
+    {
+        hash ^= label[i].unicode();
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+bool PublicSuffixList::isAddress(const QString &host)
+{
+    // IPv6 addresses are the only hosts that contain a colon
+    if (host.contains(QChar(':')))
+        return true;
+
+    // No top-level domain is numeric, so a host ending with a number is treated as an IPv4 address
+    int end = host.size();
+    if (end > 0 && host.at(end - 1) == QChar('.'))
+        --end;
+
+    int start = host.lastIndexOf(QChar('.'), end - 1) + 1;
+    if (start >= end)
+        return false;
+
+    for (int i = start; i < end; ++i)
+    {
+        if (!host.at(i).isDigit())
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef PUBLICSUFFIXLIST_H
+#define PUBLICSUFFIXLIST_H
+
+#include <vector>
+#include <QByteArray>
+#include <QChar>
+#include <QHash>
+#include <QString>
+#include <QStringRef>
+#include <QtGlobal>
+
+/**
+ * @class PublicSuffixList
+ * @brief Determines the registrable domain of a host name (ex: example.com for www.example.com, example.co.uk
+ *        for ads.example.co.uk), using the rules of the Public Suffix List (https://publicsuffix.org).
+ *        The rules are compiled into a trie of reversed host name labels, so that a lookup is a single
+ *        walk over the labels of the host, without any memory allocation.
+ */
+class PublicSuffixList
+{
+public:
+    /// Constructs an empty public suffix list. Hosts are matched against the default rule ("*") only
+    PublicSuffixList();
+
+    /// Returns the public suffix list that was bundled with the application
+    static const PublicSuffixList &instance();
+
+    /// Loads the rules from the given file in the Public Suffix List format. Returns true on success, false if else
+    bool loadFile(const QString &fileName);
+
+    /// Adds the rules found in the given data, which is in the Public Suffix List format
+    void parse(const QByteArray &data);
+
+    /// Returns the number of rules in the list
+    int size() const;
+
+    /**
+     * @brief Returns the registrable domain of the host: the public suffix of the host and the label before it
+     * @param host Lower case host name
+     * @return A reference to the registrable domain within the given host. The reference is null if the host
+     *         is an IP address, is itself a public suffix, or has no registrable domain for another reason
+     */
+    QStringRef getRegistrableDomain(const QString &host) const;
+
+    /**
+     * @brief Returns the public suffix of the host (ex: co.uk for www.example.co.uk)
+     * @param host Lower case host name
+     * @return A reference to the public suffix within the given host, or a null reference if the host is an IP address
+     */
+    QStringRef getPublicSuffix(const QString &host) const;
+
+private:
+    /// Bits describing the rules that end at a node of the trie
+    enum NodeFlag : quint8
+    {
+        /// A normal rule ends at the node
+        FlagRule      = 0x01,
+
+        /// An exception rule (!rule) ends at the node
+        FlagException = 0x02,
+
+        /// A wildcard rule (*.rule) applies to the children of the node
+        FlagWildcard  = 0x04
+    };
+
+    /// Node of the trie, representing one label of a rule
+    struct Node
+    {
+        /// Position of the node's label in the label buffer
+        int LabelPos;
+
+        /// Length of the node's label
+        int LabelLength;
+
+        /// Combination of \ref NodeFlag bits
+        quint8 Flags;
+    };
+
+    /// Adds a single rule to the trie
+    void addRule(const QString &rule);
+
+    /// Returns the position in the host at which the public suffix begins, or -1 if the host is empty or an IP address.
+    /// Sets end to the position after the last label of the host, which excludes any trailing dot
+    int findPublicSuffix(const QString &host, int &end) const;
+
+    /// Returns the index of the child of the node with the given label, or -1 if there is no such child
+    int findChild(int node, const QChar *label, int length) const;
+
+    /// Returns the index of the child of the node with the given label, creating the child if it does not exist
+    int getOrAddChild(int node, const QString &label);
+
+    /// Returns the key of the edge from the given node with a label of the given hash
+    static inline quint64 getEdgeKey(int node, quint32 labelHash)
+    {
+        return (static_cast<quint64>(node) << 32) | labelHash;
+    }
+
+    /// Returns the hash of a label
+    static quint32 hashLabel(const QChar *label, int length);
+
+    /// Returns true if the host is an IPv4 or IPv6 address, false if else
+    static bool isAddress(const QString &host);
+
+private:
+    /// Nodes of the trie. The first node is the root
+    std::vector<Node> m_nodes;
+
+    /// Labels of every node, stored one after the other
+    QString m_labels;
+
+    /// Edges between nodes, keyed by the parent node and the hash of the child's label
+    QMultiHash<quint64, int> m_edges;
+
+    /// Number of rules in the list
+    int m_numRules;
+};
+
+#endif // PUBLICSUFFIXLIST_H
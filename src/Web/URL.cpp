@@ -1,4 +1,5 @@
 #include "URL.h"
+#include "PublicSuffixList.h"
 
 URL::URL() :
     QUrl()
@@ -22,19 +23,6 @@ URL::URL(const QString &url, URL::ParsingMode parsingMode) :
 
 QString URL::getSecondLevelDomain() const
 {
-    const QString topLevelDomain = this->topLevelDomain();
-    const QString host = this->host();
-
-    if (topLevelDomain.isEmpty() || host.isEmpty())
-        return QString();
-
-    QString domain = host.left(host.size() - topLevelDomain.size());
-
-    if (domain.count(QChar('.')) == 0)
-        return host;
-
-    while (domain.count(QChar('.')) != 0)
-        domain = domain.mid(domain.indexOf(QChar('.')) + 1);
-
-    return domain + topLevelDomain;
+    const QString host = this->host().toLower();
+    return PublicSuffixList::instance().getRegistrableDomain(host).toString();
 }
@@ -22,7 +22,8 @@ public:
     /// Constructs a URL from the given string a parsing mode
     URL(const QString &url, ParsingMode parsingMode = URL::TolerantMode);
 
-    /// Returns the second-level domain of the URL (ex: websiteA.com; websiteB.co.uk)
+    /// Returns the second-level domain of the URL (ex: websiteA.com; websiteB.co.uk), as determined by the \ref PublicSuffixList.
+    /// Returns an empty string if the host of the URL is an IP address or a public suffix
     QString getSecondLevelDomain() const;
 };
 
@@ -1,3 +1,4 @@
+#include "AdBlockBridge.h"
 #include "AdBlockManager.h"
 #include "AuthDialog.h"
 #include "AutoFill.h"
@@ -31,21 +32,14 @@
 
 WebPage::WebPage(QObject *parent) :
     QWebEnginePage(parent),
-    m_history(new WebHistory(this)),
-    m_mainFrameHost(),
-    m_domainFilterStyle(),
-    m_mainFrameAdBlockScript(),
-    m_needInjectAdBlockScript(true)
+    m_history(new WebHistory(this))
 {
     setupSlots();
 }
 
 WebPage::WebPage(QWebEngineProfile *profile, QObject *parent) :
     QWebEnginePage(profile, parent),
-    m_history(new WebHistory(this)),
-    m_mainFrameHost(),
-    m_domainFilterStyle(),
-    m_needInjectAdBlockScript(true)
+    m_history(new WebHistory(this))
 {
     setupSlots();
 }
@@ -60,13 +54,12 @@ void WebPage::setupSlots()
     channel->registerObject(QLatin1String("extStorage"), sBrowserApplication->getExtStorage());
     channel->registerObject(QLatin1String("autofill"), new AutoFillBridge(this));
     channel->registerObject(QLatin1String("favicons"), new FaviconStoreBridge(this));
+    channel->registerObject(QLatin1String("adblock"), new AdBlockBridge(this));
     setWebChannel(channel, QWebEngineScript::ApplicationWorld);
 
     connect(this, &WebPage::authenticationRequired,      this, &WebPage::onAuthenticationRequired);
     connect(this, &WebPage::proxyAuthenticationRequired, this, &WebPage::onProxyAuthenticationRequired);
-    connect(this, &WebPage::loadProgress,                this, &WebPage::onLoadProgress);
     connect(this, &WebPage::loadFinished,                this, &WebPage::onLoadFinished);
-    connect(this, &WebPage::urlChanged,                  this, &WebPage::onMainFrameUrlChanged);
     connect(this, &WebPage::featurePermissionRequested,  this, &WebPage::onFeaturePermissionRequested);
     connect(this, &WebPage::renderProcessTerminated,     this, &WebPage::onRenderProcessTerminated);
 
@@ -130,6 +123,10 @@ bool WebPage::acceptNavigationRequest(const QUrl &url, QWebEnginePage::Navigatio
         auto pageScripts = sBrowserApplication->getUserScriptManager()->getAllScriptsFor(url);
         for (auto &script : pageScripts)
             scriptCollection.insert(script);
+
+        // Cosmetic filters are applied from the creation of the document, before its first paint
+        for (const QWebEngineScript &script : AdBlockManager::instance().getCosmeticScripts(URL(url)))
+            scriptCollection.insert(script);
     }
 
     //TODO: if !isMainFrame, check the url and inject the AutoFill script if enabled & applicable
@@ -296,57 +293,11 @@ void WebPage::onFeaturePermissionRequested(const QUrl &securityOrigin, WebPage::
     setFeaturePermission(securityOrigin, feature, policy);
 }
 
-void WebPage::onMainFrameUrlChanged(const QUrl &url)
-{
-    URL urlCopy(url);
-    QString urlHost = urlCopy.host().toLower();
-    if (!urlHost.isEmpty() && m_mainFrameHost.compare(urlHost) != 0)
-    {
-        m_mainFrameHost = urlHost;
-        m_domainFilterStyle = QString("<style>%1</style>").arg(AdBlockManager::instance().getDomainStylesheet(urlCopy));
-        m_domainFilterStyle.replace("'", "\\'");
-    }
-}
-
-void WebPage::onLoadProgress(int percent)
-{
-    if (percent > 0 && percent < 100 && m_needInjectAdBlockScript)
-    {
-        URL pageUrl(url());
-        if (pageUrl.host().isEmpty())
-            return;
-
-        m_needInjectAdBlockScript = false;
-
-        m_mainFrameAdBlockScript = AdBlockManager::instance().getDomainJavaScript(pageUrl);
-        if (!m_mainFrameAdBlockScript.isEmpty())
-            runJavaScript(m_mainFrameAdBlockScript, QWebEngineScript::ApplicationWorld);
-    }
-
-    //if (percent == 100)
-    //    emit loadFinished(true);
-}
-
 void WebPage::onLoadFinished(bool ok)
 {
     if (!ok)
         return;
 
-    URL pageUrl(url());
-
-    QString adBlockStylesheet = AdBlockManager::instance().getStylesheet(pageUrl);
-    adBlockStylesheet.replace("'", "\\'");
-    runJavaScript(QString("document.body.insertAdjacentHTML('beforeend', '%1');").arg(adBlockStylesheet));
-    runJavaScript(QString("document.body.insertAdjacentHTML('beforeend', '%1');").arg(m_domainFilterStyle));
-
-    if (m_needInjectAdBlockScript)
-        m_mainFrameAdBlockScript = AdBlockManager::instance().getDomainJavaScript(pageUrl);
-
-    if (!m_mainFrameAdBlockScript.isEmpty())
-        runJavaScript(m_mainFrameAdBlockScript, QWebEngineScript::UserWorld);
-
-    m_needInjectAdBlockScript = true;
-
     sBrowserApplication->getAutoFill()->onPageLoaded(this, url());
 }
 
@@ -24,24 +24,34 @@ AdBlockManager::AdBlockManager(QObject *parent) :
     m_configFile("AdBlockStub.json"),
     m_subscriptionDir(),
     m_stylesheet(),
+    m_genericSelectors(),
     m_cosmeticJSTemplate(),
+    m_stylesheetJSTemplate(),
     m_subscriptions(),
-    m_importantBlockFilters(),
-    m_blockFilters(),
-    m_allowFilters(),
+    m_snapshot(std::make_shared<AdBlockFilterSnapshot>()),
+    m_snapshotSequence(0),
+    m_snapshotPending(false),
+    m_decisionCache(1024),
+    m_pageExceptionFilters(),
     m_domainStyleFilters(),
     m_domainJSFilters(),
+    m_genericJSFilters(),
     m_customStyleFilters(),
-    m_genericHideFilters(),
+    m_genericCustomStyleFilters(),
     m_cspFilters(),
     m_resourceMap(),
-    m_resourceContentTypeMap(),
+    m_decodedResourceMap(),
     m_domainStylesheetCache(24),
     m_jsInjectionCache(24),
+    m_pageExceptionCache(24),
+    m_cosmeticScriptCache(24),
+    m_cosmeticCache(nullptr),
     m_emptyStr(),
     m_adBlockModel(nullptr),
     m_numRequestsBlocked(0),
-    m_pageAdBlockCount()
+    m_pageAdBlockCount(),
+    m_loadInProgress(false),
+    m_reloadPending(false)
 {
 }
 
@@ -88,7 +98,7 @@ void AdBlockManager::createUserSubscription()
 
 void AdBlockManager::loadStarted(const QUrl &url)
 {
-    m_pageAdBlockCount[url] = 0;
+    m_pageAdBlockCount.reset(url);
 }
 
 AdBlockModel *AdBlockManager::getModel()
@@ -96,22 +106,26 @@ AdBlockModel *AdBlockManager::getModel()
     return nullptr;
 }
 
-const QString &AdBlockManager::getStylesheet(const URL &url) const
+const QString &AdBlockManager::getStylesheet(const URL &url)
 {
     // Check generic hide filters
-    QString requestUrl = url.toString(URL::FullyEncoded).toLower();
-    QString secondLevelDomain = url.getSecondLevelDomain();
-    if (secondLevelDomain.isEmpty())
-        secondLevelDomain = url.host();
-    for (AdBlockFilter *filter : m_genericHideFilters)
-    {
-        if (filter->isMatch(requestUrl, requestUrl, secondLevelDomain, ElementType::Other))
-            return m_emptyStr;
-    }
+    AdBlockRequestContext context(url, url, ElementType::GenericHide);
+    if (m_pageExceptionFilters.findMatch(context))
+        return m_emptyStr;
 
     return m_stylesheet;
 }
 
+QString AdBlockManager::getGenericStylesheet(const URL &url, const QStringList &classes, const QStringList &ids)
+{
+    // Check generic hide filters
+    AdBlockRequestContext context(url, url, ElementType::GenericHide);
+    if (m_pageExceptionFilters.findMatch(context))
+        return QString();
+
+    return m_genericSelectors.getStylesheet(classes, ids);
+}
+
 const QString &AdBlockManager::getDomainStylesheet(const URL &url)
 {
     if (!m_enabled)
@@ -129,7 +143,7 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
 
     QString stylesheet;
     int numStylesheetRules = 0;
-    for (AdBlockFilter *filter : m_domainStyleFilters)
+    for (AdBlockFilter *filter : m_domainStyleFilters.getFilters(domain))
     {
         if (filter->isDomainStyleMatch(domain) && !filter->isException())
         {
@@ -151,7 +165,7 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
     }
 
     // Check for custom stylesheet rules
-    for (AdBlockFilter *filter : m_customStyleFilters)
+    for (AdBlockFilter *filter : m_customStyleFilters.getFilters(domain))
     {
         if (filter->isDomainStyleMatch(domain))
             stylesheet.append(filter->getEvalString());
@@ -177,16 +191,11 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
                                    "})();");
     bool usedCspScript = false;
 
-    QString domain = url.host().toLower();
-    if (domain.startsWith(QLatin1String("www.")))
-        domain = domain.mid(4);
-    if (domain.isEmpty())
-        domain = url.getSecondLevelDomain();
-
-    QString requestUrl = url.toString(QUrl::FullyEncoded).toLower();
+    AdBlockRequestContext context(url, url, ElementType::InlineScript);
+    const QString &domain = context.RequestDomain;
 
     // Check for cache hit
-    std::string requestHostStdStr = url.host().toLower().toStdString();
+    std::string requestHostStdStr = context.RequestHost.toStdString();
     if (requestHostStdStr.empty())
         requestHostStdStr = domain.toStdString();
 
@@ -194,37 +203,23 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
         return m_jsInjectionCache.get(requestHostStdStr);
 
     QString javascript;
-    for (AdBlockFilter *filter : m_domainJSFilters)
+    for (AdBlockFilter *filter : m_domainJSFilters.getFilters(domain))
     {
         if (filter->isDomainStyleMatch(domain))
             javascript.append(filter->getEvalString());
     }
-    for (AdBlockFilter *filter : m_importantBlockFilters)
-    {
-        if (filter->hasElementType(filter->m_blockedTypes, ElementType::InlineScript) && filter->isMatch(requestUrl, requestUrl, domain, ElementType::InlineScript))
-        {
-            javascript.append(cspScript.arg(QLatin1String("script-src 'unsafe-eval' * blob: data:")));
-            usedCspScript = true;
-            break;
-        }
-    }
-    for (AdBlockFilter *filter : m_blockFilters)
+    AdBlockSnapshotPublisher::Reader snapshot = getSnapshot();
+    if (snapshot->findImportantBlockFilter(context) || snapshot->findBlockFilter(context))
     {
-        if (usedCspScript)
-            break;
-
-        if (filter->hasElementType(filter->m_blockedTypes, ElementType::InlineScript) &&filter->isMatch(requestUrl, requestUrl, domain, ElementType::InlineScript))
-        {
-            javascript.append(cspScript.arg(QLatin1String("script-src 'unsafe-eval' * blob: data:")));
-            usedCspScript = true;
-            break;
-        }
+        javascript.append(cspScript.arg(QLatin1String("script-src 'unsafe-eval' * blob: data:")));
+        usedCspScript = true;
     }
+    context.Type = ElementType::CSP;
     for (AdBlockFilter *filter : m_cspFilters)
     {
         if (usedCspScript)
             break;
-        if (!filter->isException() && filter->isMatch(requestUrl, requestUrl, domain, ElementType::CSP))
+        if (!filter->isException() && filter->isMatch(context))
         {
             //qDebug() << "Adding CSP rule from filter: " << filter->getRule();
             javascript.append(cspScript.arg(filter->getContentSecurityPolicy()));
@@ -249,12 +244,8 @@ bool AdBlockManager::shouldBlockRequest(QWebEngineUrlRequestInfo &info)
     if (!m_enabled)
         return false;
 
-    // Get request URL and the originating URL
-    QString requestUrl = info.requestUrl().toString(QUrl::FullyEncoded).toLower();
-    QString baseUrl = getSecondLevelDomain(info.firstPartyUrl()).toLower();//.toString(QUrl::FullyEncoded).toLower();
-
-    if (baseUrl.isEmpty())
-        baseUrl = info.firstPartyUrl().host().toLower();
+    AdBlockRequestContext context(info.requestUrl(), info.firstPartyUrl());
+    const QByteArray &requestUrl = context.RequestUrlLower;
 
     // Convert QWebEngine request info type to ours
     ElementType elemType = ElementType::None;
@@ -276,9 +267,9 @@ bool AdBlockManager::shouldBlockRequest(QWebEngineUrlRequestInfo &info)
             elemType |= ElementType::Image;
             break;
         case QWebEngineUrlRequestInfo::ResourceTypeSubResource:
-            if (requestUrl.endsWith(QLatin1String("htm"))
-                || requestUrl.endsWith(QLatin1String("html"))
-                || requestUrl.endsWith(QLatin1String("xml")))
+            if (requestUrl.endsWith("htm")
+                || requestUrl.endsWith("html")
+                || requestUrl.endsWith("xml"))
             {
                 elemType |= ElementType::Subdocument;
             }
@@ -310,54 +301,39 @@ bool AdBlockManager::shouldBlockRequest(QWebEngineUrlRequestInfo &info)
             break;
     }
 
-    // Perform document type and third party type checking
-    QString domain = info.requestUrl().host().toLower();
-    if (domain.startsWith(QLatin1String("www.")))
-        domain = domain.mid(4);
-    if (domain.isEmpty())
-        domain = getSecondLevelDomain(info.requestUrl());
-
-    if (getSecondLevelDomain(info.requestUrl()) != getSecondLevelDomain(info.firstPartyUrl()))
+    // Perform third party type checking
+    if (context.ThirdParty)
         elemType |= ElementType::ThirdParty;
+    context.Type = elemType;
 
     // Compare to filters
-    for (AdBlockFilter *filter : m_importantBlockFilters)
+    AdBlockSnapshotPublisher::Reader snapshot = getSnapshot();
+    if (AdBlockFilter *filter = snapshot->findImportantBlockFilter(context))
     {
-        if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
+        recordBlockedRequest(info.firstPartyUrl());
+        //qDebug() << "blocked " << requestUrl << " by rule " << filter->getRule();
+        if (filter->isRedirect())
         {
-            ++m_numRequestsBlocked;
-            ++m_pageAdBlockCount[info.firstPartyUrl()];
-            //qDebug() << "blocked " << requestUrl << " by rule " << filter->getRule();
-            if (filter->isRedirect())
-            {
-                info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
-                return false;
-            }
-            return true;
+            info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
+            return false;
         }
+        return true;
     }
-    for (AdBlockFilter *filter : m_allowFilters)
+    if (snapshot->findAllowFilter(context))
     {
-        if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
-        {
-            //qDebug() << "allowed " << requestUrl << " by rule " << filter->getRule();
-            return false;
-        }
+        //qDebug() << "allowed " << requestUrl << " by rule " << filter->getRule();
+        return false;
     }
-    for (AdBlockFilter *filter : m_blockFilters)
+    if (AdBlockFilter *filter = snapshot->findBlockFilter(context))
     {
-        if (filter->isMatch(baseUrl, requestUrl, domain, elemType))
+        recordBlockedRequest(info.firstPartyUrl());
+        //qDebug() << "blocked " << requestUrl << " by rule " << filter->getRule();
+        if (filter->isRedirect())
         {
-            ++m_numRequestsBlocked;
-            ++m_pageAdBlockCount[info.firstPartyUrl()];
-            //qDebug() << "blocked " << requestUrl << " by rule " << filter->getRule();
-            if (filter->isRedirect())
-            {
-                info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
-                return false;
-            }
-            return true;
+            info.redirect(QUrl(QString("blocked:%1").arg(filter->getRedirectName())));
+            return false;
         }
+        return true;
     }
     return false;
 }
@@ -369,21 +345,28 @@ quint64 AdBlockManager::getRequestsBlockedCount() const
 
 int AdBlockManager::getNumberAdsBlocked(const QUrl &url)
 {
-    auto it = m_pageAdBlockCount.find(url);
-    if (it != m_pageAdBlockCount.end())
-        return *it;
+    return m_pageAdBlockCount.getCount(url);
+}
 
-    return 0;
+AdBlockSnapshotPublisher::Reader AdBlockManager::getSnapshot() const
+{
+    return m_snapshot.read();
 }
 
-QString AdBlockManager::getResource(const QString &key) const
+void AdBlockManager::publishSnapshot(std::shared_ptr<const AdBlockFilterSnapshot> snapshot)
 {
-    return m_resourceMap.value(key);
+    m_snapshot.publish(std::move(snapshot));
 }
 
-QString AdBlockManager::getResourceContentType(const QString &key) const
+void AdBlockManager::recordBlockedRequest(const QUrl &firstPartyUrl)
 {
-    return m_resourceContentTypeMap.value(key);
+    ++m_numRequestsBlocked;
+    m_pageAdBlockCount.increment(firstPartyUrl);
+}
+
+AdBlockResource AdBlockManager::getResource(const QString &key) const
+{
+    return m_decodedResourceMap.value(key);
 }
 
 int AdBlockManager::getNumSubscriptions() const
@@ -438,25 +421,6 @@ void AdBlockManager::reloadSubscriptions()
     extractFilters();
 }
 
-QString AdBlockManager::getSecondLevelDomain(const QUrl &url) const
-{
-    const QString topLevelDomain = url.topLevelDomain();
-    const QString host = url.host();
-
-    if (topLevelDomain.isEmpty() || host.isEmpty())
-        return QString();
-
-    QString domain = host.left(host.size() - topLevelDomain.size());
-
-    if (domain.count(QChar('.')) == 0)
-        return host;
-
-    while (domain.count(QChar('.')) != 0)
-        domain = domain.mid(domain.indexOf(QChar('.')) + 1);
-
-    return domain + topLevelDomain;
-}
-
 void AdBlockManager::loadDynamicTemplate()
 {
     QFile templateFile(QLatin1String(":/AdBlock.js"));
@@ -488,13 +452,35 @@ void AdBlockManager::loadResourceFile(const QString &path)
         return;
 
     bool readingValue = false;
-    QString currentKey, mimeType;
-    QByteArray currentValue;
-    QList<QByteArray> contents = f.readAll().split('\n');
-    f.close();
-    for (int i = 0; i < contents.size(); ++i)
+    QString currentKey;
+    QByteArray mimeType, currentValue;
+
+    // Stores the current value in both resource maps, decoding it if the content type says it is base64-encoded
+    auto insertResource = [&]() {
+        AdBlockResource resource;
+        const int base64Idx = mimeType.indexOf(";base64");
+        if (base64Idx >= 0)
+        {
+            resource.MimeType = mimeType.left(base64Idx);
+            resource.Data = QByteArray::fromBase64(currentValue);
+        }
+        else
+        {
+            resource.MimeType = mimeType;
+            resource.Data = currentValue;
+        }
+
+        m_resourceMap.insert(currentKey, QString::fromUtf8(currentValue));
+        m_decodedResourceMap.insert(currentKey, resource);
+        currentValue.clear();
+    };
+
+    while (!f.atEnd())
     {
-        const QByteArray &line = contents.at(i);
+        QByteArray line = f.readLine();
+        while (line.endsWith('\n') || line.endsWith('\r'))
+            line.chop(1);
+
         if ((!readingValue && line.isEmpty()) || line.startsWith('#'))
             continue;
 
@@ -503,12 +489,11 @@ void AdBlockManager::loadResourceFile(const QString &path)
         {
             int sepIdx = line.indexOf(' ');
             if (sepIdx < 0)
-                currentKey = line;
+                currentKey = QString::fromUtf8(line);
             else
             {
-                currentKey = line.left(sepIdx);
-                mimeType = line.mid(sepIdx + 1);
-                m_resourceContentTypeMap.insert(currentKey, mimeType);
+                currentKey = QString::fromUtf8(line.left(sepIdx));
+                mimeType = line.mid(sepIdx + 1).trimmed();
             }
             readingValue = true;
         }
@@ -518,18 +503,21 @@ void AdBlockManager::loadResourceFile(const QString &path)
             if (!line.isEmpty())
             {
                 currentValue.append(line);
-                if (mimeType.contains(QLatin1String("javascript")))
+                if (mimeType.contains("javascript"))
                     currentValue.append('\n');
             }
             else
             {
                 // Insert key-value pair into map once an empty line is reached and search for next key
-                m_resourceMap.insert(currentKey, QString(currentValue));
-                currentValue.clear();
+                insertResource();
                 readingValue = false;
             }
         }
     }
+
+    // The last resource in a file does not need to be followed by an empty line
+    if (readingValue && !currentValue.isEmpty())
+        insertResource();
 }
 
 void AdBlockManager::loadSubscriptions()
@@ -589,14 +577,14 @@ void AdBlockManager::loadSubscriptions()
 
 void AdBlockManager::clearFilters()
 {
-    m_importantBlockFilters.clear();
-    m_allowFilters.clear();
-    m_blockFilters.clear();
     m_stylesheet.clear();
+    m_genericSelectors.clear();
     m_domainStyleFilters.clear();
     m_domainJSFilters.clear();
+    m_genericJSFilters.clear();
     m_customStyleFilters.clear();
-    m_genericHideFilters.clear();
+    m_genericCustomStyleFilters.clear();
+    m_pageExceptionFilters.clear();
     m_cspFilters.clear();
 }
 
@@ -609,8 +597,10 @@ void AdBlockManager::extractFilters()
     // Used to remove bad filters (badfilter option from uBlock)
     QSet<QString> badFilters, badHideFilters;
 
+    std::vector<AdBlockFilter*> importantBlockFilters, blockFilters, allowFilters, genericHideFilters;
+
     // Setup global stylesheet string
-    m_stylesheet = QLatin1String("<style>");
+    m_stylesheet.clear();
 
     for (AdBlockSubscription &s : m_subscriptions)
     {
@@ -634,11 +624,13 @@ void AdBlockManager::extractFilters()
             }
             else if (filter->getCategory() == FilterCategory::StylesheetJS)
             {
-                m_domainJSFilters.push_back(filter);
+                for (const QString &domain : filter->m_domainBlacklist)
+                    m_domainJSFilters.insert(domain, filter);
             }
             else if (filter->getCategory() == FilterCategory::StylesheetCustom)
             {
-                m_customStyleFilters.push_back(filter);
+                for (const QString &domain : filter->m_domainBlacklist)
+                    m_customStyleFilters.insert(domain, filter);
             }
             else if (filter->hasElementType(filter->m_blockedTypes, ElementType::BadFilter))
             {
@@ -654,45 +646,52 @@ void AdBlockManager::extractFilters()
                 if (filter->isException())
                 {
                     if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
-                        m_genericHideFilters.push_back(filter);
+                        genericHideFilters.push_back(filter);
                     else
-                        m_allowFilters.push_back(filter);
+                        allowFilters.push_back(filter);
                 }
                 else if (filter->isImportant())
                 {
                     if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
                         badHideFilters.insert(filter->getRule());
                     else
-                        m_importantBlockFilters.push_back(filter);
+                        importantBlockFilters.push_back(filter);
                 }
                 else
-                    m_blockFilters.push_back(filter);
+                    blockFilters.push_back(filter);
             }
         }
     }
 
-    // Remove bad filters from m_allowFilters, m_blockFilters, m_genericHideFilters, m_cspFilters
-    for (auto it = m_allowFilters.begin(); it != m_allowFilters.end(); ++it)
+    // Remove bad filters from allowFilters, blockFilters, genericHideFilters, m_cspFilters
+    for (auto it = allowFilters.begin(); it != allowFilters.end(); ++it)
     {
         if (badFilters.contains((*it)->getRule()))
-            m_allowFilters.erase(it);
+            allowFilters.erase(it);
     }
-    for (auto it = m_blockFilters.begin(); it != m_blockFilters.end(); ++it)
+    for (auto it = blockFilters.begin(); it != blockFilters.end(); ++it)
     {
         if (badFilters.contains((*it)->getRule()))
-            m_blockFilters.erase(it);
+            blockFilters.erase(it);
     }
     for (auto it = m_cspFilters.begin(); it != m_cspFilters.end(); ++it)
     {
         if (badFilters.contains((*it)->getRule()))
             m_cspFilters.erase(it);
     }
-    for (auto it = m_genericHideFilters.begin(); it != m_genericHideFilters.end(); ++it)
+    for (auto it = genericHideFilters.begin(); it != genericHideFilters.end(); ++it)
     {
         if (badHideFilters.contains((*it)->getRule()))
-            m_genericHideFilters.erase(it);
+            genericHideFilters.erase(it);
     }
 
+    AdBlockFilterSlice networkFilters;
+    networkFilters.ImportantBlockFilters = importantBlockFilters;
+    networkFilters.BlockFilters = blockFilters;
+    networkFilters.AllowFilters = allowFilters;
+    publishSnapshot(std::make_shared<AdBlockFilterSnapshot>(networkFilters, std::vector<std::shared_ptr<const AdBlockFilterList>>()));
+    m_pageExceptionFilters.build(genericHideFilters);
+
     // Parse stylesheet exceptions
     QHashIterator<QString, AdBlockFilter*> it(stylesheetExceptionMap);
     while (it.hasNext())
@@ -704,7 +703,7 @@ void AdBlockManager::extractFilters()
             continue;
 
         AdBlockFilter *filter = it.value();
-        stylesheetFilterMap.value(it.key())->m_domainWhitelist.unite(filter->m_domainBlacklist);
+        stylesheetFilterMap.value(it.key())->addDomainsToWhitelist(filter->m_domainBlacklist);
     }
 
     // Parse stylesheet blocking rules
@@ -717,10 +716,14 @@ void AdBlockManager::extractFilters()
 
         if (filter->hasDomainRules())
         {
-            m_domainStyleFilters.push_back(filter);
+            for (const QString &domain : filter->m_domainBlacklist)
+                m_domainStyleFilters.insert(domain, filter);
             continue;
         }
 
+        if (m_genericSelectors.insert(filter->getEvalString()))
+            continue;
+
         if (numStylesheetRules > 1000)
         {
             m_stylesheet = m_stylesheet.left(m_stylesheet.size() - 1);
@@ -738,7 +741,6 @@ void AdBlockManager::extractFilters()
         m_stylesheet = m_stylesheet.left(m_stylesheet.size() - 1);
         m_stylesheet.append(QLatin1String("{ display: none !important; } "));
     }
-    m_stylesheet.append(QLatin1String("</style>"));
 }
 
 void AdBlockManager::save()
@@ -757,7 +759,7 @@ void AdBlockManager::save()
     // Subscription object format: { "enabled": (true|false), "last_update": (timestamp),
     //                               "next_update": (timestamp), "source": "origin_url" }
     QJsonObject configObj;
-    configObj.insert(QLatin1String("requests_blocked"), QJsonValue(QString::number(m_numRequestsBlocked)));
+    configObj.insert(QLatin1String("requests_blocked"), QJsonValue(QString::number(m_numRequestsBlocked.load())));
     for (auto it = m_subscriptions.cbegin(); it != m_subscriptions.cend(); ++it)
     {
         QJsonObject subscriptionObj;
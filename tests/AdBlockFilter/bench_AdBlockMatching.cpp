@@ -0,0 +1,593 @@
+#include "AdBlockFilter.h"
+#include "AdBlockFilterParser.h"
+#include "AdBlockFilterSnapshot.h"
+#include "AdBlockRequestContext.h"
+#include "AdBlockSubscription.h"
+#include "Bitfield.h"
+#include "StringSearch.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QUrl>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+/**
+ * Replays a corpus of network requests through the filter matching path of the ad block system, and reports
+ * its throughput, per-request latency, filter loading time and peak memory use as JSON, so that results can be
+ * compared across commits.
+ *
+ * Filter lists are given with --list (the list in the data directory is used by default), and the corpus with
+ * --corpus, as a tab separated file of (first party URL, request URL, resource type) lines. Resource types use
+ * the names of the filter options, such as "script" or "xmlhttprequest". Without a corpus, a deterministic one is
+ * generated from the seed, with a mix of first party, CDN, advertising and tracking requests.
+ *
+ * Each request is also evaluated against the filters as they were before \ref AdBlockFilterSlice::optimize, and
+ * the benchmark exits with an error if the optimizer changed any decision.
+ */
+
+namespace
+{
+    /// A request of the corpus
+    struct BenchmarkRequest
+    {
+        /// URL of the page that made the request
+        QUrl FirstPartyUrl;
+
+        /// URL of the requested resource
+        QUrl RequestUrl;
+
+        /// Type of the requested resource
+        ElementType Type;
+    };
+
+    /// Removes the filters disabled by a badfilter rule from the network containers, without any of the other steps
+    /// of \ref AdBlockFilterSlice::optimize
+    void removeBadFilters(AdBlockFilterSlice &filters)
+    {
+        for (std::vector<AdBlockFilter*> *container : { &filters.ImportantBlockFilters, &filters.BlockFilters, &filters.BlockFiltersByPattern,
+                                                         &filters.BlockFiltersByDomain, &filters.AllowFilters, &filters.AllowFiltersByDomain })
+        {
+            container->erase(std::remove_if(container->begin(), container->end(), [&filters](AdBlockFilter *filter) {
+                return filters.BadFilters.contains(filter->getRule());
+            }), container->end());
+        }
+    }
+
+    /// Returns true if both decisions take the same action on the request, false if else
+    bool isSameDecision(const AdBlockDecisionCache::Decision &a, const AdBlockDecisionCache::Decision &b)
+    {
+        if (a.Matched != b.Matched)
+            return false;
+        if (!a.Matched)
+            return true;
+        return a.Action == b.Action && a.Filter->getRedirectName() == b.Filter->getRedirectName();
+    }
+
+    /// Returns the element type with the given filter option name, or ElementType::Other if the name is not known
+    ElementType getResourceType(const QString &name)
+    {
+        return eOptionMap.value(name.trimmed().toLower(), ElementType::Other);
+    }
+
+    /// Loads a corpus of tab separated (first party URL, request URL, resource type) lines. Empty lines and lines
+    /// starting with '#' are ignored
+    std::vector<BenchmarkRequest> loadCorpus(const QString &path)
+    {
+        std::vector<BenchmarkRequest> requests;
+
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return requests;
+
+        QString line;
+        QTextStream stream(&file);
+        while (stream.readLineInto(&line))
+        {
+            if (line.isEmpty() || line.startsWith(QChar('#')))
+                continue;
+
+            const QStringList fields = line.split(QChar('\t'));
+            if (fields.size() < 3)
+                continue;
+
+            requests.push_back(BenchmarkRequest { QUrl(fields.at(0)), QUrl(fields.at(1)), getResourceType(fields.at(2)) });
+        }
+
+        return requests;
+    }
+
+    /// Generates a corpus of the given number of requests. The same seed always produces the same corpus
+    std::vector<BenchmarkRequest> generateCorpus(int numRequests, quint32 seed)
+    {
+        std::mt19937 random(seed);
+        auto pick = [&random](const auto &values) -> decltype(values.at(0)) {
+            std::uniform_int_distribution<std::size_t> distribution(0, values.size() - 1);
+            return values.at(distribution(random));
+        };
+        auto number = [&random](int maxValue) {
+            return std::uniform_int_distribution<int>(0, maxValue)(random);
+        };
+        // Not every path has a placeholder, so it is replaced rather than given to QString::arg
+        auto expand = [&number](const QString &path) {
+            return QString(path).replace(QLatin1String("%1"), QString::number(number(99999)));
+        };
+
+        const std::vector<QString> sites {
+            QLatin1String("news.example.com"), QLatin1String("shop.example.com"), QLatin1String("blog.example.org"),
+            QLatin1String("video.example.com"), QLatin1String("forum.example.net"), QLatin1String("docs.example.org"),
+            QLatin1String("www.example.org"), QLatin1String("social.example.org"), QLatin1String("partner.example.org"),
+            QLatin1String("mail.example.net"), QLatin1String("maps.example.com"), QLatin1String("www.example.co.uk")
+        };
+        const std::vector<QString> cdnHosts {
+            QLatin1String("cdn.example.net"), QLatin1String("static.example.com"), QLatin1String("fonts.example.net"),
+            QLatin1String("img.example.org"), QLatin1String("assets.example.co.uk")
+        };
+        const std::vector<QString> adHosts {
+            QLatin1String("ads.example.com"), QLatin1String("adserver.example.net"), QLatin1String("adnetwork.example"),
+            QLatin1String("track.example.org"), QLatin1String("metrics.example.com"), QLatin1String("pixel.example.net"),
+            QLatin1String("beacon.example.org"), QLatin1String("cdn-ads.example"), QLatin1String("banners.example.com"),
+            QLatin1String("pagead.example.com"), QLatin1String("stats.example.net"), QLatin1String("analytics.example.org"),
+            QLatin1String("widgets.example.net"), QLatin1String("adtrack.example"), QLatin1String("legacy.example.net")
+        };
+        const std::vector<QString> adPaths {
+            QLatin1String("/adserver/serve?zone=%1"), QLatin1String("/banner/top/img.png?v=%1"), QLatin1String("/ads/banner_%1.gif"),
+            QLatin1String("/images/ad_728x90.png?%1"), QLatin1String("/img/ad-300x250.jpg?%1"), QLatin1String("/pixel.gif?uid=%1"),
+            QLatin1String("/track/event?name=view&id=%1"), QLatin1String("/js/prebid%1.js"), QLatin1String("/ads.js?client=%1"),
+            QLatin1String("/affiliate/%1/click"), QLatin1String("/pagead/show_ads.js?%1"), QLatin1String("/collect?tid=%1"),
+            QLatin1String("/analytics.js?%1"), QLatin1String("/ad.php"), QLatin1String("/search?q=ad_type&ad_type=%1")
+        };
+        const std::vector<QString> pagePaths {
+            QLatin1String("/"), QLatin1String("/index.html"), QLatin1String("/articles/%1"), QLatin1String("/products/item-%1"),
+            QLatin1String("/search?q=term%1&page=2"), QLatin1String("/user/profile/%1"), QLatin1String("/watch?v=%1")
+        };
+
+        struct ResourceKind
+        {
+            QString Path;
+            ElementType Type;
+        };
+        const std::vector<ResourceKind> resources {
+            { QLatin1String("/static/js/app.%1.js"), ElementType::Script },
+            { QLatin1String("/static/css/main.%1.css"), ElementType::Stylesheet },
+            { QLatin1String("/images/photos/%1.jpg"), ElementType::Image },
+            { QLatin1String("/api/v2/items?offset=%1&limit=20"), ElementType::XMLHTTPRequest },
+            { QLatin1String("/embed/frame-%1.html"), ElementType::Subdocument },
+            { QLatin1String("/media/video-%1.mp4"), ElementType::Other },
+            { QLatin1String("/fonts/open-sans-%1.woff2"), ElementType::Other },
+            { QLatin1String("/favicon.ico"), ElementType::Image }
+        };
+        const std::vector<ElementType> adTypes {
+            ElementType::Script, ElementType::Image, ElementType::Subdocument, ElementType::XMLHTTPRequest, ElementType::Ping
+        };
+
+        // Each random value is drawn in its own statement, since the evaluation order of function arguments is
+        // unspecified and would otherwise make the corpus depend on the compiler
+        std::vector<BenchmarkRequest> requests;
+        requests.reserve(static_cast<std::size_t>(numRequests));
+        for (int i = 0; i < numRequests; ++i)
+        {
+            const QString &site = pick(sites);
+            const QString pagePath = expand(pick(pagePaths));
+            const QUrl firstPartyUrl(QString("https://%1%2").arg(site, pagePath));
+
+            QString host, path;
+            ElementType type = ElementType::Script;
+
+            const int kind = number(99);
+            if (kind < 62)
+            {
+                // Resource of the page itself, or from a content delivery network
+                const ResourceKind &resource = pick(resources);
+                host = (kind < 40) ? site : pick(cdnHosts);
+                path = expand(resource.Path);
+                type = resource.Type;
+            }
+            else if (kind < 94)
+            {
+                // Advertising or tracking host, or an advertising path on an unrelated host
+                host = (kind < 82) ? pick(adHosts) : pick(cdnHosts);
+                path = expand(pick(adPaths));
+                type = pick(adTypes);
+            }
+            else if (number(1) == 0)
+            {
+                // Host that only a regular expression filter matches
+                const int server = number(99);
+                const int network = number(99);
+                host = QString("srv%1.adnet%2.example").arg(server).arg(network);
+                path = expand(QLatin1String("/p/%1.js"));
+            }
+            else
+            {
+                // Path that only a regular expression filter matches
+                const int high = number(0x7fffffff);
+                const int low = number(0xffff);
+                host = QLatin1String("cdn.example.net");
+                path = QString("/%1%2.js").arg(high, 24, 16, QChar('0')).arg(low, 8, 16, QChar('0'));
+            }
+
+            requests.push_back(BenchmarkRequest { firstPartyUrl, QUrl(QString("https://%1%2").arg(host, path)), type });
+        }
+
+        return requests;
+    }
+
+    /// Returns the peak resident set size of the process in kilobytes, or -1 if it is not available
+    qint64 getPeakRssKb()
+    {
+#if defined(Q_OS_MACOS)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return static_cast<qint64>(usage.ru_maxrss) / 1024;
+#elif defined(Q_OS_UNIX)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return static_cast<qint64>(usage.ru_maxrss);
+#endif
+        return -1;
+    }
+
+    /// Returns the value at the given percentile (0 to 100) of the sorted values
+    qint64 getPercentile(const std::vector<qint64> &sortedValues, double percentile)
+    {
+        if (sortedValues.empty())
+            return 0;
+
+        const std::size_t index = static_cast<std::size_t>(percentile / 100.0 * static_cast<double>(sortedValues.size() - 1) + 0.5);
+        return sortedValues.at(std::min(index, sortedValues.size() - 1));
+    }
+
+    /// Rabin-Karp search of a needle, as done by AdBlockFilter::filterContains and URLSuggestionWorker::isStringMatch
+    /// before they used \ref StringSearch. Kept as the baseline that the kernels are compared with
+    class RabinKarpSearch
+    {
+    public:
+        /// Precomputes the hashes of the needle, as the filters did when they were parsed
+        explicit RabinKarpSearch(const QString &needle) :
+            m_needle(needle),
+            m_needleHash(0),
+            m_differenceHash(1)
+        {
+            for (int i = 1; i < m_needle.size(); ++i)
+                m_differenceHash = (m_differenceHash * RadixLength) % Prime;
+
+            for (int i = 0; i < m_needle.size(); ++i)
+                m_needleHash = (RadixLength * m_needleHash + m_needle.at(i).unicode()) % Prime;
+        }
+
+        /// Returns the position of the needle in the haystack, or -1 if it is not found
+        int indexOf(const QString &haystack) const
+        {
+            const int needleLength = m_needle.size();
+            const int haystackLength = haystack.size();
+            if (needleLength > haystackLength)
+                return -1;
+            if (needleLength == 0)
+                return 0;
+
+            const QChar *needlePtr = m_needle.constData();
+            const QChar *haystackPtr = haystack.constData();
+
+            quint64 t = 0;
+            for (int i = 0; i < needleLength; ++i)
+                t = (RadixLength * t + haystackPtr[i].unicode()) % Prime;
+
+            const int lengthDiff = haystackLength - needleLength;
+            for (int i = 0; i <= lengthDiff; ++i)
+            {
+                if (m_needleHash == t)
+                {
+                    int j = 0;
+                    while (j < needleLength && haystackPtr[i + j].unicode() == needlePtr[j].unicode())
+                        ++j;
+
+                    if (j == needleLength)
+                        return i;
+                }
+
+                if (i < lengthDiff)
+                {
+                    t = RadixLength * (t + Prime - m_differenceHash * haystackPtr[i].unicode() % Prime) % Prime;
+                    t = (t + haystackPtr[needleLength + i].unicode()) % Prime;
+                }
+            }
+
+            return -1;
+        }
+
+    private:
+        /// Radix and modulus of the rolling hash
+        static constexpr quint64 RadixLength = 256ULL;
+        static constexpr quint64 Prime = 89999027ULL;
+
+        /// The string searched for
+        QString m_needle;
+
+        /// Hash of the needle
+        quint64 m_needleHash;
+
+        /// Weight of the character leaving the window, RadixLength ^ (needle length - 1) mod Prime
+        quint64 m_differenceHash;
+    };
+
+    /**
+     * @brief Times substring searches on the request URLs of the corpus
+     *
+     * The URLs are searched both as UTF-16 strings, the form that the filters and URL suggestions search, and as
+     * encoded bytes. The UTF-16 searches include the Rabin-Karp baseline that \ref StringSearch replaced.
+     * @return Mean time of a search in nanoseconds, for each method and form of the URLs
+     */
+    QJsonObject benchmarkStringSearch(const std::vector<BenchmarkRequest> &requests)
+    {
+        const std::vector<QByteArray> needles {
+            QByteArrayLiteral("/ads/"), QByteArrayLiteral("banner"), QByteArrayLiteral("pixel.gif?"), QByteArrayLiteral("analytics.js"),
+            QByteArrayLiteral("/affiliate/"), QByteArrayLiteral("doubleclick"), QByteArrayLiteral("&ad_type="), QByteArrayLiteral("/track/event?")
+        };
+
+        std::vector<QString> stringNeedles;
+        std::vector<RabinKarpSearch> rabinKarpNeedles;
+        for (const QByteArray &needle : needles)
+        {
+            stringNeedles.push_back(QString::fromLatin1(needle));
+            rabinKarpNeedles.emplace_back(stringNeedles.back());
+        }
+
+        std::vector<QByteArray> urls;
+        std::vector<QString> stringUrls;
+        urls.reserve(requests.size());
+        stringUrls.reserve(requests.size());
+        for (const BenchmarkRequest &request : requests)
+        {
+            urls.push_back(request.RequestUrl.toEncoded(QUrl::FullyEncoded));
+            stringUrls.push_back(request.RequestUrl.toString(QUrl::FullyEncoded));
+        }
+
+        const double numSearches = static_cast<double>(urls.size() * needles.size());
+        int matches = 0;
+
+        auto timeSearches = [&](const auto &haystacks, const auto &searchNeedles, const auto &search) {
+            QElapsedTimer timer;
+            timer.start();
+            for (const auto &haystack : haystacks)
+            {
+                for (const auto &needle : searchNeedles)
+                    matches += search(haystack, needle) >= 0 ? 1 : 0;
+            }
+            return numSearches > 0 ? static_cast<double>(timer.nsecsElapsed()) / numSearches : 0.0;
+        };
+
+        QJsonObject utf16Result, latin1Result;
+        utf16Result.insert(QLatin1String("RabinKarp"), timeSearches(stringUrls, rabinKarpNeedles, [](const QString &url, const RabinKarpSearch &needle) {
+            return needle.indexOf(url);
+        }));
+        utf16Result.insert(QLatin1String("QString"), timeSearches(stringUrls, stringNeedles, [](const QString &url, const QString &needle) {
+            return url.indexOf(needle);
+        }));
+        latin1Result.insert(QLatin1String("QByteArray"), timeSearches(urls, needles, [](const QByteArray &url, const QByteArray &needle) {
+            return url.indexOf(needle);
+        }));
+
+        const StringSearch::Kernel defaultKernel = StringSearch::getKernel();
+        for (StringSearch::Kernel kernel : { StringSearch::Kernel::Scalar, StringSearch::Kernel::SSE2, StringSearch::Kernel::AVX2 })
+        {
+            if (!StringSearch::setKernel(kernel))
+                continue;
+
+            const QLatin1String kernelName(StringSearch::getKernelName());
+            utf16Result.insert(kernelName, timeSearches(stringUrls, stringNeedles, [](const QString &url, const QString &needle) {
+                return StringSearch::indexOf(url, needle);
+            }));
+            latin1Result.insert(kernelName, timeSearches(urls, needles, [](const QByteArray &url, const QByteArray &needle) {
+                return StringSearch::indexOf(url, needle);
+            }));
+        }
+        StringSearch::setKernel(defaultKernel);
+
+        QJsonObject result;
+        result.insert(QLatin1String("utf16"), utf16Result);
+        result.insert(QLatin1String("latin1"), latin1Result);
+
+        // Keeps the searches from being optimized away
+        result.insert(QLatin1String("matches"), matches);
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QLatin1String("AdBlockMatchingBenchmark"));
+
+    QCommandLineParser commandLine;
+    commandLine.setApplicationDescription(QLatin1String("Measures the request matching throughput of the ad block filters"));
+    commandLine.addHelpOption();
+
+    QCommandLineOption listOption(QLatin1String("list"), QLatin1String("Filter list to load. May be given more than once"), QLatin1String("file"));
+    QCommandLineOption corpusOption(QLatin1String("corpus"), QLatin1String("Tab separated corpus of (first party URL, request URL, type) lines"), QLatin1String("file"));
+    QCommandLineOption requestsOption(QLatin1String("requests"), QLatin1String("Number of requests to generate without a corpus"), QLatin1String("count"), QLatin1String("50000"));
+    QCommandLineOption seedOption(QLatin1String("seed"), QLatin1String("Seed of the generated corpus"), QLatin1String("seed"), QLatin1String("1"));
+    QCommandLineOption iterationsOption(QLatin1String("iterations"), QLatin1String("Number of times the corpus is replayed"), QLatin1String("count"), QLatin1String("5"));
+    QCommandLineOption outputOption(QLatin1String("output"), QLatin1String("Writes the results to the given file instead of the standard output"), QLatin1String("file"));
+    commandLine.addOptions({ listOption, corpusOption, requestsOption, seedOption, iterationsOption, outputOption });
+    commandLine.process(app);
+
+    QStringList listPaths = commandLine.values(listOption);
+    if (listPaths.isEmpty())
+        listPaths.append(QLatin1String(ADBLOCK_BENCHMARK_DATA_DIR "/benchmark_filters.txt"));
+
+    // Load each filter list as a subscription, which parses its rules and sorts them into a slice
+    AdBlockFilterSlice filters;
+    std::vector<std::shared_ptr<const AdBlockFilterList>> filterLists;
+    std::size_t numFilters = 0;
+    qint64 loadTimeNs = 0;
+
+    for (const QString &path : listPaths)
+    {
+        if (!QFile::exists(path))
+        {
+            QTextStream(stderr) << "Could not open filter list " << path << endl;
+            return 1;
+        }
+
+        AdBlockSubscription subscription(path);
+
+        QElapsedTimer timer;
+        timer.start();
+        subscription.load();
+        loadTimeNs += timer.nsecsElapsed();
+
+        numFilters += subscription.getFilters()->size();
+        filterLists.push_back(subscription.getFilters());
+        filters.append(subscription.getSlice());
+    }
+
+    // The reference snapshot only has the filters disabled by badfilter rules removed, as was done before the optimizer
+    AdBlockFilterSlice referenceFilters = filters;
+    removeBadFilters(referenceFilters);
+    const AdBlockFilterSnapshot referenceSnapshot(referenceFilters, filterLists);
+
+    // Optimize the filters, and build the snapshot the same way as AdBlockManager::rebuildFilters
+    QElapsedTimer snapshotTimer;
+    snapshotTimer.start();
+    std::shared_ptr<AdBlockFilterList> mergedFilters = std::make_shared<AdBlockFilterList>();
+    const AdBlockFilterSlice::OptimizationStatistics optimization = filters.optimize(*mergedFilters);
+    filterLists.push_back(mergedFilters);
+    std::shared_ptr<const AdBlockFilterSnapshot> snapshot = std::make_shared<AdBlockFilterSnapshot>(filters, std::move(filterLists));
+    const qint64 snapshotTimeNs = snapshotTimer.nsecsElapsed();
+
+    // Load or generate the corpus
+    std::vector<BenchmarkRequest> requests;
+    const QString corpusPath = commandLine.value(corpusOption);
+    if (!corpusPath.isEmpty())
+    {
+        requests = loadCorpus(corpusPath);
+        if (requests.empty())
+        {
+            QTextStream(stderr) << "Could not load any request from the corpus " << corpusPath << endl;
+            return 1;
+        }
+    }
+    else
+        requests = generateCorpus(std::max(1, commandLine.value(requestsOption).toInt()), commandLine.value(seedOption).toUInt());
+
+    // The optimizer must not change the outcome of any request
+    int numMismatches = 0;
+    for (const BenchmarkRequest &request : requests)
+    {
+        AdBlockRequestContext context(request.RequestUrl, request.FirstPartyUrl);
+        context.Type = request.Type;
+        if (context.ThirdParty)
+            context.Type |= ElementType::ThirdParty;
+
+        if (!isSameDecision(referenceSnapshot.evaluate(context), snapshot->evaluate(context)))
+        {
+            if (numMismatches == 0)
+                QTextStream(stderr) << "Optimized filters changed the decision of " << request.RequestUrl.toString() << endl;
+            ++numMismatches;
+        }
+    }
+
+    // The first pass warms up the caches and is not measured. Each request is timed from the creation of its context,
+    // since that is part of the work done for every intercepted request
+    const int iterations = std::max(1, commandLine.value(iterationsOption).toInt());
+    std::vector<qint64> latencies;
+    latencies.reserve(requests.size() * static_cast<std::size_t>(iterations));
+
+    int numBlocked = 0, numAllowed = 0;
+    qint64 totalTimeNs = 0;
+    QElapsedTimer requestTimer;
+    for (int pass = 0; pass <= iterations; ++pass)
+    {
+        numBlocked = 0;
+        numAllowed = 0;
+        for (const BenchmarkRequest &request : requests)
+        {
+            requestTimer.start();
+
+            AdBlockRequestContext context(request.RequestUrl, request.FirstPartyUrl);
+            context.Type = request.Type;
+            if (context.ThirdParty)
+                context.Type |= ElementType::ThirdParty;
+
+            const AdBlockDecisionCache::Decision decision = snapshot->evaluate(context);
+            const qint64 elapsed = requestTimer.nsecsElapsed();
+
+            if (decision.Matched)
+            {
+                if (decision.Action == AdBlockFilterAction::Allow)
+                    ++numAllowed;
+                else
+                    ++numBlocked;
+            }
+
+            if (pass > 0)
+            {
+                latencies.push_back(elapsed);
+                totalTimeNs += elapsed;
+            }
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const double numMeasured = static_cast<double>(latencies.size());
+
+    QJsonObject filterStats;
+    filterStats.insert(QLatin1String("lists"), listPaths.size());
+    filterStats.insert(QLatin1String("filters"), static_cast<double>(numFilters));
+    filterStats.insert(QLatin1String("load_ms"), static_cast<double>(loadTimeNs) / 1000000.0);
+    filterStats.insert(QLatin1String("snapshot_ms"), static_cast<double>(snapshotTimeNs) / 1000000.0);
+
+    QJsonObject optimizerStats;
+    optimizerStats.insert(QLatin1String("badfilter"), static_cast<double>(optimization.BadFilters));
+    optimizerStats.insert(QLatin1String("duplicates"), static_cast<double>(optimization.Duplicates));
+    optimizerStats.insert(QLatin1String("subsumed"), static_cast<double>(optimization.Subsumed));
+    optimizerStats.insert(QLatin1String("merged"), static_cast<double>(optimization.Merged));
+    optimizerStats.insert(QLatin1String("decision_mismatches"), numMismatches);
+    filterStats.insert(QLatin1String("optimizer"), optimizerStats);
+
+    QJsonObject matchingStats;
+    matchingStats.insert(QLatin1String("requests"), static_cast<int>(requests.size()));
+    matchingStats.insert(QLatin1String("iterations"), iterations);
+    matchingStats.insert(QLatin1String("blocked"), numBlocked);
+    matchingStats.insert(QLatin1String("allowed_by_exception"), numAllowed);
+    matchingStats.insert(QLatin1String("requests_per_second"), totalTimeNs > 0 ? numMeasured * 1000000000.0 / static_cast<double>(totalTimeNs) : 0.0);
+    matchingStats.insert(QLatin1String("mean_ns"), numMeasured > 0 ? static_cast<double>(totalTimeNs) / numMeasured : 0.0);
+    matchingStats.insert(QLatin1String("p50_ns"), static_cast<double>(getPercentile(latencies, 50.0)));
+    matchingStats.insert(QLatin1String("p99_ns"), static_cast<double>(getPercentile(latencies, 99.0)));
+    matchingStats.insert(QLatin1String("max_ns"), latencies.empty() ? 0.0 : static_cast<double>(latencies.back()));
+
+    QJsonObject results;
+    results.insert(QLatin1String("filters"), filterStats);
+    results.insert(QLatin1String("matching"), matchingStats);
+    results.insert(QLatin1String("string_search_ns"), benchmarkStringSearch(requests));
+    results.insert(QLatin1String("peak_rss_kb"), static_cast<double>(getPeakRssKb()));
+
+    const QByteArray json = QJsonDocument(results).toJson();
+    const QString outputPath = commandLine.value(outputOption);
+    if (outputPath.isEmpty())
+    {
+        QTextStream(stdout) << json;
+        return numMismatches > 0 ? 1 : 0;
+    }
+
+    QFile outputFile(outputPath);
+    if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate) || outputFile.write(json) < 0)
+    {
+        QTextStream(stderr) << "Could not write the results to " << outputPath << endl;
+        return 1;
+    }
+    return numMismatches > 0 ? 1 : 0;
+}
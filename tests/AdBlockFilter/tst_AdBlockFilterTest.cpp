@@ -1,8 +1,35 @@
+#include "AdBlockCompiledPattern.h"
+#include "AdBlockCosmeticCache.h"
+#include "AdBlockDecisionCache.h"
+#include "AdBlockDomainListPool.h"
+#include "AdBlockDomainTrie.h"
 #include "AdBlockFilter.h"
+#include "AdBlockFilterCache.h"
+#include "AdBlockFilterIndex.h"
 #include "AdBlockFilterParser.h"
+#include "AdBlockFilterSnapshot.h"
+#include "AdBlockLog.h"
+#include "AdBlockPatternMatcher.h"
+#include "AdBlockProfiler.h"
+#include "AdBlockRequestContext.h"
+#include "AdBlockPageCounter.h"
+#include "AdBlockSelectorIndex.h"
+#include "AdBlockSnapshotPublisher.h"
+#include "AdBlockSubscription.h"
+#include "PublicSuffixList.h"
+#include "StringSearch.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QString>
+#include <QTemporaryDir>
+#include <QtConcurrent>
 #include <QtTest>
 #include <QUrl>
 
@@ -21,6 +48,27 @@ private Q_SLOTS:
     void testCase1();
     void testCase2();
     void testCase3();
+    void testPatternMatcher();
+    void testRequestContext();
+    void testPublicSuffixList();
+    void testPageExceptions();
+    void testFilterIndexOrder();
+    void testCompiledPattern();
+    void testFilterCache();
+    void testCosmeticCache();
+    void testDomainTrie();
+    void testSelectorIndex();
+    void testFilterSnapshot();
+    void testSnapshotPublisher();
+    void testPageCounter();
+    void testFilterSlice();
+    void testFilterOptimizer();
+    void testOptimizerDecisions();
+    void testDecisionCache();
+    void testAdBlockLog();
+    void testDomainListPool();
+    void testStringSearch();
+    void testProfiler();
 
 private:
     std::unique_ptr<AdBlockFilter> domainCSSFilter;
@@ -129,6 +177,950 @@ void AdBlockFilterTest::testCase3()
     QVERIFY2(blockScriptDomainRule->isMatch(baseUrl, requestUrlStr, domain, elemType), "Block rule should match the request"); 
 }
 
+void AdBlockFilterTest::testPatternMatcher()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> bannerRule = parser.makeFilter(QLatin1String("banner/ads/"));
+    std::unique_ptr<AdBlockFilter> imageOnlyRule = parser.makeFilter(QLatin1String("-advert-$image"));
+    std::unique_ptr<AdBlockFilter> matchCaseRule = parser.makeFilter(QLatin1String("/AdFrame.$match-case"));
+
+    AdBlockPatternMatcher matcher;
+    matcher.build({ bannerRule.get(), imageOnlyRule.get(), matchCaseRule.get() });
+
+    const QUrl firstPartyUrl(QLatin1String("https://example.com/"));
+    auto findMatch = [&](const QString &requestUrl, ElementType type) {
+        return matcher.findMatch(AdBlockRequestContext(QUrl(requestUrl), firstPartyUrl, type));
+    };
+
+    QCOMPARE(findMatch(QLatin1String("https://cdn.example.com/banner/ads/1.png"), ElementType::Image), bannerRule.get());
+    QCOMPARE(findMatch(QLatin1String("https://cdn.example.com/img/-advert-.png"), ElementType::Image), imageOnlyRule.get());
+    QVERIFY2(findMatch(QLatin1String("https://cdn.example.com/img/-advert-.js"), ElementType::Script) == nullptr,
+             "Filter with the image option should not match a script request");
+    QCOMPARE(findMatch(QLatin1String("https://example.com/AdFrame.html"), ElementType::Subdocument), matchCaseRule.get());
+    QVERIFY2(findMatch(QLatin1String("https://example.com/adframe.html"), ElementType::Subdocument) == nullptr,
+             "Match-case filter should not match a request with different letter case");
+}
+
+void AdBlockFilterTest::testRequestContext()
+{
+    const AdBlockRequestContext context(QUrl(QLatin1String("https://www.Ads.Tracker.co.uk/Pixel.gif?id=1")),
+                                        QUrl(QLatin1String("https://news.example.com/article")),
+                                        ElementType::Image);
+    QCOMPARE(context.RequestUrl, QByteArray("https://www.ads.tracker.co.uk/Pixel.gif?id=1"));
+    QCOMPARE(context.RequestUrlLower, QByteArray("https://www.ads.tracker.co.uk/pixel.gif?id=1"));
+    QCOMPARE(context.RequestHost, QLatin1String("www.ads.tracker.co.uk"));
+    QCOMPARE(context.RequestDomain, QLatin1String("ads.tracker.co.uk"));
+    QCOMPARE(context.RequestSecondLevelDomain, QLatin1String("tracker.co.uk"));
+    QCOMPARE(context.RequestSecondLevelDomainBytes, QByteArray("tracker.co.uk"));
+    QCOMPARE(context.getRequestUrlString(true), QLatin1String("https://www.ads.tracker.co.uk/Pixel.gif?id=1"));
+    QCOMPARE(context.getRequestUrlString(false), QLatin1String("https://www.ads.tracker.co.uk/pixel.gif?id=1"));
+    QCOMPARE(context.FirstPartyHost, QLatin1String("news.example.com"));
+    QCOMPARE(context.FirstPartyDomain, QLatin1String("example.com"));
+    QVERIFY2(context.ThirdParty, "Request to a different second-level domain should be third party");
+    QVERIFY2(!context.Tokens.empty(), "Request URL should be tokenized");
+
+    const AdBlockRequestContext sameSite(QUrl(QLatin1String("https://static.example.com/app.js")),
+                                         QUrl(QLatin1String("https://example.com/")),
+                                         ElementType::Script);
+    QVERIFY2(!sameSite.ThirdParty, "Request to the same second-level domain should not be third party");
+
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> pixelRule = parser.makeFilter(QLatin1String("/Pixel.gif$match-case,domain=example.com"));
+    std::unique_ptr<AdBlockFilter> domainStartRule = parser.makeFilter(QLatin1String("||ads.tracker.co.uk/"));
+    QVERIFY2(pixelRule->isMatch(context), "Match-case filter should be compared with the request URL in its original case");
+    QVERIFY2(domainStartRule->isMatch(context), "Domain anchored filter should match a subdomain of the request host");
+    QCOMPARE(domainStartRule->getEvalString(), QString("ads.tracker.co.uk/"));
+
+    // Domain filters are matched against the bytes of the request host, on label boundaries
+    std::unique_ptr<AdBlockFilter> domainRule = parser.makeFilter(QLatin1String("||tracker.co.uk^"));
+    std::unique_ptr<AdBlockFilter> partialLabelRule = parser.makeFilter(QLatin1String("||racker.co.uk^"));
+    QVERIFY(domainRule->getCategory() == FilterCategory::Domain);
+    QCOMPARE(domainRule->getEvalString(), QString("tracker.co.uk"));
+    QVERIFY2(domainRule->isMatch(context), "Domain filter should match a subdomain of its domain");
+    QVERIFY2(!partialLabelRule->isMatch(context), "Domain filter should not match part of a label");
+
+    // Characters outside of the ASCII range are matched in their percent-encoded form
+    const AdBlockRequestContext encodedContext(QUrl(QString::fromUtf8("https://example.net/Ünïcode/ad.js")),
+                                               QUrl(QLatin1String("https://example.com/")),
+                                               ElementType::Script);
+    QCOMPARE(encodedContext.RequestUrlLower, QByteArray("https://example.net/%c3%9cn%c3%afcode/ad.js"));
+    std::unique_ptr<AdBlockFilter> encodedRule = parser.makeFilter(QLatin1String("/%C3%9Cn%C3%AFcode/ad."));
+    QVERIFY2(encodedRule->isMatch(encodedContext), "Filter should match the encoded request URL regardless of letter case");
+}
+
+void AdBlockFilterTest::testPublicSuffixList()
+{
+    PublicSuffixList list;
+    list.parse(QByteArray("// Comment\ncom\nuk\nco.uk\n*.ck\n!www.ck\n"));
+    QCOMPARE(list.size(), 5);
+
+    auto registrableDomain = [&list](const char *host) {
+        return list.getRegistrableDomain(QLatin1String(host)).toString();
+    };
+    QCOMPARE(registrableDomain("www.example.com"), QLatin1String("example.com"));
+    QCOMPARE(registrableDomain("ads.tracker.co.uk"), QLatin1String("tracker.co.uk"));
+    QCOMPARE(registrableDomain("a.b.foo.ck"), QLatin1String("b.foo.ck"));
+    QCOMPARE(registrableDomain("x.www.ck"), QLatin1String("www.ck"));
+    QCOMPARE(registrableDomain("example.unlisted"), QLatin1String("example.unlisted"));
+    QVERIFY2(list.getRegistrableDomain(QLatin1String("co.uk")).isNull(), "A public suffix has no registrable domain");
+    QVERIFY2(list.getRegistrableDomain(QLatin1String("192.168.0.1")).isNull(), "An IP address has no registrable domain");
+
+    const QString host = QLatin1String("cdn.example.github.io");
+    QCOMPARE(PublicSuffixList::instance().getRegistrableDomain(host).toString(), QLatin1String("example.github.io"));
+    QCOMPARE(PublicSuffixList::instance().getPublicSuffix(host).toString(), QLatin1String("github.io"));
+}
+
+void AdBlockFilterTest::testPageExceptions()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> genericHideRule = parser.makeFilter(QLatin1String("@@||example.com^$generichide"));
+    std::unique_ptr<AdBlockFilter> elemHideRule = parser.makeFilter(QLatin1String("@@||news.example.org^$elemhide"));
+
+    AdBlockFilterIndex pageExceptions;
+    pageExceptions.build({ genericHideRule.get(), elemHideRule.get() });
+
+    auto findMatch = [&pageExceptions](const QString &pageUrl, ElementType type) {
+        const QUrl url(pageUrl);
+        return pageExceptions.findMatch(AdBlockRequestContext(url, url, type));
+    };
+
+    QCOMPARE(findMatch(QLatin1String("https://www.example.com/"), ElementType::GenericHide), genericHideRule.get());
+    QVERIFY2(findMatch(QLatin1String("https://www.example.com/"), ElementType::ElemHide) == nullptr,
+             "A generichide exception should not disable domain-specific element hiding");
+    QCOMPARE(findMatch(QLatin1String("https://news.example.org/story"), ElementType::ElemHide), elemHideRule.get());
+    QVERIFY2(findMatch(QLatin1String("https://example.net/"), ElementType::GenericHide) == nullptr,
+             "Page exceptions should only apply to the pages they match");
+    QVERIFY2(!genericHideRule->isMatch(QLatin1String("example.com"), QLatin1String("https://example.com/ad.js"),
+                                       QLatin1String("example.com"), ElementType::Script),
+             "A page exception should not allow network requests");
+}
+
+void AdBlockFilterTest::testFilterIndexOrder()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> pathRule = parser.makeFilter(QLatin1String("/ads/banner"));
+    std::unique_ptr<AdBlockFilter> hostRule = parser.makeFilter(QLatin1String("||cdn.example.com^"));
+    std::unique_ptr<AdBlockFilter> domainRule = parser.makeFilter(QLatin1String("$script,domain=site.org"));
+    std::unique_ptr<AdBlockFilter> fallbackRule = parser.makeFilter(QLatin1String("$script"));
+
+    const QUrl requestUrl(QLatin1String("https://cdn.example.com/ads/banner.js"));
+    const QUrl firstPartyUrl(QLatin1String("https://site.org/"));
+    const AdBlockRequestContext context(requestUrl, firstPartyUrl, ElementType::Script);
+
+    // Every filter matches the request, and whichever comes first in the list must win,
+    // regardless of the bucket it was stored in
+    std::vector<AdBlockFilter*> filters { pathRule.get(), hostRule.get(), domainRule.get(), fallbackRule.get() };
+    std::sort(filters.begin(), filters.end());
+    do
+    {
+        AdBlockFilterIndex index;
+        index.build(filters);
+        QCOMPARE(index.findMatch(context), filters.front());
+    }
+    while (std::next_permutation(filters.begin(), filters.end()));
+}
+
+void AdBlockFilterTest::testCompiledPattern()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> wildcardRule = parser.makeFilter(QLatin1String("||ads.example.com^*/banner/*.gif|"));
+    std::unique_ptr<AdBlockFilter> separatorRule = parser.makeFilter(QLatin1String("/track^id=*&ref=*^"));
+    std::unique_ptr<AdBlockFilter> regExpRule = parser.makeFilter(QLatin1String("/\\/ads?\\/[0-9]+x[0-9]+\\.png/"));
+
+    const AdBlockCompiledPattern wildcardPattern = AdBlockCompiledPattern::compileWildcard(QLatin1String("||Ads.example.com^*/banner/*.gif|"), false);
+    QVERIFY2(wildcardPattern.isCompiled(), "Wildcard pattern should be compiled");
+    const std::vector<QByteArray> expectedSegments { "ads.example.com^", "/banner/", ".gif" };
+    QVERIFY2(wildcardPattern.getSegments() == expectedSegments, "Wildcard pattern was not split into its segments");
+
+    const AdBlockCompiledPattern regExpPattern = AdBlockCompiledPattern::compileRegExp(QLatin1String("\\/ads?\\/[0-9]+x[0-9]+\\.png"), false);
+    QVERIFY2(!regExpPattern.isCompiled(), "Regular expression should not be compiled");
+    const std::vector<QByteArray> expectedLiterals { "/ad", "/", "x", ".png" };
+    QVERIFY2(regExpPattern.getSegments() == expectedLiterals, "Required literals of the regular expression were not extracted");
+    QVERIFY2(AdBlockCompiledPattern::compileRegExp(QLatin1String("ads|banners"), false).getSegments().empty(),
+             "Alternatives should not have required literals");
+
+    const QUrl firstPartyUrl(QLatin1String("https://example.org/"));
+    auto isMatch = [&](AdBlockFilter *filter, const QString &requestUrl) {
+        return filter->isMatch(AdBlockRequestContext(QUrl(requestUrl), firstPartyUrl, ElementType::Image));
+    };
+
+    AdBlockCompiledPattern::resetStatistics();
+
+    QVERIFY(isMatch(wildcardRule.get(), QLatin1String("https://cdn.ads.example.com/img/banner/1.gif")));
+    QVERIFY(isMatch(wildcardRule.get(), QLatin1String("https://ads.example.com:8080/banner/x/2.gif")));
+    QVERIFY2(!isMatch(wildcardRule.get(), QLatin1String("https://notads.example.com/banner/1.gif")),
+             "Domain anchor should only match at the start of a host label");
+    QVERIFY2(!isMatch(wildcardRule.get(), QLatin1String("https://ads.example.com/banner/1.gif?x=1")),
+             "End anchor should only match at the end of the URL");
+    QVERIFY2(!isMatch(wildcardRule.get(), QLatin1String("https://ads.example.community/banner/1.gif")),
+             "Separator should not match a letter");
+
+    QVERIFY(isMatch(separatorRule.get(), QLatin1String("https://example.net/track?id=5&ref=home")));
+    QVERIFY(isMatch(separatorRule.get(), QLatin1String("https://example.net/track/id=5&x=1&ref=a/b")));
+    QVERIFY2(!isMatch(separatorRule.get(), QLatin1String("https://example.net/tracker?id=5&ref=home")),
+             "Separator should not match a letter");
+    QVERIFY2(!isMatch(separatorRule.get(), QLatin1String("https://example.net/track?ref=home&id=5")),
+             "Segments should only match in order");
+
+    QVERIFY(isMatch(regExpRule.get(), QLatin1String("https://example.net/ad/300x250.png")));
+    QVERIFY(!isMatch(regExpRule.get(), QLatin1String("https://example.net/ads/large.png")));
+    QVERIFY(!isMatch(regExpRule.get(), QLatin1String("https://example.net/news/index.html")));
+
+    const AdBlockCompiledPattern::Statistics stats = AdBlockCompiledPattern::getStatistics();
+    QCOMPARE(stats.Evaluations, quint64(12));
+    QCOMPARE(stats.CompiledMatches, quint64(9));
+    QCOMPARE(stats.PrefilterRejections, quint64(2));
+    QCOMPARE(stats.RegExpEvaluations, quint64(1));
+}
+
+void AdBlockFilterTest::testFilterCache()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    const QString subscriptionPath = tempDir.filePath(QLatin1String("list.txt"));
+    QFile subscriptionFile(subscriptionPath);
+    QVERIFY(subscriptionFile.open(QIODevice::WriteOnly));
+    subscriptionFile.write("! Title: Test List\n||mssl.fwmrm.net$script,domain=zerohedge.com\n/banner[0-9]+\\.gif/\n");
+    subscriptionFile.close();
+
+    AdBlockFilterParser parser;
+    std::vector<std::unique_ptr<AdBlockFilter>> filters;
+    filters.push_back(parser.makeFilter(QLatin1String("||mssl.fwmrm.net$script,domain=zerohedge.com")));
+    filters.push_back(parser.makeFilter(QLatin1String("/banner[0-9]+\\.gif/")));
+
+    const QString cacheDir = tempDir.filePath(QLatin1String("cache"));
+    AdBlockFilterCache writer(cacheDir, subscriptionPath, 1);
+    QVERIFY2(writer.save(QLatin1String("Test List"), 4, filters), "Filter cache should be written");
+
+    QString title;
+    int expireDays = 0;
+    std::vector<std::unique_ptr<AdBlockFilter>> cachedFilters;
+    AdBlockFilterCache reader(cacheDir, subscriptionPath, 1);
+    QVERIFY2(reader.load(title, expireDays, cachedFilters), "Filter cache should match the subscription file");
+    QCOMPARE(title, QString("Test List"));
+    QCOMPARE(expireDays, 4);
+    QCOMPARE(cachedFilters.size(), filters.size());
+
+    const QString baseUrl = QLatin1String("zerohedge.com");
+    const QString scriptUrl = QLatin1String("https://mssl.fwmrm.net/p/nbcu_live/admanager.js");
+    QVERIFY2(cachedFilters.at(0)->isMatch(baseUrl, scriptUrl, QLatin1String("mssl.fwmrm.net"), ElementType::Script | ElementType::ThirdParty),
+             "Cached domain filter should match the request");
+    QVERIFY2(!cachedFilters.at(0)->isMatch(QLatin1String("example.com"), scriptUrl, QLatin1String("mssl.fwmrm.net"), ElementType::Script),
+             "Cached domain filter should keep its domain option");
+    QVERIFY2(cachedFilters.at(1)->isMatch(baseUrl, QLatin1String("https://example.com/banner12.gif"), QLatin1String("example.com"), ElementType::Image),
+             "Cached regular expression filter should match the request");
+    QCOMPARE(cachedFilters.at(1)->getRule(), filters.at(1)->getRule());
+
+    // The cache must not be used by a different resource set, or after the subscription file changes
+    cachedFilters.clear();
+    AdBlockFilterCache otherResources(cacheDir, subscriptionPath, 2);
+    QVERIFY2(!otherResources.load(title, expireDays, cachedFilters), "Filter cache should not match a different resource key");
+
+    QVERIFY(subscriptionFile.open(QIODevice::Append));
+    subscriptionFile.write("||example.com^\n");
+    subscriptionFile.close();
+    AdBlockFilterCache staleReader(cacheDir, subscriptionPath, 1);
+    QVERIFY2(!staleReader.load(title, expireDays, cachedFilters), "Filter cache should not match a modified subscription file");
+    QVERIFY(cachedFilters.empty());
+
+    // Subscription files are read without a subscription, as done by the background load of the manager
+    AdBlockSubscription::LoadedFilters loaded = AdBlockSubscription::readFilters(subscriptionPath, cacheDir, QHash<QString, QString>());
+    QVERIFY(loaded.Loaded);
+    QCOMPARE(loaded.Title, QString("Test List"));
+    QCOMPARE(loaded.Filters->size(), std::size_t(3));
+    QCOMPARE(loaded.FileSize, QFileInfo(subscriptionPath).size());
+    QVERIFY2(!AdBlockSubscription::readFilters(tempDir.filePath(QLatin1String("missing.txt")), QString(), QHash<QString, QString>()).Loaded,
+             "Missing subscription file should not be loaded");
+}
+
+void AdBlockFilterTest::testCosmeticCache()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    const QString cachePath = tempDir.filePath(QLatin1String("cache/cosmetic.cache"));
+    const QString stylesheet = QLatin1String("#ad-sidebar, .ad-banner { display: none !important; }");
+    const QString script = QLatin1String("(function() { window.adBlockDetected = false; })();");
+    QString value;
+
+    // Nothing is cached until the filters are known
+    AdBlockCosmeticCache writer(cachePath, 2, 1024);
+    writer.insert(QLatin1String("css:example.com"), stylesheet);
+    QVERIFY(!writer.find(QLatin1String("css:example.com"), value));
+
+    writer.setFilterSetKey(QByteArray("filters-1"));
+    writer.insert(QLatin1String("css:example.com"), stylesheet);
+    writer.insert(QLatin1String("js:www.example.com"), script);
+    writer.insert(QLatin1String("js:example.org"), QString());
+    QCOMPARE(writer.size(), 2);
+    QVERIFY2(!writer.find(QLatin1String("css:example.com"), value), "Least recently used entry should be replaced");
+    QVERIFY(writer.find(QLatin1String("js:www.example.com"), value));
+    QCOMPARE(value, script);
+    QVERIFY2(writer.save(), "Cosmetic cache should be written");
+
+    AdBlockCosmeticCache reader(cachePath, 2, 1024);
+    reader.setFilterSetKey(QByteArray("filters-1"));
+    QCOMPARE(reader.size(), 2);
+    QVERIFY(reader.find(QLatin1String("js:www.example.com"), value));
+    QCOMPARE(value, script);
+    QVERIFY2(reader.find(QLatin1String("js:example.org"), value), "Empty entries should be cached");
+    QVERIFY(value.isEmpty());
+
+    // Entries built from other filters are not used
+    AdBlockCosmeticCache staleReader(cachePath, 2, 1024);
+    staleReader.setFilterSetKey(QByteArray("filters-2"));
+    QCOMPARE(staleReader.size(), 0);
+
+    reader.setFilterSetKey(QByteArray("filters-2"));
+    QVERIFY(!reader.find(QLatin1String("js:www.example.com"), value));
+
+    // Entries past the size limit of the file are left out, starting with the least recently used
+    AdBlockCosmeticCache limitedWriter(cachePath, 4, stylesheet.toUtf8().size() + 10);
+    limitedWriter.setFilterSetKey(QByteArray("filters-3"));
+    limitedWriter.insert(QLatin1String("js:www.example.com"), script);
+    limitedWriter.insert(QLatin1String("css:example.com"), stylesheet);
+    QVERIFY(limitedWriter.save());
+
+    AdBlockCosmeticCache limitedReader(cachePath, 4, 1024);
+    limitedReader.setFilterSetKey(QByteArray("filters-3"));
+    QCOMPARE(limitedReader.size(), 1);
+    QVERIFY(limitedReader.find(QLatin1String("css:example.com"), value));
+    QCOMPARE(value, stylesheet);
+}
+
+void AdBlockFilterTest::testDomainTrie()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> domainRule = parser.makeFilter(QLatin1String("||example.com^"));
+    std::unique_ptr<AdBlockFilter> subdomainRule = parser.makeFilter(QLatin1String("||ads.example.com^"));
+    std::unique_ptr<AdBlockFilter> entityRule = parser.makeFilter(QLatin1String("||tracker.net^$domain=google.*"));
+
+    AdBlockDomainTrie trie;
+    trie.insert(domainRule->getEvalString(), domainRule.get());
+    trie.insert(subdomainRule->getEvalString(), subdomainRule.get());
+    trie.insert(QLatin1String("google."), entityRule.get());
+
+    auto findAll = [&trie](const QString &host) {
+        std::vector<AdBlockFilter*> filters;
+        trie.findMatches(host, [&filters](AdBlockFilter *filter) {
+            filters.push_back(filter);
+            return false;
+        });
+        return filters;
+    };
+
+    std::vector<AdBlockFilter*> matches = findAll(QLatin1String("cdn.ads.example.com"));
+    QCOMPARE(matches.size(), std::size_t(2));
+    QCOMPARE(matches.at(0), domainRule.get());
+    QCOMPARE(matches.at(1), subdomainRule.get());
+
+    QVERIFY2(findAll(QLatin1String("notexample.com")).empty(), "Domain filter should only match at a label boundary");
+
+    matches = findAll(QLatin1String("www.google.de"));
+    QCOMPARE(matches.size(), std::size_t(1));
+    QCOMPARE(matches.at(0), entityRule.get());
+
+    QVERIFY2(entityRule->isDomainStyleMatch(QLatin1String("mail.google.com")), "Entity domain option should match any top-level domain");
+    QVERIFY2(!entityRule->isDomainStyleMatch(QLatin1String("google.example.com")), "Entity domain option should not match another domain");
+
+    // Cosmetic filters are stored under each domain of their domain list
+    std::unique_ptr<AdBlockFilter> cosmeticRule = parser.makeFilter(QLatin1String("example.com,shop.example.com,~news.example.com##.banner"));
+    AdBlockDomainTrie cosmeticTrie;
+    cosmeticTrie.insert(QLatin1String("example.com"), cosmeticRule.get());
+    cosmeticTrie.insert(QLatin1String("shop.example.com"), cosmeticRule.get());
+
+    matches = cosmeticTrie.getFilters(QLatin1String("cart.shop.example.com"));
+    QCOMPARE(matches.size(), std::size_t(1));
+    QCOMPARE(matches.at(0), cosmeticRule.get());
+    QVERIFY2(cosmeticTrie.getFilters(QLatin1String("example.org")).empty(), "Cosmetic filter should not be found for an unlisted domain");
+    QVERIFY2(!cosmeticRule->isDomainStyleMatch(QLatin1String("news.example.com")), "Excluded domain should not match the cosmetic filter");
+}
+
+void AdBlockFilterTest::testSelectorIndex()
+{
+    QCOMPARE(AdBlockSelectorIndex::getSelectorKey(QLatin1String(".ad-banner")), QString(".ad-banner"));
+    QCOMPARE(AdBlockSelectorIndex::getSelectorKey(QLatin1String("div#sponsored > a")), QString("#sponsored"));
+    QCOMPARE(AdBlockSelectorIndex::getSelectorKey(QLatin1String("a[href*=\".ads.\"] .promo")), QString(".promo"));
+    QCOMPARE(AdBlockSelectorIndex::getSelectorKey(QLatin1String("div:not(.content).ad")), QString(".ad"));
+    QVERIFY2(AdBlockSelectorIndex::getSelectorKey(QLatin1String("a[href^=\"http://ads.\"]")).isEmpty(), "Attribute selector should not have a key");
+    QVERIFY2(AdBlockSelectorIndex::getSelectorKey(QLatin1String(".ad, .banner")).isEmpty(), "Selector list should not have a key");
+    QVERIFY2(AdBlockSelectorIndex::getSelectorKey(QLatin1String(".ad\\:top")).isEmpty(), "Escaped class name should not have a key");
+
+    AdBlockSelectorIndex index;
+    QVERIFY(index.insert(QLatin1String(".ad-banner")));
+    QVERIFY(index.insert(QLatin1String("div.ad-banner > img")));
+    QVERIFY(index.insert(QLatin1String("#sponsored")));
+    QVERIFY(!index.insert(QLatin1String("iframe[src*=\"ads\"]")));
+    QCOMPARE(index.size(), 3);
+
+    QVERIFY2(index.getStylesheet({ QLatin1String("content") }, { QLatin1String("main") }).isEmpty(),
+             "Page without a known class or id should not receive any rule");
+
+    const QString stylesheet = index.getStylesheet({ QLatin1String("ad-banner"), QLatin1String("ad-banner") }, { QLatin1String("sponsored") });
+    QCOMPARE(stylesheet, QString(".ad-banner,div.ad-banner > img,#sponsored{ display: none !important; } "));
+
+    index.clear();
+    QVERIFY(index.empty());
+}
+
+void AdBlockFilterTest::testFilterSnapshot()
+{
+    AdBlockFilterParser parser;
+    std::shared_ptr<AdBlockFilterList> filterList = std::make_shared<AdBlockFilterList>();
+    filterList->push_back(parser.makeFilter(QLatin1String("||ads.example.com^")));
+    filterList->push_back(parser.makeFilter(QLatin1String("/banner/*/img^")));
+    filterList->push_back(parser.makeFilter(QLatin1String("@@||ads.example.com/allowed/")));
+
+    AdBlockFilterSlice filters;
+    filters.BlockFiltersByDomain.push_back(filterList->at(0).get());
+    filters.BlockFilters.push_back(filterList->at(1).get());
+    filters.AllowFilters.push_back(filterList->at(2).get());
+
+    std::shared_ptr<const AdBlockFilterSnapshot> snapshot = std::make_shared<AdBlockFilterSnapshot>(filters, std::vector<std::shared_ptr<const AdBlockFilterList>>{ filterList });
+
+    // The snapshot owns the filters together with the list it was built from
+    AdBlockFilter *domainFilter = filterList->at(0).get();
+    filterList.reset();
+
+    const QUrl firstPartyUrl(QLatin1String("https://www.example.org"));
+    auto makeContext = [&firstPartyUrl](const QString &requestUrl) {
+        return AdBlockRequestContext(QUrl(requestUrl), firstPartyUrl, ElementType::Image | ElementType::ThirdParty);
+    };
+
+    QCOMPARE(snapshot->findBlockFilter(makeContext(QLatin1String("https://ads.example.com/pixel.gif"))), domainFilter);
+    QVERIFY2(snapshot->findBlockFilter(makeContext(QLatin1String("https://cdn.example.net/banner/top/img.png"))) != nullptr,
+             "Wildcard filter should match the request");
+    QVERIFY2(snapshot->findAllowFilter(makeContext(QLatin1String("https://ads.example.com/allowed/pixel.gif"))) != nullptr,
+             "Exception filter should match the request");
+    QVERIFY2(snapshot->findImportantBlockFilter(makeContext(QLatin1String("https://ads.example.com/pixel.gif"))) == nullptr,
+             "Snapshot without important filters should not find one");
+
+    // Exception filters only decide requests that a blocking filter matches
+    AdBlockDecisionCache::Decision decision = snapshot->evaluate(makeContext(QLatin1String("https://ads.example.com/pixel.gif")));
+    QVERIFY(decision.Matched && decision.Action == AdBlockFilterAction::Block && decision.Filter == domainFilter);
+    decision = snapshot->evaluate(makeContext(QLatin1String("https://ads.example.com/allowed/pixel.gif")));
+    QVERIFY(decision.Matched && decision.Action == AdBlockFilterAction::Allow);
+    decision = snapshot->evaluate(makeContext(QLatin1String("https://cdn.example.net/allowed/pixel.gif")));
+    QVERIFY2(!decision.Matched, "Request without a matching blocking filter should be left alone");
+
+    // Domain filters are matched against the full request host, including a www. prefix, wherever they are stored
+    std::unique_ptr<AdBlockFilter> importantRule = parser.makeFilter(QLatin1String("||www.example.com^$important"));
+    QVERIFY(importantRule->getCategory() == FilterCategory::Domain);
+    AdBlockFilterSlice importantFilters;
+    importantFilters.ImportantBlockFilters.push_back(importantRule.get());
+    AdBlockFilterSnapshot importantSnapshot(importantFilters, std::vector<std::shared_ptr<const AdBlockFilterList>>());
+    QCOMPARE(importantSnapshot.findImportantBlockFilter(makeContext(QLatin1String("https://www.example.com/ads.js"))), importantRule.get());
+    QCOMPARE(importantSnapshot.findImportantBlockFilter(makeContext(QLatin1String("https://cdn.www.example.com/ads.js"))), importantRule.get());
+    QVERIFY2(importantSnapshot.findImportantBlockFilter(makeContext(QLatin1String("https://example.com/ads.js"))) == nullptr,
+             "Filter of a www. host should not match its parent domain");
+
+    AdBlockFilterSnapshot emptySnapshot;
+    QVERIFY(emptySnapshot.empty());
+    QVERIFY(emptySnapshot.findBlockFilter(makeContext(QLatin1String("https://ads.example.com/pixel.gif"))) == nullptr);
+}
+
+void AdBlockFilterTest::testSnapshotPublisher()
+{
+    std::shared_ptr<const AdBlockFilterSnapshot> older = std::make_shared<AdBlockFilterSnapshot>();
+    std::shared_ptr<const AdBlockFilterSnapshot> initial = std::make_shared<AdBlockFilterSnapshot>();
+    std::weak_ptr<const AdBlockFilterSnapshot> initialRef = initial;
+
+    AdBlockSnapshotPublisher publisher(std::move(initial));
+    QCOMPARE(publisher.read()->getGeneration(), initialRef.lock()->getGeneration());
+
+    // The replaced snapshot is released once no reader holds it
+    std::shared_ptr<const AdBlockFilterSnapshot> newer = std::make_shared<AdBlockFilterSnapshot>();
+    QVERIFY(publisher.publish(newer));
+    QVERIFY2(initialRef.expired(), "Replaced snapshot should be released by the publisher");
+    QVERIFY2(!publisher.publish(older), "Snapshot built before the current one should not be published");
+    QCOMPARE(publisher.read()->getGeneration(), newer->getGeneration());
+    newer.reset();
+
+    // Readers on other threads only ever see snapshots that are still alive, in the order they were published
+    std::atomic<bool> done(false);
+    auto readSnapshots = [&publisher, &done]() {
+        quint64 lastGeneration = 0;
+        while (!done.load())
+        {
+            AdBlockSnapshotPublisher::Reader reader = publisher.read();
+            const quint64 generation = reader->getGeneration();
+            if (generation < lastGeneration || !reader->empty())
+                return false;
+            lastGeneration = generation;
+        }
+        return true;
+    };
+    QFuture<bool> firstReader = QtConcurrent::run(readSnapshots);
+    QFuture<bool> secondReader = QtConcurrent::run(readSnapshots);
+
+    bool published = true;
+    for (int i = 0; i < 200; ++i)
+        published = publisher.publish(std::make_shared<AdBlockFilterSnapshot>()) && published;
+
+    done = true;
+    QVERIFY(published);
+    QVERIFY(firstReader.result());
+    QVERIFY(secondReader.result());
+}
+
+void AdBlockFilterTest::testPageCounter()
+{
+    const QUrl pageUrl(QLatin1String("https://www.example.org/news"));
+    const QUrl otherPageUrl(QLatin1String("https://www.example.org/sports"));
+
+    AdBlockPageCounter counter;
+    QCOMPARE(counter.getCount(pageUrl), 0);
+
+    counter.reset(pageUrl);
+    counter.increment(pageUrl);
+    counter.increment(pageUrl);
+    counter.increment(otherPageUrl);
+    QCOMPARE(counter.getCount(pageUrl), 2);
+    QCOMPARE(counter.getCount(otherPageUrl), 1);
+
+    // Counts are reset when the page is loaded again
+    counter.reset(pageUrl);
+    QCOMPARE(counter.getCount(pageUrl), 0);
+    QCOMPARE(counter.getCount(otherPageUrl), 1);
+
+    // Increments from several threads are not lost
+    std::vector<int> tasks(8);
+    QtConcurrent::blockingMap(tasks, [&counter, &pageUrl](int &) {
+        for (int i = 0; i < 1000; ++i)
+            counter.increment(pageUrl);
+    });
+    QCOMPARE(counter.getCount(pageUrl), 8000);
+}
+
+void AdBlockFilterTest::testFilterSlice()
+{
+    AdBlockFilterParser parser;
+    AdBlockFilterList first, second;
+    first.push_back(parser.makeFilter(QLatin1String("||ads.example.com^")));
+    first.push_back(parser.makeFilter(QLatin1String("/banner/*/img^")));
+    first.push_back(parser.makeFilter(QLatin1String("##.ad-banner")));
+    second.push_back(parser.makeFilter(QLatin1String("ad_frame")));
+    second.push_back(parser.makeFilter(QLatin1String("/banner/*/img^$badfilter")));
+    second.push_back(parser.makeFilter(QLatin1String("example.org#@#.ad-banner")));
+
+    const AdBlockFilterSlice firstSlice = AdBlockFilterSlice::fromFilters(first);
+    QCOMPARE(firstSlice.BlockFiltersByDomain.size(), std::size_t(1));
+    QCOMPARE(firstSlice.BlockFilters.size(), std::size_t(1));
+    QCOMPARE(firstSlice.StylesheetFilters.size(), 1);
+    QVERIFY(firstSlice.HasStylesheetRules && !firstSlice.HasScriptRules);
+
+    // Badfilter rules disable the filters of every slice they are combined with
+    AdBlockFilterSlice filters = firstSlice;
+    filters.append(AdBlockFilterSlice::fromFilters(second));
+    QCOMPARE(filters.BlockFiltersByPattern.size(), std::size_t(1));
+    QCOMPARE(filters.StylesheetExceptions.size(), 1);
+    QVERIFY(filters.BadFilters.contains(QLatin1String("/banner/*/img^")));
+    QVERIFY(filters.HasScriptRules);
+
+    AdBlockFilterList mergedFilters;
+    QCOMPARE(filters.optimize(mergedFilters).BadFilters, std::size_t(1));
+    QVERIFY(filters.BlockFilters.empty());
+    QCOMPARE(filters.BlockFiltersByDomain.size(), std::size_t(1));
+    QCOMPARE(filters.optimize(mergedFilters).BadFilters, std::size_t(0));
+}
+
+void AdBlockFilterTest::testFilterOptimizer()
+{
+    AdBlockFilterParser parser;
+    AdBlockFilterList easyList, otherList;
+    for (const char *rule : { "||example.com^", "||ads.example.com^", "||tracker.net^$image", "||tracker.net^$script",
+                              "||cdn.tracker.net^$image", "/adframe.", "||example.org^$third-party", "@@||ads.example.com/allowed/",
+                              "||popup.example^$important" })
+        easyList.push_back(parser.makeFilter(QLatin1String(rule)));
+    for (const char *rule : { "||example.com^", "/adframe.", "||sub.example.org^", "||banner.example^", "||banner.example^$badfilter",
+                              "/adframe.$script,redirect=noop.js", "||popup.example^$important,badfilter" })
+        otherList.push_back(parser.makeFilter(QLatin1String(rule)));
+
+    AdBlockFilterSlice filters = AdBlockFilterSlice::fromFilters(easyList);
+    filters.append(AdBlockFilterSlice::fromFilters(otherList));
+
+    AdBlockFilterList mergedFilters;
+    const AdBlockFilterSlice::OptimizationStatistics statistics = filters.optimize(mergedFilters);
+    QCOMPARE(statistics.BadFilters, std::size_t(2));
+    QCOMPARE(statistics.Duplicates, std::size_t(2));
+    QCOMPARE(statistics.Subsumed, std::size_t(2));
+    QCOMPARE(statistics.Merged, std::size_t(1));
+
+    // Filters of subdomains with other options are kept. Copies are also removed from a container that mixes blocking and
+    // redirecting filters
+    QVERIFY2(filters.ImportantBlockFilters.empty(), "Important filter disabled by a badfilter rule should be removed");
+    QCOMPARE(filters.BlockFiltersByDomain.size(), std::size_t(4));
+    QCOMPARE(filters.BlockFiltersByPattern.size(), std::size_t(2));
+    QCOMPARE(mergedFilters.size(), std::size_t(1));
+    QCOMPARE(mergedFilters.front()->getRule(), QString("||tracker.net^$image"));
+
+    AdBlockFilterSnapshot snapshot(filters, std::vector<std::shared_ptr<const AdBlockFilterList>>());
+    const QUrl firstPartyUrl(QLatin1String("https://www.example.net"));
+    auto evaluate = [&](const QString &requestUrl, ElementType type) {
+        return snapshot.evaluate(AdBlockRequestContext(QUrl(requestUrl), firstPartyUrl, type | ElementType::ThirdParty));
+    };
+
+    AdBlockDecisionCache::Decision decision = evaluate(QLatin1String("https://cdn.tracker.net/pixel.gif"), ElementType::Image);
+    QVERIFY2(decision.Matched && decision.Action == AdBlockFilterAction::Block, "Parent domain filter should block the subdomain");
+    decision = evaluate(QLatin1String("https://tracker.net/tag.js"), ElementType::Script);
+    QVERIFY2(decision.Matched && decision.Action == AdBlockFilterAction::Block, "Merged filter should block both element types");
+    decision = evaluate(QLatin1String("https://tracker.net/style.css"), ElementType::Stylesheet);
+    QVERIFY2(!decision.Matched, "Merged filter should not block other element types");
+    decision = evaluate(QLatin1String("https://ads.example.com/banner.gif"), ElementType::Image);
+    QVERIFY(decision.Matched && decision.Action == AdBlockFilterAction::Block);
+    decision = evaluate(QLatin1String("https://ads.example.com/allowed/pixel.gif"), ElementType::Image);
+    QVERIFY(decision.Matched && decision.Action == AdBlockFilterAction::Allow);
+    decision = evaluate(QLatin1String("https://banner.example/ad.gif"), ElementType::Image);
+    QVERIFY2(!decision.Matched, "Filter disabled by a badfilter rule should be removed");
+    decision = evaluate(QLatin1String("https://popup.example/window.html"), ElementType::Subdocument);
+    QVERIFY2(!decision.Matched, "Important filter disabled by a badfilter rule should be removed");
+    decision = evaluate(QLatin1String("https://cdn.example.net/adframe.js"), ElementType::Script);
+    QVERIFY2(decision.Matched && decision.Action == AdBlockFilterAction::Block,
+             "Blocking filter listed before the redirecting filter should decide the request");
+}
+
+void AdBlockFilterTest::testOptimizerDecisions()
+{
+    // Rules that mix blocking, redirecting and exception filters with copies, subdomains and mergeable element types,
+    // added to the benchmark filter list
+    AdBlockFilterParser parser;
+    AdBlockFilterList mixedList;
+    for (const char *rule : { "||ads.example.com^$script,redirect=noop.js", "||ads.example.com^", "||cdn.ads.example.com^",
+                              "||pixel.example.net^$script", "||pixel.example.net^$image,redirect=1x1.gif", "||pixel.example.net^$subdocument",
+                              "/banner.$image", "/banner.$script,redirect=noop.js", "/banner.$subdocument", "/banner.$image",
+                              "@@||track.example.org/optout/$image", "@@||optout.track.example.org^", "||example.org^$badfilter" })
+        mixedList.push_back(parser.makeFilter(QLatin1String(rule)));
+
+    AdBlockSubscription subscription(QLatin1String(ADBLOCK_BENCHMARK_DATA_DIR "/benchmark_filters.txt"));
+    subscription.load();
+    QVERIFY(!subscription.getFilters()->empty());
+
+    AdBlockFilterSlice filters = subscription.getSlice();
+    filters.append(AdBlockFilterSlice::fromFilters(mixedList));
+
+    // The reference only has the disabled filters removed
+    AdBlockFilterSlice referenceFilters = filters;
+    for (std::vector<AdBlockFilter*> *container : { &referenceFilters.ImportantBlockFilters, &referenceFilters.BlockFilters,
+                                                     &referenceFilters.BlockFiltersByPattern, &referenceFilters.BlockFiltersByDomain,
+                                                     &referenceFilters.AllowFilters, &referenceFilters.AllowFiltersByDomain })
+    {
+        container->erase(std::remove_if(container->begin(), container->end(), [&referenceFilters](AdBlockFilter *filter) {
+            return referenceFilters.BadFilters.contains(filter->getRule());
+        }), container->end());
+    }
+    const AdBlockFilterSnapshot referenceSnapshot(referenceFilters, std::vector<std::shared_ptr<const AdBlockFilterList>>());
+
+    AdBlockFilterList mergedFilters;
+    const AdBlockFilterSlice::OptimizationStatistics statistics = filters.optimize(mergedFilters);
+    QVERIFY(statistics.Duplicates > 0 && statistics.Subsumed > 0);
+    const AdBlockFilterSnapshot snapshot(filters, std::vector<std::shared_ptr<const AdBlockFilterList>>());
+
+    // Requests are made to every domain with a domain filter and to a subdomain of it, from first and third party pages
+    QSet<QString> hosts;
+    for (const std::vector<AdBlockFilter*> *container : { &referenceFilters.BlockFiltersByDomain, &referenceFilters.AllowFiltersByDomain })
+    {
+        for (const AdBlockFilter *filter : *container)
+        {
+            const QString domain = filter->getEvalString();
+            if (domain.endsWith(QChar('.')))
+                continue;
+            hosts.insert(domain);
+            hosts.insert(QLatin1String("cdn.") + domain);
+        }
+    }
+
+    const std::vector<QString> paths { QLatin1String("/"), QLatin1String("/ads/banner.js"), QLatin1String("/banner.gif"),
+                                       QLatin1String("/optout/pixel.gif"), QLatin1String("/pagead/show.html?id=1") };
+    const std::vector<ElementType> types { ElementType::Script, ElementType::Image, ElementType::Subdocument,
+                                           ElementType::XMLHTTPRequest, ElementType::Ping };
+    const std::vector<QUrl> firstPartyUrls { QUrl(QLatin1String("https://www.example.net/")), QUrl(QLatin1String("https://news.example.org/")),
+                                             QUrl(QLatin1String("https://ads.example.com/")) };
+
+    int numRequests = 0;
+    for (const QString &host : hosts)
+    {
+        for (const QString &path : paths)
+        {
+            const QUrl requestUrl(QLatin1String("https://") + host + path);
+            for (const QUrl &firstPartyUrl : firstPartyUrls)
+            {
+                for (ElementType type : types)
+                {
+                    AdBlockRequestContext context(requestUrl, firstPartyUrl);
+                    context.Type = type;
+                    if (context.ThirdParty)
+                        context.Type |= ElementType::ThirdParty;
+
+                    const AdBlockDecisionCache::Decision expected = referenceSnapshot.evaluate(context);
+                    const AdBlockDecisionCache::Decision actual = snapshot.evaluate(context);
+                    const bool isSameDecision = expected.Matched == actual.Matched
+                            && (!expected.Matched || (expected.Action == actual.Action
+                                                      && expected.Filter->getRedirectName() == actual.Filter->getRedirectName()));
+                    if (!isSameDecision)
+                        QFAIL(qPrintable(QString("Optimized filters changed the decision of %1 (%2) from %3")
+                                         .arg(requestUrl.toString(), expected.Matched ? expected.Filter->getRule() : QString("no match"),
+                                              firstPartyUrl.toString())));
+                    ++numRequests;
+                }
+            }
+        }
+    }
+    QVERIFY(numRequests > 0);
+}
+
+void AdBlockFilterTest::testDecisionCache()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> filter = parser.makeFilter(QLatin1String("||ads.example.com^"));
+
+    const QUrl firstPartyUrl(QLatin1String("https://www.example.org"));
+    AdBlockRequestContext imageContext(QUrl(QLatin1String("https://ads.example.com/pixel.gif")), firstPartyUrl, ElementType::Image);
+    AdBlockRequestContext scriptContext(QUrl(QLatin1String("https://ads.example.com/pixel.gif")), firstPartyUrl, ElementType::Script);
+    AdBlockRequestContext otherPageContext(QUrl(QLatin1String("https://ads.example.com/pixel.gif")), QUrl(QLatin1String("https://news.example.org")), ElementType::Image);
+
+    const quint64 key = AdBlockDecisionCache::makeKey(imageContext);
+    QCOMPARE(AdBlockDecisionCache::makeKey(imageContext), key);
+    QVERIFY2(AdBlockDecisionCache::makeKey(scriptContext) != key, "Request type should be part of the key");
+    QVERIFY2(AdBlockDecisionCache::makeKey(otherPageContext) != key, "First party should be part of the key");
+
+    AdBlockDecisionCache cache(4);
+    AdBlockDecisionCache::Decision decision { false, AdBlockFilterAction::Allow, nullptr };
+    QVERIFY(!cache.find(key, 1, decision));
+
+    cache.insert(key, 1, AdBlockDecisionCache::Decision { true, AdBlockFilterAction::Block, filter.get() }, 1000);
+    QVERIFY(cache.find(key, 1, decision));
+    QVERIFY(decision.Matched);
+    QVERIFY(decision.Action == AdBlockFilterAction::Block);
+    QCOMPARE(decision.Filter, filter.get());
+
+    // Decisions made with an older generation of the filters are discarded
+    QVERIFY2(!cache.find(key, 2, decision), "Decision should be invalidated by a newer generation");
+    cache.insert(key, 1, AdBlockDecisionCache::Decision { true, AdBlockFilterAction::Block, filter.get() }, 1000);
+    QVERIFY2(!cache.find(key, 2, decision), "Decision of an older generation should not be stored");
+
+    const AdBlockDecisionCache::Statistics stats = cache.getStatistics();
+    QCOMPARE(stats.Lookups, quint64(4));
+    QCOMPARE(stats.Hits, quint64(1));
+    QCOMPARE(stats.TimeSavedNs, quint64(1000));
+
+    cache.resetStatistics();
+    QCOMPARE(cache.getStatistics().Lookups, quint64(0));
+
+    cache.insert(key, 2, AdBlockDecisionCache::Decision { true, AdBlockFilterAction::Redirect, filter.get() }, 1000);
+    QVERIFY(cache.find(key, 2, decision));
+    QVERIFY(decision.Action == AdBlockFilterAction::Redirect);
+    cache.clear();
+    QVERIFY2(!cache.find(key, 2, decision), "Decision should be removed by clear");
+
+    // Lookups and inserts made from several threads never return a decision stored under another key
+    std::atomic<int> mismatches(0);
+    std::vector<int> threads { 0, 1, 2, 3 };
+    QtConcurrent::blockingMap(threads, [&cache, &filter, &mismatches](int &thread) {
+        AdBlockDecisionCache::Decision found { false, AdBlockFilterAction::Allow, nullptr };
+        for (quint64 i = 0; i < 2000; ++i)
+        {
+            const quint64 requestKey = (i * 4 + static_cast<quint64>(thread)) * 0x9E3779B97F4A7C15ULL;
+            const bool matched = (requestKey & 1) != 0;
+            cache.insert(requestKey, 2, AdBlockDecisionCache::Decision { matched, AdBlockFilterAction::Block, filter.get() }, 1);
+            if (cache.find(requestKey, 2, found) && found.Matched != matched)
+                ++mismatches;
+        }
+    });
+    QCOMPARE(mismatches.load(), 0);
+}
+
+void AdBlockFilterTest::testAdBlockLog()
+{
+    AdBlockLog log;
+    const QUrl firstPartyUrl(QLatin1String("https://www.example.org/"));
+    const QUrl otherPartyUrl(QLatin1String("https://news.example.org/"));
+    const QUrl requestUrl(QLatin1String("https://ads.example.com/pixel.gif"));
+
+    log.addEntry(AdBlockFilterAction::Block, firstPartyUrl, requestUrl, ElementType::Image, QLatin1String("||ads.example.com^"));
+    log.addEntry(AdBlockFilterAction::Allow, otherPartyUrl, requestUrl, ElementType::Image, QLatin1String("@@||ads.example.com^"));
+
+    std::vector<AdBlockLogEntry> entries = log.getAllEntries();
+    QCOMPARE(entries.size(), size_t(2));
+    QVERIFY(entries.at(0).Action == AdBlockFilterAction::Block);
+    QCOMPARE(entries.at(0).FirstPartyUrl, firstPartyUrl);
+    QCOMPARE(entries.at(0).RequestUrl, requestUrl);
+    QCOMPARE(entries.at(0).Rule, QString("||ads.example.com^"));
+    QCOMPARE(log.getEntriesFor(otherPartyUrl).size(), size_t(1));
+
+    // The cursor only returns the entries added after the previous read
+    quint64 cursor = 0;
+    QCOMPARE(log.getEntriesSince(cursor).size(), size_t(2));
+    QCOMPARE(log.getEntriesSince(cursor).size(), size_t(0));
+    log.addEntry(AdBlockFilterAction::Redirect, firstPartyUrl, requestUrl, ElementType::Image, QLatin1String("||ads.example.com^$redirect=1x1.gif"));
+    entries = log.getEntriesSince(cursor, firstPartyUrl);
+    QCOMPARE(entries.size(), size_t(1));
+    QVERIFY(entries.at(0).Action == AdBlockFilterAction::Redirect);
+
+    // The oldest entries are overwritten once the log is full
+    for (quint64 i = 0; i < AdBlockLog::capacity(); ++i)
+        log.addEntry(AdBlockFilterAction::Block, firstPartyUrl, requestUrl, ElementType::Image, QLatin1String("||ads.example.com^"));
+    QCOMPARE(static_cast<quint64>(log.getAllEntries().size()), AdBlockLog::capacity());
+    QCOMPARE(log.getEntriesFor(otherPartyUrl).size(), size_t(0));
+
+    // First party URLs longer than the stored length are still found
+    const QUrl longPartyUrl(QLatin1String("https://long.example.org/?q=") + QString(AdBlockLog::MaxStringLength, QLatin1Char('a')));
+    log.addEntry(AdBlockFilterAction::Block, longPartyUrl, requestUrl, ElementType::Image, QLatin1String("||ads.example.com^"));
+    entries = log.getEntriesFor(longPartyUrl);
+    QCOMPARE(entries.size(), size_t(1));
+    QCOMPARE(entries.at(0).FirstPartyUrl.toString(QUrl::FullyEncoded).size(), AdBlockLog::MaxStringLength);
+}
+
+void AdBlockFilterTest::testDomainListPool()
+{
+    AdBlockDomainListPool pool;
+    const QVector<QString> list = pool.intern({ QLatin1String("b.com"), QLatin1String("a.com"), QLatin1String("b.com") });
+    QCOMPARE(list, QVector<QString>({ QLatin1String("a.com"), QLatin1String("b.com") }));
+
+    // Identical lists share their memory
+    const QVector<QString> sameList = pool.intern({ QLatin1String("a.com"), QLatin1String("b.com") });
+    QVERIFY2(sameList.constData() == list.constData(), "Interned lists with the same domains should be shared");
+    QCOMPARE(pool.size(), 1);
+
+    // Filters made by the same parser share the lists of their domain options, and still match by parent domain
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> first = parser.makeFilter(QLatin1String("example.com,~shop.example.com##.ad"));
+    std::unique_ptr<AdBlockFilter> second = parser.makeFilter(QLatin1String("~shop.example.com,example.com##.banner"));
+    QVERIFY(first->isDomainStyleMatch(QLatin1String("www.example.com")));
+    QVERIFY(!first->isDomainStyleMatch(QLatin1String("shop.example.com")));
+    QVERIFY(second->isDomainStyleMatch(QLatin1String("example.com")));
+    QVERIFY(!second->isDomainStyleMatch(QLatin1String("example.org")));
+
+    // The rule text is kept for logging and comparison with badfilter rules
+    std::unique_ptr<AdBlockFilter> badFilter = parser.makeFilter(QLatin1String("||ads.example.com^$image,badfilter"));
+    QCOMPARE(badFilter->getRule(), QString("||ads.example.com^$image"));
+}
+
+void AdBlockFilterTest::testStringSearch()
+{
+    const QString url = QLatin1String("https://www.example.com/assets/js/Vendor/AdServer/banner.js?utm_source=newsletter&id=%C3%A9");
+    const std::vector<QString> needles {
+        QLatin1String("h"), QLatin1String("/"), QLatin1String("?"), QLatin1String("%C3%A9"), QLatin1String("https://www."),
+        QLatin1String("/adserver/"), QLatin1String("/AdServer/"), QLatin1String("banner.js?utm_source=newsletter&id="),
+        QLatin1String("letter&id=%C3%A9"), QLatin1String("example.org"), QLatin1String("NEWSLETTER"), url, url + QChar('x')
+    };
+
+    // Every kernel supported by the machine must agree with QString
+    const StringSearch::Kernel defaultKernel = StringSearch::getKernel();
+    for (StringSearch::Kernel kernel : { StringSearch::Kernel::Scalar, StringSearch::Kernel::SSE2, StringSearch::Kernel::AVX2 })
+    {
+        if (!StringSearch::setKernel(kernel))
+            continue;
+
+        for (const QString &needle : needles)
+        {
+            for (Qt::CaseSensitivity cs : { Qt::CaseSensitive, Qt::CaseInsensitive })
+            {
+                const QByteArray urlBytes = url.toLatin1(), needleBytes = needle.toLatin1();
+                for (int from = 0; from < url.size(); from += 7)
+                {
+                    const int expected = url.indexOf(needle, from, cs);
+                    QCOMPARE(StringSearch::indexOf(url, needle, from, cs), expected);
+                    QCOMPARE(StringSearch::indexOf(urlBytes, needleBytes, from, cs), expected);
+                }
+                QCOMPARE(StringSearch::contains(url, needle, cs), url.contains(needle, cs));
+                QCOMPARE(StringSearch::startsWith(url, needle, cs), url.startsWith(needle, cs));
+                QCOMPARE(StringSearch::endsWith(urlBytes, needleBytes, cs), url.endsWith(needle, cs));
+            }
+        }
+
+        // Only ASCII letters are folded, and characters outside of the Latin-1 range are compared as they are
+        const QString unicodeUrl = QString::fromUtf8("https://例子.example/Ünïcödé/ÜPPER/page");
+        QCOMPARE(StringSearch::indexOf(unicodeUrl, QString::fromUtf8("/Ünïcödé/")), 18);
+        QCOMPARE(StringSearch::indexOf(unicodeUrl, QString::fromUtf8("/ünïcödé/"), 0, Qt::CaseInsensitive), -1);
+        QCOMPARE(StringSearch::indexOf(unicodeUrl, QString::fromUtf8("ÜPPER/PAGE"), 0, Qt::CaseInsensitive), 27);
+        QVERIFY(StringSearch::contains(unicodeUrl, QString()));
+    }
+    StringSearch::setKernel(defaultKernel);
+}
+
+void AdBlockFilterTest::testProfiler()
+{
+    AdBlockFilterParser parser;
+    std::unique_ptr<AdBlockFilter> filter = parser.makeFilter(QLatin1String("||ads.example.com^$image"));
+    std::unique_ptr<AdBlockFilter> otherFilter = parser.makeFilter(QLatin1String("/banner,\"quoted\"/"));
+
+    const QUrl firstPartyUrl(QLatin1String("https://www.example.org"));
+    AdBlockRequestContext adContext(QUrl(QLatin1String("https://ads.example.com/pixel.gif")), firstPartyUrl, ElementType::Image);
+    AdBlockRequestContext otherContext(QUrl(QLatin1String("https://cdn.example.org/app.js")), firstPartyUrl, ElementType::Image);
+
+    AdBlockProfiler &profiler = AdBlockProfiler::instance();
+    profiler.reset();
+
+    // Nothing is recorded while profiling is disabled
+    QVERIFY(!AdBlockProfiler::isEnabled());
+    QVERIFY(filter->isMatch(adContext));
+    QVERIFY(profiler.getFilterProfiles().empty());
+
+    AdBlockProfiler::setEnabled(true);
+    QVERIFY(filter->isMatch(adContext));
+    QVERIFY(!filter->isMatch(otherContext));
+    QVERIFY(filter->isOptionMatch(adContext));
+    QVERIFY(!otherFilter->isMatch(adContext));
+    profiler.recordRequest(AdBlockProfiler::RequestPath::Evaluated, 100);
+    profiler.recordRequest(AdBlockProfiler::RequestPath::Evaluated, 600);
+    profiler.recordRequest(AdBlockProfiler::RequestPath::Cached, 50);
+    AdBlockProfiler::setEnabled(false);
+
+    const std::vector<AdBlockProfiler::FilterProfile> profiles = profiler.getFilterProfiles();
+    QCOMPARE(profiles.size(), size_t(2));
+    auto it = std::find_if(profiles.begin(), profiles.end(), [](const AdBlockProfiler::FilterProfile &profile) {
+        return profile.Rule == QLatin1String("||ads.example.com^$image");
+    });
+    QVERIFY(it != profiles.end());
+    QCOMPARE(it->Evaluations, quint64(3));
+    QCOMPARE(it->Hits, quint64(2));
+
+    // Requests are sorted into buckets that double in width
+    const AdBlockProfiler::LatencyHistogram evaluated = profiler.getRequestLatencies(AdBlockProfiler::RequestPath::Evaluated);
+    QCOMPARE(evaluated.Requests, quint64(2));
+    QCOMPARE(evaluated.Buckets[0], quint64(1));
+    QCOMPARE(evaluated.Buckets[2], quint64(1));
+    QCOMPARE(evaluated.MaxNs, quint64(600));
+    QCOMPARE(evaluated.getPercentile(50.0), qint64(250));
+    QCOMPARE(evaluated.getPercentile(99.0), qint64(600));
+    QCOMPARE(profiler.getRequestLatencies(AdBlockProfiler::RequestPath::Cached).Requests, quint64(1));
+
+    // Rules are quoted in the CSV export
+    const QByteArray csv = profiler.toCsv();
+    QVERIFY(csv.startsWith("rule,evaluations,hits,total_ns,mean_ns\n"));
+    QVERIFY(csv.contains("\"/banner,\"\"quoted\"\"/\",1,0,"));
+
+    const QJsonObject json = QJsonDocument::fromJson(profiler.toJson()).object();
+    QCOMPARE(json.value(QLatin1String("filters")).toArray().size(), 2);
+    const QJsonObject evaluatedJson = json.value(QLatin1String("request_latency")).toObject().value(QLatin1String("evaluated")).toObject();
+    QCOMPARE(evaluatedJson.value(QLatin1String("requests")).toInt(), 2);
+    QCOMPARE(evaluatedJson.value(QLatin1String("buckets")).toArray().size(), AdBlockProfiler::NumBuckets);
+
+    profiler.reset();
+    QVERIFY(profiler.getFilterProfiles().empty());
+    QCOMPARE(profiler.getRequestLatencies(AdBlockProfiler::RequestPath::Evaluated).Requests, quint64(0));
+
+    // Evaluations recorded on several threads are merged by rule, including those of a copy of the filter
+    AdBlockFilter filterCopy(*filter);
+    std::vector<int> iterations(64);
+    AdBlockProfiler::setEnabled(true);
+    QtConcurrent::blockingMap(iterations, [&](int &) {
+        for (int i = 0; i < 100; ++i)
+        {
+            filter->isMatch(adContext);
+            filterCopy.isMatch(otherContext);
+        }
+    });
+    AdBlockProfiler::setEnabled(false);
+
+    const std::vector<AdBlockProfiler::FilterProfile> threadProfiles = profiler.getFilterProfiles();
+    QCOMPARE(threadProfiles.size(), size_t(1));
+    QCOMPARE(threadProfiles.front().Evaluations, quint64(64 * 200));
+    QCOMPARE(threadProfiles.front().Hits, quint64(64 * 100));
+    profiler.reset();
+}
+
 QTEST_APPLESS_MAIN(AdBlockFilterTest)
 
 #include "tst_AdBlockFilterTest.moc"
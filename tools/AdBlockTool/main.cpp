@@ -0,0 +1,524 @@
+#include "AdBlockFilter.h"
+#include "AdBlockFilterParser.h"
+#include "AdBlockFilterSnapshot.h"
+#include "AdBlockRequestContext.h"
+#include "AdBlockSubscription.h"
+#include "Bitfield.h"
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QUrl>
+#include <QtConcurrent>
+
+/**
+ * Command line front end to the filter engine of the ad block system, for use outside of the browser.
+ *
+ * The tool loads one or more subscription files, and either reports statistics about their filters (--stats),
+ * or reads network requests from a file or the standard input and writes the decision made for each of them.
+ * Requests are given one per line, either as tab separated (first party URL, request URL, resource type) fields,
+ * or as JSON objects with "first_party_url", "url" and "type" members (--format jsonl). Resource types use the
+ * names of the filter options, such as "script" or "xmlhttprequest", along with the request types of browser
+ * extensions, such as "main_frame" or "xhr". Requests are classified in batches across the global thread pool,
+ * and the decisions are written in the order of the input.
+ */
+
+namespace
+{
+    /// Number of requests that are read and classified at a time
+    constexpr int BatchSize = 16384;
+
+    /// Number of requests classified by each task of the thread pool
+    constexpr int ChunkSize = 256;
+
+    /// A request read from the input, and its decision
+    struct ClassifiedRequest
+    {
+        /// URL of the page that made the request
+        QString FirstPartyUrl;
+
+        /// URL of the requested resource
+        QString RequestUrl;
+
+        /// Resource type as given in the input
+        QString TypeName;
+
+        /// True if the input line could be read, false if else
+        bool Valid;
+
+        /// Decision made by the filters
+        AdBlockDecisionCache::Decision Decision;
+    };
+
+    /// Returns the element type with the given name, or ElementType::Other if the name is not known
+    ElementType getElementType(const QString &name)
+    {
+        static const QHash<QString, ElementType> extensionTypes = {
+            { QStringLiteral("main_frame"), ElementType::Document },     { QStringLiteral("sub_frame"), ElementType::Subdocument },
+            { QStringLiteral("xhr"), ElementType::XMLHTTPRequest },      { QStringLiteral("fetch"), ElementType::XMLHTTPRequest },
+            { QStringLiteral("beacon"), ElementType::Ping },             { QStringLiteral("csp_report"), ElementType::Ping },
+            { QStringLiteral("object_subrequest"), ElementType::ObjectSubrequest }
+        };
+
+        const QString key = name.trimmed().toLower();
+        auto it = eOptionMap.find(key);
+        if (it != eOptionMap.end())
+            return it.value();
+
+        return extensionTypes.value(key, ElementType::Other);
+    }
+
+    /// Returns the name of the given filter category
+    QString getCategoryName(FilterCategory category)
+    {
+        switch (category)
+        {
+            case FilterCategory::Stylesheet:       return QStringLiteral("stylesheet");
+            case FilterCategory::StylesheetJS:     return QStringLiteral("stylesheet_js");
+            case FilterCategory::StylesheetCustom: return QStringLiteral("stylesheet_custom");
+            case FilterCategory::Domain:           return QStringLiteral("domain");
+            case FilterCategory::DomainStart:      return QStringLiteral("domain_start");
+            case FilterCategory::StringStartMatch: return QStringLiteral("string_start_match");
+            case FilterCategory::StringEndMatch:   return QStringLiteral("string_end_match");
+            case FilterCategory::StringExactMatch: return QStringLiteral("string_exact_match");
+            case FilterCategory::StringContains:   return QStringLiteral("string_contains");
+            case FilterCategory::RegExp:           return QStringLiteral("regexp");
+            case FilterCategory::None:
+            default:                               return QStringLiteral("none");
+        }
+    }
+
+    /// Returns the rule of a filter with the badfilter option, given the rule that it disables
+    QString getBadFilterRule(const QString &rule)
+    {
+        return rule + (rule.contains(QChar('$')) ? QLatin1String(",badfilter") : QLatin1String("$badfilter"));
+    }
+
+    /// Returns the name of the action taken on a request
+    QString getActionName(const AdBlockDecisionCache::Decision &decision)
+    {
+        if (!decision.Matched)
+            return QStringLiteral("allow");
+
+        switch (decision.Action)
+        {
+            case AdBlockFilterAction::Block:    return QStringLiteral("block");
+            case AdBlockFilterAction::Redirect: return QStringLiteral("redirect");
+            case AdBlockFilterAction::Allow:
+            default:                            return QStringLiteral("allow");
+        }
+    }
+
+    /// Parses a line of the input into a request, setting its valid flag to false if the line cannot be read
+    ClassifiedRequest parseRequest(const QString &line, bool json)
+    {
+        ClassifiedRequest request { QString(), QString(), QString(), false, AdBlockDecisionCache::Decision { false, AdBlockFilterAction::Allow, nullptr } };
+
+        if (json)
+        {
+            const QJsonObject object = QJsonDocument::fromJson(line.toUtf8()).object();
+            request.FirstPartyUrl = object.value(QLatin1String("first_party_url")).toString();
+            request.RequestUrl = object.value(QLatin1String("url")).toString();
+            request.TypeName = object.value(QLatin1String("type")).toString();
+        }
+        else
+        {
+            const QStringList fields = line.split(QChar('\t'));
+            if (fields.size() >= 2)
+            {
+                request.FirstPartyUrl = fields.at(0);
+                request.RequestUrl = fields.at(1);
+                request.TypeName = fields.size() > 2 ? fields.at(2) : QString();
+            }
+        }
+
+        request.Valid = !request.RequestUrl.isEmpty();
+        return request;
+    }
+
+    /// Matches each valid request of the batch against the filters, across the global thread pool
+    void classifyRequests(const AdBlockFilterSnapshot &snapshot, std::vector<ClassifiedRequest> &requests)
+    {
+        const int numRequests = static_cast<int>(requests.size());
+        std::vector<int> chunks(static_cast<std::size_t>((numRequests + ChunkSize - 1) / ChunkSize));
+        std::iota(chunks.begin(), chunks.end(), 0);
+
+        QtConcurrent::blockingMap(chunks, [&snapshot, &requests, numRequests](int chunk) {
+            const int end = std::min((chunk + 1) * ChunkSize, numRequests);
+            for (int i = chunk * ChunkSize; i < end; ++i)
+            {
+                ClassifiedRequest &request = requests[static_cast<std::size_t>(i)];
+                if (!request.Valid)
+                    continue;
+
+                // Requests are typed the same way as in AdBlockManager::getRequestType
+                AdBlockRequestContext context(QUrl(request.RequestUrl), QUrl(request.FirstPartyUrl));
+                context.Type = getElementType(request.TypeName);
+                if (context.ThirdParty)
+                    context.Type |= ElementType::ThirdParty;
+
+                request.Decision = snapshot.evaluate(context);
+            }
+        });
+    }
+
+    /// Writes the decision of a request as a line of the output
+    void writeDecision(QTextStream &output, const ClassifiedRequest &request, bool json)
+    {
+        const AdBlockFilter *filter = request.Decision.Filter;
+        const QString action = request.Valid ? getActionName(request.Decision) : QStringLiteral("invalid");
+        const QString rule = filter != nullptr ? filter->getRule() : QString();
+        const QString redirect = filter != nullptr ? filter->getRedirectName() : QString();
+
+        if (json)
+        {
+            QJsonObject object;
+            object.insert(QLatin1String("url"), request.RequestUrl);
+            object.insert(QLatin1String("first_party_url"), request.FirstPartyUrl);
+            object.insert(QLatin1String("type"), request.TypeName);
+            object.insert(QLatin1String("action"), action);
+            object.insert(QLatin1String("rule"), filter != nullptr ? QJsonValue(rule) : QJsonValue());
+            if (!redirect.isEmpty())
+                object.insert(QLatin1String("redirect"), redirect);
+            output << QJsonDocument(object).toJson(QJsonDocument::Compact) << '\n';
+            return;
+        }
+
+        output << action << '\t' << request.RequestUrl << '\t' << rule << '\t' << redirect << '\n';
+    }
+
+    /// Returns the current and peak resident memory of the process, in kilobytes, as a JSON object. The object is
+    /// empty on systems that do not report them through /proc/self/status
+    QJsonObject getMemoryUsage()
+    {
+        QJsonObject memory;
+
+        QFile statusFile(QLatin1String("/proc/self/status"));
+        if (!statusFile.open(QIODevice::ReadOnly | QIODevice::Text))
+            return memory;
+
+        const QHash<QString, QString> fields = {
+            { QStringLiteral("VmRSS:"), QStringLiteral("resident_kb") },
+            { QStringLiteral("VmHWM:"), QStringLiteral("peak_resident_kb") }
+        };
+
+        QTextStream status(&statusFile);
+        QString line;
+        while (status.readLineInto(&line))
+        {
+            const QStringList parts = line.simplified().split(QLatin1Char(' '));
+            if (parts.size() >= 2 && fields.contains(parts.at(0)))
+                memory.insert(fields.value(parts.at(0)), parts.at(1).toLongLong());
+        }
+        return memory;
+    }
+
+    /**
+     * @brief Returns statistics about the filters of the given subscriptions as a JSON object
+     * @param subscriptions Loaded subscriptions
+     * @param filters Slices of the subscriptions, appended together in the order of the subscriptions
+     * @param optimization Number of filters that were removed from the containers by each step of the optimizer
+     * @param memory Memory used by the process once the filters were loaded, as returned by \ref getMemoryUsage
+     */
+    QJsonObject getStatistics(const std::vector<std::unique_ptr<AdBlockSubscription>> &subscriptions, const AdBlockFilterSlice &filters,
+                              const AdBlockFilterSlice::OptimizationStatistics &optimization, const QJsonObject &memory)
+    {
+        QJsonArray lists;
+        QHash<QString, int> categoryCounts, ruleCounts;
+        QSet<QString> networkRules;
+        QJsonArray deadRules;
+        int numFilters = 0, numRedirects = 0, numRegExps = 0, numUncompiledRegExps = 0, numInvalidRegExps = 0;
+
+        for (const std::unique_ptr<AdBlockSubscription> &subscription : subscriptions)
+        {
+            std::shared_ptr<const AdBlockFilterList> filterList = subscription->getFilters();
+
+            QJsonObject list;
+            list.insert(QLatin1String("path"), subscription->getFilePath());
+            list.insert(QLatin1String("name"), subscription->getName());
+            list.insert(QLatin1String("filters"), static_cast<int>(filterList->size()));
+            lists.append(list);
+
+            for (const std::unique_ptr<AdBlockFilter> &filter : *filterList)
+            {
+                ++numFilters;
+                ++categoryCounts[getCategoryName(filter->getCategory())];
+
+                // Badfilter rules are stored without their option, so they are kept apart from the rules they disable
+                const QString rule = filter->getRule();
+                ++ruleCounts[filter->isBadFilter() ? getBadFilterRule(rule) : rule];
+                if (!filter->isBadFilter())
+                    networkRules.insert(rule);
+
+                if (filter->isRedirect())
+                    ++numRedirects;
+
+                if (filter->getCategory() == FilterCategory::RegExp)
+                    ++numRegExps;
+
+                if (const QRegularExpression *regExp = filter->getRegExp())
+                {
+                    ++numUncompiledRegExps;
+                    if (!regExp->isValid())
+                    {
+                        ++numInvalidRegExps;
+                        deadRules.append(QJsonObject { { QLatin1String("rule"), rule }, { QLatin1String("reason"), QLatin1String("invalid_regexp") } });
+                    }
+                }
+            }
+        }
+
+        // Rules that appear more than once, in the same list or across lists
+        QJsonArray duplicateRules;
+        int numDuplicates = 0;
+        for (auto it = ruleCounts.cbegin(); it != ruleCounts.cend(); ++it)
+        {
+            if (it.value() < 2)
+                continue;
+
+            numDuplicates += it.value() - 1;
+            duplicateRules.append(QJsonObject { { QLatin1String("rule"), it.key() }, { QLatin1String("count"), it.value() } });
+        }
+
+        // Badfilter rules without a filter to disable, and element hiding exceptions without a filter to except
+        int numUnusedBadFilters = 0, numUnmatchedExceptions = 0;
+        for (const QString &rule : filters.BadFilters)
+        {
+            if (networkRules.contains(rule))
+                continue;
+
+            ++numUnusedBadFilters;
+            deadRules.append(QJsonObject { { QLatin1String("rule"), getBadFilterRule(rule) }, { QLatin1String("reason"), QLatin1String("unused_badfilter") } });
+        }
+        for (auto it = filters.StylesheetExceptions.cbegin(); it != filters.StylesheetExceptions.cend(); ++it)
+        {
+            if (filters.StylesheetFilters.contains(it.key()))
+                continue;
+
+            ++numUnmatchedExceptions;
+            deadRules.append(QJsonObject { { QLatin1String("rule"), it.value()->getRule() }, { QLatin1String("reason"), QLatin1String("unmatched_stylesheet_exception") } });
+        }
+
+        QJsonObject categories;
+        for (auto it = categoryCounts.cbegin(); it != categoryCounts.cend(); ++it)
+            categories.insert(it.key(), it.value());
+
+        auto count = [](const std::vector<AdBlockFilter*> &container) {
+            return static_cast<int>(container.size());
+        };
+
+        QJsonObject network;
+        network.insert(QLatin1String("important_block"), count(filters.ImportantBlockFilters));
+        network.insert(QLatin1String("block"), count(filters.BlockFilters));
+        network.insert(QLatin1String("block_by_pattern"), count(filters.BlockFiltersByPattern));
+        network.insert(QLatin1String("block_by_domain"), count(filters.BlockFiltersByDomain));
+        network.insert(QLatin1String("allow"), count(filters.AllowFilters));
+        network.insert(QLatin1String("allow_by_domain"), count(filters.AllowFiltersByDomain));
+        network.insert(QLatin1String("page_exceptions"), count(filters.PageExceptionFilters));
+        network.insert(QLatin1String("csp"), count(filters.CSPFilters));
+        network.insert(QLatin1String("redirect"), numRedirects);
+        network.insert(QLatin1String("badfilter"), filters.BadFilters.size());
+
+        QJsonObject cosmetic;
+        cosmetic.insert(QLatin1String("stylesheet"), filters.StylesheetFilters.size());
+        cosmetic.insert(QLatin1String("stylesheet_exceptions"), filters.StylesheetExceptions.size());
+        cosmetic.insert(QLatin1String("script"), count(filters.DomainJSFilters));
+        cosmetic.insert(QLatin1String("custom_style"), count(filters.CustomStyleFilters));
+
+        QJsonObject regExps;
+        regExps.insert(QLatin1String("rules"), numRegExps);
+        regExps.insert(QLatin1String("not_compiled"), numUncompiledRegExps);
+        regExps.insert(QLatin1String("invalid"), numInvalidRegExps);
+
+        QJsonObject duplicates;
+        duplicates.insert(QLatin1String("redundant_copies"), numDuplicates);
+        duplicates.insert(QLatin1String("rules"), duplicateRules);
+
+        QJsonObject dead;
+        dead.insert(QLatin1String("disabled_by_badfilter"), static_cast<int>(optimization.BadFilters));
+        dead.insert(QLatin1String("unused_badfilter"), numUnusedBadFilters);
+        dead.insert(QLatin1String("invalid_regexp"), numInvalidRegExps);
+        dead.insert(QLatin1String("unmatched_stylesheet_exception"), numUnmatchedExceptions);
+        dead.insert(QLatin1String("rules"), deadRules);
+
+        QJsonObject optimizer;
+        optimizer.insert(QLatin1String("badfilter"), static_cast<int>(optimization.BadFilters));
+        optimizer.insert(QLatin1String("duplicates"), static_cast<int>(optimization.Duplicates));
+        optimizer.insert(QLatin1String("subsumed"), static_cast<int>(optimization.Subsumed));
+        optimizer.insert(QLatin1String("merged"), static_cast<int>(optimization.Merged));
+        optimizer.insert(QLatin1String("eliminated"), static_cast<int>(optimization.BadFilters + optimization.Duplicates
+                                                                      + optimization.Subsumed + optimization.Merged));
+
+        QJsonObject statistics;
+        statistics.insert(QLatin1String("lists"), lists);
+        statistics.insert(QLatin1String("filters"), numFilters);
+        statistics.insert(QLatin1String("categories"), categories);
+        statistics.insert(QLatin1String("network"), network);
+        statistics.insert(QLatin1String("cosmetic"), cosmetic);
+        statistics.insert(QLatin1String("regexp"), regExps);
+        statistics.insert(QLatin1String("duplicates"), duplicates);
+        statistics.insert(QLatin1String("dead"), dead);
+        statistics.insert(QLatin1String("optimizer"), optimizer);
+        statistics.insert(QLatin1String("memory"), memory);
+        return statistics;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QLatin1String("viper-adblock"));
+
+    QCommandLineParser commandLine;
+    commandLine.setApplicationDescription(QLatin1String("Classifies network requests with the ad block filters of Viper Browser"));
+    commandLine.addHelpOption();
+
+    QCommandLineOption listOption({ QLatin1String("l"), QLatin1String("list") },
+                                  QLatin1String("Subscription file to load. May be given more than once"), QLatin1String("file"));
+    QCommandLineOption inputOption({ QLatin1String("i"), QLatin1String("input") },
+                                   QLatin1String("File to read requests from, or - for the standard input"), QLatin1String("file"), QLatin1String("-"));
+    QCommandLineOption formatOption({ QLatin1String("f"), QLatin1String("format") },
+                                    QLatin1String("Format of the requests and decisions: tsv or jsonl"), QLatin1String("format"), QLatin1String("tsv"));
+    QCommandLineOption threadsOption({ QLatin1String("j"), QLatin1String("threads") },
+                                     QLatin1String("Number of threads used to classify requests. Defaults to the number of cores"), QLatin1String("count"));
+    QCommandLineOption statsOption(QLatin1String("stats"), QLatin1String("Writes statistics about the filters as JSON, instead of classifying requests"));
+    commandLine.addOptions({ listOption, inputOption, formatOption, threadsOption, statsOption });
+    commandLine.process(app);
+
+    QTextStream errors(stderr);
+
+    const QStringList listPaths = commandLine.values(listOption);
+    if (listPaths.isEmpty())
+    {
+        errors << "At least one subscription file must be given with --list" << endl;
+        return 1;
+    }
+
+    const QString format = commandLine.value(formatOption).toLower();
+    if (format != QLatin1String("tsv") && format != QLatin1String("jsonl"))
+    {
+        errors << "Unknown format " << format << ", expected tsv or jsonl" << endl;
+        return 1;
+    }
+    const bool json = format == QLatin1String("jsonl");
+
+    if (commandLine.isSet(threadsOption))
+        QThreadPool::globalInstance()->setMaxThreadCount(std::max(1, commandLine.value(threadsOption).toInt()));
+
+    // Load the subscriptions, and combine their filters the same way as AdBlockManager::rebuildFilters
+    std::vector<std::unique_ptr<AdBlockSubscription>> subscriptions;
+    AdBlockFilterSlice filters;
+    std::vector<std::shared_ptr<const AdBlockFilterList>> filterLists;
+    for (const QString &path : listPaths)
+    {
+        if (!QFileInfo(path).isReadable())
+        {
+            errors << "Could not read subscription file " << path << endl;
+            return 1;
+        }
+
+        std::unique_ptr<AdBlockSubscription> subscription = std::make_unique<AdBlockSubscription>(path);
+        subscription->load();
+        filterLists.push_back(subscription->getFilters());
+        filters.append(subscription->getSlice());
+        subscriptions.push_back(std::move(subscription));
+    }
+
+    // Statistics are gathered from the containers before they are given to the snapshot
+    std::shared_ptr<AdBlockFilterList> mergedFilters = std::make_shared<AdBlockFilterList>();
+    const AdBlockFilterSlice::OptimizationStatistics optimization = filters.optimize(*mergedFilters);
+    filterLists.push_back(mergedFilters);
+
+    QTextStream output(stdout);
+    output.setCodec("UTF-8");
+
+    if (commandLine.isSet(statsOption))
+    {
+        // Memory is read before the statistics are gathered, since they build their own tables of the rules
+        const QJsonObject memory = getMemoryUsage();
+        output << QJsonDocument(getStatistics(subscriptions, filters, optimization, memory)).toJson();
+        return 0;
+    }
+
+    const AdBlockFilterSnapshot snapshot(filters, std::move(filterLists));
+
+    QFile inputFile;
+    bool inputOpened = false;
+    const QString inputPath = commandLine.value(inputOption);
+    if (inputPath == QLatin1String("-"))
+        inputOpened = inputFile.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+    else
+    {
+        inputFile.setFileName(inputPath);
+        inputOpened = inputFile.open(QIODevice::ReadOnly | QIODevice::Text);
+    }
+    if (!inputOpened)
+    {
+        errors << "Could not read requests from " << inputPath << endl;
+        return 1;
+    }
+
+    QTextStream input(&inputFile);
+    input.setCodec("UTF-8");
+
+    // Requests are read, classified and written one batch at a time, so that the input can be of any size
+    quint64 numRequests = 0, numBlocked = 0, numRedirected = 0, numExcepted = 0, numInvalid = 0;
+    std::vector<ClassifiedRequest> batch;
+    batch.reserve(BatchSize);
+
+    QString line;
+    bool atEnd = false;
+    while (!atEnd)
+    {
+        batch.clear();
+        while (static_cast<int>(batch.size()) < BatchSize)
+        {
+            if (!input.readLineInto(&line))
+            {
+                atEnd = true;
+                break;
+            }
+
+            // Empty lines and tab separated comments are not requests
+            if (line.isEmpty() || (!json && line.startsWith(QChar('#'))))
+                continue;
+
+            batch.push_back(parseRequest(line, json));
+        }
+
+        classifyRequests(snapshot, batch);
+
+        for (const ClassifiedRequest &request : batch)
+        {
+            writeDecision(output, request, json);
+
+            ++numRequests;
+            if (!request.Valid)
+                ++numInvalid;
+            else if (request.Decision.Matched && request.Decision.Action == AdBlockFilterAction::Block)
+                ++numBlocked;
+            else if (request.Decision.Matched && request.Decision.Action == AdBlockFilterAction::Redirect)
+                ++numRedirected;
+            else if (request.Decision.Matched)
+                ++numExcepted;
+        }
+        output.flush();
+    }
+
+    errors << "Classified " << numRequests << " requests: " << numBlocked << " blocked, " << numRedirected << " redirected, "
+           << numExcepted << " allowed by an exception, " << numInvalid << " invalid" << endl;
+    return 0;
+}